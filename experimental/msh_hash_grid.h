@@ -31,6 +31,16 @@
     - MSH_HG_REALLOC
     - MSH_HG_FREE
 
+  Scanning the contents of bins uses SSE2, AVX2 or AVX-512, depending on what the compiler targets
+  (e.g. -mavx2 or -mavx512f). For that the grid keeps a structure-of-arrays copy of its points,
+  which takes additional 16 bytes per point. To use plain C code and skip the copy:
+    #define MSH_HG_NO_SIMD
+
+  Searches run on OpenMP threads when compiled with it. To run them on your own thread pool
+  instead, include 'msh_jobs.h' before this file and set 'work_ctx' in the search description.
+  Queries are then processed in batches, sized so that the results of one batch take about
+  MSH_HG_QUERY_BATCH_BYTES (32kB by default), which can be redefined like the allocation macros.
+
   msh_hash_grid_init_2d
   ---------------------
     void msh_hash_grid_init_2d( msh_hash_grid_t* hg,
@@ -70,6 +80,17 @@
 
   float radius         - OPTION: radius within which we wish to find neighbors for each query
   int sort             - OPTION: should the results be sorted from closest to farthest
+  int reorder          - OPTION: should the queries be processed in the order of grid cells they
+                                 fall into. Helps when consecutive query pts are far apart, as
+                                 neighboring queries then reuse the same bins. Results are still
+                                 stored in the order of 'query_pts'.
+  msh_jobs_ctx_t* work_ctx
+                       - OPTION: job system to run the queries on. The implementation has to be
+                                 compiled with 'msh_jobs.h' included first. Queries are split into
+                                 batches which the jobs pick up one at a time until none are left.
+                                 The calling thread helps out until the jobs of this search are
+                                 done, so several threads can search on the same 'work_ctx' at
+                                 once. When NULL, OpenMP is used if enabled.
   size_t max_n_neigh/k - OPTION: maximum number of neighbors allowed for each query.
 
   float* distances_sq  - OUTPUT: max_n_neigh * n_query_pts matrix of squared distances to neighbors 
@@ -98,6 +119,41 @@
   'k' (specified in 'search_desc') neighbors will be found.  Depending on how large 'k' is, 
   these queries might not be very fast.
 
+  msh_hash_grid_insert
+  ---------------------
+    int32_t msh_hash_grid_insert( msh_hash_grid_t* hg, const float* pt );
+
+  Adds point 'pt' to an initialized grid 'hg' and returns its index. Indices continue after the
+  points passed to init, so the returned index is the one reported by searches.
+
+  msh_hash_grid_remove
+  ---------------------
+    void msh_hash_grid_remove( msh_hash_grid_t* hg, const int32_t idx );
+
+  Removes the point with index 'idx' from 'hg'. Removing an already removed point does nothing.
+
+  msh_hash_grid_update
+  ---------------------
+    void msh_hash_grid_update( msh_hash_grid_t* hg, const int32_t idx, const float* pt );
+
+  Moves the point with index 'idx' to 'pt', keeping its index.
+
+  msh_hash_grid_compact
+  ---------------------
+    void msh_hash_grid_compact( msh_hash_grid_t* hg );
+
+  Rebuilds 'hg' from the points it currently holds, releasing space left over by moved bins and
+  extending the grid over points that were placed outside of its original bounds. Until then,
+  such points are checked by every query, so a long-lived grid should be compacted from time to
+  time, e.g. once per frame after a batch of updates. The grid also compacts itself when either
+  of these grows too large.
+
+  Insert, remove and update keep one grid usable across many small changes of the point set,
+  instead of terminating and re-initializing it. Each bin keeps a few free slots after
+  compaction; a bin that fills up is moved to the end of the storage. The first modification
+  allocates a table of 4 bytes per point index. These functions must not run concurrently with
+  searches or with each other.
+
   ==============================================================================
   DEPENDENCIES
 
@@ -125,7 +181,8 @@
 
   ==============================================================================
   TODOs:
-  [ ] Replace openMP with a custom threading/scheduler implementation
+  [x] Allow running queries on a custom threading/scheduler implementation (msh_jobs)
+  [ ] Run grid construction and query reordering on msh_jobs as well
   [ ] Compatibility function
     [ ] Allow user to specify compatibility function instead of just L2 norm
     [ ] Allow user to provide some extra user data like normals for computing the distances
@@ -139,6 +196,7 @@
   [x] Optimization - spatial locality - sort linear data on bin idx or morton curves
          --> Does not seem to produce improvement. Something else must be dominating the times
          --> Maybe morton curves will be better
+         --> Cells are sorted along a Morton curve, queries can be reordered the same way
   [x] Fix knn search
       [x] Multithread knn
   [x] Heap implementation for knn radius
@@ -184,6 +242,10 @@
 #define MSH_HG_FREE(x) free((x))
 #endif
 
+#ifndef MSH_HG_QUERY_BATCH_BYTES
+#define MSH_HG_QUERY_BATCH_BYTES 32768
+#endif
+
 #if defined(_OPENMP)
 #include <omp.h>
 #endif
@@ -211,9 +273,8 @@ typedef struct msh_hash_grid_search_desc
   };
 
   int sort;
-#ifdef MSH_JOBS
-  msh_jobs_ctx_t* work_ctx;
-#endif
+  int reorder;
+  struct msh_jobs_ctx* work_ctx;
 } msh_hash_grid_search_desc_t;
 
 void   msh_hash_grid_init_2d( msh_hash_grid_t* hg,
@@ -230,6 +291,14 @@ size_t msh_hash_grid_radius_search( const msh_hash_grid_t* hg,
 size_t msh_hash_grid_knn_search( const msh_hash_grid_t* hg,
                                  msh_hash_grid_search_desc_t* search_desc );
 
+int32_t msh_hash_grid_insert( msh_hash_grid_t* hg, const float* pt );
+
+void   msh_hash_grid_remove( msh_hash_grid_t* hg, const int32_t idx );
+
+void   msh_hash_grid_update( msh_hash_grid_t* hg, const int32_t idx, const float* pt );
+
+void   msh_hash_grid_compact( msh_hash_grid_t* hg );
+
 
 typedef struct msh_hg_v3
 {
@@ -242,7 +311,6 @@ typedef struct msh_hg_v3i
   int32_t i;
 } msh_hg_v3i_t;
 
-typedef struct msh_hg_bin_data msh_hg__bin_data_t;
 typedef struct msh_hg_bin_info msh_hg__bin_info_t;
 typedef struct msh_hg_map msh_hg_map_t;
 
@@ -265,8 +333,26 @@ typedef struct msh_hash_grid
   uint8_t _pts_dim;
   uint16_t _num_threads;
   int32_t _dont_use_omp;
+  int32_t _use_morton;
   uint32_t max_n_pts_in_bin;
   size_t _n_pts;
+
+  // Bookkeeping for incremental updates. '_slots' and '_overflow' are only allocated once the
+  // grid is modified after initialization.
+  size_t _n_bins;
+  size_t _bins_cap;
+  size_t _data_len;
+  size_t _data_cap;
+  size_t _compacted_data_len;
+  int32_t _n_ids;
+  uint32_t* _slots;
+  msh_hg_v3i_t* _overflow;
+
+  // Structure-of-arrays copy of 'data_buffer' scanned by the SIMD kernels. Unused with no SIMD.
+  float* _xs;
+  float* _ys;
+  float* _zs;
+  int32_t* _ids;
 } msh_hash_grid_t;
 
 typedef struct msh_hg_map
@@ -277,16 +363,11 @@ typedef struct msh_hg_map
   size_t _cap;
 } msh_hg_map_t;
 
-typedef struct msh_hg_bin_data
-{
-  int32_t n_pts;
-  msh_hg_v3i_t* data;
-} msh_hg__bin_data_t;
-
 typedef struct msh_hg_bin_info
 {
   uint32_t offset;
   uint32_t length;
+  uint32_t capacity;
 } msh_hg__bin_info_t;
 
 
@@ -359,6 +440,73 @@ uint64_t* msh_hg_map_get( const msh_hg_map_t* map, uint64_t key );
 #define MSH_HG_INLINE __attribute__((always_inline, unused)) inline
 #endif
 
+#if !defined(MSH_HG_NO_SIMD)
+#if defined(__AVX512F__)
+#define MSH_HG__AVX512
+#define MSH_HG__SIMD_WIDTH 16
+#include <immintrin.h>
+#elif defined(__AVX2__)
+#define MSH_HG__AVX2
+#define MSH_HG__SIMD_WIDTH 8
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MSH_HG__SSE2
+#define MSH_HG__SIMD_WIDTH 4
+#include <emmintrin.h>
+#endif
+#endif
+
+#if defined(MSH_HG__SIMD_WIDTH)
+#define MSH_HG__SIMD
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+MSH_HG_INLINE uint32_t
+msh_hash_grid__ctz( uint32_t x )
+{
+#if defined(_MSC_VER)
+  unsigned long idx;
+  _BitScanForward( &idx, x );
+  return idx;
+#else
+  return __builtin_ctz( x );
+#endif
+}
+#endif
+
+// Bins are scanned a full SIMD register at a time, so the copy of the points is padded to allow
+// reading past the end of the last bin.
+void
+msh_hash_grid__soa_resize( msh_hash_grid_t* hg, size_t cap )
+{
+#if defined(MSH_HG__SIMD)
+  size_t padded_cap = cap + MSH_HG__SIMD_WIDTH;
+  hg->_xs  = (float*)MSH_HG_REALLOC( hg->_xs, padded_cap * sizeof(float) );
+  hg->_ys  = (float*)MSH_HG_REALLOC( hg->_ys, padded_cap * sizeof(float) );
+  hg->_zs  = (float*)MSH_HG_REALLOC( hg->_zs, padded_cap * sizeof(float) );
+  hg->_ids = (int32_t*)MSH_HG_REALLOC( hg->_ids, padded_cap * sizeof(int32_t) );
+  MSH_HG_MEMSET( hg->_xs + cap, 0, MSH_HG__SIMD_WIDTH * sizeof(float) );
+  MSH_HG_MEMSET( hg->_ys + cap, 0, MSH_HG__SIMD_WIDTH * sizeof(float) );
+  MSH_HG_MEMSET( hg->_zs + cap, 0, MSH_HG__SIMD_WIDTH * sizeof(float) );
+  MSH_HG_MEMSET( hg->_ids + cap, 0, MSH_HG__SIMD_WIDTH * sizeof(int32_t) );
+#else
+  (void)hg; (void)cap;
+#endif
+}
+
+MSH_HG_INLINE void
+msh_hash_grid__store_pt( msh_hash_grid_t* hg, const size_t slot, const msh_hg_v3i_t pt )
+{
+  hg->data_buffer[slot] = pt;
+#if defined(MSH_HG__SIMD)
+  hg->_xs[slot]  = pt.x;
+  hg->_ys[slot]  = pt.y;
+  hg->_zs[slot]  = pt.z;
+  hg->_ids[slot] = pt.i;
+#endif
+}
+
 
 MSH_HG_INLINE msh_hg_v3_t
 msh_hg__vec3_add( msh_hg_v3_t a, msh_hg_v3_t b )
@@ -379,18 +527,197 @@ msh_hash_grid__bin_pt( const msh_hash_grid_t* hg, uint64_t ix, uint64_t iy, uint
   return bin_idx;
 }
 
-int32_t 
-msh_hash_grid__uint64_compare( const void * a, const void * b )
+// NOTE: Cells (and points within data_buffer) are ordered along a Morton curve, so that
+// cells close in space are also close in memory. Bin table is still keyed by the linear bin index,
+// so the cell key is only used for sorting. Grids too large for the Morton code to hold all
+// cell coordinates fall back to sorting by the linear bin index.
+MSH_HG_INLINE uint64_t
+msh_hash_grid__part1by1( uint64_t x )
+{
+  x &= 0x00000000ffffffffULL;
+  x = ( x | (x << 16) ) & 0x0000ffff0000ffffULL;
+  x = ( x | (x << 8)  ) & 0x00ff00ff00ff00ffULL;
+  x = ( x | (x << 4)  ) & 0x0f0f0f0f0f0f0f0fULL;
+  x = ( x | (x << 2)  ) & 0x3333333333333333ULL;
+  x = ( x | (x << 1)  ) & 0x5555555555555555ULL;
+  return x;
+}
+
+MSH_HG_INLINE uint64_t
+msh_hash_grid__compact1by1( uint64_t x )
+{
+  x &= 0x5555555555555555ULL;
+  x = ( x ^ (x >> 1)  ) & 0x3333333333333333ULL;
+  x = ( x ^ (x >> 2)  ) & 0x0f0f0f0f0f0f0f0fULL;
+  x = ( x ^ (x >> 4)  ) & 0x00ff00ff00ff00ffULL;
+  x = ( x ^ (x >> 8)  ) & 0x0000ffff0000ffffULL;
+  x = ( x ^ (x >> 16) ) & 0x00000000ffffffffULL;
+  return x;
+}
+
+MSH_HG_INLINE uint64_t
+msh_hash_grid__part1by2( uint64_t x )
+{
+  x &= 0x00000000001fffffULL;
+  x = ( x | (x << 32) ) & 0x001f00000000ffffULL;
+  x = ( x | (x << 16) ) & 0x001f0000ff0000ffULL;
+  x = ( x | (x << 8)  ) & 0x100f00f00f00f00fULL;
+  x = ( x | (x << 4)  ) & 0x10c30c30c30c30c3ULL;
+  x = ( x | (x << 2)  ) & 0x1249249249249249ULL;
+  return x;
+}
+
+MSH_HG_INLINE uint64_t
+msh_hash_grid__compact1by2( uint64_t x )
+{
+  x &= 0x1249249249249249ULL;
+  x = ( x ^ (x >> 2)  ) & 0x10c30c30c30c30c3ULL;
+  x = ( x ^ (x >> 4)  ) & 0x100f00f00f00f00fULL;
+  x = ( x ^ (x >> 8)  ) & 0x001f0000ff0000ffULL;
+  x = ( x ^ (x >> 16) ) & 0x001f00000000ffffULL;
+  x = ( x ^ (x >> 32) ) & 0x00000000001fffffULL;
+  return x;
+}
+
+int32_t
+msh_hash_grid__fits_morton( const msh_hash_grid_t* hg )
+{
+  uint64_t max_dim = MSH_HG_MAX3( hg->width, hg->height, hg->depth );
+  if( hg->_pts_dim == 2 ) { return max_dim <= ((uint64_t)1 << 32); }
+  else                    { return max_dim <= ((uint64_t)1 << 21); }
+}
+
+MSH_HG_INLINE uint64_t
+msh_hash_grid__cell_key( const msh_hash_grid_t* hg, uint64_t ix, uint64_t iy, uint64_t iz )
+{
+  if( !hg->_use_morton ) { return msh_hash_grid__bin_pt( hg, ix, iy, iz ); }
+  if( hg->_pts_dim == 2 )
+  {
+    return msh_hash_grid__part1by1( ix ) | (msh_hash_grid__part1by1( iy ) << 1);
+  }
+  return msh_hash_grid__part1by2( ix ) |
+         (msh_hash_grid__part1by2( iy ) << 1) |
+         (msh_hash_grid__part1by2( iz ) << 2);
+}
+
+MSH_HG_INLINE uint64_t
+msh_hash_grid__cell_key_to_bin( const msh_hash_grid_t* hg, uint64_t key )
+{
+  if( !hg->_use_morton ) { return key; }
+  if( hg->_pts_dim == 2 )
+  {
+    return msh_hash_grid__bin_pt( hg, msh_hash_grid__compact1by1( key ),
+                                      msh_hash_grid__compact1by1( key >> 1 ), 0 );
+  }
+  return msh_hash_grid__bin_pt( hg, msh_hash_grid__compact1by2( key ),
+                                    msh_hash_grid__compact1by2( key >> 1 ),
+                                    msh_hash_grid__compact1by2( key >> 2 ) );
+}
+
+int32_t
+msh_hash_grid__cell_key_bits( const msh_hash_grid_t* hg )
 {
-  return ( *(uint64_t*)a - *(uint64_t*)b );
+  // Keys are bounded by the key of a cell with all coordinate bits set
+  uint64_t max_key = 0;
+  if( hg->_use_morton )
+  {
+    uint64_t mask[3] = { hg->width - 1, hg->height - 1, hg->depth - 1 };
+    for( int32_t i = 0; i < 3; ++i )
+    {
+      for( int32_t shift = 1; shift < 64; shift *= 2 ) { mask[i] |= mask[i] >> shift; }
+    }
+    max_key = msh_hash_grid__cell_key( hg, mask[0], mask[1], mask[2] );
+  }
+  else
+  {
+    max_key = (uint64_t)hg->_slab_size * hg->depth;
+  }
+  int32_t n_key_bits = 0;
+  while( n_key_bits < 64 && (max_key >> n_key_bits) ) { n_key_bits++; }
+  return n_key_bits;
 }
 
+// Number of bits of the bin index sorted in each radix sort pass
+#define MSH_HG__RADIX_BITS 11
+#define MSH_HG__RADIX_SIZE (1 << MSH_HG__RADIX_BITS)
+
+
+
+// Sorts 'keys[0]' along with 'indices[0]' by the low 'n_key_bits' bits of the keys, using a
+// parallel LSD radix sort. Each pass is stable. 'keys[1]' and 'indices[1]' are used as scratch
+// space, and the return value tells which of the two buffers holds the sorted result.
+int32_t
+msh_hash_grid__radix_sort( const msh_hash_grid_t* hg, uint64_t* keys[2], int32_t* indices[2],
+                           const int32_t n, const int32_t n_key_bits )
+{
+  int32_t n_tasks = MSH_HG_MAX( 1, MSH_HG_MIN( (int32_t)hg->_num_threads, n ) );
+  int32_t n_per_task = ( n + n_tasks - 1 ) / n_tasks;
+  size_t offsets_size = n_tasks * MSH_HG__RADIX_SIZE * sizeof(uint32_t);
+
+  uint32_t* digit_offsets = (uint32_t*)MSH_HG_MALLOC( offsets_size );
+  int32_t src = 0;
+  for( int32_t shift = 0; shift < n_key_bits; shift += MSH_HG__RADIX_BITS )
+  {
+    const uint64_t* src_keys = keys[src];
+    MSH_HG_MEMSET( digit_offsets, 0, offsets_size );
+
+#if defined(_OPENMP)
+    #pragma omp parallel for if (!hg->_dont_use_omp) num_threads(n_tasks)
+#endif
+    for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
+    {
+      int32_t low_lim  = task_idx * n_per_task;
+      int32_t high_lim = MSH_HG_MIN( low_lim + n_per_task, n );
+      uint32_t* counts = digit_offsets + task_idx * MSH_HG__RADIX_SIZE;
+      for( int32_t i = low_lim; i < high_lim; ++i )
+      {
+        counts[ (src_keys[i] >> shift) & (MSH_HG__RADIX_SIZE - 1) ]++;
+      }
+    }
+
+    // Turn the per-task histograms into scatter offsets. Skip the pass if all keys share a digit.
+    uint32_t offset = 0;
+    int32_t is_single_digit = 0;
+    for( int32_t digit = 0; digit < MSH_HG__RADIX_SIZE; ++digit )
+    {
+      uint32_t digit_count = 0;
+      for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
+      {
+        uint32_t count = digit_offsets[ task_idx * MSH_HG__RADIX_SIZE + digit ];
+        digit_offsets[ task_idx * MSH_HG__RADIX_SIZE + digit ] = offset;
+        offset += count;
+        digit_count += count;
+      }
+      if( digit_count == (uint32_t)n ) { is_single_digit = 1; }
+    }
+    if( is_single_digit ) { continue; }
 
+#if defined(_OPENMP)
+    #pragma omp parallel for if (!hg->_dont_use_omp) num_threads(n_tasks)
+#endif
+    for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
+    {
+      int32_t low_lim  = task_idx * n_per_task;
+      int32_t high_lim = MSH_HG_MIN( low_lim + n_per_task, n );
+      uint32_t* offsets = digit_offsets + task_idx * MSH_HG__RADIX_SIZE;
+      for( int32_t i = low_lim; i < high_lim; ++i )
+      {
+        uint64_t key = src_keys[i];
+        uint32_t dst_idx = offsets[ (key >> shift) & (MSH_HG__RADIX_SIZE - 1) ]++;
+        keys[1 - src][dst_idx]    = key;
+        indices[1 - src][dst_idx] = indices[src][i];
+      }
+    }
+    src = 1 - src;
+  }
+  MSH_HG_FREE( digit_offsets );
+  return src;
+}
 
 void
 msh_hash_grid__init( msh_hash_grid_t* hg,
-                     const float* pts, const int32_t n_pts, const int32_t dim,
-                     const float radius )
+                     const float* pts, const int32_t* ids, const int32_t n_pts, const int32_t dim,
+                     const float radius, const uint32_t bin_slack )
 {
   assert( dim == 2 || dim == 3 );
 
@@ -411,26 +738,59 @@ msh_hash_grid__init( msh_hash_grid_t* hg,
 
   hg->_pts_dim = dim;
 
+  // NOTE: Construction is split into a few passes over contiguous ranges of points, one
+  // range per thread. Each pass is an independent loop, so without OpenMP it runs sequentially.
+  int32_t n_tasks = MSH_HG_MAX( 1, MSH_HG_MIN( (int32_t)hg->_num_threads, n_pts ) );
+  int32_t n_pts_per_task = ( n_pts + n_tasks - 1 ) / n_tasks;
+
   // Compute bbox
+  msh_hg_v3_t* task_min_pts = (msh_hg_v3_t*)MSH_HG_MALLOC( 2 * n_tasks * sizeof(msh_hg_v3_t) );
+  msh_hg_v3_t* task_max_pts = task_min_pts + n_tasks;
+#if defined(_OPENMP)
+  #pragma omp parallel for if (!hg->_dont_use_omp) num_threads(n_tasks)
+#endif
+  for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
+  {
+    int32_t low_lim  = task_idx * n_pts_per_task;
+    int32_t high_lim = MSH_HG_MIN( low_lim + n_pts_per_task, n_pts );
+    msh_hg_v3_t min_pt = (msh_hg_v3_t){ .x =  1e9, .y =  1e9, .z =  1e9 };
+    msh_hg_v3_t max_pt = (msh_hg_v3_t){ .x = -1e9, .y = -1e9, .z = -1e9 };
+    for( int32_t i = low_lim; i < high_lim; ++i )
+    {
+      const float* pt_ptr = &pts[ dim * i ];
+      msh_hg_v3_t pt;
+      if( dim == 2 ) { pt = (msh_hg_v3_t){ .x = pt_ptr[0], .y = pt_ptr[1], .z = 0 }; }
+      else           { pt = (msh_hg_v3_t){ .x = pt_ptr[0], .y = pt_ptr[1], .z = pt_ptr[2] }; };
+
+      min_pt.x = (min_pt.x > pt.x) ? pt.x : min_pt.x;
+      min_pt.y = (min_pt.y > pt.y) ? pt.y : min_pt.y;
+      min_pt.z = (min_pt.z > pt.z) ? pt.z : min_pt.z;
+
+      max_pt.x = (max_pt.x < pt.x) ? pt.x : max_pt.x;
+      max_pt.y = (max_pt.y < pt.y) ? pt.y : max_pt.y;
+      max_pt.z = (max_pt.z < pt.z) ? pt.z : max_pt.z;
+    }
+    task_min_pts[task_idx] = min_pt;
+    task_max_pts[task_idx] = max_pt;
+  }
+
   hg->min_pt = (msh_hg_v3_t){ .x =  1e9, .y =  1e9, .z =  1e9 };
   hg->max_pt = (msh_hg_v3_t){ .x = -1e9, .y = -1e9, .z = -1e9 };
-
-  for( int i = 0; i < n_pts; ++i )
+  for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
   {
-    const float* pt_ptr = &pts[ dim * i ];
-
-    msh_hg_v3_t pt;
-    if( dim == 2 ) { pt = (msh_hg_v3_t){ .x = pt_ptr[0], .y = pt_ptr[1], .z = 0 }; }
-    else           { pt = (msh_hg_v3_t){ .x = pt_ptr[0], .y = pt_ptr[1], .z = pt_ptr[2] }; };
-
-    hg->min_pt.x = (hg->min_pt.x > pt.x) ? pt.x : hg->min_pt.x;
-    hg->min_pt.y = (hg->min_pt.y > pt.y) ? pt.y : hg->min_pt.y;
-    hg->min_pt.z = (hg->min_pt.z > pt.z) ? pt.z : hg->min_pt.z;
-
-    hg->max_pt.x = (hg->max_pt.x < pt.x) ? pt.x : hg->max_pt.x;
-    hg->max_pt.y = (hg->max_pt.y < pt.y) ? pt.y : hg->max_pt.y;
-    hg->max_pt.z = (hg->max_pt.z < pt.z) ? pt.z : hg->max_pt.z;
+    hg->min_pt.x = MSH_HG_MIN( hg->min_pt.x, task_min_pts[task_idx].x );
+    hg->min_pt.y = MSH_HG_MIN( hg->min_pt.y, task_min_pts[task_idx].y );
+    hg->min_pt.z = MSH_HG_MIN( hg->min_pt.z, task_min_pts[task_idx].z );
 
+    hg->max_pt.x = MSH_HG_MAX( hg->max_pt.x, task_max_pts[task_idx].x );
+    hg->max_pt.y = MSH_HG_MAX( hg->max_pt.y, task_max_pts[task_idx].y );
+    hg->max_pt.z = MSH_HG_MAX( hg->max_pt.z, task_max_pts[task_idx].z );
+  }
+  MSH_HG_FREE( task_min_pts );
+  if( n_pts == 0 )
+  {
+    hg->min_pt = (msh_hg_v3_t){ .x = 0.0f, .y = 0.0f, .z = 0.0f };
+    hg->max_pt = (msh_hg_v3_t){ .x = 0.0f, .y = 0.0f, .z = 0.0f };
   }
   hg->max_pt.x += 0.0001f; hg->max_pt.y += 0.0001f; hg->max_pt.z += 0.0001f;
   hg->min_pt.x -= 0.0001f; hg->min_pt.y -= 0.0001f; hg->min_pt.z -= 0.0001f;
@@ -450,110 +810,146 @@ msh_hash_grid__init( msh_hash_grid_t* hg,
   hg->depth     = (int)(dim_z / hg->cell_size + 1.0) ;
   hg->_inv_cell_size = 1.0f/ hg->cell_size;
   hg->_slab_size = hg->height * hg->width;
-  hg->_n_pts = 0;
+  hg->_use_morton = msh_hash_grid__fits_morton( hg );
+  hg->_n_pts = n_pts;
+  hg->_n_ids = n_pts;
+  hg->_slots = NULL;
+  hg->_overflow = NULL;
+
+  // Compute cell key of each point. These, paired with point indices, are the sort keys.
+  uint64_t* bin_keys[2];
+  int32_t*  pt_indices[2];
+  bin_keys[0]   = (uint64_t*)MSH_HG_MALLOC( 2 * n_pts * sizeof(uint64_t) );
+  bin_keys[1]   = bin_keys[0] + n_pts;
+  pt_indices[0] = (int32_t*)MSH_HG_MALLOC( 2 * n_pts * sizeof(int32_t) );
+  pt_indices[1] = pt_indices[0] + n_pts;
 
-  // Create hash table
-  hg->bin_table = (msh_hg_map_t*)MSH_HG_CALLOC( 1, sizeof(msh_hg_map_t) );
-  msh_hg_map_init( hg->bin_table, 128 );
-  msh_hg_array( msh_hg__bin_data_t ) bin_table_data = {0};
-  uint64_t n_bins = 0;
-  for( int i = 0 ; i < n_pts; ++i )
+#if defined(_OPENMP)
+  #pragma omp parallel for if (!hg->_dont_use_omp) num_threads(n_tasks)
+#endif
+  for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
   {
-    const float* pt_ptr = &pts[ dim * i ];
-    msh_hg_v3i_t pt_data;
-    if( dim == 2 )
-    {
-      pt_data = (msh_hg_v3i_t){ .x = pt_ptr[0], .y = pt_ptr[1], .z = 0, .i = i };
-    }
-    else
+    int32_t low_lim  = task_idx * n_pts_per_task;
+    int32_t high_lim = MSH_HG_MIN( low_lim + n_pts_per_task, n_pts );
+    for( int32_t i = low_lim; i < high_lim; ++i )
     {
-      pt_data = (msh_hg_v3i_t){ .x = pt_ptr[0], .y = pt_ptr[1], .z = pt_ptr[2], .i = i };
+      const float* pt_ptr = &pts[ dim * i ];
+      float z = ( dim == 2 ) ? 0.0f : pt_ptr[2];
+      uint64_t ix = (uint64_t)( ( pt_ptr[0] - hg->min_pt.x ) * hg->_inv_cell_size );
+      uint64_t iy = (uint64_t)( ( pt_ptr[1] - hg->min_pt.y ) * hg->_inv_cell_size );
+      uint64_t iz = (uint64_t)( ( z - hg->min_pt.z ) * hg->_inv_cell_size );
+      bin_keys[0][i]   = msh_hash_grid__cell_key( hg, ix, iy, iz );
+      pt_indices[0][i] = i;
     }
+  }
 
-    uint64_t ix = (uint64_t)( ( pt_data.x - hg->min_pt.x ) * hg->_inv_cell_size );
-    uint64_t iy = (uint64_t)( ( pt_data.y - hg->min_pt.y ) * hg->_inv_cell_size );
-    uint64_t iz = (uint64_t)( ( pt_data.z - hg->min_pt.z ) * hg->_inv_cell_size );
+  // Sort (cell, point) pairs. Points within a bin stay in the order of their indices. We only
+  // need as many passes as there are bits in the largest cell key.
+  int32_t n_key_bits = msh_hash_grid__cell_key_bits( hg );
 
-    uint64_t bin_idx = msh_hash_grid__bin_pt( hg, ix, iy, iz );
+  int32_t src = msh_hash_grid__radix_sort( hg, bin_keys, pt_indices, n_pts, n_key_bits );
 
-    uint64_t* bin_table_idx = msh_hg_map_get( hg->bin_table, bin_idx );
+  // Count bins starting in each task's range, so that the bins can be numbered by a prefix sum
+  const uint64_t* sorted_keys    = bin_keys[src];
+  const int32_t*  sorted_indices = pt_indices[src];
+  uint64_t* unique_keys          = bin_keys[1 - src];
+  uint32_t* task_bin_offsets     = (uint32_t*)MSH_HG_CALLOC( n_tasks + 1, sizeof(uint32_t) );
 
-    if( bin_table_idx )
-    {
-      bin_table_data[*bin_table_idx].n_pts += 1;
-      msh_hg_array_push( bin_table_data[*bin_table_idx].data, pt_data );
-    }
-    else
+#if defined(_OPENMP)
+  #pragma omp parallel for if (!hg->_dont_use_omp) num_threads(n_tasks)
+#endif
+  for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
+  {
+    int32_t low_lim  = task_idx * n_pts_per_task;
+    int32_t high_lim = MSH_HG_MIN( low_lim + n_pts_per_task, n_pts );
+    uint32_t n_task_bins = 0;
+    for( int32_t i = low_lim; i < high_lim; ++i )
     {
-      msh_hg_map_insert( hg->bin_table, bin_idx, n_bins );
-
-      msh_hg__bin_data_t new_bin = {0};
-      new_bin.n_pts = 1;
-      msh_hg_array_push( new_bin.data, pt_data );
-      msh_hg_array_push( bin_table_data, new_bin );
-      n_bins++;
+      n_task_bins += ( i == 0 || sorted_keys[i] != sorted_keys[i - 1] );
     }
+    task_bin_offsets[task_idx + 1] = n_task_bins;
+  }
+  for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
+  {
+    task_bin_offsets[task_idx + 1] += task_bin_offsets[task_idx];
   }
+  uint32_t n_bins = task_bin_offsets[n_tasks];
 
-  // Prepare storage for linear data
+  // Lay the points into the linear storage, and record where each bin starts. Each bin is
+  // followed by 'bin_slack' free slots, so that it can grow in place.
+  size_t data_len = (size_t)n_pts + (size_t)n_bins * bin_slack;
   hg->offsets     = (msh_hg__bin_info_t*)MSH_HG_MALLOC( n_bins * sizeof(msh_hg__bin_info_t) );
-  hg->data_buffer = (msh_hg_v3i_t*)MSH_HG_MALLOC( n_pts * sizeof( msh_hg_v3i_t ) );
-  MSH_HG_MEMSET( hg->offsets, 0, n_bins * sizeof(msh_hg__bin_info_t) );
+  hg->data_buffer = (msh_hg_v3i_t*)MSH_HG_MALLOC( data_len * sizeof( msh_hg_v3i_t ) );
+  hg->_xs = NULL; hg->_ys = NULL; hg->_zs = NULL; hg->_ids = NULL;
+  msh_hash_grid__soa_resize( hg, data_len );
 
-  // Gather indices of bins that have data in them from hash table
-  msh_array( uint64_t ) filled_bin_indices = {0};
-  for( size_t i = 0; i < msh_hg_map_cap(hg->bin_table); ++i )
+#if defined(_OPENMP)
+  #pragma omp parallel for if (!hg->_dont_use_omp) num_threads(n_tasks)
+#endif
+  for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
   {
-    // Remember that msh_hg_map internally increments the index, so we need to decrement it here.
-    if( hg->bin_table->keys[i] )
+    int32_t low_lim  = task_idx * n_pts_per_task;
+    int32_t high_lim = MSH_HG_MIN( low_lim + n_pts_per_task, n_pts );
+    uint32_t bin_idx = task_bin_offsets[task_idx];
+    for( int32_t i = low_lim; i < high_lim; ++i )
     {
-      msh_array_push( filled_bin_indices, hg->bin_table->keys[i] - 1);
+      if( i == 0 || sorted_keys[i] != sorted_keys[i - 1] )
+      {
+        unique_keys[bin_idx]        = msh_hash_grid__cell_key_to_bin( hg, sorted_keys[i] );
+        hg->offsets[bin_idx].offset = i + bin_idx * bin_slack;
+        bin_idx++;
+      }
+      // NOTE: 'bin_idx - 1' is the bin of the i-th point, also when a bin spans tasks.
+      const float* pt_ptr = &pts[ dim * sorted_indices[i] ];
+      msh_hash_grid__store_pt( hg, i + (bin_idx - 1) * bin_slack,
+        (msh_hg_v3i_t){ .x = pt_ptr[0],
+                        .y = pt_ptr[1],
+                        .z = ( dim == 2 ) ? 0.0f : pt_ptr[2],
+                        .i = ids ? ids[ sorted_indices[i] ] : sorted_indices[i] } );
     }
   }
-  qsort( filled_bin_indices, msh_hg_array_len( filled_bin_indices ), sizeof(uint64_t), msh_hash_grid__uint64_compare );
+  MSH_HG_FREE( task_bin_offsets );
 
-  // Now lay the data into an array based on the sorted keys (following fill order)
-  // TODO(maciej): Morton ordering?
+  // Bin lengths follow from the offsets of consecutive bins
   hg->max_n_pts_in_bin = 0;
-  uint32_t offset = 0;
-  for( size_t i = 0; i < msh_hg_array_len(filled_bin_indices); ++i )
+  for( uint32_t i = 0; i < n_bins; ++i )
   {
-    uint64_t* bin_index = msh_hg_map_get( hg->bin_table, filled_bin_indices[i] );
-    assert( bin_index );
-    msh_hg__bin_data_t* bin = &bin_table_data[ *bin_index ];
-    assert( bin );
-    uint32_t n_bin_pts = bin->n_pts;
-    hg->_n_pts += n_bin_pts;
-    hg->max_n_pts_in_bin = MSH_HG_MAX( n_bin_pts, hg->max_n_pts_in_bin );
-    for( uint32_t j = 0; j < n_bin_pts; ++j )
-    {
-      hg->data_buffer[ offset + j ] = bin->data[j] ;
-    }
-    hg->offsets[ *bin_index ] = (msh_hg__bin_info_t) { .offset = offset, .length = n_bin_pts };
-    offset += n_bin_pts;
+    uint32_t next_offset = ( i + 1 < n_bins ) ? hg->offsets[i + 1].offset : (uint32_t)data_len;
+    hg->offsets[i].capacity = next_offset - hg->offsets[i].offset;
+    hg->offsets[i].length   = hg->offsets[i].capacity - bin_slack;
+    hg->max_n_pts_in_bin = MSH_HG_MAX( hg->offsets[i].length, hg->max_n_pts_in_bin );
   }
+  hg->_n_bins             = n_bins;
+  hg->_bins_cap           = n_bins;
+  hg->_data_len           = data_len;
+  hg->_data_cap           = data_len;
+  hg->_compacted_data_len = data_len;
 
-
-  // Clean-up temporary data
-  for( size_t i = 0; i < n_bins; ++i )
+  // Create hash table. It is sized upfront, so inserting the sorted bins never rehashes.
+  hg->bin_table = (msh_hg_map_t*)MSH_HG_CALLOC( 1, sizeof(msh_hg_map_t) );
+  msh_hg_map_init( hg->bin_table, MSH_HG_MAX( 2 * n_bins + 1, 128 ) );
+  for( uint32_t i = 0; i < n_bins; ++i )
   {
-    msh_hg_array_free( bin_table_data[i].data );
+    msh_hg_map_insert( hg->bin_table, unique_keys[i], i );
   }
-  msh_hg_array_free( bin_table_data );
+
+  // Clean-up temporary data
+  MSH_HG_FREE( bin_keys[0] );
+  MSH_HG_FREE( pt_indices[0] );
 }
 
 void
 msh_hash_grid_init_2d( msh_hash_grid_t* hg,
                        const float* pts, const int32_t n_pts, const float radius)
 {
-  msh_hash_grid__init( hg, pts, n_pts, 2, radius );
+  msh_hash_grid__init( hg, pts, NULL, n_pts, 2, radius, 0 );
 }
 
 void
 msh_hash_grid_init_3d( msh_hash_grid_t* hg,
                        const float* pts, const int32_t n_pts, const float radius)
 {
-  msh_hash_grid__init( hg, pts, n_pts, 3, radius );
+  msh_hash_grid__init( hg, pts, NULL, n_pts, 3, radius, 0 );
 }
 
 
@@ -571,7 +967,264 @@ msh_hash_grid_term( msh_hash_grid_t* hg )
 
   MSH_HG_FREE( hg->data_buffer ); hg->data_buffer = NULL;
   MSH_HG_FREE( hg->offsets );     hg->offsets = NULL;
+  if( hg->bin_table ) { msh_hg_map_free( hg->bin_table ); }
   MSH_HG_FREE( hg->bin_table );   hg->bin_table = NULL;
+  msh_hg_array_free( hg->_slots );
+  msh_hg_array_free( hg->_overflow );
+  MSH_HG_FREE( hg->_xs );  hg->_xs = NULL;
+  MSH_HG_FREE( hg->_ys );  hg->_ys = NULL;
+  MSH_HG_FREE( hg->_zs );  hg->_zs = NULL;
+  MSH_HG_FREE( hg->_ids ); hg->_ids = NULL;
+  hg->_n_pts    = 0;
+  hg->_n_ids    = 0;
+  hg->_n_bins   = 0;
+  hg->_data_len = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Incremental updates
+//
+// Each bin owns 'capacity' slots of 'data_buffer', of which the first 'length' are used. Bins that
+// run out of slots are moved to the end of 'data_buffer', leaving their old slots unused until
+// the grid is compacted. Points outside of the grid bounds are kept in '_overflow' and scanned by
+// every query. Compaction rebuilds the grid, which also extends its bounds over such points.
+// '_slots' maps point indices to their position in 'data_buffer' (or '_overflow').
+
+#define MSH_HG__OVERFLOW_SLOT    0x80000000u
+#define MSH_HG__INVALID_SLOT     0xffffffffu
+#define MSH_HG__BIN_SLACK        2
+#define MSH_HG__MAX_OVERFLOW_PTS 1024
+
+MSH_HG_INLINE msh_hg_v3i_t
+msh_hash_grid__make_pt( const msh_hash_grid_t* hg, const float* pt, const int32_t idx )
+{
+  float z = ( hg->_pts_dim == 2 ) ? 0.0f : pt[2];
+  return (msh_hg_v3i_t){ .x = pt[0], .y = pt[1], .z = z, .i = idx };
+}
+
+int32_t
+msh_hash_grid__locate_bin( const msh_hash_grid_t* hg, const msh_hg_v3i_t* pt, uint64_t* bin_idx )
+{
+  double fx = ( pt->x - hg->min_pt.x ) * hg->_inv_cell_size;
+  double fy = ( pt->y - hg->min_pt.y ) * hg->_inv_cell_size;
+  double fz = ( pt->z - hg->min_pt.z ) * hg->_inv_cell_size;
+  if( fx < 0.0 || fx >= hg->width  ||
+      fy < 0.0 || fy >= hg->height ||
+      fz < 0.0 || fz >= hg->depth ) { return 0; }
+
+  *bin_idx = msh_hash_grid__bin_pt( hg, (uint64_t)fx, (uint64_t)fy, (uint64_t)fz );
+  return 1;
+}
+
+void
+msh_hash_grid__prepare_update( msh_hash_grid_t* hg )
+{
+  if( hg->_slots ) { return; }
+
+  for( int32_t i = 0; i < hg->_n_ids; ++i ) { msh_hg_array_push( hg->_slots, MSH_HG__INVALID_SLOT ); }
+  for( size_t i = 0; i < hg->_n_bins; ++i )
+  {
+    msh_hg__bin_info_t bin = hg->offsets[i];
+    for( uint32_t j = bin.offset; j < bin.offset + bin.length; ++j )
+    {
+      hg->_slots[ hg->data_buffer[j].i ] = j;
+    }
+  }
+}
+
+void
+msh_hash_grid__push_pt( msh_hash_grid_t* hg, const msh_hg_v3i_t pt )
+{
+  uint64_t bin_idx;
+  if( !msh_hash_grid__locate_bin( hg, &pt, &bin_idx ) )
+  {
+    hg->_slots[pt.i] = MSH_HG__OVERFLOW_SLOT | (uint32_t)msh_hg_array_len( hg->_overflow );
+    msh_hg_array_push( hg->_overflow, pt );
+    return;
+  }
+
+  uint64_t* bin_table_idx = msh_hg_map_get( hg->bin_table, bin_idx );
+  if( !bin_table_idx )
+  {
+    if( hg->_n_bins == hg->_bins_cap )
+    {
+      hg->_bins_cap = MSH_HG_MAX( 16, 2 * hg->_bins_cap );
+      hg->offsets = (msh_hg__bin_info_t*)MSH_HG_REALLOC( hg->offsets,
+                                                 hg->_bins_cap * sizeof(msh_hg__bin_info_t) );
+    }
+    hg->offsets[hg->_n_bins] = (msh_hg__bin_info_t){ .offset   = (uint32_t)hg->_data_len,
+                                                     .length   = 0,
+                                                     .capacity = 0 };
+    msh_hg_map_insert( hg->bin_table, bin_idx, hg->_n_bins );
+    bin_table_idx = msh_hg_map_get( hg->bin_table, bin_idx );
+    hg->_n_bins++;
+  }
+
+  msh_hg__bin_info_t* bin = &hg->offsets[ *bin_table_idx ];
+  if( bin->length == bin->capacity )
+  {
+    // The last bin in storage can grow in place, others are moved to the end
+    uint32_t new_capacity = MSH_HG_MAX( 4, 2 * bin->capacity );
+    int32_t is_last       = ( bin->offset + bin->capacity == hg->_data_len );
+    size_t new_offset     = is_last ? bin->offset : hg->_data_len;
+    size_t new_data_len   = new_offset + new_capacity;
+    assert( new_data_len < MSH_HG__OVERFLOW_SLOT );
+    if( new_data_len > hg->_data_cap )
+    {
+      hg->_data_cap = MSH_HG_MAX( new_data_len, 2 * hg->_data_cap );
+      hg->data_buffer = (msh_hg_v3i_t*)MSH_HG_REALLOC( hg->data_buffer,
+                                                   hg->_data_cap * sizeof(msh_hg_v3i_t) );
+      msh_hash_grid__soa_resize( hg, hg->_data_cap );
+    }
+    if( !is_last )
+    {
+      for( uint32_t j = 0; j < bin->length; ++j )
+      {
+        msh_hash_grid__store_pt( hg, new_offset + j, hg->data_buffer[bin->offset + j] );
+        hg->_slots[ hg->data_buffer[new_offset + j].i ] = new_offset + j;
+      }
+      bin->offset = new_offset;
+    }
+    bin->capacity = new_capacity;
+    hg->_data_len = new_data_len;
+  }
+
+  uint32_t slot = bin->offset + bin->length++;
+  msh_hash_grid__store_pt( hg, slot, pt );
+  hg->_slots[pt.i] = slot;
+  hg->max_n_pts_in_bin = MSH_HG_MAX( bin->length, hg->max_n_pts_in_bin );
+}
+
+void
+msh_hash_grid__pop_pt( msh_hash_grid_t* hg, const int32_t idx )
+{
+  // Fill the hole with the last point of the bin (or overflow list)
+  uint32_t slot = hg->_slots[idx];
+  if( slot & MSH_HG__OVERFLOW_SLOT )
+  {
+    uint32_t i    = slot & ~MSH_HG__OVERFLOW_SLOT;
+    uint32_t last = msh_hg_array_len( hg->_overflow ) - 1;
+    hg->_overflow[i] = hg->_overflow[last];
+    hg->_slots[ hg->_overflow[i].i ] = slot;
+    msh_hg_array__hdr( hg->_overflow )->len--;
+  }
+  else
+  {
+    uint64_t bin_idx = 0;
+    int32_t is_in_grid = msh_hash_grid__locate_bin( hg, &hg->data_buffer[slot], &bin_idx );
+    assert( is_in_grid ); (void)is_in_grid;
+    uint64_t* bin_table_idx = msh_hg_map_get( hg->bin_table, bin_idx );
+    assert( bin_table_idx );
+    msh_hg__bin_info_t* bin = &hg->offsets[ *bin_table_idx ];
+    uint32_t last = bin->offset + bin->length - 1;
+    msh_hash_grid__store_pt( hg, slot, hg->data_buffer[last] );
+    hg->_slots[ hg->data_buffer[slot].i ] = slot;
+    bin->length--;
+  }
+  hg->_slots[idx] = MSH_HG__INVALID_SLOT;
+}
+
+size_t
+msh_hash_grid__gather_pts( const msh_hg_v3i_t* data, const size_t n_pts, const int32_t dim,
+                           float* pts, int32_t* ids )
+{
+  for( size_t i = 0; i < n_pts; ++i )
+  {
+    pts[ dim * i ]     = data[i].x;
+    pts[ dim * i + 1 ] = data[i].y;
+    if( dim == 3 ) { pts[ dim * i + 2 ] = data[i].z; }
+    ids[i] = data[i].i;
+  }
+  return n_pts;
+}
+
+void
+msh_hash_grid_compact( msh_hash_grid_t* hg )
+{
+  // Gather the points that are still in the grid and rebuild it from them
+  size_t n_pts   = hg->_n_pts;
+  int32_t dim    = hg->_pts_dim;
+  float* pts     = (float*)MSH_HG_MALLOC( n_pts * dim * sizeof(float) );
+  int32_t* ids   = (int32_t*)MSH_HG_MALLOC( n_pts * sizeof(int32_t) );
+  size_t n_added = 0;
+  for( size_t i = 0; i < hg->_n_bins; ++i )
+  {
+    msh_hg__bin_info_t bin = hg->offsets[i];
+    n_added += msh_hash_grid__gather_pts( hg->data_buffer + bin.offset, bin.length, dim,
+                                          pts + dim * n_added, ids + n_added );
+  }
+  n_added += msh_hash_grid__gather_pts( hg->_overflow, msh_hg_array_len( hg->_overflow ), dim,
+                                        pts + dim * n_added, ids + n_added );
+  assert( n_added == n_pts );
+
+  msh_hash_grid_t new_hg = {0};
+  new_hg._num_threads  = hg->_num_threads;
+  new_hg._dont_use_omp = hg->_dont_use_omp;
+  msh_hash_grid__init( &new_hg, pts, ids, n_pts, dim, 0.5 * hg->cell_size, MSH_HG__BIN_SLACK );
+  new_hg._n_ids = hg->_n_ids;
+  msh_hash_grid_term( hg );
+  *hg = new_hg;
+
+  MSH_HG_FREE( pts );
+  MSH_HG_FREE( ids );
+}
+
+void
+msh_hash_grid__compact_if_needed( msh_hash_grid_t* hg )
+{
+  if( msh_hg_array_len( hg->_overflow ) > MSH_HG__MAX_OVERFLOW_PTS ||
+      hg->_data_len > 2 * hg->_compacted_data_len + 1024 )
+  {
+    msh_hash_grid_compact( hg );
+  }
+}
+
+int32_t
+msh_hash_grid_insert( msh_hash_grid_t* hg, const float* pt )
+{
+  msh_hash_grid__prepare_update( hg );
+  int32_t idx = hg->_n_ids++;
+  msh_hg_array_push( hg->_slots, MSH_HG__INVALID_SLOT );
+  msh_hash_grid__push_pt( hg, msh_hash_grid__make_pt( hg, pt, idx ) );
+  hg->_n_pts++;
+  msh_hash_grid__compact_if_needed( hg );
+  return idx;
+}
+
+void
+msh_hash_grid_remove( msh_hash_grid_t* hg, const int32_t idx )
+{
+  msh_hash_grid__prepare_update( hg );
+  assert( idx >= 0 && idx < hg->_n_ids );
+  if( hg->_slots[idx] == MSH_HG__INVALID_SLOT ) { return; }
+  msh_hash_grid__pop_pt( hg, idx );
+  hg->_n_pts--;
+  msh_hash_grid__compact_if_needed( hg );
+}
+
+void
+msh_hash_grid_update( msh_hash_grid_t* hg, const int32_t idx, const float* pt )
+{
+  msh_hash_grid__prepare_update( hg );
+  assert( idx >= 0 && idx < hg->_n_ids );
+  uint32_t slot = hg->_slots[idx];
+  if( slot == MSH_HG__INVALID_SLOT ) { return; }
+
+  // Points that stay within their bin are simply overwritten
+  msh_hg_v3i_t new_pt = msh_hash_grid__make_pt( hg, pt, idx );
+  uint64_t old_bin_idx, new_bin_idx;
+  if( !(slot & MSH_HG__OVERFLOW_SLOT) &&
+      msh_hash_grid__locate_bin( hg, &hg->data_buffer[slot], &old_bin_idx ) &&
+      msh_hash_grid__locate_bin( hg, &new_pt, &new_bin_idx ) &&
+      old_bin_idx == new_bin_idx )
+  {
+    msh_hash_grid__store_pt( hg, slot, new_pt );
+    return;
+  }
+
+  msh_hash_grid__pop_pt( hg, idx );
+  msh_hash_grid__push_pt( hg, new_pt );
+  msh_hash_grid__compact_if_needed( hg );
 }
 
 
@@ -729,13 +1382,13 @@ msh_hash_grid__heapify( float *dists, int32_t* ind, size_t len, size_t cur )
   }
 }
 
-void msh_hash_grid__heap_make( real32_t* dists, int32_t* ind, size_t len )
+void msh_hash_grid__heap_make( float* dists, int32_t* ind, size_t len )
 {
   int64_t i = len >> 1;
   while ( i >= 0 ) { msh_hash_grid__heapify( dists, ind, len, i-- ); }
 }
 
-void msh_hash_grid__heap_pop( real32_t* dists, int32_t* ind, size_t len )
+void msh_hash_grid__heap_pop( float* dists, int32_t* ind, size_t len )
 {
   float max_dist = dists[0];
   dists[0] = dists[len-1];
@@ -750,7 +1403,7 @@ void msh_hash_grid__heap_pop( real32_t* dists, int32_t* ind, size_t len )
   if( len > 0 ){ msh_hash_grid__heapify( dists, ind, len, 0 ); }
 }
 
-void msh_hash_grid__heap_push( real32_t* dists, int32_t* ind, size_t len )
+void msh_hash_grid__heap_push( float* dists, int32_t* ind, size_t len )
 {
   int64_t i = len - 1;
   float d = dists[i];
@@ -773,8 +1426,8 @@ typedef struct msh_hash_grid_dist_storage
 {
   size_t    cap;
   size_t    len;
-  real32_t  max_dist;
-  real32_t* dists;
+  float  max_dist;
+  float* dists;
   int32_t*  indices;
   int32_t   is_heap;
 } msh_hash_grid_dist_storage_t;
@@ -826,19 +1479,10 @@ msh_hash_grid_dist_storage_push( msh_hash_grid_dist_storage_t* q,
 }
 
 void
-msh_hash_grid__find_neighbors_in_bin( const msh_hash_grid_t* hg, const uint64_t bin_idx,
-                                      const float radius_sq, const float* pt,
-                                      msh_hash_grid_dist_storage_t* s )
+msh_hash_grid__find_neighbors_in_range( const msh_hash_grid_t* hg, const msh_hg_v3i_t* data,
+                                        const uint32_t n_pts, const float radius_sq,
+                                        const float* pt, msh_hash_grid_dist_storage_t* s )
 {
-  
-  // issue this whole things stops working if we use doubles.
-  uint64_t* bin_table_idx = msh_hg_map_get( hg->bin_table, bin_idx );
-  if( !bin_table_idx ) { return; }
-
-  msh_hg__bin_info_t bi = hg->offsets[ *bin_table_idx ];
-  uint32_t n_pts = bi.length;
-  const msh_hg_v3i_t* data = &hg->data_buffer[bi.offset];
-
   float px = pt[0];
   float py = pt[1];
   float pz = (hg->_pts_dim == 2 ) ? 0.0 : pt[2];
@@ -863,29 +1507,320 @@ msh_hash_grid__find_neighbors_in_bin( const msh_hash_grid_t* hg, const uint64_t
   }
 }
 
-uint32_t
-msh_hash_grid__radius_search( const msh_hash_grid_t* hg, 
-                              msh_hash_grid_search_desc_t* hg_sd, 
-                              uint32_t start_idx, uint32_t end_idx  )
+#if defined(MSH_HG__SIMD)
+// Computes squared distances to a register's worth of points at a time, and compresses the ones
+// below the threshold before pushing them to the storage. Once the storage is full, the
+// threshold shrinks to the distance of the farthest neighbor kept.
+void
+msh_hash_grid__find_neighbors_in_soa( const msh_hash_grid_t* hg, const uint32_t offset,
+                                      const uint32_t n_pts, const float radius_sq,
+                                      const float* pt, msh_hash_grid_dist_storage_t* s )
 {
-  if( !hg || !hg_sd ) { return 0; }
-  enum { MAX_BIN_COUNT = 256 };
-  int32_t bin_indices[ MAX_BIN_COUNT ];
-  float bin_dists_sq[ MAX_BIN_COUNT ];
-
-  float radius          = hg_sd->radius;
-  double radius_sq      = (double)radius * (double)radius;
-  size_t row_size       = hg_sd->max_n_neigh;
+  const float* xs    = hg->_xs + offset;
+  const float* ys    = hg->_ys + offset;
+  const float* zs    = hg->_zs + offset;
+  const int32_t* ids = hg->_ids + offset;
+  float pz = (hg->_pts_dim == 2 ) ? 0.0f : pt[2];
+
+  float   passing_dists[MSH_HG__SIMD_WIDTH];
+  int32_t passing_ids[MSH_HG__SIMD_WIDTH];
+  for( uint32_t i = 0; i < n_pts; i += MSH_HG__SIMD_WIDTH )
+  {
+    float threshold = radius_sq;
+    if( s->len >= s->cap ) { threshold = MSH_HG_MIN( threshold, s->max_dist ); }
+
+    uint32_t mask = 0;
+    uint32_t n_passing = 0;
+#if defined(MSH_HG__AVX512)
+    __m512 vx = _mm512_sub_ps( _mm512_loadu_ps( xs + i ), _mm512_set1_ps( pt[0] ) );
+    __m512 vy = _mm512_sub_ps( _mm512_loadu_ps( ys + i ), _mm512_set1_ps( pt[1] ) );
+    __m512 vz = _mm512_sub_ps( _mm512_loadu_ps( zs + i ), _mm512_set1_ps( pz ) );
+    __m512 d  = _mm512_add_ps( _mm512_add_ps( _mm512_mul_ps( vx, vx ), _mm512_mul_ps( vy, vy ) ),
+                               _mm512_mul_ps( vz, vz ) );
+    mask = _mm512_cmp_ps_mask( d, _mm512_set1_ps( threshold ), _CMP_LT_OQ );
+    if( n_pts - i < MSH_HG__SIMD_WIDTH ) { mask &= (1u << (n_pts - i)) - 1; }
+    _mm512_mask_compressstoreu_ps( passing_dists, (__mmask16)mask, d );
+    _mm512_mask_compressstoreu_epi32( passing_ids, (__mmask16)mask,
+                                      _mm512_loadu_si512( (const void*)(ids + i) ) );
+    for( ; mask; mask &= mask - 1 ) { n_passing++; }
+#else
+    float dists[MSH_HG__SIMD_WIDTH];
+#if defined(MSH_HG__AVX2)
+    __m256 vx = _mm256_sub_ps( _mm256_loadu_ps( xs + i ), _mm256_set1_ps( pt[0] ) );
+    __m256 vy = _mm256_sub_ps( _mm256_loadu_ps( ys + i ), _mm256_set1_ps( pt[1] ) );
+    __m256 vz = _mm256_sub_ps( _mm256_loadu_ps( zs + i ), _mm256_set1_ps( pz ) );
+    __m256 d  = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( vx, vx ), _mm256_mul_ps( vy, vy ) ),
+                               _mm256_mul_ps( vz, vz ) );
+    mask = _mm256_movemask_ps( _mm256_cmp_ps( d, _mm256_set1_ps( threshold ), _CMP_LT_OQ ) );
+    _mm256_storeu_ps( dists, d );
+#else
+    __m128 vx = _mm_sub_ps( _mm_loadu_ps( xs + i ), _mm_set1_ps( pt[0] ) );
+    __m128 vy = _mm_sub_ps( _mm_loadu_ps( ys + i ), _mm_set1_ps( pt[1] ) );
+    __m128 vz = _mm_sub_ps( _mm_loadu_ps( zs + i ), _mm_set1_ps( pz ) );
+    __m128 d  = _mm_add_ps( _mm_add_ps( _mm_mul_ps( vx, vx ), _mm_mul_ps( vy, vy ) ),
+                            _mm_mul_ps( vz, vz ) );
+    mask = _mm_movemask_ps( _mm_cmplt_ps( d, _mm_set1_ps( threshold ) ) );
+    _mm_storeu_ps( dists, d );
+#endif
+    if( n_pts - i < MSH_HG__SIMD_WIDTH ) { mask &= (1u << (n_pts - i)) - 1; }
+    for( ; mask; mask &= mask - 1 )
+    {
+      uint32_t lane = msh_hash_grid__ctz( mask );
+      passing_dists[n_passing] = dists[lane];
+      passing_ids[n_passing]   = ids[i + lane];
+      n_passing++;
+    }
+#endif
+
+    for( uint32_t j = 0; j < n_passing; ++j )
+    {
+      msh_hash_grid_dist_storage_push( s, passing_dists[j], passing_ids[j] );
+    }
+  }
+}
+#endif
+
+void
+msh_hash_grid__find_neighbors_in_bin( const msh_hash_grid_t* hg, const uint64_t bin_idx,
+                                      const float radius_sq, const float* pt,
+                                      msh_hash_grid_dist_storage_t* s )
+{
+  
+  // issue this whole things stops working if we use doubles.
+  uint64_t* bin_table_idx = msh_hg_map_get( hg->bin_table, bin_idx );
+  if( !bin_table_idx ) { return; }
+
+  msh_hg__bin_info_t bi = hg->offsets[ *bin_table_idx ];
+#if defined(MSH_HG__SIMD)
+  msh_hash_grid__find_neighbors_in_soa( hg, bi.offset, bi.length, radius_sq, pt, s );
+#else
+  msh_hash_grid__find_neighbors_in_range( hg, &hg->data_buffer[bi.offset], bi.length,
+                                          radius_sq, pt, s );
+#endif
+}
+
+// Points that were moved outside of the grid bounds are not in any bin, so each query checks
+// them separately.
+void
+msh_hash_grid__find_neighbors_in_overflow( const msh_hash_grid_t* hg, const float radius_sq,
+                                           const float* pt, msh_hash_grid_dist_storage_t* s )
+{
+  if( !hg->_overflow ) { return; }
+  msh_hash_grid__find_neighbors_in_range( hg, hg->_overflow, msh_hg_array_len( hg->_overflow ),
+                                          radius_sq, pt, s );
+}
+
+// Returns the order in which to process query points, following the Morton order of the cells
+// they fall into, so that queries processed one after another touch nearby bins. Queries outside
+// of the grid are ordered by the nearest cell.
+int32_t*
+msh_hash_grid__sort_queries( const msh_hash_grid_t* hg, const msh_hash_grid_search_desc_t* hg_sd )
+{
+  int32_t n_query_pts = hg_sd->n_query_pts;
+  int32_t n_tasks = MSH_HG_MAX( 1, MSH_HG_MIN( (int32_t)hg->_num_threads, n_query_pts ) );
+  int32_t n_pts_per_task = ( n_query_pts + n_tasks - 1 ) / n_tasks;
+
+  uint64_t* keys[2];
+  int32_t*  indices[2];
+  keys[0]    = (uint64_t*)MSH_HG_MALLOC( 2 * n_query_pts * sizeof(uint64_t) );
+  keys[1]    = keys[0] + n_query_pts;
+  indices[0] = (int32_t*)MSH_HG_MALLOC( 2 * n_query_pts * sizeof(int32_t) );
+  indices[1] = indices[0] + n_query_pts;
+
+#if defined(_OPENMP)
+  #pragma omp parallel for if (!hg->_dont_use_omp) num_threads(n_tasks)
+#endif
+  for( int32_t task_idx = 0; task_idx < n_tasks; ++task_idx )
+  {
+    int32_t low_lim  = task_idx * n_pts_per_task;
+    int32_t high_lim = MSH_HG_MIN( low_lim + n_pts_per_task, n_query_pts );
+    for( int32_t i = low_lim; i < high_lim; ++i )
+    {
+      const float* pt_ptr = hg_sd->query_pts + hg->_pts_dim * i;
+      double fx = ( pt_ptr[0] - hg->min_pt.x ) * hg->_inv_cell_size;
+      double fy = ( pt_ptr[1] - hg->min_pt.y ) * hg->_inv_cell_size;
+      double fz = ( hg->_pts_dim == 2 ) ? 0.0 : ( pt_ptr[2] - hg->min_pt.z ) * hg->_inv_cell_size;
+      uint64_t ix = (uint64_t)MSH_HG_MIN( MSH_HG_MAX( fx, 0.0 ), (double)(hg->width - 1) );
+      uint64_t iy = (uint64_t)MSH_HG_MIN( MSH_HG_MAX( fy, 0.0 ), (double)(hg->height - 1) );
+      uint64_t iz = (uint64_t)MSH_HG_MIN( MSH_HG_MAX( fz, 0.0 ), (double)(hg->depth - 1) );
+      keys[0][i]    = msh_hash_grid__cell_key( hg, ix, iy, iz );
+      indices[0][i] = i;
+    }
+  }
+
+  int32_t src = msh_hash_grid__radix_sort( hg, keys, indices, n_query_pts,
+                                           msh_hash_grid__cell_key_bits( hg ) );
+  if( src ) { memcpy( indices[0], indices[1], n_query_pts * sizeof(int32_t) ); }
+  MSH_HG_FREE( keys[0] );
+  return indices[0];
+}
+
+typedef uint32_t (msh_hash_grid__search_range_fn_t)( const msh_hash_grid_t* hg,
+                                                      msh_hash_grid_search_desc_t* hg_sd,
+                                                      const int32_t* query_order,
+                                                      uint32_t start_idx, uint32_t end_idx );
+
+#ifdef MSH_JOBS
+typedef struct msh_hash_grid__search_batches
+{
+  const msh_hash_grid_t* hg;
+  msh_hash_grid_search_desc_t* hg_sd;
+  const int32_t* query_order;
+  msh_hash_grid__search_range_fn_t* search_range;
+  uint32_t n_query_pts;
+  uint32_t batch_size;
+  uint32_t n_batches;
+  uint32_t volatile next_batch;
+  uint32_t volatile total_num_neighbors;
+  uint32_t volatile n_jobs_done;
+} msh_hash_grid__search_batches_t;
+
+// NOTE: Jobs do not own a fixed range of queries. Each one keeps claiming the next
+// unprocessed batch until there are none left, so threads that got cheap queries take over the
+// work that would otherwise wait behind the expensive ones.
+MSH_JOBS_JOB_SIGNATURE(msh_hash_grid__run_search_batches)
+{
+  msh_hash_grid__search_batches_t* sb = (msh_hash_grid__search_batches_t*)params;
+  uint32_t num_neighbors = 0;
+  for( ;; )
+  {
+    uint32_t batch_idx = msh_jobs_atomic_add( &sb->next_batch, 1 );
+    if( batch_idx >= sb->n_batches ) { break; }
+    uint32_t start_idx = batch_idx * sb->batch_size;
+    uint32_t end_idx   = MSH_HG_MIN( start_idx + sb->batch_size, sb->n_query_pts );
+    num_neighbors += sb->search_range( sb->hg, sb->hg_sd, sb->query_order, start_idx, end_idx );
+  }
+  msh_jobs_atomic_add( &sb->total_num_neighbors, num_neighbors );
+  msh_jobs_atomic_increment( &sb->n_jobs_done ); // Last access to 'sb', it may be gone after this
+  return 0;
+}
+
+size_t
+msh_hash_grid__run_search_jobs( const msh_hash_grid_t* hg, msh_hash_grid_search_desc_t* hg_sd,
+                                const int32_t* query_order,
+                                msh_hash_grid__search_range_fn_t* search_range )
+{
+  msh_jobs_ctx_t* work_ctx = hg_sd->work_ctx;
+  uint32_t n_query_pts     = hg_sd->n_query_pts;
+  uint32_t n_jobs          = work_ctx->thread_count + 1; // Calling thread works too.
+
+  // Size batches so that the result rows written by one batch stay in cache, but keep a few
+  // batches per job around for balancing the load.
+  size_t row_bytes    = hg_sd->max_n_neigh * ( sizeof(float) + sizeof(int32_t) );
+  uint32_t batch_size = (uint32_t)MSH_HG_MAX( MSH_HG_QUERY_BATCH_BYTES / row_bytes, 1 );
+  batch_size = MSH_HG_MIN( batch_size, ( n_query_pts + 4 * n_jobs - 1 ) / ( 4 * n_jobs ) );
+  batch_size = MSH_HG_MAX( batch_size, 16 );
+
+  msh_hash_grid__search_batches_t sb = {0};
+  sb.hg           = hg;
+  sb.hg_sd        = hg_sd;
+  sb.query_order  = query_order;
+  sb.search_range = search_range;
+  sb.n_query_pts  = n_query_pts;
+  sb.batch_size   = batch_size;
+  sb.n_batches    = ( n_query_pts + batch_size - 1 ) / batch_size;
+
+  n_jobs = MSH_HG_MIN( n_jobs, MSH_HG_MIN( sb.n_batches, MSH_JOBS_QUEUE_SIZE - 1 ) );
+  if( n_jobs <= 1 )
+  {
+    return search_range( hg, hg_sd, query_order, 0, n_query_pts );
+  }
+
+  for( uint32_t job_idx = 0; job_idx < n_jobs; ++job_idx )
+  {
+    msh_jobs_push_work( work_ctx, msh_hash_grid__run_search_batches, &sb );
+  }
+  // Other jobs in 'work_ctx' might belong to someone else, so only wait for ours
+  msh_jobs_wait_for_counter( work_ctx, &sb.n_jobs_done, n_jobs );
+
+  return msh_jobs_atomic_add( &sb.total_num_neighbors, 0 );
+}
+#endif
+
+// Runs 'search_range' over all queries in 'hg_sd'. Queries are split into batches that are handed
+// out to the jobs of the user's job system if one was provided. Otherwise each OpenMP thread
+// gets a contiguous range of queries.
+size_t
+msh_hash_grid__run_search( const msh_hash_grid_t* hg, msh_hash_grid_search_desc_t* hg_sd,
+                           msh_hash_grid__search_range_fn_t* search_range )
+{
+  enum { MAX_THREAD_COUNT = 512 };
+  uint32_t n_query_pts = hg_sd->n_query_pts;
+  int32_t* query_order = hg_sd->reorder ? msh_hash_grid__sort_queries( hg, hg_sd ) : NULL;
+  uint32_t total_num_neighbors = 0;
+
+#ifdef MSH_JOBS
+  if( hg_sd->work_ctx && hg_sd->work_ctx->thread_count > 0 )
+  {
+    total_num_neighbors = msh_hash_grid__run_search_jobs( hg, hg_sd, query_order, search_range );
+    MSH_HG_FREE( query_order );
+    return total_num_neighbors;
+  }
+#else
+  assert( !hg_sd->work_ctx && "'work_ctx' needs 'msh_jobs.h' included before the implementation" );
+#endif
+
+  uint32_t n_pts_per_thread = n_query_pts;
+  uint32_t num_neighbors_per_thread[MAX_THREAD_COUNT] = {0};
+  uint32_t num_threads = hg->_num_threads;
+  assert( num_threads <= MAX_THREAD_COUNT );
 
+#if defined(_OPENMP)
+  #pragma omp parallel if (!hg->_dont_use_omp)
+  {
+    if( n_query_pts < num_threads ) { num_threads = n_query_pts; }
+    n_pts_per_thread = ceilf((float)n_query_pts / num_threads);
+    uint32_t thread_idx = omp_get_thread_num();
+#else
+  for( uint32_t thread_idx = 0; thread_idx < num_threads; ++thread_idx )
+  {
+#endif
+    if( thread_idx < num_threads )
+    {
+      uint32_t low_lim      = thread_idx * n_pts_per_thread;
+      uint32_t high_lim     = MSH_HG_MIN((thread_idx + 1) * n_pts_per_thread, n_query_pts);
+      num_neighbors_per_thread[thread_idx] = search_range( hg, hg_sd, query_order,
+                                                           low_lim, high_lim );
+    }
+  }
+
+  for( uint32_t i = 0 ; i < num_threads; ++i )
+  {
+    total_num_neighbors += num_neighbors_per_thread[i];
+  }
+  MSH_HG_FREE( query_order );
+
+  return total_num_neighbors;
+}
+
+uint32_t
+msh_hash_grid__radius_search_range( const msh_hash_grid_t* hg,
+                                    msh_hash_grid_search_desc_t* hg_sd,
+                                    const int32_t* query_order,
+                                    uint32_t start_idx, uint32_t end_idx )
+{
+  enum { MAX_BIN_COUNT = 512 };
+  size_t row_size      = hg_sd->max_n_neigh;
+  double radius        = hg_sd->radius;
+  uint64_t slab_size   = hg->_slab_size;
+  double cs            = hg->cell_size;
+  double ics           = hg->_inv_cell_size;
+  int64_t w            = hg->width;
+  int64_t h            = hg->height;
+  int64_t d            = hg->depth;
+  double radius_sq     = radius * radius;
+
+  int32_t bin_indices[ MAX_BIN_COUNT ];
+  float bin_dists_sq[ MAX_BIN_COUNT ];
   msh_hash_grid_dist_storage_t storage;
 
   uint32_t total_num_neighbors = 0;
   for( uint32_t pt_idx = start_idx; pt_idx < end_idx; ++pt_idx )
   {
-    float* query_pt       = hg_sd->query_pts + (hg->_pts_dim * pt_idx);
-    size_t* n_neighbors   = hg_sd->n_neighbors ? (hg_sd->n_neighbors + pt_idx) : NULL;
-    float* dists_sq       = hg_sd->distances_sq + (pt_idx * row_size);
-    int32_t* indices      = hg_sd->indices + (pt_idx * row_size);
+    uint32_t query_idx    = query_order ? (uint32_t)query_order[pt_idx] : pt_idx;
+    float* query_pt       = hg_sd->query_pts + query_idx * hg->_pts_dim;
+    float* dists_sq       = hg_sd->distances_sq + (query_idx * row_size);
+    int32_t* indices      = hg_sd->indices + (query_idx * row_size);
 
     // Prep the storage for the next point
     msh_hash_grid_dist_storage_init( &storage, row_size, dists_sq, indices );
@@ -906,62 +1841,60 @@ msh_hash_grid__radius_search( const msh_hash_grid_t* hg,
     }
 
     // Get base bin idx for query pt
-    int64_t ix = (int64_t)( q.x * hg->_inv_cell_size );
-    int64_t iy = (int64_t)( q.y * hg->_inv_cell_size );
-    int64_t iz = (int64_t)( q.z * hg->_inv_cell_size );
+    int64_t ix = (int64_t)( q.x * ics );
+    int64_t iy = (int64_t)( q.y * ics );
+    int64_t iz = (int64_t)( q.z * ics );
 
     // Decide where to look
-    int64_t px  = (int64_t)( (q.x + radius) * hg->_inv_cell_size );
-    int64_t nx  = (int64_t)( (q.x - radius) * hg->_inv_cell_size );
+    int64_t px  = (int64_t)( (q.x + radius) * ics );
+    int64_t nx  = (int64_t)( (q.x - radius) * ics );
     int64_t opx = px - ix;
     int64_t onx = nx - ix;
 
-    int64_t py  = (int64_t)( (q.y + radius) * hg->_inv_cell_size );
-    int64_t ny  = (int64_t)( (q.y - radius) * hg->_inv_cell_size );
+    int64_t py  = (int64_t)( (q.y + radius) * ics );
+    int64_t ny  = (int64_t)( (q.y - radius) * ics );
     int64_t opy = py - iy;
     int64_t ony = ny - iy;
 
-    int64_t pz  = (int64_t)( (q.z + radius) * hg->_inv_cell_size );
-    int64_t nz  = (int64_t)( (q.z - radius) * hg->_inv_cell_size );
+    int64_t pz  = (int64_t)( (q.z + radius) * ics );
+    int64_t nz  = (int64_t)( (q.z - radius) * ics );
     int64_t opz = pz - iz;
     int64_t onz = nz - iz;
-
-
     uint32_t n_visited_bins = 0;
     float dx, dy, dz;
     int64_t cx, cy, cz;
     for( int64_t oz = onz; oz <= opz; ++oz )
     {
       cz = (int64_t)iz + oz;
-      if( cz < 0 || cz >= (int64_t)hg->depth ) { continue; }
-      uint64_t idx_z = cz * hg->_slab_size;
+      if( cz < 0 || cz >= d ) { continue; }
+      uint64_t idx_z = cz * slab_size;
 
-      if( oz < 0 )      { dz = q.z - (cz + 1) * hg->cell_size; }
-      else if( oz > 0 ) { dz = cz * hg->cell_size - q.z; }
+      if( oz < 0 )      { dz = q.z - (cz + 1) * cs; }
+      else if( oz > 0 ) { dz = cz * cs - q.z; }
       else              { dz = 0.0f; }
 
       for( int64_t oy = ony; oy <= opy; ++oy )
       {
         cy = iy + oy;
-        if( cy < 0 || cy >= (int64_t)hg->height ) { continue; }
-        uint64_t idx_y = cy * hg->width;
+        if( cy < 0 || cy >= h ) { continue; }
+        uint64_t idx_y = cy * w;
 
-        if( oy < 0 )      { dy = q.y - (cy + 1) * hg->cell_size; }
-        else if( oy > 0 ) { dy = cy * hg->cell_size - q.y; }
+        if( oy < 0 )      { dy = q.y - (cy + 1) * cs; }
+        else if( oy > 0 ) { dy = cy * cs - q.y; }
         else              { dy = 0.0f; }
 
         for( int64_t ox = onx; ox <= opx; ++ox )
         {
           cx = ix + ox;
-          if( cx < 0 || cx >= (int64_t)hg->width ) { continue; }
+          if( cx < 0 || cx >= w ) { continue; }
 
           // assert( n_visited_bins < MAX_BIN_COUNT );
-          if( n_visited_bins >= MAX_BIN_COUNT ) { goto msh_hash_grid_lbl__find_neighbors2; }
+          if( n_visited_bins >= MAX_BIN_COUNT ) { goto msh_hash_grid_lbl__find_neighbors; }
 
           bin_indices[n_visited_bins] = idx_z + idx_y + cx;
 
-          if( ox < 0 )      { dx = q.x - (cx + 1) * hg->cell_size; }
-          else if( ox > 0 ) { dx = cx * hg->cell_size - q.x; }
+          if( ox < 0 )      { dx = q.x - (cx + 1) * cs; }
+          else if( ox > 0 ) { dx = cx * cs - q.x; }
           else              { dx = 0.0f; }
 
           bin_dists_sq[n_visited_bins] = dz * dz + dy * dy + dx * dx;
@@ -970,7 +1903,7 @@ msh_hash_grid__radius_search( const msh_hash_grid_t* hg,
       }
     }
 
-msh_hash_grid_lbl__find_neighbors2:
+msh_hash_grid_lbl__find_neighbors:
     msh_hash_grid__sort( bin_dists_sq, bin_indices, n_visited_bins );
 
     for( uint32_t i = 0; i < n_visited_bins; ++i )
@@ -982,113 +1915,16 @@ msh_hash_grid_lbl__find_neighbors2:
         break;
       }
     }
+    msh_hash_grid__find_neighbors_in_overflow( hg, radius_sq, query_pt, &storage );
 
     if( hg_sd->sort ) { msh_hash_grid__sort( dists_sq, indices, storage.len ); }
 
-    if( n_neighbors ) { (*n_neighbors++) = storage.len; }
-
+    if( hg_sd->n_neighbors ) { hg_sd->n_neighbors[query_idx] = storage.len; }
     total_num_neighbors += storage.len;
   }
-  return total_num_neighbors;;
-}
-
-#ifdef MSH_JOBS
-typedef struct msh_hash_grid__work_opts
-{
-  const msh_hash_grid_t* hg;
-  msh_hash_grid_search_desc_t* hg_sd;
-  uint32_t start_idx;
-  uint32_t end_idx;
-  uint32_t volatile *total_num_neighbors;
-} msh_hash_grid__work_opts_t;
-
-MSH_JOBS_JOB_SIGNATURE(msh_hash_grid__run_radius_search)
-{
-  msh_hash_grid__work_opts_t opts = *((msh_hash_grid__work_opts_t*)params);
-  uint32_t cur_num_neighbors = msh_hash_grid__radius_search( opts.hg, opts.hg_sd, opts.start_idx, opts.end_idx );
-  msh_jobs_atomic_add( opts.total_num_neighbors, cur_num_neighbors );
-  return 0;
-}
-#endif
-
-size_t 
-msh_hash_grid_radius_search2( const msh_hash_grid_t* hg,
-                             msh_hash_grid_search_desc_t* hg_sd )
-{
-  assert( hg_sd->query_pts );
-  assert( hg_sd->distances_sq );
-  assert( hg_sd->indices );
-  assert( hg_sd->radius > 0.0 );
-  assert( hg_sd->n_query_pts > 0 );
-  assert( hg_sd->max_n_neigh > 0 );
-
-#ifdef MSH_JOBS
-  uint32_t single_thread_limit = 64;
-  if( !hg_sd->work_ctx || hg_sd->n_query_pts < single_thread_limit )
-  {
-    return msh_hash_grid__radius_search( hg, hg_sd, 0, hg_sd->n_query_pts );
-  }
-  else
-  {
-#if 1
-    uint32_t volatile total_num_neighbors = 0;
-    enum{ MSH_HASH_GRID__N_TASKS = 128 };
-    msh_hash_grid__work_opts_t work_array[MSH_HASH_GRID__N_TASKS];
-    uint32_t n_pts_per_task = hg_sd->n_query_pts / MSH_HASH_GRID__N_TASKS + 1;
-    n_pts_per_task = n_pts_per_task < single_thread_limit ? single_thread_limit : n_pts_per_task;
-    for( uint32_t work_idx = 0; work_idx < MSH_HASH_GRID__N_TASKS; ++work_idx )
-    {
-      uint32_t start_idx = work_idx * n_pts_per_task;
-      uint32_t end_idx = msh_min( (work_idx + 1) * n_pts_per_task, hg_sd->n_query_pts );
-      if( start_idx > hg_sd->n_query_pts ) { break; }
-      msh_hash_grid__work_opts_t* work_entry = work_array + work_idx;
-      work_entry->hg = hg;
-      work_entry->hg_sd = hg_sd;
-      work_entry->total_num_neighbors = &total_num_neighbors;
-      work_entry->start_idx = start_idx;
-      work_entry->end_idx = end_idx;
-      msh_jobs_push_work( hg_sd->work_ctx, msh_hash_grid__run_radius_search, work_entry );
-    }
-    msh_jobs_complete_all_work( hg_sd->work_ctx );
-
-    return total_num_neighbors;
-#else
-    // NOTE(maciej): This does not work completely, as it sometimes overflows the queue
-    uint32_t volatile total_num_neighbors = 0;
-    uint32_t start_idx = 0;
-    int64_t pts_left = hg_sd->n_query_pts;
-
-    // NOTE(maciej): We could always just generate 16 jobs or smth like that to avoid malloc. Will need to test.
-    uint32_t work_idx = 0;
-    uint32_t n_tasks = pts_left / single_thread_limit + 1;
-    msh_hash_grid__work_opts_t* work_array = malloc( n_tasks * sizeof(msh_hash_grid__work_opts_t) );
-    while( pts_left > 0 )
-    {
-      uint32_t count = (pts_left >= single_thread_limit) ? single_thread_limit : pts_left;
-      msh_hash_grid__work_opts_t* work_entry = work_array + work_idx++;
-      work_entry->hg = hg;
-      work_entry->hg_sd = hg_sd;
-      work_entry->total_num_neighbors = &total_num_neighbors;
-      work_entry->start_idx = start_idx;
-      work_entry->end_idx = start_idx + count;
-      msh_jobs_push_work( hg_sd->work_ctx, msh_hash_grid__run_radius_search, work_entry );
-      
-      pts_left -= single_thread_limit;
-      start_idx += single_thread_limit;
-    }
-    msh_jobs_complete_all_work( hg_sd->work_ctx );
-    free( work_array );
-
-    return total_num_neighbors;
-#endif
-  }
-#else
-  return msh_hash_grid__radius_search( hg, hg_sd, 0, hg_sd->n_query_pts );
-#endif
+  return total_num_neighbors;
 }
 
-
-
 size_t msh_hash_grid_radius_search( const msh_hash_grid_t* hg,
                                     msh_hash_grid_search_desc_t* hg_sd )
 {
@@ -1099,166 +1935,7 @@ size_t msh_hash_grid_radius_search( const msh_hash_grid_t* hg,
   assert( hg_sd->n_query_pts > 0 );
   assert( hg_sd->max_n_neigh > 0 );
 
-  // Unpack the some useful data from structs
-  enum { MAX_BIN_COUNT = 512, MAX_THREAD_COUNT = 512 };
-  uint32_t n_query_pts = hg_sd->n_query_pts;
-  size_t row_size      = hg_sd->max_n_neigh;
-  double radius        = hg_sd->radius;
-  uint64_t slab_size   = hg->_slab_size;
-  double cs            = hg->cell_size;
-  double ics           = hg->_inv_cell_size;
-  int64_t w            = hg->width;
-  int64_t h            = hg->height;
-  int64_t d            = hg->depth;
-  double radius_sq     = radius * radius;
-
-  uint32_t n_pts_per_thread = n_query_pts;
-  uint32_t total_num_neighbors = 0;
-  uint32_t num_neighbors_per_thread[MAX_THREAD_COUNT] = {0};
-  uint32_t num_threads = hg->_num_threads;
-  assert( num_threads <= MAX_THREAD_COUNT );
-
-#if defined(_OPENMP)
-  #pragma omp parallel if (!hg->_dont_use_omp)
-  {
-    if( n_query_pts < num_threads ) { num_threads = n_query_pts; }
-    n_pts_per_thread = ceilf((float)n_query_pts / num_threads);
-    uint32_t thread_idx = omp_get_thread_num();
-#else
-  for( uint32_t thread_idx = 0; thread_idx < num_threads; ++thread_idx )
-  {
-#endif
-    if( thread_idx < num_threads )
-    {
-      uint32_t low_lim      = thread_idx * n_pts_per_thread;
-      uint32_t high_lim     = MSH_HG_MIN((thread_idx + 1) * n_pts_per_thread, n_query_pts);
-      uint32_t cur_n_pts    = high_lim - low_lim;
-
-      float* query_pt       = hg_sd->query_pts + low_lim * hg->_pts_dim;
-      size_t* n_neighbors   = hg_sd->n_neighbors ? (hg_sd->n_neighbors + low_lim) : NULL;
-      float* dists_sq       = hg_sd->distances_sq + (low_lim * row_size);
-      int32_t* indices      = hg_sd->indices + (low_lim * row_size);
-
-      int32_t bin_indices[ MAX_BIN_COUNT ];
-      float bin_dists_sq[ MAX_BIN_COUNT ];
-      msh_hash_grid_dist_storage_t storage;
-
-      for( uint32_t pt_idx = 0; pt_idx < cur_n_pts; ++pt_idx )
-      {
-        // Prep the storage for the next point
-        msh_hash_grid_dist_storage_init( &storage, row_size, dists_sq, indices );
-
-        // Normalize query pt with respect to grid
-        msh_hg_v3_t q;
-        if( hg->_pts_dim == 2 )
-        {
-          q = (msh_hg_v3_t) { query_pt[0] - hg->min_pt.x,
-                              query_pt[1] - hg->min_pt.y,
-                              0.0 };
-        }
-        else
-        {
-          q = (msh_hg_v3_t) { query_pt[0] - hg->min_pt.x,
-                              query_pt[1] - hg->min_pt.y,
-                              query_pt[2] - hg->min_pt.z };
-        }
-
-        // Get base bin idx for query pt
-        int64_t ix = (int64_t)( q.x * ics );
-        int64_t iy = (int64_t)( q.y * ics );
-        int64_t iz = (int64_t)( q.z * ics );
-
-        // Decide where to look
-        int64_t px  = (int64_t)( (q.x + radius) * ics );
-        int64_t nx  = (int64_t)( (q.x - radius) * ics );
-        int64_t opx = px - ix;
-        int64_t onx = nx - ix;
-
-        int64_t py  = (int64_t)( (q.y + radius) * ics );
-        int64_t ny  = (int64_t)( (q.y - radius) * ics );
-        int64_t opy = py - iy;
-        int64_t ony = ny - iy;
-
-        int64_t pz  = (int64_t)( (q.z + radius) * ics );
-        int64_t nz  = (int64_t)( (q.z - radius) * ics );
-        int64_t opz = pz - iz;
-        int64_t onz = nz - iz;
-        uint32_t n_visited_bins = 0;
-        float dx, dy, dz;
-        int64_t cx, cy, cz;
-        for( int64_t oz = onz; oz <= opz; ++oz )
-        {
-          cz = (int64_t)iz + oz;
-          if( cz < 0 || cz >= d ) { continue; }
-          uint64_t idx_z = cz * slab_size;
-
-          if( oz < 0 )      { dz = q.z - (cz + 1) * cs; }
-          else if( oz > 0 ) { dz = cz * cs - q.z; }
-          else              { dz = 0.0f; }
-
-          for( int64_t oy = ony; oy <= opy; ++oy )
-          {
-            cy = iy + oy;
-            if( cy < 0 || cy >= h ) { continue; }
-            uint64_t idx_y = cy * w;
-
-            if( oy < 0 )      { dy = q.y - (cy + 1) * cs; }
-            else if( oy > 0 ) { dy = cy * cs - q.y; }
-            else              { dy = 0.0f; }
-
-            for( int64_t ox = onx; ox <= opx; ++ox )
-            {
-              cx = ix + ox;
-              if( cx < 0 || cx >= w ) { continue; }
-
-              // assert( n_visited_bins < MAX_BIN_COUNT );
-              if( n_visited_bins >= MAX_BIN_COUNT ) { goto msh_hash_grid_lbl__find_neighbors; }
-
-              bin_indices[n_visited_bins] = idx_z + idx_y + cx;
-
-              if( ox < 0 )      { dx = q.x - (cx + 1) * cs; }
-              else if( ox > 0 ) { dx = cx * cs - q.x; }
-              else              { dx = 0.0f; }
-
-              bin_dists_sq[n_visited_bins] = dz * dz + dy * dy + dx * dx;
-              n_visited_bins++;
-            }
-          }
-        }
-        
-msh_hash_grid_lbl__find_neighbors:
-        msh_hash_grid__sort( bin_dists_sq, bin_indices, n_visited_bins );
-
-        for( uint32_t i = 0; i < n_visited_bins; ++i )
-        {
-          msh_hash_grid__find_neighbors_in_bin( hg, bin_indices[i], radius_sq, query_pt, &storage );
-          if( storage.len >= row_size &&
-              storage.max_dist <= bin_dists_sq[i] )
-          {
-            break;
-          }
-        }
-        
-
-        if( hg_sd->sort ) { msh_hash_grid__sort( dists_sq, indices, storage.len ); }
-
-        if( n_neighbors ) { (*n_neighbors++) = storage.len; }
-        num_neighbors_per_thread[thread_idx] += storage.len;
-
-        // Advance pointers
-        dists_sq += row_size;
-        indices  += row_size;
-        query_pt += hg->_pts_dim;
-      }
-    }
-  }
-
-  for( uint32_t i = 0 ; i < num_threads; ++i )
-  {
-    total_num_neighbors += num_neighbors_per_thread[i];
-  }
-
-  return total_num_neighbors;
+  return msh_hash_grid__run_search( hg, hg_sd, msh_hash_grid__radius_search_range );
 }
 
 
@@ -1272,6 +1949,11 @@ msh_hash_grid__add_bin_contents( const msh_hash_grid_t* hg, const uint64_t bin_i
 
   if( !bin_table_idx ) { return; }
   msh_hg__bin_info_t bi = hg->offsets[*bin_table_idx];
+#if defined(MSH_HG__SIMD)
+  // Every point is a candidate, only the distance to the current k-th neighbor limits the scan
+  msh_hash_grid__find_neighbors_in_soa( hg, bi.offset, bi.length, MSH_F32_MAX, pt, s );
+  return;
+#endif
   int n_pts = bi.length;
   const msh_hg_v3i_t* data = &hg->data_buffer[bi.offset];
 
@@ -1294,20 +1976,13 @@ msh_hash_grid__add_bin_contents( const msh_hash_grid_t* hg, const uint64_t bin_i
   
 }
 
-size_t 
-msh_hash_grid_knn_search( const msh_hash_grid_t* hg,
-                          msh_hash_grid_search_desc_t* hg_sd )
+uint32_t
+msh_hash_grid__knn_search_range( const msh_hash_grid_t* hg,
+                                 msh_hash_grid_search_desc_t* hg_sd,
+                                 const int32_t* query_order,
+                                 uint32_t start_idx, uint32_t end_idx )
 {
-  assert( hg_sd->query_pts );
-  assert( hg_sd->distances_sq );
-  assert( hg_sd->indices );
-  assert( hg_sd->n_query_pts > 0 );
-  assert( hg_sd->max_n_neigh > 0 );
-  assert( hg_sd->k > 0 );
-
-  // Unpack the some useful data from structs
-  enum { MAX_BIN_COUNT = 128, MAX_THREAD_COUNT = 128 };
-  uint32_t n_query_pts = hg_sd->n_query_pts;
+  enum { MAX_BIN_COUNT = 128 };
   uint32_t k           = hg_sd->k;
   uint64_t slab_size   = hg->_slab_size;
   int8_t sort          = hg_sd->sort;
@@ -1315,144 +1990,131 @@ msh_hash_grid_knn_search( const msh_hash_grid_t* hg,
   int64_t w            = hg->width;
   int64_t h            = hg->height;
   int64_t d            = hg->depth;
+  int32_t max_layer    = MSH_HG_MAX3( w, h, d );
+
+  int32_t bin_indices[ MAX_BIN_COUNT ];
+  msh_hash_grid_dist_storage_t storage;
 
-  uint32_t n_pts_per_thread = n_query_pts;
   uint32_t total_num_neighbors = 0;
-  uint32_t num_neighbors_per_thread[MAX_THREAD_COUNT] = {0};
-  uint32_t num_threads = hg->_num_threads;
-  assert( num_threads <= MAX_THREAD_COUNT );
-#if defined(_OPENMP)
-  #pragma omp parallel if (!hg->_dont_use_omp)
-  {
-    if( n_query_pts < num_threads ) { num_threads = n_query_pts; }
-    uint32_t thread_idx = omp_get_thread_num();
-#else
-  for( uint32_t thread_idx = 0; thread_idx < num_threads; ++thread_idx )
+  for( uint32_t pt_idx = start_idx; pt_idx < end_idx; ++pt_idx )
   {
-#endif
-    if( thread_idx < num_threads )
-    {
-      uint32_t low_lim      = thread_idx * n_pts_per_thread;
-      uint32_t high_lim     = MSH_HG_MIN((thread_idx + 1) * n_pts_per_thread, n_query_pts);
-      uint32_t cur_n_pts    = high_lim - low_lim;
+    uint32_t query_idx    = query_order ? (uint32_t)query_order[pt_idx] : pt_idx;
+    float* query_pt       = hg_sd->query_pts + query_idx * hg->_pts_dim;
+    float* dists_sq       = hg_sd->distances_sq + (query_idx * k);
+    int32_t* indices      = hg_sd->indices + (query_idx * k);
 
-      float *query_pt       = hg_sd->query_pts + low_lim * hg->_pts_dim;
-      size_t* n_neighbors   = hg_sd->n_neighbors ? (hg_sd->n_neighbors + low_lim) : NULL;
-      float* dists_sq       = hg_sd->distances_sq + (low_lim * k);
-      int32_t* indices      = hg_sd->indices + (low_lim * k);
+    // Prep the storage for the next point
+    msh_hash_grid_dist_storage_init( &storage, k, dists_sq, indices );
 
-      int32_t bin_indices[ MAX_BIN_COUNT ];
-      msh_hash_grid_dist_storage_t storage;
-      
-      for( uint32_t pt_idx = 0; pt_idx < cur_n_pts; ++pt_idx )
+    // Normalize query pt with respect to grid
+    float dx, dy, dz;
+    int64_t cx, cy, cz;
+    int32_t layer = 0;
+    int8_t should_break = 0;
+
+    msh_hg_v3_t pt_prime;
+    if( hg->_pts_dim == 2 )
+    {
+      pt_prime = (msh_hg_v3_t) { query_pt[0] - hg->min_pt.x,
+                                 query_pt[1] - hg->min_pt.y,
+                                 0.0 };
+    }
+    else
+    {
+      pt_prime = (msh_hg_v3_t) { query_pt[0] - hg->min_pt.x,
+                                 query_pt[1] - hg->min_pt.y,
+                                 query_pt[2] - hg->min_pt.z };
+    }
+    // get base bin for query
+    uint64_t ix = (uint64_t)( (pt_prime.x) * hg->_inv_cell_size );
+    uint64_t iy = (uint64_t)( (pt_prime.y) * hg->_inv_cell_size );
+    uint64_t iz = (uint64_t)( (pt_prime.z) * hg->_inv_cell_size );
+    while( true )
+    {
+      int32_t inc_x = 1;
+      uint32_t n_visited_bins = 0;
+      for( int64_t oz = -layer; oz <= layer; oz++ )
       {
-        // Prep the storage for the next point
-        msh_hash_grid_dist_storage_init( &storage, k, dists_sq, indices );
+        cz = iz + oz;
+        if( cz < 0 || cz >= d ) continue;
+        uint64_t idx_z = cz * slab_size;
 
-        // Normalize query pt with respect to grid
-        float dx, dy, dz;
-        int64_t cx, cy, cz;
-        int32_t layer = 0;
-        int8_t should_break = 0;
+        if( oz < 0 )      { dz = pt_prime.z - (cz + 1) * cs; }
+        else if( oz > 0 ) { dz = cz * cs - pt_prime.z; }
+        else              { dz = 0.0f; }
 
-        msh_hg_v3_t pt_prime;
-        if( hg->_pts_dim == 2 )
-        {
-          pt_prime = (msh_hg_v3_t) { query_pt[0] - hg->min_pt.x,
-                                     query_pt[1] - hg->min_pt.y,
-                                     0.0 };
-        }
-        else
-        {
-          pt_prime = (msh_hg_v3_t) { query_pt[0] - hg->min_pt.x,
-                                     query_pt[1] - hg->min_pt.y,
-                                     query_pt[2] - hg->min_pt.z };
-        }
-        // get base bin for query
-        uint64_t ix = (uint64_t)( (pt_prime.x) * hg->_inv_cell_size );
-        uint64_t iy = (uint64_t)( (pt_prime.y) * hg->_inv_cell_size );
-        uint64_t iz = (uint64_t)( (pt_prime.z) * hg->_inv_cell_size );
-        while( true )
+        for( int64_t oy = -layer; oy <= layer; oy++ )
         {
-          int32_t inc_x = 1;
-          uint32_t n_visited_bins = 0;
-          for( int64_t oz = -layer; oz <= layer; oz++ )
-          {
-            cz = iz + oz;
-            if( cz < 0 || cz >= d ) continue;
-            uint64_t idx_z = cz * slab_size;
-
-            if( oz < 0 )      { dz = pt_prime.z - (cz + 1) * cs; }
-            else if( oz > 0 ) { dz = cz * cs - pt_prime.z; }
-            else              { dz = 0.0f; }
+          cy = iy + oy;
+          if( cy < 0 || cy >= h ) continue;
+          uint64_t idx_y = cy * w;
 
-            for( int64_t oy = -layer; oy <= layer; oy++ )
-            {
-              cy = iy + oy;
-              if( cy < 0 || cy >= h ) continue;
-              uint64_t idx_y = cy * w;
+          if( oy < 0 )      { dy = pt_prime.y - (cy + 1) * cs; }
+          else if( oy > 0 ) { dy = cy * cs - pt_prime.y; }
+          else              { dy = 0.0f; }
 
-              if( oy < 0 )      { dy = pt_prime.y - (cy + 1) * cs; }
-              else if( oy > 0 ) { dy = cy * cs - pt_prime.y; }
-              else              { dy = 0.0f; }
+          if( abs(oy) != layer && abs(oz) != layer ) { inc_x = 2 * layer; }
+          else                                       { inc_x = 1; }
 
-              if( abs(oy) != layer && abs(oz) != layer ) { inc_x = 2 * layer; }
-              else                                       { inc_x = 1; }
-
-              for( int64_t ox = -layer; ox <= layer; ox += inc_x )
-              {
-                cx = ix + ox;
-                if( cx < 0 || cx >= w ) continue;
+          for( int64_t ox = -layer; ox <= layer; ox += inc_x )
+          {
+            cx = ix + ox;
+            if( cx < 0 || cx >= w ) continue;
 
-                if( ox < 0 )      { dx = pt_prime.x - (cx + 1) * cs; }
-                else if( ox > 0 ) { dx = cx * cs - pt_prime.x; }
-                else              { dx = 0.0f; }
+            if( ox < 0 )      { dx = pt_prime.x - (cx + 1) * cs; }
+            else if( ox > 0 ) { dx = cx * cs - pt_prime.x; }
+            else              { dx = 0.0f; }
 
-                float dist_sq = dz * dz + dy * dy + dx * dx;
+            float dist_sq = dz * dz + dy * dy + dx * dx;
 
-                if( storage.len >= k &&
-                    dist_sq > storage.max_dist ) { continue; }
+            if( storage.len >= k &&
+                dist_sq > storage.max_dist ) { continue; }
 
-                assert( n_visited_bins < MAX_BIN_COUNT );
+            assert( n_visited_bins < MAX_BIN_COUNT );
 
-                bin_indices[n_visited_bins]  = idx_z + idx_y + cx;
+            bin_indices[n_visited_bins]  = idx_z + idx_y + cx;
 
-                n_visited_bins++;
-              }
-            }
-          }
-
-          for( uint32_t bin_idx = 0; bin_idx < n_visited_bins; ++bin_idx )
-          {
-            msh_hash_grid__add_bin_contents( hg, bin_indices[bin_idx], query_pt, &storage );
+            n_visited_bins++;
           }
-          
-          
-          layer++;
-          if( should_break ) { break; }
-          if( storage.len >= k ) { should_break = true; }
         }
-        if( n_neighbors ) { (*n_neighbors++) = storage.len; }
-        num_neighbors_per_thread[thread_idx] += storage.len;
-
-        if( sort ) { msh_hash_grid__sort( dists_sq, indices, storage.len ); }
+      }
 
-        // Advance pointers
-        dists_sq += k;
-        indices  += k;
-        query_pt += hg->_pts_dim;
+      for( uint32_t bin_idx = 0; bin_idx < n_visited_bins; ++bin_idx )
+      {
+        msh_hash_grid__add_bin_contents( hg, bin_indices[bin_idx], query_pt, &storage );
       }
+      
+      
+      layer++;
+      if( should_break ) { break; }
+      if( storage.len >= k ) { should_break = true; }
+
+      // Whole grid was visited, which happens when it has less than k points left
+      if( layer > max_layer ) { break; }
     }
-  }
+    msh_hash_grid__find_neighbors_in_overflow( hg, MSH_F32_MAX, query_pt, &storage );
+    if( hg_sd->n_neighbors ) { hg_sd->n_neighbors[query_idx] = storage.len; }
+    total_num_neighbors += storage.len;
 
-  for( uint32_t i = 0 ; i < num_threads; ++i )
-  {
-    total_num_neighbors += num_neighbors_per_thread[i];
+    if( sort ) { msh_hash_grid__sort( dists_sq, indices, storage.len ); }
   }
-
   return total_num_neighbors;
 }
 
+size_t 
+msh_hash_grid_knn_search( const msh_hash_grid_t* hg,
+                          msh_hash_grid_search_desc_t* hg_sd )
+{
+  assert( hg_sd->query_pts );
+  assert( hg_sd->distances_sq );
+  assert( hg_sd->indices );
+  assert( hg_sd->n_query_pts > 0 );
+  assert( hg_sd->max_n_neigh > 0 );
+  assert( hg_sd->k > 0 );
+
+  return msh_hash_grid__run_search( hg, hg_sd, msh_hash_grid__knn_search_range );
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // msh_array / msh_hg_map implementation
@@ -1512,7 +2174,7 @@ msh_hg_map_init( msh_hg_map_t* map, uint32_t cap )
 
 void
 msh_hg_map__grow( msh_hg_map_t *map, size_t new_cap) {
-  new_cap = msh_max( new_cap, 16 );
+  new_cap = MSH_HG_MAX( new_cap, 16 );
   msh_hg_map_t new_map;
   new_map.keys = (uint64_t*)MSH_HG_CALLOC( new_cap, sizeof(uint64_t) );
   new_map.vals = (uint64_t*)MSH_HG_MALLOC( new_cap * sizeof(uint64_t) );
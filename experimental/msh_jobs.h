@@ -128,6 +128,7 @@ typedef struct msh_jobs_work_queue
   uint32_t volatile next_entry_to_read;
 
   uint32_t volatile max_job_count;
+  uint32_t volatile write_lock;
   msh_jobs_job_entry_t* entries;
   msh_jobs_semaphore_t semaphore_handle;
 } msh_jobs_work_queue_t;
@@ -141,6 +142,7 @@ typedef struct msh_jobs_ctx
 
   struct msh_jobs_thread_info* thread_infos;
   uint32_t thread_count;
+  uint32_t volatile should_quit;
 } msh_jobs_ctx_t;
 
 typedef struct msh_jobs_thread_info
@@ -156,8 +158,14 @@ int32_t msh_jobs_get_processor_info( msh_jobs_processor_info_t* info );
 int32_t msh_jobs_init_ctx( msh_jobs_ctx_t* ctx, uint32_t n_threads );
 int32_t msh_jobs_push_work( msh_jobs_ctx_t* ctx, msh_jobs_job_signature_t task, void* data );
 void    msh_jobs_complete_all_work( msh_jobs_ctx_t* ctx );
+void    msh_jobs_wait_for_counter( msh_jobs_ctx_t* ctx, uint32_t volatile* counter, uint32_t value );
 void    msh_jobs_term_ctx( msh_jobs_ctx_t* ctx );
 
+// All of these return the value from before the operation
+uint32_t msh_jobs_atomic_add( uint32_t volatile *value, uint32_t val );
+uint32_t msh_jobs_atomic_increment( uint32_t volatile *value );
+uint32_t msh_jobs_atomic_compare_exchange( uint32_t volatile *dest, uint32_t new_val, uint32_t old_val );
+
 // sew_stitches_and_wait(sewing, jobs, 10); //-> Nice api, PAss array of jobs and run
 // job structure
 
@@ -201,6 +209,17 @@ msh_jobs_thread_detach( msh_jobs_thread_t *thread )
 #endif
 }
 
+void
+msh_jobs_thread_join( msh_jobs_thread_t *thread )
+{
+#if MSH_JOBS_PLATFORM_WINDOWS
+  WaitForSingleObject( *thread, INFINITE );
+  CloseHandle( *thread );
+#else
+  pthread_join( *thread, NULL );
+#endif
+}
+
 int32_t
 msh_jobs_semaphore_create( msh_jobs_semaphore_t* sem, uint32_t initial_count, uint32_t maximum_count )
 {
@@ -252,7 +271,7 @@ uint32_t
 msh_jobs_atomic_add( uint32_t volatile *value, uint32_t val )
 {
 #if MSH_JOBS_PLATFORM_WINDOWS
-  return (uint32_t)InterlockedAdd( (LONG volatile*)value, val );
+  return (uint32_t)InterlockedExchangeAdd( (LONG volatile*)value, val );
 #else
   return (uint32_t)__sync_fetch_and_add( value, val );
 #endif
@@ -262,7 +281,7 @@ uint32_t
 msh_jobs_atomic_increment( uint32_t volatile *value )
 {
 #if MSH_JOBS_PLATFORM_WINDOWS
-  return (uint32_t)InterlockedIncrement( (LONG volatile*)value );
+  return (uint32_t)InterlockedIncrement( (LONG volatile*)value ) - 1;
 #else
   return (uint32_t)__sync_fetch_and_add( value, 1 );
 #endif
@@ -291,15 +310,21 @@ int32_t
 msh_jobs_push_work( msh_jobs_ctx_t* ctx, msh_jobs_job_signature_t task, void* data )
 {
   msh_jobs_work_queue_t* queue = &ctx->queue;
+
+  // NOTE: Consumers only look at 'next_entry_to_write', so producers just need to take turns.
+  while( msh_jobs_atomic_compare_exchange( &queue->write_lock, 1, 0 ) != 0 ) {}
+
   uint32_t next_entry_to_write = queue->next_entry_to_write;
   uint32_t new_next_entry_to_write = (next_entry_to_write + 1) % queue->max_job_count;
   while( new_next_entry_to_write == queue->next_entry_to_read ) { msh_jobs__sleep(1); };// Spin until we can write again
   msh_jobs_job_entry_t *job = queue->entries + next_entry_to_write;
   job->task = task;
   job->data = data;
-  ++queue->completion_goal;
+  msh_jobs_atomic_increment( &queue->completion_goal );
   MSH_JOBS_WRITE_BARRIER();
   queue->next_entry_to_write = new_next_entry_to_write;
+  msh_jobs_atomic_compare_exchange( &queue->write_lock, 0, 1 );
+
   msh_jobs_semaphore_release( &queue->semaphore_handle, 1 );
   return MSH_JOBS_NO_ERR;
 }
@@ -309,7 +334,6 @@ msh_jobs_execute_next_job_entry( int32_t thread_idx, msh_jobs_work_queue_t* queu
 {
   int32_t should_sleep = false;
   if (!queue->entries ||
-       queue->completion_goal == 0 || 
        queue->max_job_count == 0) { return true; }
 
   uint32_t original_next_entry_to_read = queue->next_entry_to_read;
@@ -347,9 +371,22 @@ msh_jobs_complete_all_work( msh_jobs_ctx_t* ctx )
   {
     msh_jobs_execute_next_job_entry( thrd_idx, &ctx->queue );
   }
-  
-  ctx->queue.completion_goal = 0;
-  ctx->queue.completion_count = 0;
+}
+
+void
+msh_jobs_wait_for_counter( msh_jobs_ctx_t* ctx, uint32_t volatile* counter, uint32_t value )
+{
+  uint32_t thrd_idx = 0;
+  if( !ctx->thread_infos || !ctx->queue.entries ) 
+  { 
+    return;
+  }
+
+  // Help with whatever is queued, but only until our own jobs are done
+  while( msh_jobs_atomic_add( counter, 0 ) != value )
+  {
+    msh_jobs_execute_next_job_entry( thrd_idx, &ctx->queue );
+  }
 }
 
 #if MSH_JOBS_PLATFORM_WINDOWS
@@ -361,13 +398,16 @@ void* msh_jobs_thread_procedure(void* params )
   msh_jobs_thread_info_t* ti = (msh_jobs_thread_info_t*)params;
   msh_jobs_ctx_t* ctx = ti->ctx;
   uint32_t thrd_idx = ti->idx;
-  for(;;)
+  while( !msh_jobs_atomic_add( &ctx->should_quit, 0 ) )
   {
     if( msh_jobs_execute_next_job_entry( thrd_idx, &ctx->queue ) )
     {
       msh_jobs_semaphore_wait( &ctx->queue.semaphore_handle );
     }
   }
+
+  // Pass the wake up along, so that every thread gets to see 'should_quit'
+  msh_jobs_semaphore_release( &ctx->queue.semaphore_handle, 1 );
   return 0;
 }
 
@@ -379,6 +419,7 @@ msh_jobs__init_queue( msh_jobs_ctx_t* ctx, uint32_t queue_size )
   ctx->queue.completion_count = 0;
   ctx->queue.next_entry_to_read = 0;
   ctx->queue.next_entry_to_write = 0;
+  ctx->queue.write_lock = 0;
   ctx->queue.entries = (msh_jobs_job_entry_t*)malloc( ctx->queue.max_job_count * sizeof(msh_jobs_job_entry_t) );
   if (!ctx->queue.entries) { return MSH_JOBS_OUT_OF_MEMORY; }
 
@@ -395,6 +436,7 @@ msh_jobs__create_threads( msh_jobs_ctx_t* ctx, uint32_t n_threads )
   // Semaphore
   uint32_t initial_count = 0;
   ctx->thread_count = n_threads ? n_threads : ctx->processor_info.logical_core_count - 1;
+  ctx->should_quit = 0;
   err = msh_jobs_semaphore_create( &ctx->queue.semaphore_handle, initial_count, ctx->thread_count );
   if (err) { return err; }
 
@@ -434,9 +476,13 @@ void
 msh_jobs_term_ctx( msh_jobs_ctx_t* ctx )
 {
   msh_jobs_complete_all_work( ctx );
+
+  // Threads keep reading 'ctx', so they need to be finished before it goes away
+  msh_jobs_atomic_add( &ctx->should_quit, 1 );
+  msh_jobs_semaphore_release( &ctx->queue.semaphore_handle, 1 );
   for( uint32_t i = 0; i < ctx->thread_count; ++i )
   {
-    msh_jobs_thread_detach( &ctx->thread_infos[i].handle );
+    msh_jobs_thread_join( &ctx->thread_infos[i].handle );
   }
   free( ctx->thread_infos );
   ctx->thread_infos = NULL;
@@ -447,7 +493,6 @@ msh_jobs_term_ctx( msh_jobs_ctx_t* ctx )
   ctx->queue.next_entry_to_write = 0;
   free( ctx->queue.entries );
   ctx->queue.entries = NULL;
-  msh_jobs_semaphore_release( &ctx->queue.semaphore_handle, ctx->thread_count );
   msh_jobs_semaphore_destroy( &ctx->queue.semaphore_handle );
 }
 
@@ -470,7 +515,6 @@ msh_jobs_get_processor_info( msh_jobs_processor_info_t* info  )
 #elif MSH_JOBS_PLATFORM_LINUX
 
   info->logical_core_count = sysconf( _SC_NPROCESSORS_ONLN );
-  goto msh_jobs_get_processor_info_exit;
 
 #elif MSH_JOBS_PLATFORM_MACOS
 
@@ -26,6 +26,14 @@
     #define MSH_PLY_ENCODER_ONLY  - only pull in writing functionality
     #define MSH_PLY_DECODER_ONLY  - only pull in reading functionality
 
+  Some parts of the library (like parsing of ASCII files) can use multiple threads. Threading is
+  opt-in, as it requires linking against the platform threading library (e.g. -lpthread):
+    #define MSH_PLY_USE_THREADS   - use native threads (pthreads / win32 threads)
+
+  Byte swapping and type conversions use SSE2, and AVX2 if the compiler targets it (e.g. -mavx2).
+  To use plain C code instead:
+    #define MSH_PLY_NO_SIMD       - do not use SIMD intrinsics
+
   msh_ply_open
   -------------------
     msh_ply_t* msh_ply_open( const char* filename, const char* mode );
@@ -33,10 +41,136 @@
   Creates a new ply file handle and returns pointer to it. 'filename' is the path to the ply file
   and 'mode' describes in what mode file should be used:
     'r' or 'rb' - read
+    'rm'        - read through a memory mapping of the file (see below)
     'w'         - write ASCII
     'wb'        - write binary(will write endianness based on your system)
+    'wz', 'wbz' - write ASCII / binary, compressed with gzip
   Note that this does not perform any reading / writing.
 
+  Gzip compressed files (e.g. 'mesh.ply.gz') are recognized when the header is parsed, in any of
+  the reading modes, and are inflated on the fly by a built-in decoder - there is no need to
+  decompress them first. Since deflate streams can only be decoded from the start, reading them
+  can not be parallelized, and 'rm' mode reads them like 'rb'. Other codecs can be supported by
+  decompressing within a custom I/O backend, see 'msh_ply_open_io'.
+
+  In 'rm' mode the file is mapped into memory instead of being read through stdio. For binary
+  files, whenever the layout requested by a descriptor exactly matches the layout of the element
+  in the file, the descriptor's data pointer is set to point directly into the mapping, and no
+  copy is made. Such pointers are valid until 'msh_ply_close' is called and must not be freed -
+  use 'msh_ply_is_mapped_data' to check whether returned data is owned by the mapping. Pages
+  are mapped copy-on-write, so the data can be modified without affecting the file. If the
+  file cannot be mapped, 'rm' silently behaves like 'rb'.
+
+  msh_ply_open_io
+  -------------------
+    typedef struct msh_ply_io
+    {
+      size_t   (*read_at)( void* user_data, uint64_t offset, void* dst, size_t size );
+      uint64_t (*size)( void* user_data );
+      void     (*close)( void* user_data );
+      void* user_data;
+    } msh_ply_io_t;
+
+    msh_ply_t* msh_ply_open_io( const msh_ply_io_t* io );
+
+  Creates a ply file handle for reading, which gets its bytes from the user provided I/O backend
+  'io' instead of a file on disk (e.g. a network share, an archive or a memory buffer).
+  'read_at' copies 'size' bytes starting at 'offset' into 'dst', and returns the number of bytes
+  copied, which can only be smaller than 'size' at the end of the data. It needs to be safe to
+  call from multiple threads at once. 'size' returns the total size of the data, and can be NULL
+  if it is not known. 'close', if set, is called by 'msh_ply_close'. Returns NULL if 'io' has no
+  'read_at' function.
+
+  Files are read in large blocks. If MSH_PLY_USE_THREADS is defined, the block following the
+  one being decoded is read ahead on a background thread, so that waiting for the storage overlaps
+  with decoding. Otherwise, files opened with 'msh_ply_open' ask the system to read ahead.
+
+  msh_ply_set_num_threads
+  -------------------
+    void msh_ply_set_num_threads( msh_ply_t* pf, int32_t num_threads );
+
+  Sets the maximum number of threads 'pf' is allowed to use. Default value of 0 means that all
+  available cores will be used. Has no effect unless MSH_PLY_USE_THREADS is defined, or a task
+  runner is set with 'msh_ply_set_task_runner'.
+
+  msh_ply_set_task_runner
+  -------------------
+    typedef void (*msh_ply_task_fn_t)( void* params );
+    typedef void (*msh_ply_run_tasks_fn_t)( msh_ply_task_fn_t fn, void* params,
+                                            size_t params_size, int32_t n_tasks,
+                                            void* user_data );
+    void msh_ply_set_task_runner( msh_ply_t* pf, msh_ply_run_tasks_fn_t run_tasks,
+                                  void* user_data );
+
+  Lets 'pf' run its parallel work on the user's own thread pool, instead of spawning threads.
+  'run_tasks' needs to call 'fn( (uint8_t*)params + i * params_size )' for every 'i' in
+  [0, n_tasks), in any order and on any threads, and return once all calls have finished.
+  'user_data' is passed to each call of 'run_tasks'. Setting 'run_tasks' to NULL restores the
+  default behaviour.
+
+  msh_ply_set_arena
+  -------------------
+    int32_t msh_ply_set_arena( msh_ply_t* pf, size_t block_size );
+
+  Makes 'pf' take memory for everything that lives as long as the handle (elements, properties,
+  descriptor lists, header text, spatial index) from an arena of 'block_size' bytes large blocks
+  (MSH_PLY_ARENA_BLOCK_SIZE if 0), instead of many small heap allocations. Whole arena is
+  released at once by 'msh_ply_close'. Temporary buffers used during reading and writing are
+  still taken from the heap. Needs to be called right after opening, before the header is parsed
+  or descriptors are added - returns MSH_PLY_ARENA_ERR otherwise, and 0 on success.
+
+  msh_ply_set_output_allocator
+  -------------------
+    typedef void* (*msh_ply_alloc_fn_t)( size_t size, void* user_data );
+    void msh_ply_set_output_allocator( msh_ply_t* pf, msh_ply_alloc_fn_t alloc,
+                                       void* user_data );
+
+  Makes 'pf' allocate the data returned to the user ('data', 'list_data' and 'list_offsets'
+  arrays of descriptors filled by 'msh_ply_read' and 'msh_ply_read_region') with 'alloc', e.g.
+  from the user's own arena. Such memory is never freed nor resized by 'pf'. Allocations are made
+  by the calling thread, before any parallel work starts. Setting 'alloc' to NULL restores the
+  default of MSH_PLY_MALLOC.
+
+  msh_ply_set_compression_level
+  -------------------
+    void msh_ply_set_compression_level( msh_ply_t* pf, int32_t level );
+
+  Sets the gzip compression level of a file opened with 'wz' or 'wbz', from 0 (no compression,
+  fastest) to 9 (best compression, slowest). Default is 6. Needs to be called before anything is
+  written. Has no effect on files that are not compressed.
+
+  msh_ply_set_quantization
+  -------------------
+    int32_t msh_ply_set_quantization( msh_ply_t* pf,
+                                      const msh_ply_quantization_t* quantization );
+
+  Makes 'pf' store floating point positions and normals of element 'quantization->element_name'
+  as integers. Positions 'position_names' are mapped onto [0, 2^position_bits - 1] range over the
+  box from 'bbox_min' to 'bbox_max' (values outside are clamped), and written as ushort (up to 16
+  bits) or uint (up to 32 bits). Normals 'normal_names' are octahedrally encoded into two
+  coordinates of 'normal_bits' bits each (8 if 0, at most 16), written as char or short. The third
+  normal property is then omitted from the file. Either set of names can be left NULL.
+  
+  The properties need to be consecutive in a float or double descriptor, in the order given. The
+  parameters are stored in header comments, and 'msh_ply_read' (as well as 'msh_ply_read_chunk')
+  dequantizes these properties when they are requested as float or double - requests of other
+  types return stored integers. Needs to be called before anything is written. Returns 0 on
+  success and error code on failure.
+
+  msh_ply_set_spatial_order
+  -------------------
+    int32_t msh_ply_set_spatial_order( msh_ply_t* pf, const msh_ply_spatial_order_t* order );
+
+  Makes 'msh_ply_write' sort rows of element 'order->element_name' along a Morton
+  (MSH_PLY_CURVE_MORTON) or Hilbert (MSH_PLY_CURVE_HILBERT) curve through the bounding box of
+  their positions 'position_names', so that points close in space are close in the file. The
+  positions need to be float or double, and the element cannot have list properties. Indices in
+  list property 'index_property_name' of element 'index_element_name' (like "vertex_indices" of
+  "face") are remapped to the new order; set 'index_element_name' to NULL if there are none.
+  Reordered data is copied, the user's buffers are not modified. The curve is recorded in a
+  header comment "comment spatial_order <element> <curve> <x> <y> <z>". Has no effect on
+  'msh_ply_write_rows'. Returns 0 on success and error code on failure.
+
   msh_ply_add_descriptor
   -------------------
     int32_t msh_ply_add_descriptor( msh_ply_t *pf, msh_ply_desc_t *desc );
@@ -51,7 +185,133 @@
   
   Performs reading of ply file described by 'pf'. Should be called after adding descriptors. 
   Returns 0 on success and error code on failure.
-    
+
+  When more than one thread is available (see 'msh_ply_set_num_threads'), binary files are
+  decoded in parallel - all requested elements are split into ranges of rows, which are then
+  decoded concurrently. Results are identical to the ones produced by a single thread.
+
+  Lists of variable length (e.g. faces mixing triangles and quads) are read without a
+  'list_size_hint' - values of all rows are packed one after another into '*desc->data', while
+  '*desc->list_data' receives the length of each list. If 'desc->list_offsets' points to an
+  'int32_t*', it additionally receives 'data_count + 1' offsets (CSR layout), such that values of
+  row 'i' are stored between offsets 'i' and 'i + 1'. 'list_data' can be left NULL in that case.
+  Offsets are counted in values, and they need to be freed by the user.
+
+  If lazy reading is enabled (see 'msh_ply_set_lazy_read'), no values are decoded - the header
+  and the layout of the file are checked, row offsets of the requested elements are recorded and
+  '*desc->data_count' of each descriptor is set. Data is then decoded by 'msh_ply_load'.
+
+  Properties can also be read into separate arrays, instead of rows interleaving all requested
+  properties. If 'desc->property_data' points to an array of 'num_properties' pointers, the k-th
+  pointer receives the array of 'data_count' values of the k-th requested property. Values are
+  scattered into their arrays as they are decoded, without an intermediate interleaved copy.
+  Arrays are parts of a single allocation returned in '*desc->data', which is the only pointer
+  that needs to be freed. Such descriptors cannot request list properties, and are only supported
+  by 'msh_ply_read' and 'msh_ply_get_property_from_element' - other readers return
+  MSH_PLY_SEPARATE_ARRAYS_ERR.
+
+  msh_ply_set_lazy_read
+  -------------------
+    void msh_ply_set_lazy_read( msh_ply_t* pf, int32_t lazy );
+
+  Makes 'msh_ply_read' defer decoding of the data of all descriptors until it is requested
+  with 'msh_ply_load', if 'lazy' is not zero. Useful for tools that only need some of the
+  requested properties, depending on what they find in the file. Needs to be set before calling
+  'msh_ply_read'.
+
+  msh_ply_load
+  -------------------
+    int32_t msh_ply_load( msh_ply_t* pf, msh_ply_desc_t* desc );
+
+  Makes sure the data of descriptor 'desc' is decoded into '*desc->data' (and the other arrays
+  requested by 'desc'), as 'msh_ply_read' would. Data is decoded only on the first call - further
+  calls return immediately, as do calls for descriptors that were read by 'msh_ply_read' without
+  lazy reading. 'desc' needs to be added to 'pf' before 'msh_ply_read' is called, and loaded
+  before 'pf' is closed. Calls for the same 'pf' cannot be made from multiple threads at once.
+  Returns 0 on success, MSH_PLY_LAZY_LOAD_ERR if 'desc' was not read by 'msh_ply_read', and error
+  code on other failures.
+
+  msh_ply_read_chunk
+  -------------------
+    int32_t msh_ply_read_chunk( msh_ply_t* pf, msh_ply_desc_t* desc, int32_t max_rows );
+
+  Reads next chunk of at most 'max_rows' rows of the element described by 'desc', which allows
+  processing files of any size with a fixed memory footprint. Unlike 'msh_ply_read', data is
+  decoded into buffers provided by the user - '*desc->data' (and '*desc->list_data', if set)
+  need to have space for 'max_rows' rows, with list properties taking 'list_size_hint' values
+  per row. Lists of variable length are packed one after another, so a chunk might contain fewer
+  rows if they do not fit. Number of rows read is stored in '*desc->data_count', which is 0
+  once all rows were read. Each descriptor keeps track of its own position, so elements can be
+  streamed in any order. Descriptor does not need to be added to 'pf'. Returns 0 on success and
+  error code on failure.
+
+  msh_ply_build_index
+  -------------------
+    int32_t msh_ply_build_index( msh_ply_t* pf, const char* index_filename,
+                                 const char* element_name, const char** position_names,
+                                 int32_t block_rows );
+
+  Builds a spatial index of element 'element_name' of file 'pf' opened for reading, and saves it
+  to 'index_filename'. Rows are split into blocks of 'block_rows' rows (MSH_PLY_INDEX_BLOCK_ROWS
+  if 0), and the index stores file offset and bounding box of positions 'position_names' of
+  each block. Rows are read in a single pass. Index is then used by 'msh_ply_read_region' of
+  'pf'. It works best for files with spatially coherent rows (see 'msh_ply_set_spatial_order').
+  Returns 0 on success and error code on failure.
+
+  msh_ply_load_index
+  -------------------
+    int32_t msh_ply_load_index( msh_ply_t* pf, const char* index_filename );
+
+  Loads index built by 'msh_ply_build_index' for use by 'msh_ply_read_region'. Index needs to
+  be built on a machine of the same endianness, for the very same file. Returns 0 on success and
+  MSH_PLY_INVALID_INDEX_ERR if the index does not match the file.
+
+  msh_ply_read_region
+  -------------------
+    int32_t msh_ply_read_region( msh_ply_t* pf, const float* aabb_min, const float* aabb_max,
+                                 msh_ply_desc_t* desc );
+
+  Reads rows of the indexed element from all of the blocks whose bounding box overlaps box from
+  'aabb_min' to 'aabb_max', without reading the rest of the file. Result is a superset of rows
+  inside the box, in file order, which the user can filter further. Like 'msh_ply_read', data is
+  allocated into '*desc->data', and the number of rows is stored in '*desc->data_count'.
+  Descriptor cannot request list properties, and does not need to be added to 'pf'. Returns 0
+  on success and error code on failure.
+
+  msh_ply_probe
+  -------------------
+    int32_t msh_ply_probe( const char* filename, msh_ply_info_t* info );
+
+  Fills 'info' with the format, the element counts and the property layouts of the file, without
+  opening a handle. Header is taken from a single, unbuffered read of the first
+  MSH_PLY_PROBE_SIZE bytes (with further reads only for unusually long headers), and is parsed
+  in place, without allocations. Compressed files are parsed through 'msh_ply_open' instead.
+  Headers that do not fit 'msh_ply_info_t' (see MSH_PLY_INFO_MAX_ELEMENTS and
+  MSH_PLY_INFO_MAX_PROPERTIES) fail with MSH_PLY_PROBE_CAPACITY_ERR. Returns 0 on success and
+  error code on failure.
+
+  msh_ply_probe_files
+  -------------------
+    int32_t msh_ply_probe_files( const char** filenames, int32_t num_files,
+                                 msh_ply_info_t* infos, int32_t* err_codes,
+                                 int32_t num_threads );
+
+  Probes 'num_files' files, spread across 'num_threads' threads (0 picks the number of cores),
+  storing results in 'infos' and error codes of individual files in 'err_codes', if it is not
+  NULL. Returns 0 if all files were probed, and error code of the first failed file otherwise.
+  Together with directory listing of 'msh_std.h' it can be used to scan whole datasets:
+
+    msh_dir_t dir;
+    msh_finfo_t file;
+    msh_dir_open( &dir, path );
+    while( dir.has_next ) {
+      msh_file_peek( &dir, &file );
+      if( !strcmp( file.ext, "ply" ) ) { ...store path of 'file.name' in 'filenames'... }
+      msh_dir_next( &dir );
+    }
+    msh_dir_close( &dir );
+    msh_ply_probe_files( filenames, num_files, infos, err_codes, 0 );
+
   msh_ply_write
   -------------------
     int32_t msh_ply_write( msh_ply_t* pf );
@@ -59,6 +319,28 @@
   Performs writing of ply file described by 'pf'. Should be called after adding descriptors.
   Returns 0 on success and error code on failure.
 
+  ASCII files are formatted in memory and written in large blocks. Floating point values are
+  printed with the fewest digits that read back as exactly the same value (so e.g. 0.1f is
+  written as '0.1', and no precision is lost). When more than one thread is available, ranges
+  of rows are formatted in parallel. Every property of an element needs to be described by one
+  of the descriptors.
+
+  Binary elements whose rows have fixed size (no lists, or lists with a 'list_size_hint') are
+  encoded property by property, in large chunks of rows. When more than one thread is available
+  and the file is not compressed, the file is sized up front, and the chunks are encoded in
+  parallel, each written straight to its place in the file with a positional write.
+
+  msh_ply_write_rows
+  -------------------
+    int32_t msh_ply_write_rows( msh_ply_t* pf, const char* element_name, int32_t n_rows );
+
+  Appends 'n_rows' rows of element 'element_name' to the file, so that data can be written as it
+  is produced, without keeping all of it in memory. Rows are taken from the beginning of the data
+  arrays of all descriptors of that element, while their 'data_count' is ignored. First call
+  writes the header with placeholder element counts, which are filled in by 'msh_ply_close'.
+  Elements need to be written in the order in which their descriptors were added. Returns 0 on
+  success and error code on failure.
+
   msh_ply_parse_header
   -------------------
     int32_t msh_ply_parse_header( msh_ply_t* pf );
@@ -82,6 +364,13 @@
   Returns a pointer to element if the element of given name has been found in 'pf'. Returns NULL 
   otherwise. Can only be called after header has been parsed!
  
+  msh_ply_is_mapped_data
+  -------------------
+    bool msh_ply_is_mapped_data( const msh_ply_t* pf, const void* data );
+
+  Returns true if 'data' points into the memory mapping of file 'pf' (see 'rm' mode of
+  'msh_ply_open'). Such data is released by 'msh_ply_close' and should not be freed by the user.
+
   msh_ply_find_property
   -------------------
     msh_ply_property_t* msh_ply_find_property( const msh_ply_element_t* el, const char* property_name );
@@ -220,6 +509,25 @@
     msh_ply_close( ply_file );
   }
 
+  ------------------------------
+  Streaming example:
+
+  Vec3f* vertices = malloc( 4096 * sizeof(Vec3f) );
+  int32_t n_vertices = 0;
+  msh_ply_desc_t desc = { .element_name = "vertex",
+                          .property_names = (const char*[]){"x", "y", "z"},
+                          .num_properties = 3,
+                          .data_type = MSH_PLY_FLOAT,
+                          .data = &vertices,
+                          .data_count = &n_vertices };
+
+  msh_ply_t* ply_file = msh_ply_open( filename, "rb" );
+  while( !msh_ply_read_chunk( ply_file, &desc, 4096 ) && n_vertices > 0 )
+  {
+    your_function_to_process_vertices( vertices, n_vertices );
+  }
+  msh_ply_close( ply_file );
+
   ==============================================================================
   DEPENDENCIES
 
@@ -230,12 +538,23 @@
     - string.h
     - stdio.h
     - stdbool.h
+    - stddef.h
+    - math.h
+    - sys/stat.h
+    Decoding of octahedral normals calls 'sqrt', so programs need to link against libm (-lm).
     Note that this file will not pull them in automatically to prevent pulling same
     files multiple time. If you do not like this behaviour and want this file to
     pull in c headers, simply define following before including the library:
 
     #define MSH_PLY_INCLUDE_LIBC_HEADERS
 
+    The implementation always includes the platform headers needed for memory mapping and
+    file access, regardless of the define above:
+    - windows.h and io.h on Windows (WIN32_LEAN_AND_MEAN is defined if it is not already)
+    - sys/mman.h, sys/stat.h, fcntl.h and unistd.h elsewhere
+    With MSH_PLY_USE_THREADS it also includes pthread.h on non-Windows platforms, so programs
+    need to link against the pthread library (-lpthread). Windows threads need no extra library.
+
   ==============================================================================
   AUTHORS:
     Maciej Halber
@@ -246,7 +565,7 @@
 
   ==============================================================================
   TODOs:
-  [ ] Support buffering -> read data in chunks, then serve it out, rather than continuously fread.
+  [x] Support buffering -> read data in chunks, then serve it out, rather than continuously fread.
   [ ] Add independence from c stdlib (like stdio etc.) -> Read from memory / Pass pointers to fopen?
   [ ] Better ascii support - check Vilya Harvey's miniply
   [ ] Getting raw data for the list property - Add different function.
@@ -275,6 +594,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <math.h>
 #include <sys/stat.h>
 #endif
 
@@ -313,10 +633,23 @@ extern "C" {
 #endif
 
 #define MSH_PLY_MAX(a, b)          ((a) > (b) ? (a) : (b))
+#define MSH_PLY_MIN(a, b)          ((a) < (b) ? (a) : (b))
 #define MSH_PLY_MAX_STR_LEN        1024
 #define MSH_PLY_MAX_REQ_PROPERTIES 32
 #define MSH_PLY_MAX_PROPERTIES     128
 #define MSH_PLY_MAX_LIST_ELEMENTS  1024
+#define MSH_PLY_MAX_THREADS        64
+#define MSH_PLY_BLOCK_SIZE         (1 << 24)
+#define MSH_PLY_INDEX_BLOCK_ROWS   4096
+#define MSH_PLY_PROBE_SIZE         4096
+#define MSH_PLY_ARENA_BLOCK_SIZE   (1 << 16)
+
+#ifndef MSH_PLY_INFO_MAX_ELEMENTS
+#define MSH_PLY_INFO_MAX_ELEMENTS 8
+#endif
+#ifndef MSH_PLY_INFO_MAX_PROPERTIES
+#define MSH_PLY_INFO_MAX_PROPERTIES 64
+#endif
 
 typedef struct msh_ply_property msh_ply_property_t;
 typedef struct msh_ply_element msh_ply_element_t;
@@ -355,10 +688,93 @@ struct msh_ply_desc
   void* list_data;
   int32_t* data_count;
   uint8_t list_size_hint;
+  void* list_offsets;
+  void** property_data;
 };
 
+typedef struct msh_ply_quantization
+{
+  const char* element_name;
+  const char* position_names[3];
+  float bbox_min[3];
+  float bbox_max[3];
+  int32_t position_bits;
+  const char* normal_names[3];
+  int32_t normal_bits;
+} msh_ply_quantization_t;
+
+typedef enum msh_ply_curve
+{
+  MSH_PLY_CURVE_NONE = 0,
+  MSH_PLY_CURVE_MORTON,
+  MSH_PLY_CURVE_HILBERT
+} msh_ply_curve_t;
+
+typedef struct msh_ply_spatial_order
+{
+  const char* element_name;
+  const char* position_names[3];
+  msh_ply_curve_t curve;
+  const char* index_element_name;
+  const char* index_property_name;
+} msh_ply_spatial_order_t;
+
+typedef struct msh_ply_io
+{
+  size_t (*read_at)(void* user_data, uint64_t offset, void* dst, size_t size);
+  uint64_t (*size)(void* user_data);
+  void (*close)(void* user_data);
+  void* user_data;
+} msh_ply_io_t;
+
+typedef struct msh_ply_info_property
+{
+  char name[32];
+  msh_ply_type_id_t type;
+  msh_ply_type_id_t list_type;   // MSH_PLY_INVALID for non-list properties
+} msh_ply_info_property_t;
+
+typedef struct msh_ply_info_element
+{
+  char name[64];
+  int32_t count;
+  int32_t first_property;   // Index into 'msh_ply_info_t.properties'
+  int32_t num_properties;
+  int32_t row_size;         // Size of a row in binary files, 0 if element has list properties
+} msh_ply_info_element_t;
+
+typedef struct msh_ply_info
+{
+  msh_ply_format_t format;
+  int32_t format_version;
+  int32_t header_size;
+  int32_t is_compressed;
+  int32_t num_elements;
+  int32_t num_properties;
+  msh_ply_info_element_t elements[MSH_PLY_INFO_MAX_ELEMENTS];
+  msh_ply_info_property_t properties[MSH_PLY_INFO_MAX_PROPERTIES];
+} msh_ply_info_t;
+
 MSH_PLY_DEF msh_ply_t* msh_ply_open(const char* filename, const char* mode);
+MSH_PLY_DEF msh_ply_t* msh_ply_open_io(const msh_ply_io_t* io);
 MSH_PLY_DEF void msh_ply_close(msh_ply_t* pf);
+typedef void (*msh_ply_task_fn_t)(void* params);
+typedef void (*msh_ply_run_tasks_fn_t)(msh_ply_task_fn_t fn,
+                                       void* params,
+                                       size_t params_size,
+                                       int32_t n_tasks,
+                                       void* user_data);
+
+MSH_PLY_DEF void msh_ply_set_num_threads(msh_ply_t* pf, int32_t num_threads);
+MSH_PLY_DEF void msh_ply_set_task_runner(msh_ply_t* pf,
+                                         msh_ply_run_tasks_fn_t run_tasks,
+                                         void* user_data);
+typedef void* (*msh_ply_alloc_fn_t)(size_t size, void* user_data);
+
+MSH_PLY_DEF int32_t msh_ply_set_arena(msh_ply_t* pf, size_t block_size);
+MSH_PLY_DEF void msh_ply_set_output_allocator(msh_ply_t* pf,
+                                              msh_ply_alloc_fn_t alloc,
+                                              void* user_data);
 MSH_PLY_DEF int32_t msh_ply_add_descriptor(msh_ply_t* pf, msh_ply_desc_t* desc);
 MSH_PLY_DEF int32_t msh_ply_parse_header(msh_ply_t* pf);
 MSH_PLY_DEF bool msh_ply_has_properties(const msh_ply_t* pf,
@@ -369,6 +785,7 @@ MSH_PLY_DEF msh_ply_property_t*
 msh_ply_find_property(const msh_ply_element_t* el, const char* property_name);
 MSH_PLY_DEF const char* msh_ply_error_msg(int32_t err);
 MSH_PLY_DEF void msh_ply_print_header(msh_ply_t* pf);
+MSH_PLY_DEF bool msh_ply_is_mapped_data(const msh_ply_t* pf, const void* data);
 
 MSH_PLY_DEF int32_t msh_ply_add_property_to_element(msh_ply_t* pf,
                                                     const msh_ply_desc_t* desc);
@@ -377,10 +794,39 @@ MSH_PLY_DEF int32_t msh_ply_get_property_from_element(msh_ply_t* pf,
 
 #ifndef MSH_PLY_ENCODER_ONLY
 MSH_PLY_DEF int32_t msh_ply_read(msh_ply_t* pf);
+MSH_PLY_DEF void msh_ply_set_lazy_read(msh_ply_t* pf, int32_t lazy);
+MSH_PLY_DEF int32_t msh_ply_load(msh_ply_t* pf, msh_ply_desc_t* desc);
+MSH_PLY_DEF int32_t msh_ply_read_chunk(msh_ply_t* pf,
+                                       msh_ply_desc_t* desc,
+                                       int32_t max_rows);
+MSH_PLY_DEF int32_t msh_ply_build_index(msh_ply_t* pf,
+                                        const char* index_filename,
+                                        const char* element_name,
+                                        const char** position_names,
+                                        int32_t block_rows);
+MSH_PLY_DEF int32_t msh_ply_load_index(msh_ply_t* pf, const char* index_filename);
+MSH_PLY_DEF int32_t msh_ply_read_region(msh_ply_t* pf,
+                                        const float* aabb_min,
+                                        const float* aabb_max,
+                                        msh_ply_desc_t* desc);
+MSH_PLY_DEF int32_t msh_ply_probe(const char* filename, msh_ply_info_t* info);
+MSH_PLY_DEF int32_t msh_ply_probe_files(const char** filenames,
+                                        int32_t num_files,
+                                        msh_ply_info_t* infos,
+                                        int32_t* err_codes,
+                                        int32_t num_threads);
 #endif
 
 #ifndef MSH_PLY_DECODER_ONLY
+MSH_PLY_DEF void msh_ply_set_compression_level(msh_ply_t* pf, int32_t level);
+MSH_PLY_DEF int32_t msh_ply_set_quantization(msh_ply_t* pf,
+                                             const msh_ply_quantization_t* quantization);
+MSH_PLY_DEF int32_t msh_ply_set_spatial_order(msh_ply_t* pf,
+                                              const msh_ply_spatial_order_t* order);
 MSH_PLY_DEF int32_t msh_ply_write(msh_ply_t* pf);
+MSH_PLY_DEF int32_t msh_ply_write_rows(msh_ply_t* pf,
+                                       const char* element_name,
+                                       int32_t n_rows);
 #endif
 
 #ifdef __cplusplus
@@ -394,6 +840,33 @@ MSH_PLY_DEF int32_t msh_ply_write(msh_ply_t* pf);
 ////////////////////////////////////////////////////////////////////////////////
 #ifdef MSH_PLY_IMPLEMENTATION
 
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(MSH_PLY_USE_THREADS)
+#include <pthread.h>
+#endif
+#endif
+
+#if !defined(MSH_PLY_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MSH_PLY__SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define MSH_PLY__AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // THIS IS A SIMPLIFIED VERSION OF MSH_ARRAY
 
@@ -407,9 +880,29 @@ typedef struct msh_ply_array_header
   size_t cap;
 } msh_ply_array_hdr_t;
 
+typedef struct msh_ply__arena_block
+{
+  struct msh_ply__arena_block* next;
+  size_t size;
+  size_t used;
+} msh_ply__arena_block_t;
+
+// Bump allocator for memory that lives as long as the handle. With zero block size it is
+// disabled, and all requests go to the heap. Nothing is freed before the arena is released.
+typedef struct msh_ply__arena
+{
+  msh_ply__arena_block_t* head;
+  size_t block_size;
+  void* last;   // Most recent allocation from 'head', which can be grown in place
+} msh_ply__arena_t;
+
 #define msh_ply_array(T) T*
 
-MSH_PLY_PRIVATE void* msh_ply__array_grow(const void* array, size_t new_len, size_t elem_size);
+MSH_PLY_PRIVATE void msh_ply__arena_free(msh_ply__arena_t* arena, void* ptr);
+MSH_PLY_PRIVATE void* msh_ply__array_grow(msh_ply__arena_t* arena,
+                                          const void* array,
+                                          size_t new_len,
+                                          size_t elem_size);
 
 #define msh_ply_array__grow_formula(x) ((2 * (x) + 5))
 #define msh_ply_array__hdr(a)                                                  \
@@ -421,16 +914,20 @@ MSH_PLY_PRIVATE void* msh_ply__array_grow(const void* array, size_t new_len, siz
 #define msh_ply_array_back(a)                                                  \
   (msh_ply_array_len((a)) ? ((a) + msh_ply_array_len((a)) - 1) : NULL)
 
-#define msh_ply_array_free(a)                                                  \
-  ((a) ? (MSH_PLY_FREE(msh_ply_array__hdr(a)), (a) = NULL) : 0)
-#define msh_ply_array_fit(a, n)                                                \
+#define msh_ply_array_free_in(arena, a)                                        \
+  ((a) ? (msh_ply__arena_free((arena), msh_ply_array__hdr(a)), (a) = NULL) : 0)
+#define msh_ply_array_fit_in(arena, a, n)                                      \
   ((n) <= msh_ply_array_cap(a)                                                 \
      ? (0)                                                                     \
-     : (*(void**)&(a) = msh_ply__array_grow((a), (n), sizeof(*(a)))))
-#define msh_ply_array_push(a, ...)                                             \
-  (msh_ply_array_fit((a), 1 + msh_ply_array_len((a))),                         \
+     : (*(void**)&(a) = msh_ply__array_grow((arena), (a), (n), sizeof(*(a)))))
+#define msh_ply_array_push_in(arena, a, ...)                                   \
+  (msh_ply_array_fit_in((arena), (a), 1 + msh_ply_array_len((a))),             \
    (a)[msh_ply_array__hdr(a)->len++] = (__VA_ARGS__))
 
+#define msh_ply_array_free(a)      msh_ply_array_free_in(NULL, a)
+#define msh_ply_array_fit(a, n)    msh_ply_array_fit_in(NULL, a, n)
+#define msh_ply_array_push(a, ...) msh_ply_array_push_in(NULL, a, __VA_ARGS__)
+
 #ifdef __cplusplus
 }
 #endif
@@ -463,11 +960,92 @@ struct msh_ply_element
   int32_t count;
   msh_ply_array(msh_ply_property_t) properties;
 
-  long file_anchor;
+  int64_t file_anchor;
+  long count_offset;   // Position of the element count in the header, when streaming rows
   void* data;
   size_t data_size;
+
+  // Checkpoints recorded every MSH_PLY__SPLIT_ROWS rows while scanning rows of variable size - file
+  // offset of the row, and the number of values each property had in all of the previous rows.
+  // They let us decode ranges of rows of such elements independently.
+  msh_ply_array(int64_t) split_offsets;
+  msh_ply_array(int32_t) split_totals;
 };
 
+typedef struct msh_ply__block_reader msh_ply__block_reader_t;
+typedef struct msh_ply__deflate msh_ply__deflate_t;
+
+// Quantization of three properties of an element, as set with 'msh_ply_set_quantization' or
+// found in the header comments. Octahedral normals are stored in the first two properties.
+typedef struct msh_ply__quantizer
+{
+  char element_name[64];
+  char names[3][32];
+  int32_t is_normal;
+  int32_t bits;
+  float min[3];
+  float max[3];
+} msh_ply__quantizer_t;
+
+// Descriptor of the values written in place of a part of user descriptor 'source' - quantized
+// properties, or the properties around them copied as they are.
+typedef struct msh_ply__quantized_desc
+{
+  msh_ply_desc_t desc;
+  const msh_ply_desc_t* source;
+  int32_t first;       // Index of the first property of 'source' that is covered
+  int32_t quantizer;   // Index of the quantizer, -1 if values are copied
+  void* data;
+  size_t capacity;
+} msh_ply__quantized_desc_t;
+
+// Element reordered by 'msh_ply_write', as set with 'msh_ply_set_spatial_order'.
+typedef struct msh_ply__spatial_order
+{
+  char element_name[64];
+  char names[3][32];
+  msh_ply_curve_t curve;
+  char index_element_name[64];
+  char index_name[32];
+} msh_ply__spatial_order_t;
+
+// Spatial index of an element, see 'msh_ply_build_index'.
+typedef struct msh_ply__index_header
+{
+  char magic[8];
+  uint32_t version;
+  int32_t block_rows;
+  int32_t n_rows;
+  int32_t n_blocks;
+  int64_t file_size;   // Size of the indexed file, to detect stale indices
+  char element_name[64];
+  char names[3][32];
+} msh_ply__index_header_t;
+
+typedef struct msh_ply__index_block
+{
+  int64_t offset;   // File offset of the first row of the block
+  float min[3];
+  float max[3];
+} msh_ply__index_block_t;
+
+// Copy of a user descriptor, which holds its data in a different order.
+typedef struct msh_ply__reordered_desc
+{
+  msh_ply_desc_t desc;
+  void* data;
+} msh_ply__reordered_desc_t;
+
+// Read position of a descriptor used with 'msh_ply_read_chunk'. Reader keeps the blocks read
+// ahead between the calls.
+typedef struct msh_ply__cursor
+{
+  const msh_ply_desc_t* desc;
+  int32_t row;
+  int64_t offset;
+  msh_ply__block_reader_t* reader;
+} msh_ply__cursor_t;
+
 struct msh_ply_file
 {
   int32_t valid;
@@ -476,11 +1054,33 @@ struct msh_ply_file
 
   msh_ply_array(msh_ply_element_t) elements;
   msh_ply_array(msh_ply_desc_t*) descriptors;
+  msh_ply_array(msh_ply__cursor_t) _cursors;
 
   FILE* _fp;
+  msh_ply_io_t _io;   // Source of the bytes of files opened for reading
+  uint8_t* _map;
+  size_t _map_size;
   int32_t _header_size;
   int32_t _system_format;
   int32_t _parsed;
+  int32_t _lazy;   // Data is decoded by 'msh_ply_load', see 'msh_ply_set_lazy_read'
+  msh_ply_array(uint8_t) _loaded;   // Whether data of each descriptor was decoded
+  int32_t _num_threads;
+  msh_ply_run_tasks_fn_t _run_tasks;
+  void* _run_tasks_data;
+  int32_t _stream_element;   // Element currently written by 'msh_ply_write_rows', -1 if none
+  int32_t _compression_level;   // Gzip level of files written with 'z' mode, -1 if not compressed
+  msh_ply__deflate_t* _deflate;
+  msh_ply_array(char) _header_text;   // Header as written, kept to patch element counts
+  msh_ply_array(msh_ply__quantizer_t) _quantizers;
+  msh_ply_array(msh_ply__quantized_desc_t*) _quantized;   // Descriptors written in place of user's
+  msh_ply__spatial_order_t _spatial_order;
+  msh_ply_array(msh_ply__reordered_desc_t*) _reordered;
+  msh_ply__index_header_t _index;
+  msh_ply__index_block_t* _index_blocks;
+  msh_ply__arena_t _arena;   // Memory of the handle, see 'msh_ply_set_arena'
+  msh_ply_alloc_fn_t _output_alloc;
+  void* _output_alloc_data;
 };
 
 enum msh_ply_err
@@ -513,6 +1113,18 @@ enum msh_ply_err
   MSH_PLY_ASCII_FILE_EOF_ERR                 = 25,
   MSH_PLY_READ_REQUIRED_PROPERTY_IS_MISSING  = 26,
   MSH_PLY_WRITE_REQUIRED_PROPERTY_IS_MISSING = 27,
+  MSH_PLY_CHUNK_BUFFER_TOO_SMALL_ERR         = 28,
+  MSH_PLY_ELEMENT_ORDER_ERR                  = 29,
+  MSH_PLY_FILE_WRITE_ERR                     = 30,
+  MSH_PLY_QUANTIZATION_ERR                   = 31,
+  MSH_PLY_SPATIAL_ORDER_ERR                  = 32,
+  MSH_PLY_INVALID_INDEX_ERR                  = 33,
+  MSH_PLY_PROBE_CAPACITY_ERR                 = 34,
+  MSH_PLY_ARENA_ERR                          = 35,
+  MSH_PLY_SEPARATE_ARRAYS_ERR                = 36,
+  MSH_PLY_LAZY_LOAD_ERR                      = 37,
+  MSH_PLY_OUT_OF_MEMORY_ERR                  = 38,
+  MSH_PLY_ASCII_PARSE_ERR                    = 39,
   MSH_PLY_NUM_OF_ERRORS
 };
 
@@ -545,10 +1157,28 @@ static const char* msh_ply_error_msgs[MSH_PLY_NUM_OF_ERRORS] = {
   "MSH_PLY: Invalid descriptor: Incorrect list type. List type cannot be float "
   "or double.",
   "MSH_PLY: Error reading ASCII PLY file.",
-  "MSH_PLY: Reached EOF when reading ASCII PLY file."
+  "MSH_PLY: Reached EOF when reading ASCII PLY file.",
   "MSH_PLY: When reading file, the required property not found in the input "
   "file",
   "MSH_PLY: When write file, the required property not found in the input file",
+  "MSH_PLY: Chunk buffer cannot hold a single row. Check the list size hint.",
+  "MSH_PLY: Rows of elements need to be written in the order of elements in the "
+  "header.",
+  "MSH_PLY: Error writing to file.",
+  "MSH_PLY: Quantized properties need to be consecutive, in a float or double "
+  "descriptor.",
+  "MSH_PLY: Spatially ordered element needs float or double positions, and "
+  "cannot have list properties.",
+  "MSH_PLY: Spatial index is missing, or it does not match the ply file.",
+  "MSH_PLY: Header has more elements or properties than 'msh_ply_info_t' can "
+  "hold.",
+  "MSH_PLY: Arena needs to be set before the header is parsed, or descriptors "
+  "are added.",
+  "MSH_PLY: Properties read into separate arrays cannot be lists, and need to "
+  "be read with 'msh_ply_read'.",
+  "MSH_PLY: Only descriptors added before 'msh_ply_read' can be loaded.",
+  "MSH_PLY: Could not allocate memory.",
+  "MSH_PLY: Invalid PLY file: Line of ASCII file has fewer values than its row.",
 };
 
 MSH_PLY_DEF const char*
@@ -557,8 +1187,82 @@ msh_ply_error_msg(int32_t err)
   return msh_ply_error_msgs[err];
 }
 
+#define MSH_PLY__ARENA_ALIGN(x) (((x) + 15) & ~(size_t)15)
+#define MSH_PLY__ARENA_HEADER   MSH_PLY__ARENA_ALIGN(sizeof(msh_ply__arena_block_t))
+
+MSH_PLY_PRIVATE void*
+msh_ply__arena_alloc(msh_ply__arena_t* arena, size_t size)
+{
+  if (!arena || !arena->block_size) { return MSH_PLY_MALLOC(size); }
+  size                          = MSH_PLY__ARENA_ALIGN(size);
+  msh_ply__arena_block_t* block = arena->head;
+  if (block && block->size - block->used >= size)
+  {
+    void* ptr = (uint8_t*)block + MSH_PLY__ARENA_HEADER + block->used;
+    block->used += size;
+    arena->last = ptr;
+    return ptr;
+  }
+
+  // Requests larger than a block get a block of their own, placed behind the current one
+  size_t data_size = MSH_PLY_MAX(arena->block_size, size);
+  block = (msh_ply__arena_block_t*)MSH_PLY_MALLOC(MSH_PLY__ARENA_HEADER + data_size);
+  if (!block) { return NULL; }
+  block->size = data_size;
+  block->used = size;
+  if (arena->head && size > arena->block_size)
+  {
+    block->next       = arena->head->next;
+    arena->head->next = block;
+  }
+  else
+  {
+    block->next = arena->head;
+    arena->head = block;
+    arena->last = (uint8_t*)block + MSH_PLY__ARENA_HEADER;
+  }
+  return (uint8_t*)block + MSH_PLY__ARENA_HEADER;
+}
+
+MSH_PLY_PRIVATE void*
+msh_ply__arena_realloc(msh_ply__arena_t* arena, void* ptr, size_t old_size, size_t new_size)
+{
+  if (!arena || !arena->block_size) { return MSH_PLY_REALLOC(ptr, new_size); }
+  msh_ply__arena_block_t* block = arena->head;
+  if (ptr && ptr == arena->last)
+  {
+    size_t offset = (size_t)((uint8_t*)ptr - ((uint8_t*)block + MSH_PLY__ARENA_HEADER));
+    if (MSH_PLY__ARENA_ALIGN(new_size) <= block->size - offset)
+    {
+      block->used = offset + MSH_PLY__ARENA_ALIGN(new_size);
+      return ptr;
+    }
+  }
+  void* new_ptr = msh_ply__arena_alloc(arena, new_size);
+  if (new_ptr && ptr) { memcpy(new_ptr, ptr, MSH_PLY_MIN(old_size, new_size)); }
+  return new_ptr;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__arena_free(msh_ply__arena_t* arena, void* ptr)
+{
+  if (!arena || !arena->block_size) { MSH_PLY_FREE(ptr); }
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__arena_release(msh_ply__arena_t* arena)
+{
+  while (arena->head)
+  {
+    msh_ply__arena_block_t* next = arena->head->next;
+    MSH_PLY_FREE(arena->head);
+    arena->head = next;
+  }
+  arena->last = NULL;
+}
+
 MSH_PLY_PRIVATE void*
-msh_ply__array_grow(const void* array, size_t new_len, size_t elem_size)
+msh_ply__array_grow(msh_ply__arena_t* arena, const void* array, size_t new_len, size_t elem_size)
 {
   size_t old_cap  = msh_ply_array_cap(array);
   size_t new_cap  = (size_t)msh_ply_array__grow_formula(old_cap);
@@ -568,12 +1272,15 @@ msh_ply__array_grow(const void* array, size_t new_len, size_t elem_size)
 
   if (array)
   {
-    new_hdr = (msh_ply_array_hdr_t*)MSH_PLY_REALLOC(msh_ply_array__hdr(array),
-                                                    new_size);
+    size_t old_size = sizeof(msh_ply_array_hdr_t) + old_cap * elem_size;
+    new_hdr         = (msh_ply_array_hdr_t*)msh_ply__arena_realloc(arena,
+                                                           msh_ply_array__hdr(array),
+                                                           old_size,
+                                                           new_size);
   }
   else
   {
-    new_hdr      = (msh_ply_array_hdr_t*)MSH_PLY_MALLOC(new_size);
+    new_hdr      = (msh_ply_array_hdr_t*)msh_ply__arena_alloc(arena, new_size);
     new_hdr->len = 0;
   }
   new_hdr->cap = new_cap;
@@ -591,7 +1298,7 @@ msh_ply__property_zero_init()
 MSH_PLY_PRIVATE msh_ply_element_t
 msh_ply__element_zero_init()
 {
-  msh_ply_element_t el = {{0}, 0, 0, 0, 0, 0};
+  msh_ply_element_t el = {{0}, 0, 0, 0, 0, 0, 0, 0, 0};
   return el;
 }
 
@@ -681,192 +1388,806 @@ msh_ply_add_descriptor(msh_ply_t* pf, msh_ply_desc_t* desc)
   if (!pf) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
   int32_t desc_err = msh_ply__validate_descriptor(desc);
   if (desc_err) { return desc_err; }
-  msh_ply_array_push(pf->descriptors, desc);
+  msh_ply_array_push_in(&pf->_arena, pf->descriptors, desc);
   return MSH_PLY_NO_ERR;
 }
 
-MSH_PLY_PRIVATE MSH_PLY_INLINE void
-msh_ply__swap_bytes(uint8_t* buffer, int32_t type_size, int32_t count)
+MSH_PLY_PRIVATE int32_t
+msh_ply__map_file(msh_ply_t* pf, const char* filename)
 {
-  for (int32_t i = 0; i < count; ++i)
+  pf->_map      = NULL;
+  pf->_map_size = 0;
+#if defined(_WIN32) || defined(_WIN64)
+  HANDLE file = CreateFileA(filename,
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+  if (file == INVALID_HANDLE_VALUE) { return MSH_PLY_FILE_OPEN_ERR; }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
   {
-    int32_t offset = i * type_size;
-    for (int32_t j = 0; j < type_size >> 1; ++j)
-    {
-      uint8_t temp                       = buffer[offset + j];
-      buffer[offset + j]                 = buffer[offset + type_size - 1 - j];
-      buffer[offset + type_size - 1 - j] = temp;
-    }
+    CloseHandle(file);
+    return MSH_PLY_FILE_OPEN_ERR;
+  }
+  // NOTE: The view keeps the mapping alive, so we can close both handles right away.
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  CloseHandle(file);
+  if (!mapping) { return MSH_PLY_FILE_OPEN_ERR; }
+  void* ptr = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!ptr) { return MSH_PLY_FILE_OPEN_ERR; }
+  pf->_map      = (uint8_t*)ptr;
+  pf->_map_size = (size_t)file_size.QuadPart;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return MSH_PLY_FILE_OPEN_ERR; }
+  struct stat file_info;
+  if (fstat(fd, &file_info) != 0 || file_info.st_size <= 0)
+  {
+    close(fd);
+    return MSH_PLY_FILE_OPEN_ERR;
   }
+  // NOTE: Private writable mapping - user can modify returned data (copy-on-write).
+  void* ptr = mmap(NULL,
+                   (size_t)file_info.st_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE,
+                   fd,
+                   0);
+  close(fd);
+  if (ptr == MAP_FAILED) { return MSH_PLY_FILE_OPEN_ERR; }
+  pf->_map      = (uint8_t*)ptr;
+  pf->_map_size = (size_t)file_info.st_size;
+#endif
+  return MSH_PLY_NO_ERR;
 }
 
-MSH_PLY_PRIVATE MSH_PLY_INLINE int32_t
-msh_ply__get_data_as_int(void* data, int32_t type, int8_t swap_endianness)
+MSH_PLY_PRIVATE void
+msh_ply__unmap_file(msh_ply_t* pf)
 {
-  int32_t retval = 0;
-  switch (type)
-  {
-    case MSH_PLY_INT8:
-      retval = ((char*)data)[0];
-      break;
-    case MSH_PLY_INT16:
-    {
-      retval = ((int16_t*)data)[0];
-      if (swap_endianness) msh_ply__swap_bytes((uint8_t*)&retval, 2, 1);
-      break;
-    }
-    case MSH_PLY_INT32:
-    {
-      retval = ((int32_t*)data)[0];
-      if (swap_endianness) msh_ply__swap_bytes((uint8_t*)&retval, 4, 1);
-      break;
-    }
-    case MSH_PLY_UINT8:
+  if (!pf->_map) { return; }
+#if defined(_WIN32) || defined(_WIN64)
+  UnmapViewOfFile(pf->_map);
+#else
+  munmap(pf->_map, pf->_map_size);
+#endif
+  pf->_map      = NULL;
+  pf->_map_size = 0;
+}
 
-      retval = ((uint8_t*)data)[0];
-      break;
-    case MSH_PLY_UINT16:
-    {
-      retval = ((uint16_t*)data)[0];
-      if (swap_endianness) msh_ply__swap_bytes((uint8_t*)&retval, 2, 1);
-      break;
-    }
-    case MSH_PLY_UINT32:
+MSH_PLY_DEF bool
+msh_ply_is_mapped_data(const msh_ply_t* pf, const void* data)
+{
+  if (!pf || !pf->_map || !data) { return false; }
+  const uint8_t* ptr = (const uint8_t*)data;
+  return (ptr >= pf->_map && ptr < pf->_map + pf->_map_size);
+}
+
+// Returns pointer to the element data within the mapping, or NULL if the element cannot be
+// served from the mapping.
+MSH_PLY_PRIVATE uint8_t*
+msh_ply__get_mapped_element_data(const msh_ply_t* pf,
+                                 const msh_ply_element_t* el,
+                                 size_t size)
+{
+  if (!pf->_map || pf->format == MSH_PLY_ASCII) { return NULL; }
+  if (el->file_anchor < 0) { return NULL; }
+  if ((size_t)el->file_anchor + size > pf->_map_size) { return NULL; }
+  return pf->_map + el->file_anchor;
+}
+
+// Default I/O backend, reading from the stdio file opened by 'msh_ply_open'. Reads do not depend
+// on the position of the file, so they can be issued from multiple threads at once.
+MSH_PLY_PRIVATE size_t
+msh_ply__file_read_at(void* user_data, uint64_t offset, void* dst, size_t size)
+{
+  FILE* fp      = (FILE*)user_data;
+  size_t n_read = 0;
+#if defined(_WIN32) || defined(_WIN64)
+  HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+  while (n_read < size)
+  {
+    uint64_t position = offset + n_read;
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset     = (DWORD)position;
+    overlapped.OffsetHigh = (DWORD)(position >> 32);
+    DWORD n_bytes         = (DWORD)MSH_PLY_MIN(size - n_read, (size_t)1 << 30);
+    DWORD n_got           = 0;
+    if (!ReadFile(file, (uint8_t*)dst + n_read, n_bytes, &n_got, &overlapped) || !n_got)
     {
-      retval = ((uint32_t*)data)[0];
-      if (swap_endianness) msh_ply__swap_bytes((uint8_t*)&retval, 4, 1);
       break;
     }
-    default:
-      retval = 0;
-      break;
+    n_read += n_got;
   }
-  return retval;
+#else
+  int fd = fileno(fp);
+  while (n_read < size)
+  {
+    ssize_t n_got = pread(fd, (uint8_t*)dst + n_read, size - n_read, (off_t)(offset + n_read));
+    if (n_got <= 0) { break; }
+    n_read += (size_t)n_got;
+  }
+#endif
+  return n_read;
 }
 
-// TODO(maciej): Static table instead of switch statement?
-MSH_PLY_PRIVATE MSH_PLY_INLINE int16_t
-msh_ply__type_to_byte_size(msh_ply_type_id_t type)
+MSH_PLY_PRIVATE uint64_t
+msh_ply__file_size(void* user_data)
 {
-  int16_t retval = 0;
-  switch (type)
+  FILE* fp = (FILE*)user_data;
+#if defined(_WIN32) || defined(_WIN64)
+  LARGE_INTEGER file_size;
+  HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+  if (!GetFileSizeEx(file, &file_size)) { return 0; }
+  return (uint64_t)file_size.QuadPart;
+#else
+  struct stat file_info;
+  if (fstat(fileno(fp), &file_info) != 0) { return 0; }
+  return (uint64_t)file_info.st_size;
+#endif
+}
+
+// Hints the system that 'size' bytes starting at file 'offset' will be read soon, so that they
+// can be read ahead while we are busy with the current ones. Only files opened by 'msh_ply_open'
+// can be advised.
+MSH_PLY_PRIVATE void
+msh_ply__advise_read(const msh_ply_t* pf, int64_t offset, size_t size)
+{
+#if defined(POSIX_FADV_WILLNEED)
+  if (pf->_io.read_at == msh_ply__file_read_at && size)
   {
-    case MSH_PLY_INT8:
-    {
-      retval = 1;
-      break;
-    }
-    case MSH_PLY_INT16:
-    {
-      retval = 2;
-      break;
-    }
-    case MSH_PLY_INT32:
-    {
-      retval = 4;
-      break;
-    }
-    case MSH_PLY_UINT8:
-    {
-      retval = 1;
-      break;
-    }
-    case MSH_PLY_UINT16:
-    {
-      retval = 2;
-      break;
-    }
-    case MSH_PLY_UINT32:
-    {
-      retval = 4;
-      break;
-    }
-    case MSH_PLY_FLOAT:
-    {
-      retval = 4;
-      break;
-    }
-    case MSH_PLY_DOUBLE:
-    {
-      retval = 8;
-      break;
-    }
-    default:
-    {
-      retval = 0;
-      break;
-    }
+    posix_fadvise(fileno(pf->_fp), (off_t)offset, (off_t)size, POSIX_FADV_WILLNEED);
   }
-  return retval;
+#else
+  (void)pf;
+  (void)offset;
+  (void)size;
+#endif
 }
 
-// TODO(maciej): Static table instead of switch statement?
-MSH_PLY_PRIVATE MSH_PLY_INLINE void
-msh_ply__property_type_to_string(msh_ply_type_id_t type, char** string)
+// Reads 'size' bytes starting at file 'offset' into 'dst'. Returns number of bytes read.
+MSH_PLY_PRIVATE size_t
+msh_ply__read_bytes(const msh_ply_t* pf, int64_t offset, void* dst, size_t size)
 {
-  switch (type)
+  if (pf->_map)
+  {
+    if ((size_t)offset >= pf->_map_size) { return 0; }
+    size_t available = pf->_map_size - (size_t)offset;
+    size = (size < available) ? size : available;
+    memcpy(dst, pf->_map + offset, size);
+    return size;
+  }
+  if (!pf->_io.read_at || offset < 0) { return 0; }
+  return pf->_io.read_at(pf->_io.user_data, (uint64_t)offset, dst, size);
+}
+
+#define MSH_PLY__MAX_OFFSET ((int64_t)(~0ULL >> 1))
+
+// Returns the size of the file, or the largest offset if the I/O backend does not know it.
+MSH_PLY_PRIVATE int64_t
+msh_ply__get_file_size(const msh_ply_t* pf)
+{
+  if (pf->_map) { return (int64_t)pf->_map_size; }
+  uint64_t size = pf->_io.size ? pf->_io.size(pf->_io.user_data) : 0;
+  if (!size || size > (uint64_t)MSH_PLY__MAX_OFFSET) { return MSH_PLY__MAX_OFFSET; }
+  return (int64_t)size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Threading helpers
+
+MSH_PLY_DEF void
+msh_ply_set_num_threads(msh_ply_t* pf, int32_t num_threads)
+{
+  if (!pf) { return; }
+  pf->_num_threads = (num_threads < 0) ? 0 : num_threads;
+}
+
+MSH_PLY_DEF void
+msh_ply_set_task_runner(msh_ply_t* pf, msh_ply_run_tasks_fn_t run_tasks, void* user_data)
+{
+  if (!pf) { return; }
+  pf->_run_tasks      = run_tasks;
+  pf->_run_tasks_data = user_data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Memory helpers
+
+MSH_PLY_DEF int32_t
+msh_ply_set_arena(msh_ply_t* pf, size_t block_size)
+{
+  if (!pf) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  // Memory that was already taken from the heap could not be told apart from the arena's
+  if (pf->elements || pf->descriptors || pf->_cursors || pf->_header_text || pf->_quantizers ||
+      pf->_loaded || pf->_index_blocks || pf->_arena.block_size)
+  {
+    return MSH_PLY_ARENA_ERR;
+  }
+  pf->_arena.block_size = block_size ? block_size : MSH_PLY_ARENA_BLOCK_SIZE;
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_DEF void
+msh_ply_set_output_allocator(msh_ply_t* pf, msh_ply_alloc_fn_t alloc, void* user_data)
+{
+  if (!pf) { return; }
+  pf->_output_alloc      = alloc;
+  pf->_output_alloc_data = user_data;
+}
+
+// Allocates memory that is handed over to the user.
+MSH_PLY_PRIVATE void*
+msh_ply__alloc_output(const msh_ply_t* pf, size_t size)
+{
+  if (pf->_output_alloc) { return pf->_output_alloc(size, pf->_output_alloc_data); }
+  return MSH_PLY_MALLOC(size);
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_num_threads(const msh_ply_t* pf)
+{
+#if !defined(MSH_PLY_USE_THREADS)
+  if (!pf->_run_tasks) { return 1; }
+#endif
+  int32_t num_threads = pf->_num_threads;
+  if (num_threads == 0)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    num_threads = (int32_t)sysinfo.dwNumberOfProcessors;
+#else
+    num_threads = (int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  }
+  if (num_threads < 1) { num_threads = 1; }
+  if (num_threads > MSH_PLY_MAX_THREADS) { num_threads = MSH_PLY_MAX_THREADS; }
+  return num_threads;
+}
+
+typedef struct msh_ply__task
+{
+  msh_ply_task_fn_t fn;
+  void* params;
+} msh_ply__task_t;
+
+#if defined(MSH_PLY_USE_THREADS)
+#if defined(_WIN32) || defined(_WIN64)
+typedef HANDLE msh_ply__thread_t;
+MSH_PLY_PRIVATE DWORD WINAPI
+msh_ply__thread_proc(void* params)
+{
+  msh_ply__task_t* task = (msh_ply__task_t*)params;
+  task->fn(task->params);
+  return 0;
+}
+#else
+typedef pthread_t msh_ply__thread_t;
+MSH_PLY_PRIVATE void*
+msh_ply__thread_proc(void* params)
+{
+  msh_ply__task_t* task = (msh_ply__task_t*)params;
+  task->fn(task->params);
+  return NULL;
+}
+#endif
+
+// Runs 'task' on a new thread. Returns 0 if the thread could not be created.
+MSH_PLY_PRIVATE int32_t
+msh_ply__thread_start(msh_ply__thread_t* thread, msh_ply__task_t* task)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  *thread = CreateThread(NULL, 0, msh_ply__thread_proc, task, 0, NULL);
+  return (*thread != NULL);
+#else
+  return !pthread_create(thread, NULL, msh_ply__thread_proc, task);
+#endif
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__thread_join(msh_ply__thread_t thread)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+#else
+  pthread_join(thread, NULL);
+#endif
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+typedef CRITICAL_SECTION msh_ply__mutex_t;
+#else
+typedef pthread_mutex_t msh_ply__mutex_t;
+#endif
+
+MSH_PLY_PRIVATE void
+msh_ply__mutex_init(msh_ply__mutex_t* mutex)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  InitializeCriticalSection(mutex);
+#else
+  pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__mutex_lock(msh_ply__mutex_t* mutex)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  EnterCriticalSection(mutex);
+#else
+  pthread_mutex_lock(mutex);
+#endif
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__mutex_unlock(msh_ply__mutex_t* mutex)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  LeaveCriticalSection(mutex);
+#else
+  pthread_mutex_unlock(mutex);
+#endif
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__mutex_term(msh_ply__mutex_t* mutex)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  DeleteCriticalSection(mutex);
+#else
+  pthread_mutex_destroy(mutex);
+#endif
+}
+#endif
+
+// Runs 'fn' on each of 'n_tasks' parameter blocks stored in 'params' array, and waits for all of
+// them to finish. Tasks are handed to the user's task runner if there is one. Otherwise each task
+// is run on its own thread, with the first one using the calling thread.
+MSH_PLY_PRIVATE void
+msh_ply__run_tasks(const msh_ply_t* pf,
+                   msh_ply_task_fn_t fn,
+                   void* params,
+                   size_t params_size,
+                   int32_t n_tasks)
+{
+  uint8_t* params_ptr = (uint8_t*)params;
+  if (pf->_run_tasks && n_tasks > 1)
+  {
+    pf->_run_tasks(fn, params, params_size, n_tasks, pf->_run_tasks_data);
+    return;
+  }
+#if defined(MSH_PLY_USE_THREADS)
+  if (n_tasks > 1 && n_tasks <= MSH_PLY_MAX_THREADS)
+  {
+    msh_ply__task_t tasks[MSH_PLY_MAX_THREADS];
+    msh_ply__thread_t threads[MSH_PLY_MAX_THREADS];
+    int32_t spawned[MSH_PLY_MAX_THREADS] = {0};
+    for (int32_t i = 1; i < n_tasks; ++i)
+    {
+      tasks[i].fn     = fn;
+      tasks[i].params = params_ptr + i * params_size;
+      spawned[i]      = msh_ply__thread_start(&threads[i], &tasks[i]);
+      // If we could not get a thread, we will just do the work ourselves.
+      if (!spawned[i]) { fn(tasks[i].params); }
+    }
+    fn(params_ptr);
+    for (int32_t i = 1; i < n_tasks; ++i)
+    {
+      if (spawned[i]) { msh_ply__thread_join(threads[i]); }
+    }
+    return;
+  }
+#endif
+  for (int32_t i = 0; i < n_tasks; ++i) { fn(params_ptr + i * params_size); }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Block reader
+//
+// Elements are read sequentially, one large block at a time. While the caller decodes the current
+// block, the bytes that follow it are read ahead into a second buffer on a background thread.
+// Next block usually starts a little before the end of the current one (at the first row or line
+// that did not fit), so the remaining bytes are copied in front of the bytes read ahead, and the
+// buffers swap their roles.
+
+#define MSH_PLY__READ_MARGIN (1 << 16)
+
+struct msh_ply__block_reader
+{
+  const msh_ply_t* pf;
+  uint8_t* bufs[2];   // MSH_PLY__READ_MARGIN + cap + 1 bytes each
+  size_t cap;
+  int32_t front;      // Buffer holding the current block
+  uint8_t* data;      // Current block
+  int64_t offset;        // File offset of the current block
+  size_t size;        // Size of the current block
+  int64_t end;           // Bytes past this offset are never requested
+
+  // Bytes following the current block, read into the other buffer
+  int64_t ahead_offset;
+  size_t ahead_cap;
+  size_t ahead_size;
+  int32_t ahead_pending;
+#if defined(MSH_PLY_USE_THREADS)
+  msh_ply__task_t ahead_task;
+  msh_ply__thread_t ahead_thread;
+#endif
+};
+
+// Prepares 'reader' for reading bytes of 'pf' up to offset 'end'. If 'end' is not known, it should
+// be set to 0, in which case the bytes are read up to the end of the file.
+MSH_PLY_PRIVATE void
+msh_ply__block_reader_init(msh_ply__block_reader_t* reader, const msh_ply_t* pf, int64_t end)
+{
+  memset(reader, 0, sizeof(*reader));
+  reader->pf           = pf;
+  reader->end          = (end > 0) ? end : msh_ply__get_file_size(pf);
+  reader->offset       = -1;
+  reader->ahead_offset = -1;
+}
+
+#if defined(MSH_PLY_USE_THREADS)
+MSH_PLY_PRIVATE void
+msh_ply__block_reader_read_ahead(void* params)
+{
+  msh_ply__block_reader_t* reader = (msh_ply__block_reader_t*)params;
+  reader->ahead_size = msh_ply__read_bytes(reader->pf,
+                                           reader->ahead_offset,
+                                           reader->bufs[!reader->front] + MSH_PLY__READ_MARGIN,
+                                           reader->ahead_cap);
+}
+#endif
+
+MSH_PLY_PRIVATE void
+msh_ply__block_reader_wait(msh_ply__block_reader_t* reader)
+{
+  if (!reader->ahead_pending) { return; }
+#if defined(MSH_PLY_USE_THREADS)
+  msh_ply__thread_join(reader->ahead_thread);
+#endif
+  reader->ahead_pending = 0;
+}
+
+// Starts reading the bytes that follow the current block. Without threads, we can only ask the
+// system to read them ahead.
+MSH_PLY_PRIVATE void
+msh_ply__block_reader_start_ahead(msh_ply__block_reader_t* reader)
+{
+  reader->ahead_offset = reader->offset + (int64_t)reader->size;
+  reader->ahead_size   = 0;
+  reader->ahead_cap    = 0;
+  if (reader->pf->_map || reader->ahead_offset >= reader->end) { return; }
+  size_t ahead_cap = MSH_PLY_MIN(reader->cap, (size_t)(reader->end - reader->ahead_offset));
+#if defined(MSH_PLY_USE_THREADS)
+  reader->ahead_cap         = ahead_cap;
+  reader->ahead_task.fn     = msh_ply__block_reader_read_ahead;
+  reader->ahead_task.params = reader;
+  reader->ahead_pending = msh_ply__thread_start(&reader->ahead_thread, &reader->ahead_task);
+  if (reader->ahead_pending) { return; }
+  reader->ahead_cap = 0;
+#endif
+  msh_ply__advise_read(reader->pf, reader->ahead_offset, ahead_cap);
+}
+
+// Returns pointer to 'size' bytes of the file starting at 'offset', or fewer of them if the file
+// ends sooner. Their number is stored in 'n_read'. Bytes stay valid until the next call, and one
+// byte past them can be written to. Returns NULL if memory could not be allocated.
+MSH_PLY_PRIVATE uint8_t*
+msh_ply__block_reader_next(msh_ply__block_reader_t* reader,
+                           int64_t offset,
+                           size_t size,
+                           size_t* n_read)
+{
+  msh_ply__block_reader_wait(reader);
+  *n_read = 0;
+  if (size > reader->cap || !reader->bufs[0])
+  {
+    reader->offset    = -1;
+    reader->size      = 0;
+    reader->ahead_cap = 0;
+    for (int32_t i = 0; i < 2; ++i)
+    {
+      size_t buf_size  = MSH_PLY__READ_MARGIN + size + 1;
+      uint8_t* new_buf = (uint8_t*)MSH_PLY_REALLOC(reader->bufs[i], buf_size);
+      if (!new_buf) { return NULL; }
+      reader->bufs[i] = new_buf;
+    }
+    reader->cap = size;
+  }
+
+  uint8_t* front = reader->bufs[reader->front] + MSH_PLY__READ_MARGIN;
+  uint8_t* back  = reader->bufs[!reader->front] + MSH_PLY__READ_MARGIN;
+  uint8_t* data  = front;
+  size_t avail   = 0;
+  if (reader->ahead_cap && offset >= reader->offset && offset <= reader->ahead_offset)
+  {
+    // Remaining bytes of the current block are joined with the bytes read ahead
+    size_t tail            = (size_t)(reader->ahead_offset - offset);
+    const uint8_t* tail_ptr = reader->data + (offset - reader->offset);
+    size_t n_ahead         = reader->ahead_size;
+    if (tail <= MSH_PLY__READ_MARGIN)
+    {
+      data = back - tail;
+      memcpy(data, tail_ptr, tail);
+      reader->front = !reader->front;
+    }
+    else
+    {
+      memmove(front, tail_ptr, tail);
+      n_ahead = MSH_PLY_MIN(n_ahead, reader->cap - tail);
+      memcpy(front + tail, back, n_ahead);
+    }
+    avail = tail + n_ahead;
+    if (avail < size && reader->ahead_size == reader->ahead_cap)
+    {
+      avail += msh_ply__read_bytes(reader->pf, offset + (int64_t)avail, data + avail, size - avail);
+    }
+  }
+  else
+  {
+    avail = msh_ply__read_bytes(reader->pf, offset, data, size);
+  }
+
+  reader->data   = data;
+  reader->offset = offset;
+  reader->size   = MSH_PLY_MIN(avail, size);
+  if (reader->size == size) { msh_ply__block_reader_start_ahead(reader); }
+  else { reader->ahead_cap = 0; }
+  *n_read = reader->size;
+  return data;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__block_reader_term(msh_ply__block_reader_t* reader)
+{
+  msh_ply__block_reader_wait(reader);
+  MSH_PLY_FREE(reader->bufs[0]);
+  MSH_PLY_FREE(reader->bufs[1]);
+  reader->bufs[0] = NULL;
+  reader->bufs[1] = NULL;
+  reader->cap     = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Bulk data kernels
+//
+// Byte swapping and type conversions are done on whole blocks of values, using SSE2 / AVX2 when
+// available, with scalar code handling the remaining values and uncommon type combinations.
+
+// Reverses the byte order of 'count' values of 'type_size' bytes each.
+MSH_PLY_PRIVATE void
+msh_ply__swap_bytes(uint8_t* buffer, int32_t type_size, int32_t count)
+{
+  size_t n_bytes = (size_t)type_size * (size_t)count;
+  size_t i       = 0;
+  if (type_size <= 1) { return; }
+#if defined(MSH_PLY__AVX2)
+  {
+    __m256i mask;
+    if (type_size == 2)
+    {
+      mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                              1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    }
+    else if (type_size == 4)
+    {
+      mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                              3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    }
+    else
+    {
+      mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                              7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    }
+    for (; i + 32 <= n_bytes; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(buffer + i));
+      _mm256_storeu_si256((__m256i*)(buffer + i), _mm256_shuffle_epi8(v, mask));
+    }
+  }
+#endif
+#if defined(MSH_PLY__SSE2)
+  // Without byte shuffles, larger types first have their 16-bit words reversed.
+  for (; i + 16 <= n_bytes; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(buffer + i));
+    if (type_size == 4)
+    {
+      v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+      v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    }
+    else if (type_size == 8)
+    {
+      v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+      v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    }
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    _mm_storeu_si128((__m128i*)(buffer + i), v);
+  }
+#endif
+  for (; i < n_bytes; i += type_size)
+  {
+    for (int32_t j = 0; j < type_size >> 1; ++j)
+    {
+      uint8_t temp                  = buffer[i + j];
+      buffer[i + j]                 = buffer[i + type_size - 1 - j];
+      buffer[i + type_size - 1 - j] = temp;
+    }
+  }
+}
+
+MSH_PLY_PRIVATE MSH_PLY_INLINE int32_t
+msh_ply__get_data_as_int(const void* data, int32_t type, int8_t swap_endianness)
+{
+  // NOTE: Values in rows of binary files are not aligned, so they are loaded via memcpy.
+  int32_t retval = 0;
+  switch (type)
   {
     case MSH_PLY_INT8:
+      retval = ((const int8_t*)data)[0];
+      break;
+    case MSH_PLY_UINT8:
+      retval = ((const uint8_t*)data)[0];
+      break;
+    case MSH_PLY_INT16:
+    case MSH_PLY_UINT16:
     {
-      *string = (char*)"char";
+      uint16_t value;
+      memcpy(&value, data, sizeof(value));
+      if (swap_endianness) { value = (uint16_t)((value >> 8) | (value << 8)); }
+      retval = (type == MSH_PLY_INT16) ? (int16_t)value : value;
+      break;
+    }
+    case MSH_PLY_INT32:
+    case MSH_PLY_UINT32:
+    {
+      uint32_t value;
+      memcpy(&value, data, sizeof(value));
+      if (swap_endianness)
+      {
+        value = (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) |
+                (value << 24);
+      }
+      retval = (int32_t)value;
+      break;
+    }
+    default:
+      retval = 0;
+      break;
+  }
+  return retval;
+}
+
+// TODO(maciej): Static table instead of switch statement?
+MSH_PLY_PRIVATE MSH_PLY_INLINE int16_t
+msh_ply__type_to_byte_size(msh_ply_type_id_t type)
+{
+  int16_t retval = 0;
+  switch (type)
+  {
+    case MSH_PLY_INT8:
+    {
+      retval = 1;
       break;
     }
     case MSH_PLY_INT16:
     {
-      *string = (char*)"short";
+      retval = 2;
       break;
     }
     case MSH_PLY_INT32:
     {
-      *string = (char*)"int";
+      retval = 4;
       break;
     }
     case MSH_PLY_UINT8:
     {
-      *string = (char*)"uchar";
+      retval = 1;
       break;
     }
     case MSH_PLY_UINT16:
     {
-      *string = (char*)"ushort";
+      retval = 2;
       break;
     }
     case MSH_PLY_UINT32:
     {
-      *string = (char*)"uint";
+      retval = 4;
       break;
     }
     case MSH_PLY_FLOAT:
     {
-      *string = (char*)"float";
+      retval = 4;
       break;
     }
     case MSH_PLY_DOUBLE:
     {
-      *string = (char*)"double";
+      retval = 8;
       break;
     }
     default:
     {
+      retval = 0;
       break;
     }
   }
+  return retval;
 }
 
-//TODO(maciej): String interning?
+// TODO(maciej): Static table instead of switch statement?
 MSH_PLY_PRIVATE MSH_PLY_INLINE void
-msh_ply__string_to_property_type(char* type_str,
-                                 msh_ply_type_id_t* pr_type,
-                                 int16_t* pr_size)
+msh_ply__property_type_to_string(msh_ply_type_id_t type, char** string)
 {
-  if (!strcmp("int8", type_str) || !strcmp("char", type_str))
-  {
-    *pr_type = MSH_PLY_INT8;
-    *pr_size = 1;
-  }
-  else if (!strcmp("uint8", type_str) || !strcmp("uchar", type_str))
+  switch (type)
   {
-    *pr_type = MSH_PLY_UINT8;
+    case MSH_PLY_INT8:
+    {
+      *string = (char*)"char";
+      break;
+    }
+    case MSH_PLY_INT16:
+    {
+      *string = (char*)"short";
+      break;
+    }
+    case MSH_PLY_INT32:
+    {
+      *string = (char*)"int";
+      break;
+    }
+    case MSH_PLY_UINT8:
+    {
+      *string = (char*)"uchar";
+      break;
+    }
+    case MSH_PLY_UINT16:
+    {
+      *string = (char*)"ushort";
+      break;
+    }
+    case MSH_PLY_UINT32:
+    {
+      *string = (char*)"uint";
+      break;
+    }
+    case MSH_PLY_FLOAT:
+    {
+      *string = (char*)"float";
+      break;
+    }
+    case MSH_PLY_DOUBLE:
+    {
+      *string = (char*)"double";
+      break;
+    }
+    default:
+    {
+      break;
+    }
+  }
+}
+
+//TODO(maciej): String interning?
+MSH_PLY_PRIVATE MSH_PLY_INLINE void
+msh_ply__string_to_property_type(char* type_str,
+                                 msh_ply_type_id_t* pr_type,
+                                 int16_t* pr_size)
+{
+  if (!strcmp("int8", type_str) || !strcmp("char", type_str))
+  {
+    *pr_type = MSH_PLY_INT8;
+    *pr_size = 1;
+  }
+  else if (!strcmp("uint8", type_str) || !strcmp("uchar", type_str))
+  {
+    *pr_type = MSH_PLY_UINT8;
     *pr_size = 1;
   }
   else if (!strcmp("int16", type_str) || !strcmp("short", type_str))
@@ -975,1524 +2296,7317 @@ msh_ply__data_assign(void* dst, void* src, int32_t type, int32_t count)
     }
     case MSH_PLY_DOUBLE:
     {
-      MSH_PLY__COPY_DATA_AS_TYPE(dst, src, double);
-      break;
+      MSH_PLY__COPY_DATA_AS_TYPE(dst, src, double);
+      break;
+    }
+    default:
+      break;
+  }
+}
+#undef MSH_PLY__COPY_DATA_AS_TYPE
+
+MSH_PLY_PRIVATE MSH_PLY_INLINE void
+msh_ply__store_value(uint8_t** dst,
+                     const int32_t type,
+                     int64_t int_value,
+                     double double_value)
+{
+  switch (type)
+  {
+    case MSH_PLY_INT8:
+    {
+      int8_t v = (int8_t)int_value;
+      memcpy(*dst, &v, sizeof(v));
+      break;
+    }
+    case MSH_PLY_INT16:
+    {
+      int16_t v = (int16_t)int_value;
+      memcpy(*dst, &v, sizeof(v));
+      break;
+    }
+    case MSH_PLY_INT32:
+    {
+      int32_t v = (int32_t)int_value;
+      memcpy(*dst, &v, sizeof(v));
+      break;
+    }
+    case MSH_PLY_UINT8:
+    {
+      uint8_t v = (uint8_t)int_value;
+      memcpy(*dst, &v, sizeof(v));
+      break;
+    }
+    case MSH_PLY_UINT16:
+    {
+      uint16_t v = (uint16_t)int_value;
+      memcpy(*dst, &v, sizeof(v));
+      break;
+    }
+    case MSH_PLY_UINT32:
+    {
+      uint32_t v = (uint32_t)int_value;
+      memcpy(*dst, &v, sizeof(v));
+      break;
+    }
+    case MSH_PLY_FLOAT:
+    {
+      float v = (float)double_value;
+      memcpy(*dst, &v, sizeof(v));
+      break;
+    }
+    case MSH_PLY_DOUBLE:
+    {
+      memcpy(*dst, &double_value, sizeof(double_value));
+      break;
+    }
+  }
+  *dst += msh_ply__type_to_byte_size((msh_ply_type_id_t)type);
+}
+
+#ifndef MSH_PLY_ENCODER_ONLY
+
+////////////////////////////////////////////////////////////////////////////////
+// Gzip decoder
+//
+// Files compressed with gzip (RFC 1951, RFC 1952) are read through an I/O backend that inflates
+// them on the fly, so the rest of the reader sees plain ply bytes. Deflate streams can only be
+// decoded front to back, while the reader revisits bytes it has already seen (e.g. elements with
+// lists are first scanned and then decoded). Decoder therefore records a checkpoint every few
+// megabytes of output - compressed bit position and the last 32KB of output, which is everything
+// needed to resume inflating from the start of the next deflate block. Reading an earlier part of
+// the file restarts from the closest checkpoint. Few decoders are kept around, each with its own
+// position, so that reads of different elements do not keep restarting each other.
+
+#define MSH_PLY__GZ_WINDOW_SIZE        (1 << 15)
+#define MSH_PLY__GZ_IN_SIZE            (1 << 16)
+#define MSH_PLY__GZ_OUT_SIZE           (MSH_PLY__GZ_WINDOW_SIZE + (1 << 20))
+#define MSH_PLY__GZ_CHECKPOINT_SPACING (1 << 22)
+#define MSH_PLY__GZ_MAX_DECODERS       4
+#define MSH_PLY__HUFFMAN_FAST_BITS     10
+
+// Canonical Huffman code. Codes of up to MSH_PLY__HUFFMAN_FAST_BITS bits are decoded with a single
+// lookup in 'fast', indexed by the next input bits. Longer codes are found by comparing the next
+// 16 bits, in the order they were written, against the last code of each length.
+typedef struct msh_ply__huffman
+{
+  uint16_t fast[1 << MSH_PLY__HUFFMAN_FAST_BITS];   // symbol | (code length << 9), 0 if longer
+  uint32_t max_code[17];   // Codes of length l are smaller than max_code[l], left aligned to 16 bits
+  uint16_t first_code[16];
+  uint16_t first_symbol[16];
+  uint16_t symbols[288];
+} msh_ply__huffman_t;
+
+enum msh_ply__gz_state
+{
+  MSH_PLY__GZ_MEMBER_HEADER,
+  MSH_PLY__GZ_BLOCK_HEADER,
+  MSH_PLY__GZ_STORED_BLOCK,
+  MSH_PLY__GZ_HUFFMAN_BLOCK,
+  MSH_PLY__GZ_MEMBER_TRAILER,
+  MSH_PLY__GZ_DONE,
+  MSH_PLY__GZ_ERROR
+};
+
+typedef struct msh_ply__gz_checkpoint
+{
+  uint64_t bit_offset;   // Position within the compressed data
+  uint64_t out_offset;   // Position within the decompressed data
+  int32_t state;         // Either MSH_PLY__GZ_MEMBER_HEADER or MSH_PLY__GZ_BLOCK_HEADER
+  int32_t window_size;
+  uint8_t* window;
+} msh_ply__gz_checkpoint_t;
+
+typedef struct msh_ply__gz_decoder
+{
+  // Compressed input, 'in_offset' is the position of in[0] within the compressed data
+  uint8_t* in;
+  size_t in_size;
+  size_t in_pos;
+  uint64_t in_offset;
+  uint64_t bits;
+  int32_t n_bits;
+  int32_t n_overrun;   // Number of bytes we pretended to read past the end of input
+
+  int32_t state;
+  int32_t is_final;
+  uint32_t stored_left;
+  msh_ply__huffman_t lit;
+  msh_ply__huffman_t dist;
+
+  // Decompressed output, including the window that matches can refer to. 'out_offset' is the
+  // position of out[0] within the decompressed data.
+  uint8_t* out;
+  size_t out_size;
+  uint64_t out_offset;
+  uint64_t member_offset;   // Position where the current gzip member starts in decompressed data
+  uint64_t last_use;
+} msh_ply__gz_decoder_t;
+
+typedef struct msh_ply__gz_reader
+{
+  msh_ply_io_t src;
+  msh_ply__gz_decoder_t* decoders[MSH_PLY__GZ_MAX_DECODERS];
+  msh_ply_array(msh_ply__gz_checkpoint_t) checkpoints;
+  uint64_t n_uses;
+#if defined(MSH_PLY_USE_THREADS)
+  msh_ply__mutex_t mutex;
+#endif
+} msh_ply__gz_reader_t;
+
+MSH_PLY_PRIVATE uint32_t
+msh_ply__reverse_bits16(uint32_t x)
+{
+  x = ((x & 0xaaaa) >> 1) | ((x & 0x5555) << 1);
+  x = ((x & 0xcccc) >> 2) | ((x & 0x3333) << 2);
+  x = ((x & 0xf0f0) >> 4) | ((x & 0x0f0f) << 4);
+  x = ((x & 0xff00) >> 8) | ((x & 0x00ff) << 8);
+  return x;
+}
+
+// Builds code from 'lengths' of 'n_symbols' symbols. Incomplete codes are accepted, as deflate
+// allows them for codes with a single symbol. Returns 0 if lengths do not describe a valid code.
+MSH_PLY_PRIVATE int32_t
+msh_ply__huffman_init(msh_ply__huffman_t* h, const uint8_t* lengths, int32_t n_symbols)
+{
+  int32_t counts[16] = {0};
+  int32_t next[16];
+  for (int32_t i = 0; i < n_symbols; ++i) { counts[lengths[i]]++; }
+  counts[0] = 0;
+
+  int32_t left = 1;
+  for (int32_t l = 1; l < 16; ++l)
+  {
+    left = (left << 1) - counts[l];
+    if (left < 0) { return 0; }
+  }
+
+  memset(h->fast, 0, sizeof(h->fast));
+  uint32_t code = 0;
+  int32_t k     = 0;
+  for (int32_t l = 1; l < 16; ++l)
+  {
+    h->first_code[l]   = (uint16_t)code;
+    h->first_symbol[l] = (uint16_t)k;
+    next[l]            = k;
+    code += (uint32_t)counts[l];
+    k += counts[l];
+    h->max_code[l] = code << (16 - l);
+    code <<= 1;
+  }
+  h->max_code[16] = 0x10000;
+
+  for (int32_t i = 0; i < n_symbols; ++i)
+  {
+    int32_t l = lengths[i];
+    if (!l) { continue; }
+    int32_t idx     = next[l]++;
+    h->symbols[idx] = (uint16_t)i;
+    if (l <= MSH_PLY__HUFFMAN_FAST_BITS)
+    {
+      uint32_t c     = h->first_code[l] + (uint32_t)(idx - h->first_symbol[l]);
+      uint32_t r     = msh_ply__reverse_bits16(c) >> (16 - l);
+      uint16_t entry = (uint16_t)(i | (l << 9));
+      for (; r < (1u << MSH_PLY__HUFFMAN_FAST_BITS); r += (1u << l)) { h->fast[r] = entry; }
+    }
+  }
+  return 1;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__gz_refill(msh_ply__gz_reader_t* gz, msh_ply__gz_decoder_t* d)
+{
+  while (d->n_bits <= 56)
+  {
+    if (d->in_pos == d->in_size)
+    {
+      d->in_offset += d->in_size;
+      d->in_pos  = 0;
+      d->in_size = gz->src.read_at(gz->src.user_data, d->in_offset, d->in, MSH_PLY__GZ_IN_SIZE);
+      if (!d->in_size)
+      {
+        // Pretend input continues with zeros, and only fail once they are actually consumed.
+        d->n_overrun++;
+        d->n_bits += 8;
+        continue;
+      }
+    }
+    d->bits |= (uint64_t)d->in[d->in_pos++] << d->n_bits;
+    d->n_bits += 8;
+  }
+}
+
+MSH_PLY_PRIVATE uint32_t
+msh_ply__gz_get_bits(msh_ply__gz_reader_t* gz, msh_ply__gz_decoder_t* d, int32_t n)
+{
+  if (d->n_bits < n) { msh_ply__gz_refill(gz, d); }
+  uint32_t value = (uint32_t)(d->bits & ((1ull << n) - 1));
+  d->bits >>= n;
+  d->n_bits -= n;
+  return value;
+}
+
+// Returns 1 if bits past the end of the input were consumed.
+MSH_PLY_PRIVATE int32_t
+msh_ply__gz_overrun(const msh_ply__gz_decoder_t* d)
+{
+  return d->n_bits < 8 * d->n_overrun;
+}
+
+// Position of the next unread bit within the compressed data.
+MSH_PLY_PRIVATE uint64_t
+msh_ply__gz_bit_offset(const msh_ply__gz_decoder_t* d)
+{
+  uint64_t n_loaded = (d->in_offset + d->in_pos + (uint64_t)d->n_overrun) * 8;
+  return n_loaded - (uint64_t)d->n_bits;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__gz_seek_bits(msh_ply__gz_reader_t* gz, msh_ply__gz_decoder_t* d, uint64_t bit_offset)
+{
+  d->in_offset = bit_offset / 8;
+  d->in_size   = 0;
+  d->in_pos    = 0;
+  d->bits      = 0;
+  d->n_bits    = 0;
+  d->n_overrun = 0;
+  // Empty buffer is reloaded from 'in_offset + in_size' on the first refill.
+  msh_ply__gz_get_bits(gz, d, (int32_t)(bit_offset % 8));
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__gz_decode_symbol(msh_ply__gz_reader_t* gz,
+                          msh_ply__gz_decoder_t* d,
+                          const msh_ply__huffman_t* h)
+{
+  if (d->n_bits < 16) { msh_ply__gz_refill(gz, d); }
+  uint32_t entry = h->fast[d->bits & ((1u << MSH_PLY__HUFFMAN_FAST_BITS) - 1)];
+  int32_t l      = 0;
+  if (entry)
+  {
+    l = (int32_t)(entry >> 9);
+    d->bits >>= l;
+    d->n_bits -= l;
+    return (int32_t)(entry & 511);
+  }
+  uint32_t code = msh_ply__reverse_bits16((uint32_t)(d->bits & 0xffff));
+  for (l = MSH_PLY__HUFFMAN_FAST_BITS + 1; l < 16; ++l)
+  {
+    if (code < h->max_code[l]) { break; }
+  }
+  if (l == 16) { return -1; }
+  int32_t idx = (int32_t)(code >> (16 - l)) - h->first_code[l] + h->first_symbol[l];
+  d->bits >>= l;
+  d->n_bits -= l;
+  return h->symbols[idx];
+}
+
+// Reads code lengths of a dynamic block, and sets up its codes.
+MSH_PLY_PRIVATE int32_t
+msh_ply__gz_read_dynamic_codes(msh_ply__gz_reader_t* gz, msh_ply__gz_decoder_t* d)
+{
+  static const uint8_t order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                    11, 4,  12, 3, 13, 2, 14, 1, 15};
+  int32_t n_lit  = (int32_t)msh_ply__gz_get_bits(gz, d, 5) + 257;
+  int32_t n_dist = (int32_t)msh_ply__gz_get_bits(gz, d, 5) + 1;
+  int32_t n_code = (int32_t)msh_ply__gz_get_bits(gz, d, 4) + 4;
+  if (n_lit > 286 || n_dist > 30) { return 0; }
+
+  uint8_t code_lengths[19] = {0};
+  for (int32_t i = 0; i < n_code; ++i)
+  {
+    code_lengths[order[i]] = (uint8_t)msh_ply__gz_get_bits(gz, d, 3);
+  }
+  msh_ply__huffman_t* code = &d->dist;   // Reused, it is set up only after the lengths are read
+  if (!msh_ply__huffman_init(code, code_lengths, 19)) { return 0; }
+
+  uint8_t lengths[286 + 30];
+  int32_t n = 0;
+  while (n < n_lit + n_dist)
+  {
+    int32_t symbol = msh_ply__gz_decode_symbol(gz, d, code);
+    if (symbol < 0) { return 0; }
+    if (symbol < 16)
+    {
+      lengths[n++] = (uint8_t)symbol;
+      continue;
+    }
+    uint8_t value  = 0;
+    int32_t repeat = 0;
+    if (symbol == 16)
+    {
+      if (!n) { return 0; }
+      value  = lengths[n - 1];
+      repeat = 3 + (int32_t)msh_ply__gz_get_bits(gz, d, 2);
+    }
+    else if (symbol == 17) { repeat = 3 + (int32_t)msh_ply__gz_get_bits(gz, d, 3); }
+    else { repeat = 11 + (int32_t)msh_ply__gz_get_bits(gz, d, 7); }
+    if (n + repeat > n_lit + n_dist) { return 0; }
+    memset(lengths + n, value, (size_t)repeat);
+    n += repeat;
+  }
+  if (!lengths[256]) { return 0; }
+  return msh_ply__huffman_init(&d->lit, lengths, n_lit) &&
+         msh_ply__huffman_init(&d->dist, lengths + n_lit, n_dist);
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__gz_set_fixed_codes(msh_ply__gz_decoder_t* d)
+{
+  uint8_t lengths[288];
+  memset(lengths, 8, 144);
+  memset(lengths + 144, 9, 112);
+  memset(lengths + 256, 7, 24);
+  memset(lengths + 280, 8, 8);
+  msh_ply__huffman_init(&d->lit, lengths, 288);
+  memset(lengths, 5, 30);
+  msh_ply__huffman_init(&d->dist, lengths, 30);
+}
+
+// Skips gzip member header. Returns 0 if there is no valid member header at the current position.
+MSH_PLY_PRIVATE int32_t
+msh_ply__gz_read_member_header(msh_ply__gz_reader_t* gz, msh_ply__gz_decoder_t* d)
+{
+  if (msh_ply__gz_get_bits(gz, d, 16) != 0x8b1f) { return 0; }
+  if (msh_ply__gz_get_bits(gz, d, 8) != 8) { return 0; }
+  uint32_t flags = msh_ply__gz_get_bits(gz, d, 8);
+  for (int32_t i = 0; i < 6; ++i) { msh_ply__gz_get_bits(gz, d, 8); }
+  if (flags & 4)
+  {
+    uint32_t extra_size = msh_ply__gz_get_bits(gz, d, 16);
+    for (uint32_t i = 0; i < extra_size; ++i) { msh_ply__gz_get_bits(gz, d, 8); }
+  }
+  // File name and comment are zero terminated
+  if (flags & 8)
+  {
+    while (msh_ply__gz_get_bits(gz, d, 8) && !msh_ply__gz_overrun(d)) {}
+  }
+  if (flags & 16)
+  {
+    while (msh_ply__gz_get_bits(gz, d, 8) && !msh_ply__gz_overrun(d)) {}
+  }
+  if (flags & 2) { msh_ply__gz_get_bits(gz, d, 16); }
+  return !msh_ply__gz_overrun(d);
+}
+
+// Decodes one element of the stream - a header, a trailer or a run of block contents. Stops before
+// the output buffer could overflow.
+MSH_PLY_PRIVATE void
+msh_ply__gz_step(msh_ply__gz_reader_t* gz, msh_ply__gz_decoder_t* d)
+{
+  static const uint16_t length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,
+                                           15, 17, 19, 23, 27, 31, 35, 43, 51,  59,
+                                           67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                           2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const uint16_t dist_base[30] = {1,    2,    3,    4,    5,    7,     9,     13,
+                                         17,   25,   33,   49,   65,   97,    129,   193,
+                                         257,  385,  513,  769,  1025, 1537,  2049,  3073,
+                                         4097, 6145, 8193, 12289, 16385, 24577};
+  static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                         6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+  switch (d->state)
+  {
+    case MSH_PLY__GZ_MEMBER_HEADER:
+    {
+      d->member_offset = d->out_offset + d->out_size;
+      d->state = msh_ply__gz_read_member_header(gz, d) ? MSH_PLY__GZ_BLOCK_HEADER
+                                                       : MSH_PLY__GZ_ERROR;
+      break;
+    }
+    case MSH_PLY__GZ_BLOCK_HEADER:
+    {
+      d->is_final   = (int32_t)msh_ply__gz_get_bits(gz, d, 1);
+      uint32_t type = msh_ply__gz_get_bits(gz, d, 2);
+      if (type == 0)
+      {
+        msh_ply__gz_get_bits(gz, d, d->n_bits % 8);
+        uint32_t size     = msh_ply__gz_get_bits(gz, d, 16);
+        uint32_t inv_size = msh_ply__gz_get_bits(gz, d, 16);
+        d->stored_left    = size;
+        d->state = (size == (~inv_size & 0xffff)) ? MSH_PLY__GZ_STORED_BLOCK : MSH_PLY__GZ_ERROR;
+      }
+      else if (type == 1)
+      {
+        msh_ply__gz_set_fixed_codes(d);
+        d->state = MSH_PLY__GZ_HUFFMAN_BLOCK;
+      }
+      else if (type == 2)
+      {
+        d->state = msh_ply__gz_read_dynamic_codes(gz, d) ? MSH_PLY__GZ_HUFFMAN_BLOCK
+                                                         : MSH_PLY__GZ_ERROR;
+      }
+      else
+      {
+        d->state = MSH_PLY__GZ_ERROR;
+      }
+      break;
+    }
+    case MSH_PLY__GZ_STORED_BLOCK:
+    {
+      // Bytes left in the bit buffer come first, then we can copy straight from the input.
+      while (d->stored_left && d->out_size < MSH_PLY__GZ_OUT_SIZE)
+      {
+        if (d->n_bits >= 8)
+        {
+          if (d->n_bits - 8 * d->n_overrun < 8) { break; }
+          d->out[d->out_size++] = (uint8_t)msh_ply__gz_get_bits(gz, d, 8);
+          d->stored_left--;
+          continue;
+        }
+        if (d->in_pos == d->in_size)
+        {
+          msh_ply__gz_refill(gz, d);
+          continue;
+        }
+        size_t n = MSH_PLY_MIN(d->in_size - d->in_pos, (size_t)d->stored_left);
+        n        = MSH_PLY_MIN(n, MSH_PLY__GZ_OUT_SIZE - d->out_size);
+        memcpy(d->out + d->out_size, d->in + d->in_pos, n);
+        d->in_pos += n;
+        d->out_size += n;
+        d->stored_left -= (uint32_t)n;
+      }
+      if (d->stored_left && d->n_overrun) { d->state = MSH_PLY__GZ_ERROR; }
+      else if (!d->stored_left)
+      {
+        d->state = d->is_final ? MSH_PLY__GZ_MEMBER_TRAILER : MSH_PLY__GZ_BLOCK_HEADER;
+      }
+      break;
+    }
+    case MSH_PLY__GZ_HUFFMAN_BLOCK:
+    {
+      uint8_t* out = d->out;
+      size_t size  = d->out_size;
+      // Window before the member start cannot be referred to
+      size_t min_pos = (d->member_offset > d->out_offset)
+                         ? (size_t)(d->member_offset - d->out_offset)
+                         : 0;
+      while (size + 258 <= MSH_PLY__GZ_OUT_SIZE)
+      {
+        int32_t symbol = msh_ply__gz_decode_symbol(gz, d, &d->lit);
+        if (symbol < 0 || msh_ply__gz_overrun(d))
+        {
+          d->state = MSH_PLY__GZ_ERROR;
+          break;
+        }
+        if (symbol < 256)
+        {
+          out[size++] = (uint8_t)symbol;
+          continue;
+        }
+        if (symbol == 256)
+        {
+          d->state = d->is_final ? MSH_PLY__GZ_MEMBER_TRAILER : MSH_PLY__GZ_BLOCK_HEADER;
+          break;
+        }
+        symbol -= 257;
+        if (symbol >= 29)
+        {
+          d->state = MSH_PLY__GZ_ERROR;
+          break;
+        }
+        size_t length = length_base[symbol] + msh_ply__gz_get_bits(gz, d, length_extra[symbol]);
+        int32_t dist_symbol = msh_ply__gz_decode_symbol(gz, d, &d->dist);
+        if (dist_symbol < 0 || dist_symbol >= 30)
+        {
+          d->state = MSH_PLY__GZ_ERROR;
+          break;
+        }
+        size_t dist =
+          dist_base[dist_symbol] + msh_ply__gz_get_bits(gz, d, dist_extra[dist_symbol]);
+        if (dist > size - min_pos || msh_ply__gz_overrun(d))
+        {
+          d->state = MSH_PLY__GZ_ERROR;
+          break;
+        }
+        const uint8_t* src = out + size - dist;
+        uint8_t* dst       = out + size;
+        if (dist >= length) { memcpy(dst, src, length); }
+        else
+        {
+          for (size_t i = 0; i < length; ++i) { dst[i] = src[i]; }
+        }
+        size += length;
+      }
+      d->out_size = size;
+      break;
+    }
+    case MSH_PLY__GZ_MEMBER_TRAILER:
+    {
+      // CRC and size of the member are not checked, as parts of it may have been skipped.
+      msh_ply__gz_get_bits(gz, d, d->n_bits % 8);
+      msh_ply__gz_get_bits(gz, d, 32);
+      msh_ply__gz_get_bits(gz, d, 32);
+      if (msh_ply__gz_overrun(d))
+      {
+        d->state = MSH_PLY__GZ_ERROR;
+        break;
+      }
+      // Another member may follow, anything else ends the stream.
+      msh_ply__gz_refill(gz, d);
+      int32_t has_member = (d->n_bits - 8 * d->n_overrun >= 16) && ((d->bits & 0xffff) == 0x8b1f);
+      d->state = has_member ? MSH_PLY__GZ_MEMBER_HEADER : MSH_PLY__GZ_DONE;
+      break;
+    }
+    default: break;
+  }
+}
+
+// Drops all but the window from the output buffer.
+MSH_PLY_PRIVATE void
+msh_ply__gz_slide(msh_ply__gz_decoder_t* d)
+{
+  if (d->out_size <= MSH_PLY__GZ_WINDOW_SIZE) { return; }
+  size_t shift = d->out_size - MSH_PLY__GZ_WINDOW_SIZE;
+  memmove(d->out, d->out + shift, MSH_PLY__GZ_WINDOW_SIZE);
+  d->out_offset += shift;
+  d->out_size = MSH_PLY__GZ_WINDOW_SIZE;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__gz_add_checkpoint(msh_ply__gz_reader_t* gz, const msh_ply__gz_decoder_t* d)
+{
+  msh_ply__gz_checkpoint_t cp;
+  cp.bit_offset  = msh_ply__gz_bit_offset(d);
+  cp.out_offset  = d->out_offset + d->out_size;
+  cp.state       = d->state;
+  cp.window_size = (int32_t)MSH_PLY_MIN(d->out_size, (size_t)MSH_PLY__GZ_WINDOW_SIZE);
+  cp.window      = (uint8_t*)MSH_PLY_MALLOC((size_t)cp.window_size + 1);
+  if (!cp.window) { return; }
+  memcpy(cp.window, d->out + d->out_size - cp.window_size, (size_t)cp.window_size);
+  msh_ply_array_push(gz->checkpoints, cp);
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__gz_restore(msh_ply__gz_reader_t* gz,
+                    msh_ply__gz_decoder_t* d,
+                    const msh_ply__gz_checkpoint_t* cp)
+{
+  msh_ply__gz_seek_bits(gz, d, cp->bit_offset);
+  if (cp->window_size) { memcpy(d->out, cp->window, (size_t)cp->window_size); }
+  d->out_size      = (size_t)cp->window_size;
+  d->out_offset    = cp->out_offset - (uint64_t)cp->window_size;
+  d->member_offset = d->out_offset;
+  d->state         = cp->state;
+}
+
+// Decodes more data, recording a checkpoint at the first block boundary past the spacing.
+MSH_PLY_PRIVATE int32_t
+msh_ply__gz_advance(msh_ply__gz_reader_t* gz, msh_ply__gz_decoder_t* d)
+{
+  if (d->out_size + 258 > MSH_PLY__GZ_OUT_SIZE) { msh_ply__gz_slide(d); }
+  size_t prev_size = d->out_size;
+  while (d->out_size == prev_size)
+  {
+    if (d->state == MSH_PLY__GZ_DONE || d->state == MSH_PLY__GZ_ERROR) { return 0; }
+    if (d->state == MSH_PLY__GZ_BLOCK_HEADER || d->state == MSH_PLY__GZ_MEMBER_HEADER)
+    {
+      const msh_ply__gz_checkpoint_t* last = msh_ply_array_back(gz->checkpoints);
+      if (d->out_offset + d->out_size >= last->out_offset + MSH_PLY__GZ_CHECKPOINT_SPACING)
+      {
+        msh_ply__gz_add_checkpoint(gz, d);
+      }
+    }
+    msh_ply__gz_step(gz, d);
+    if (d->out_size + 258 > MSH_PLY__GZ_OUT_SIZE && d->out_size == prev_size)
+    {
+      msh_ply__gz_slide(d);
+      prev_size = d->out_size;
+    }
+  }
+  return 1;
+}
+
+MSH_PLY_PRIVATE msh_ply__gz_decoder_t*
+msh_ply__gz_decoder_create(void)
+{
+  msh_ply__gz_decoder_t* d = (msh_ply__gz_decoder_t*)MSH_PLY_MALLOC(sizeof(*d));
+  if (!d) { return NULL; }
+  memset(d, 0, sizeof(*d));
+  d->in  = (uint8_t*)MSH_PLY_MALLOC(MSH_PLY__GZ_IN_SIZE);
+  d->out = (uint8_t*)MSH_PLY_MALLOC(MSH_PLY__GZ_OUT_SIZE);
+  if (!d->in || !d->out)
+  {
+    MSH_PLY_FREE(d->in);
+    MSH_PLY_FREE(d->out);
+    MSH_PLY_FREE(d);
+    return NULL;
+  }
+  d->state = MSH_PLY__GZ_ERROR;
+  return d;
+}
+
+// Picks decoder to serve 'offset' - the one that got furthest without passing it, unless it is
+// behind the closest checkpoint. Then a new or the least recently used decoder restarts from there.
+MSH_PLY_PRIVATE msh_ply__gz_decoder_t*
+msh_ply__gz_get_decoder(msh_ply__gz_reader_t* gz, uint64_t offset)
+{
+  size_t lo = 0;
+  size_t hi = msh_ply_array_len(gz->checkpoints);
+  while (hi - lo > 1)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (gz->checkpoints[mid].out_offset <= offset) { lo = mid; }
+    else
+    {
+      hi = mid;
+    }
+  }
+  const msh_ply__gz_checkpoint_t* cp = &gz->checkpoints[lo];
+
+  msh_ply__gz_decoder_t* best = NULL;
+  int32_t slot                = -1;
+  for (int32_t i = 0; i < MSH_PLY__GZ_MAX_DECODERS; ++i)
+  {
+    msh_ply__gz_decoder_t* d = gz->decoders[i];
+    if (!d)
+    {
+      if (slot < 0 || gz->decoders[slot]) { slot = i; }
+      continue;
+    }
+    if (slot < 0 || (gz->decoders[slot] && d->last_use < gz->decoders[slot]->last_use))
+    {
+      slot = i;
+    }
+    if (d->state == MSH_PLY__GZ_ERROR || offset < d->out_offset) { continue; }
+    if (!best || d->out_offset + d->out_size > best->out_offset + best->out_size) { best = d; }
+  }
+
+  if (!best || best->out_offset + best->out_size < cp->out_offset)
+  {
+    if (!gz->decoders[slot]) { gz->decoders[slot] = msh_ply__gz_decoder_create(); }
+    if (gz->decoders[slot])
+    {
+      best = gz->decoders[slot];
+      msh_ply__gz_restore(gz, best, cp);
+    }
+  }
+  if (best) { best->last_use = ++gz->n_uses; }
+  return best;
+}
+
+MSH_PLY_PRIVATE size_t
+msh_ply__gz_read_at(void* user_data, uint64_t offset, void* dst, size_t size)
+{
+  msh_ply__gz_reader_t* gz = (msh_ply__gz_reader_t*)user_data;
+  size_t n_read            = 0;
+#if defined(MSH_PLY_USE_THREADS)
+  msh_ply__mutex_lock(&gz->mutex);
+#endif
+  msh_ply__gz_decoder_t* d = msh_ply__gz_get_decoder(gz, offset);
+  while (d && n_read < size)
+  {
+    uint64_t pos = offset + n_read;
+    uint64_t end = d->out_offset + d->out_size;
+    if (pos < end)
+    {
+      size_t n = (size_t)MSH_PLY_MIN(end - pos, (uint64_t)(size - n_read));
+      memcpy((uint8_t*)dst + n_read, d->out + (pos - d->out_offset), n);
+      n_read += n;
+      continue;
+    }
+    if (!msh_ply__gz_advance(gz, d)) { break; }
+  }
+#if defined(MSH_PLY_USE_THREADS)
+  msh_ply__mutex_unlock(&gz->mutex);
+#endif
+  return n_read;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__gz_close(void* user_data)
+{
+  msh_ply__gz_reader_t* gz = (msh_ply__gz_reader_t*)user_data;
+  for (int32_t i = 0; i < MSH_PLY__GZ_MAX_DECODERS; ++i)
+  {
+    msh_ply__gz_decoder_t* d = gz->decoders[i];
+    if (!d) { continue; }
+    MSH_PLY_FREE(d->in);
+    MSH_PLY_FREE(d->out);
+    MSH_PLY_FREE(d);
+  }
+  for (size_t i = 0; i < msh_ply_array_len(gz->checkpoints); ++i)
+  {
+    MSH_PLY_FREE(gz->checkpoints[i].window);
+  }
+  msh_ply_array_free(gz->checkpoints);
+#if defined(MSH_PLY_USE_THREADS)
+  msh_ply__mutex_term(&gz->mutex);
+#endif
+  if (gz->src.close) { gz->src.close(gz->src.user_data); }
+  MSH_PLY_FREE(gz);
+}
+
+// If the file starts with gzip magic number, its I/O backend is wrapped with the decoder. Mapped
+// files are read through their backend instead, as the mapping only holds compressed bytes.
+MSH_PLY_PRIVATE int32_t
+msh_ply__detect_compression(msh_ply_t* pf)
+{
+  uint8_t magic[2] = {0};
+  if (pf->_io.read_at == msh_ply__gz_read_at) { return MSH_PLY_NO_ERR; }
+  if (msh_ply__read_bytes(pf, 0, magic, 2) != 2) { return MSH_PLY_NO_ERR; }
+  if (magic[0] != 0x1f || magic[1] != 0x8b) { return MSH_PLY_NO_ERR; }
+
+  msh_ply__gz_reader_t* gz = (msh_ply__gz_reader_t*)MSH_PLY_MALLOC(sizeof(*gz));
+  if (!gz) { return MSH_PLY_FILE_OPEN_ERR; }
+  memset(gz, 0, sizeof(*gz));
+  gz->src = pf->_io;
+  msh_ply__gz_checkpoint_t start;
+  memset(&start, 0, sizeof(start));
+  start.state = MSH_PLY__GZ_MEMBER_HEADER;
+  msh_ply_array_push(gz->checkpoints, start);
+#if defined(MSH_PLY_USE_THREADS)
+  msh_ply__mutex_init(&gz->mutex);
+#endif
+  msh_ply__unmap_file(pf);
+  pf->_io.read_at   = msh_ply__gz_read_at;
+  pf->_io.size      = NULL;
+  pf->_io.close     = msh_ply__gz_close;
+  pf->_io.user_data = gz;
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__parse_ply_cmd(char* line, msh_ply_t* pf)
+{
+  char cmd_str[MSH_PLY_MAX_STR_LEN];
+  if (sscanf(line, "%s", cmd_str))
+  {
+    if (!strcmp(cmd_str, "ply"))
+    {
+      pf->valid = true;
+      return MSH_PLY_NO_ERR;
+    }
+  }
+  return MSH_PLY_INVALID_FILE_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__parse_format_cmd(char* line, msh_ply_t* pf)
+{
+  char cmd[MSH_PLY_MAX_STR_LEN];
+  char frmt_str[MSH_PLY_MAX_STR_LEN];
+  char frmt_ver_str[MSH_PLY_MAX_STR_LEN];
+  if (sscanf(line, "%s %s %s", &cmd[0], &frmt_str[0], &frmt_ver_str[0]) != 3)
+  {
+    return MSH_PLY_FORMAT_CMD_ERR;
+  }
+  if (!strcmp("ascii", frmt_str)) { pf->format = (int32_t)MSH_PLY_ASCII; }
+  else if (!strcmp("binary_little_endian", frmt_str))
+  {
+    pf->format = (int32_t)MSH_PLY_LITTLE_ENDIAN;
+  }
+  else if (!strcmp("binary_big_endian", frmt_str))
+  {
+    pf->format = (int32_t)MSH_PLY_BIG_ENDIAN;
+  }
+  else
+  {
+    return MSH_PLY_INVALID_FORMAT_ERR;
+  }
+  pf->format_version = atoi(frmt_ver_str);
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__parse_element_cmd(char* line, msh_ply_t* pf)
+{
+  char cmd[MSH_PLY_MAX_STR_LEN];
+  msh_ply_element_t el = msh_ply__element_zero_init();
+  int32_t el_count     = 0;
+  el.properties        = NULL;
+  if (sscanf(line, "%s %s %d", &cmd[0], &el.name[0], &el_count) != 3)
+  {
+    return MSH_PLY_ELEMENT_CMD_ERR;
+  }
+  el.count = el_count;
+  msh_ply_array_push_in(&pf->_arena, pf->elements, el);
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__parse_property_cmd(char* line, msh_ply_t* pf)
+{
+  char cmd[MSH_PLY_MAX_STR_LEN];
+  char type_str[MSH_PLY_MAX_STR_LEN];
+  char list_str[MSH_PLY_MAX_STR_LEN];
+  char list_type_str[MSH_PLY_MAX_STR_LEN];
+  int32_t valid_format = 0;
+
+  msh_ply_element_t* el = msh_ply_array_back(pf->elements);
+  msh_ply_property_t pr = msh_ply__property_zero_init();
+  // Try to parse regular property format
+  if (sscanf(line, "%s %s %s", &cmd[0], &type_str[0], (char*)&pr.name) == 3)
+  {
+    msh_ply__string_to_property_type(type_str, &pr.type, &pr.byte_size);
+    pr.list_type      = MSH_PLY_INVALID;
+    pr.list_byte_size = 0;
+    pr.list_count     = 1;
+    valid_format      = 1;
+  }
+
+  // Try to parse list property format
+  cmd[0]           = 0;
+  type_str[0]      = 0;
+  list_str[0]      = 0;
+  list_type_str[0] = 0;
+  if (sscanf(line,
+             "%s %s %s %s %s",
+             &cmd[0],
+             &list_str[0],
+             &list_type_str[0],
+             &type_str[0],
+             (char*)&pr.name) == 5)
+  {
+    if (strcmp(list_str, "list")) { return MSH_PLY_PROPERTY_CMD_ERR; }
+    msh_ply__string_to_property_type(type_str, &pr.type, &pr.byte_size);
+    msh_ply__string_to_property_type(list_type_str,
+                                     &pr.list_type,
+                                     &pr.list_byte_size);
+    pr.list_count = 0;
+    valid_format  = 1;
+  }
+  pr.total_byte_size = 0;
+  pr.total_count     = 0;
+  // Both failed
+  if (!valid_format) { return MSH_PLY_PROPERTY_CMD_ERR; }
+
+  // Either succeded
+  msh_ply_array_push_in(&pf->_arena, el->properties, pr);
+
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__parse_command(char* cmd, char* line, msh_ply_t* pf)
+{
+  if (!strcmp(cmd, "ply")) { return msh_ply__parse_ply_cmd(line, pf); }
+  if (!strcmp(cmd, "format")) { return msh_ply__parse_format_cmd(line, pf); }
+  if (!strcmp(cmd, "element")) { return msh_ply__parse_element_cmd(line, pf); }
+  if (!strcmp(cmd, "property"))
+  {
+    return msh_ply__parse_property_cmd(line, pf);
+  }
+  return MSH_PLY_UNRECOGNIZED_CMD_ERR;
+}
+
+// Header is read in small blocks through the I/O backend, and split into lines. Like with 'fgets',
+// lines that do not fit within 'line' are returned in pieces.
+typedef struct msh_ply__header_reader
+{
+  char buf[4096];
+  int64_t offset;   // File offset of the first byte of 'buf'
+  size_t pos;
+  size_t size;
+} msh_ply__header_reader_t;
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__read_header_line(const msh_ply_t* pf,
+                          msh_ply__header_reader_t* reader,
+                          char* line,
+                          size_t line_cap)
+{
+  size_t len = 0;
+  while (len + 1 < line_cap)
+  {
+    if (reader->pos == reader->size)
+    {
+      reader->offset += (int64_t)reader->size;
+      reader->pos  = 0;
+      reader->size = msh_ply__read_bytes(pf, reader->offset, reader->buf, sizeof(reader->buf));
+      if (!reader->size) { break; }
+    }
+    char c      = reader->buf[reader->pos++];
+    line[len++] = c;
+    if (c == '\n') { break; }
+  }
+  line[len] = 0;
+  return (len > 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Dequantization
+//
+// Files written with 'msh_ply_set_quantization' describe quantized properties in header comments:
+//   comment quantized <element> <x> <y> <z> <bits> <min x> <min y> <min z> <max x> <max y> <max z>
+//   comment octahedral <element> <nx> <ny> <nz> <bits>
+// Float and double requests of these properties are decoded as usual, and then dequantized in
+// place. Octahedral normals keep two coordinates only - requests of all three of them read the
+// second one twice, to reserve space for the third.
+
+MSH_PLY_PRIVATE void
+msh_ply__parse_comment(const char* line, msh_ply_t* pf)
+{
+  msh_ply__quantizer_t q;
+  memset(&q, 0, sizeof(q));
+  int32_t n = sscanf(line,
+                     "comment quantized %63s %31s %31s %31s %d %f %f %f %f %f %f",
+                     q.element_name,
+                     q.names[0],
+                     q.names[1],
+                     q.names[2],
+                     &q.bits,
+                     &q.min[0],
+                     &q.min[1],
+                     &q.min[2],
+                     &q.max[0],
+                     &q.max[1],
+                     &q.max[2]);
+  if (n == 11 && q.bits >= 1 && q.bits <= 32)
+  {
+    msh_ply_array_push_in(&pf->_arena, pf->_quantizers, q);
+    return;
+  }
+  n = sscanf(line,
+             "comment octahedral %63s %31s %31s %31s %d",
+             q.element_name,
+             q.names[0],
+             q.names[1],
+             q.names[2],
+             &q.bits);
+  if (n == 5 && q.bits >= 2 && q.bits <= 16)
+  {
+    q.is_normal = 1;
+    msh_ply_array_push_in(&pf->_arena, pf->_quantizers, q);
+  }
+}
+
+// Finds the positions of the properties of quantizer 'q' among the names requested by 'desc'.
+// Returns the number of properties that were found, while missing ones get index -1.
+MSH_PLY_PRIVATE int32_t
+msh_ply__find_quantized_properties(const msh_ply_desc_t* desc,
+                                   const msh_ply__quantizer_t* q,
+                                   int32_t* idx)
+{
+  int32_t n_found = 0;
+  if (strcmp(desc->element_name, q->element_name)) { return 0; }
+  for (int32_t c = 0; c < 3; ++c)
+  {
+    idx[c] = -1;
+    for (int32_t i = 0; i < desc->num_properties; ++i)
+    {
+      if (!strcmp(desc->property_names[i], q->names[c]))
+      {
+        idx[c] = i;
+        n_found++;
+        break;
+      }
+    }
+  }
+  return n_found;
+}
+
+// Returns the property names 'desc' should be read with - either its own names, or their copy
+// stored in 'names', where the third coordinates of octahedral normals are replaced.
+MSH_PLY_PRIVATE const char**
+msh_ply__get_names_to_read(const msh_ply_t* pf, const msh_ply_desc_t* desc, const char** names)
+{
+  const char** result = desc->property_names;
+  if (desc->num_properties > MSH_PLY_MAX_REQ_PROPERTIES) { return result; }
+  for (size_t i = 0; i < msh_ply_array_len(pf->_quantizers); ++i)
+  {
+    const msh_ply__quantizer_t* q = &pf->_quantizers[i];
+    int32_t idx[3];
+    if (!q->is_normal || msh_ply__find_quantized_properties(desc, q, idx) != 3) { continue; }
+    if (result != names)
+    {
+      memcpy(names, desc->property_names, desc->num_properties * sizeof(const char*));
+      result = names;
+    }
+    names[idx[2]] = q->names[1];
+  }
+  return result;
+}
+
+#define MSH_PLY__DEQUANTIZE_POSITIONS(T)                                       \
+  {                                                                            \
+    T* values = (T*)data;                                                      \
+    for (int32_t c = 0; c < 3; ++c)                                            \
+    {                                                                          \
+      if (idx[c] < 0) { continue; }                                            \
+      T offset = (T)q->min[c];                                                 \
+      T scale  = (T)(((double)q->max[c] - q->min[c]) / (double)max_value);     \
+      for (int32_t i = 0; i < n_rows; ++i)                                     \
+      {                                                                        \
+        T* value = &values[(size_t)i * row_stride + idx[c] * column_stride];   \
+        *value   = offset + *value * scale;                                    \
+      }                                                                        \
+    }                                                                          \
+  }
+
+#define MSH_PLY__DEQUANTIZE_NORMALS(T)                                         \
+  {                                                                            \
+    T* values = (T*)data;                                                      \
+    T scale   = (T)(1.0 / (double)max_value);                                  \
+    for (int32_t i = 0; i < n_rows; ++i)                                       \
+    {                                                                          \
+      T* row = &values[(size_t)i * row_stride];                                \
+      T* x   = &row[idx[0] * column_stride];                                   \
+      T* y   = &row[idx[1] * column_stride];                                   \
+      T* z   = &row[idx[2] * column_stride];                                   \
+      T u    = *x * scale;                                                     \
+      T v    = *y * scale;                                                     \
+      T w    = (T)1 - (u < 0 ? -u : u) - (v < 0 ? -v : v);                     \
+      T t    = w < 0 ? -w : (T)0;                                              \
+      u += u >= 0 ? -t : t;                                                    \
+      v += v >= 0 ? -t : t;                                                    \
+      T length = (T)sqrt((double)(u * u + v * v + w * w));                     \
+      *x       = u / length;                                                   \
+      *y       = v / length;                                                   \
+      *z       = w / length;                                                   \
+    }                                                                          \
+  }
+
+// Dequantizes 'n_rows' rows of data read with 'desc'. Only integer properties are converted, so
+// that files with unrelated comments are left alone. Properties read into separate arrays are
+// stored 'n_rows' values apart, one after another.
+MSH_PLY_PRIVATE void
+msh_ply__dequantize(const msh_ply_t* pf, const msh_ply_desc_t* desc, int32_t n_rows)
+{
+  if (desc->list_type != MSH_PLY_INVALID || n_rows <= 0) { return; }
+  if (desc->data_type != MSH_PLY_FLOAT && desc->data_type != MSH_PLY_DOUBLE) { return; }
+  uint8_t* data = *(uint8_t**)desc->data;
+  if (!data || msh_ply_is_mapped_data(pf, data)) { return; }
+  const msh_ply_element_t* el = msh_ply_find_element(pf, desc->element_name);
+  if (!el) { return; }
+
+  size_t row_stride    = desc->property_data ? 1 : (size_t)desc->num_properties;
+  size_t column_stride = desc->property_data ? (size_t)n_rows : 1;
+  for (size_t i = 0; i < msh_ply_array_len(pf->_quantizers); ++i)
+  {
+    const msh_ply__quantizer_t* q = &pf->_quantizers[i];
+    int32_t idx[3];
+    int32_t n_found = msh_ply__find_quantized_properties(desc, q, idx);
+    if (n_found == 0 || (q->is_normal && n_found != 3)) { continue; }
+
+    int32_t is_integer = 1;
+    for (int32_t c = 0; c < (q->is_normal ? 2 : 3); ++c)
+    {
+      const msh_ply_property_t* pr = msh_ply_find_property(el, q->names[c]);
+      if (idx[c] < 0) { continue; }
+      if (!pr || pr->type == MSH_PLY_FLOAT || pr->type == MSH_PLY_DOUBLE) { is_integer = 0; }
+    }
+    if (!is_integer) { continue; }
+
+    if (q->is_normal)
+    {
+      int32_t max_value = (1 << (q->bits - 1)) - 1;
+      if (desc->data_type == MSH_PLY_FLOAT) { MSH_PLY__DEQUANTIZE_NORMALS(float); }
+      else
+      {
+        MSH_PLY__DEQUANTIZE_NORMALS(double);
+      }
+    }
+    else
+    {
+      uint64_t max_value = ((uint64_t)1 << q->bits) - 1;
+      if (desc->data_type == MSH_PLY_FLOAT) { MSH_PLY__DEQUANTIZE_POSITIONS(float); }
+      else
+      {
+        MSH_PLY__DEQUANTIZE_POSITIONS(double);
+      }
+    }
+  }
+}
+
+#undef MSH_PLY__DEQUANTIZE_POSITIONS
+#undef MSH_PLY__DEQUANTIZE_NORMALS
+
+MSH_PLY_DEF int32_t
+msh_ply_parse_header(msh_ply_t* pf)
+{
+  int32_t line_no = 0;
+  char line[MSH_PLY_MAX_STR_LEN];
+  int32_t err_code = 0;
+  msh_ply__header_reader_t reader;
+  reader.offset = 0;
+  reader.pos    = 0;
+  reader.size   = 0;
+  err_code      = msh_ply__detect_compression(pf);
+  if (err_code) { return err_code; }
+  while (msh_ply__read_header_line(pf, &reader, line, MSH_PLY_MAX_STR_LEN))
+  {
+    line_no++;
+    char cmd[MSH_PLY_MAX_STR_LEN];
+    if (sscanf(line, "%s", cmd) != (unsigned)1)
+    {
+      return MSH_PLY_LINE_PARSE_ERR;
+    }
+    if (!strcmp(cmd, "end_header")) break;
+    if (!strcmp(cmd, "comment"))
+    {
+      msh_ply__parse_comment(line, pf);
+      continue;
+    }
+    if (!strcmp(cmd, "obj_info")) continue;
+    err_code = msh_ply__parse_command(cmd, line, pf);
+    if (err_code) break;
+  }
+  pf->_header_size = (int32_t)(reader.offset + (int64_t)reader.pos);
+  if (err_code == MSH_PLY_NO_ERR) { pf->_parsed = 1; }
+  return err_code;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Header probing
+//
+// Probing parses the header straight from the buffer of the first read into 'msh_ply_info_t',
+// with no file handle, no stdio buffering and no allocations. Headers that continue past the
+// first MSH_PLY_PROBE_SIZE bytes are read again into a larger heap buffer.
+
+#define MSH_PLY__PROBE_MAX_SIZE (1 << 20)
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__probe_property(char (*args)[64], int32_t n_args, msh_ply_info_t* info)
+{
+  if (!info->num_elements) { return MSH_PLY_PROPERTY_CMD_ERR; }
+  if (info->num_properties == MSH_PLY_INFO_MAX_PROPERTIES) { return MSH_PLY_PROBE_CAPACITY_ERR; }
+  msh_ply_info_element_t* el  = &info->elements[info->num_elements - 1];
+  msh_ply_info_property_t* pr = &info->properties[info->num_properties];
+  const char* name            = NULL;
+  int16_t byte_size           = 0;
+  int16_t list_byte_size      = 0;
+  pr->type                    = MSH_PLY_INVALID;
+  pr->list_type               = MSH_PLY_INVALID;
+  if (n_args == 2)
+  {
+    msh_ply__string_to_property_type(args[0], &pr->type, &byte_size);
+    name = args[1];
+  }
+  else if (n_args == 4 && !strcmp(args[0], "list"))
+  {
+    msh_ply__string_to_property_type(args[1], &pr->list_type, &list_byte_size);
+    msh_ply__string_to_property_type(args[2], &pr->type, &byte_size);
+    name = args[3];
+    if (pr->list_type == MSH_PLY_INVALID) { return MSH_PLY_PROPERTY_CMD_ERR; }
+  }
+  if (!name || pr->type == MSH_PLY_INVALID) { return MSH_PLY_PROPERTY_CMD_ERR; }
+  strncpy(pr->name, name, sizeof(pr->name) - 1);
+  pr->name[sizeof(pr->name) - 1] = 0;
+
+  // Negative row size marks elements with lists, until the whole header is parsed
+  if (pr->list_type != MSH_PLY_INVALID) { el->row_size = -1; }
+  else if (el->row_size >= 0) { el->row_size += byte_size; }
+  el->num_properties++;
+  info->num_properties++;
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__probe_line(const char* line, msh_ply_info_t* info)
+{
+  char cmd[32];
+  char args[4][64];
+  int32_t n = sscanf(line, "%31s %63s %63s %63s %63s", cmd, args[0], args[1], args[2], args[3]);
+  if (n < 1) { return MSH_PLY_LINE_PARSE_ERR; }
+  if (!strcmp(cmd, "comment") || !strcmp(cmd, "obj_info")) { return MSH_PLY_NO_ERR; }
+  if (!strcmp(cmd, "format"))
+  {
+    if (n < 3) { return MSH_PLY_FORMAT_CMD_ERR; }
+    if (!strcmp("ascii", args[0])) { info->format = MSH_PLY_ASCII; }
+    else if (!strcmp("binary_little_endian", args[0])) { info->format = MSH_PLY_LITTLE_ENDIAN; }
+    else if (!strcmp("binary_big_endian", args[0])) { info->format = MSH_PLY_BIG_ENDIAN; }
+    else { return MSH_PLY_INVALID_FORMAT_ERR; }
+    info->format_version = atoi(args[1]);
+    return MSH_PLY_NO_ERR;
+  }
+  if (!strcmp(cmd, "element"))
+  {
+    if (n < 3) { return MSH_PLY_ELEMENT_CMD_ERR; }
+    if (info->num_elements == MSH_PLY_INFO_MAX_ELEMENTS) { return MSH_PLY_PROBE_CAPACITY_ERR; }
+    msh_ply_info_element_t* el = &info->elements[info->num_elements++];
+    memcpy(el->name, args[0], sizeof(el->name));
+    el->count          = atoi(args[1]);
+    el->first_property = info->num_properties;
+    el->num_properties = 0;
+    el->row_size       = 0;
+    return MSH_PLY_NO_ERR;
+  }
+  if (!strcmp(cmd, "property")) { return msh_ply__probe_property(args, n - 1, info); }
+  return MSH_PLY_UNRECOGNIZED_CMD_ERR;
+}
+
+// Parses complete lines of the header stored in 'buf'. Header size remains zero if 'end_header'
+// is not within the first 'size' bytes.
+MSH_PLY_PRIVATE int32_t
+msh_ply__probe_header(const char* buf, size_t size, msh_ply_info_t* info)
+{
+  char line[MSH_PLY_MAX_STR_LEN];
+  const char* cp       = buf;
+  const char* end      = buf + size;
+  info->header_size    = 0;
+  info->num_elements   = 0;
+  info->num_properties = 0;
+  if (size < 3 || strncmp(buf, "ply", 3)) { return MSH_PLY_INVALID_FILE_ERR; }
+  while (cp < end)
+  {
+    const char* eol = (const char*)memchr(cp, '\n', end - cp);
+    if (!eol) { break; }
+    size_t len = MSH_PLY_MIN((size_t)(eol - cp), MSH_PLY_MAX_STR_LEN - 1);
+    memcpy(line, cp, len);
+    line[len] = 0;
+    cp        = eol + 1;
+    if (!strncmp(line, "ply", 3)) { continue; }
+    if (!strncmp(line, "end_header", 10))
+    {
+      info->header_size = (int32_t)(cp - buf);
+      break;
+    }
+    int32_t err_code = msh_ply__probe_line(line, info);
+    if (err_code) { return err_code; }
+  }
+  for (int32_t i = 0; i < info->num_elements; ++i)
+  {
+    if (info->elements[i].row_size < 0) { info->elements[i].row_size = 0; }
+  }
+  return MSH_PLY_NO_ERR;
+}
+
+// Compressed headers can only be reached by inflating the stream, which is left to the decoder.
+MSH_PLY_PRIVATE int32_t
+msh_ply__probe_compressed(const char* filename, msh_ply_info_t* info)
+{
+  msh_ply_t* pf = msh_ply_open(filename, "rb");
+  if (!pf) { return MSH_PLY_FILE_OPEN_ERR; }
+  int32_t err_code     = msh_ply_parse_header(pf);
+  info->format         = (msh_ply_format_t)pf->format;
+  info->format_version = pf->format_version;
+  info->header_size    = pf->_header_size;
+  info->num_elements   = 0;
+  info->num_properties = 0;
+  for (size_t i = 0; i < msh_ply_array_len(pf->elements) && !err_code; ++i)
+  {
+    const msh_ply_element_t* el = &pf->elements[i];
+    int32_t n_properties        = (int32_t)msh_ply_array_len(el->properties);
+    if (info->num_elements == MSH_PLY_INFO_MAX_ELEMENTS ||
+        info->num_properties + n_properties > MSH_PLY_INFO_MAX_PROPERTIES)
+    {
+      err_code = MSH_PLY_PROBE_CAPACITY_ERR;
+      break;
+    }
+    msh_ply_info_element_t* info_el = &info->elements[info->num_elements++];
+    memcpy(info_el->name, el->name, sizeof(info_el->name));
+    info_el->count          = (int32_t)el->count;
+    info_el->first_property = info->num_properties;
+    info_el->num_properties = n_properties;
+    info_el->row_size       = 0;
+    bool has_lists          = false;
+    for (int32_t j = 0; j < n_properties; ++j)
+    {
+      const msh_ply_property_t* pr    = &el->properties[j];
+      msh_ply_info_property_t* info_pr = &info->properties[info->num_properties++];
+      memcpy(info_pr->name, pr->name, sizeof(info_pr->name));
+      info_pr->type      = pr->type;
+      info_pr->list_type = pr->list_type;
+      has_lists |= (pr->list_type != MSH_PLY_INVALID);
+      info_el->row_size += pr->byte_size;
+    }
+    if (has_lists) { info_el->row_size = 0; }
+  }
+  msh_ply_close(pf);
+  return err_code;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_probe(const char* filename, msh_ply_info_t* info)
+{
+  info->num_elements   = 0;
+  info->num_properties = 0;
+  info->header_size    = 0;
+  FILE* fp             = filename ? fopen(filename, "rb") : NULL;
+  if (!fp) { return MSH_PLY_FILE_OPEN_ERR; }
+  setvbuf(fp, NULL, _IONBF, 0);
+
+  char probe_buf[MSH_PLY_PROBE_SIZE];
+  char* buf        = probe_buf;
+  size_t cap       = sizeof(probe_buf);
+  size_t size      = fread(buf, 1, cap, fp);
+  int32_t err_code = MSH_PLY_NO_ERR;
+  const uint8_t* magic = (const uint8_t*)buf;
+  info->is_compressed  = (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b);
+  while (!info->is_compressed)
+  {
+    err_code = msh_ply__probe_header(buf, size, info);
+    if (err_code || info->header_size) { break; }
+    if (size < cap || cap >= MSH_PLY__PROBE_MAX_SIZE)
+    {
+      err_code = MSH_PLY_INVALID_FILE_ERR;
+      break;
+    }
+    char* new_buf = (char*)MSH_PLY_MALLOC(cap * 8);
+    if (!new_buf)
+    {
+      err_code = MSH_PLY_FILE_OPEN_ERR;
+      break;
+    }
+    memcpy(new_buf, buf, size);
+    if (buf != probe_buf) { MSH_PLY_FREE(buf); }
+    buf = new_buf;
+    cap *= 8;
+    size += fread(buf + size, 1, cap - size, fp);
+  }
+  if (buf != probe_buf) { MSH_PLY_FREE(buf); }
+  fclose(fp);
+  if (info->is_compressed) { err_code = msh_ply__probe_compressed(filename, info); }
+  return err_code;
+}
+
+typedef struct msh_ply__probe_worker
+{
+  const char** filenames;
+  msh_ply_info_t* infos;
+  int32_t* err_codes;
+  int32_t num_files;
+  int32_t first;
+  int32_t stride;
+  int32_t first_failed;
+  int32_t err_code;
+} msh_ply__probe_worker_t;
+
+MSH_PLY_PRIVATE void
+msh_ply__probe_files_worker(void* params)
+{
+  msh_ply__probe_worker_t* w = (msh_ply__probe_worker_t*)params;
+  for (int32_t i = w->first; i < w->num_files; i += w->stride)
+  {
+    int32_t err_code = msh_ply_probe(w->filenames[i], &w->infos[i]);
+    if (w->err_codes) { w->err_codes[i] = err_code; }
+    if (err_code && !w->err_code)
+    {
+      w->err_code     = err_code;
+      w->first_failed = i;
+    }
+  }
+}
+
+// Files are interleaved between workers, so that directories sorted by size are split evenly.
+MSH_PLY_DEF int32_t
+msh_ply_probe_files(const char** filenames,
+                    int32_t num_files,
+                    msh_ply_info_t* infos,
+                    int32_t* err_codes,
+                    int32_t num_threads)
+{
+  msh_ply_t runner;
+  memset(&runner, 0, sizeof(runner));
+  runner._num_threads = num_threads;
+  int32_t n_workers   = MSH_PLY_MIN(msh_ply__get_num_threads(&runner), num_files);
+  if (n_workers < 1) { return MSH_PLY_NO_ERR; }
+
+  msh_ply__probe_worker_t workers[MSH_PLY_MAX_THREADS];
+  for (int32_t i = 0; i < n_workers; ++i)
+  {
+    workers[i].filenames    = filenames;
+    workers[i].infos        = infos;
+    workers[i].err_codes    = err_codes;
+    workers[i].num_files    = num_files;
+    workers[i].first        = i;
+    workers[i].stride       = n_workers;
+    workers[i].first_failed = num_files;
+    workers[i].err_code     = MSH_PLY_NO_ERR;
+  }
+  msh_ply__run_tasks(&runner,
+                     msh_ply__probe_files_worker,
+                     workers,
+                     sizeof(msh_ply__probe_worker_t),
+                     n_workers);
+
+  int32_t err_code     = MSH_PLY_NO_ERR;
+  int32_t first_failed = num_files;
+  for (int32_t i = 0; i < n_workers; ++i)
+  {
+    if (workers[i].err_code && workers[i].first_failed < first_failed)
+    {
+      first_failed = workers[i].first_failed;
+      err_code     = workers[i].err_code;
+    }
+  }
+  return err_code;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ASCII parsing helpers
+//
+// ASCII element data is read in large blocks, which are split on the line boundaries. Lines are
+// then converted to the binary layout (in system endianness) by number of threads, each working
+// on a contiguous range of lines.
+
+typedef struct msh_ply__text_block
+{
+  char* buf;
+  size_t cap;
+  int64_t offset;       // File offset of the first byte that was not yet consumed
+  int32_t n_rows;    // Number of complete rows in the last block
+  size_t n_bytes;    // Number of bytes taken by those rows
+  msh_ply__block_reader_t* reader;
+  msh_ply__block_reader_t own_reader;
+} msh_ply__text_block_t;
+
+// Blocks are read through 'reader', or through a reader owned by the block if it is NULL.
+MSH_PLY_PRIVATE int32_t
+msh_ply__text_block_init(msh_ply__text_block_t* block,
+                         const msh_ply_t* pf,
+                         msh_ply__block_reader_t* reader,
+                         int64_t offset,
+                         size_t cap)
+{
+  block->cap     = cap;
+  block->buf     = NULL;
+  block->offset  = offset;
+  block->n_rows  = 0;
+  block->n_bytes = 0;
+  block->reader  = reader;
+  if (!block->reader)
+  {
+    msh_ply__block_reader_init(&block->own_reader, pf, 0);
+    block->reader = &block->own_reader;
+  }
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__text_block_term(msh_ply__text_block_t* block)
+{
+  if (block->reader == &block->own_reader) { msh_ply__block_reader_term(block->reader); }
+  block->buf = NULL;
+  block->cap = 0;
+}
+
+// Reads next block of complete lines, up to 'max_rows' of them. Each line in the block is
+// terminated with '\n', even if the last line of the file is not.
+MSH_PLY_PRIVATE int32_t
+msh_ply__text_block_next(msh_ply__text_block_t* block, int32_t max_rows)
+{
+  block->offset += (int64_t)block->n_bytes;
+  block->n_rows  = 0;
+  block->n_bytes = 0;
+  if (max_rows <= 0) { return MSH_PLY_NO_ERR; }
+
+  for (;;)
+  {
+    size_t n_read = 0;
+    block->buf =
+      (char*)msh_ply__block_reader_next(block->reader, block->offset, block->cap, &n_read);
+    if (!block->buf) { return MSH_PLY_ASCII_FILE_READ_ERR; }
+    if (n_read == 0) { return MSH_PLY_ASCII_FILE_EOF_ERR; }
+    int32_t reached_eof = (n_read < block->cap);
+
+    const char* cp  = block->buf;
+    const char* end = block->buf + n_read;
+    while (block->n_rows < max_rows && cp < end)
+    {
+      const char* line_end = (const char*)memchr(cp, '\n', end - cp);
+      if (!line_end)
+      {
+        if (!reached_eof) { break; }
+        // Last line of the file has no line break - fake it.
+        block->buf[n_read] = '\n';
+        line_end           = end;
+      }
+      cp = line_end + 1;
+      block->n_rows++;
+    }
+    block->n_bytes = (size_t)(cp - block->buf);
+
+    if (block->n_rows > 0 || reached_eof) { break; }
+
+    // Single line did not fit within the block - need to grow it.
+    block->cap = 2 * block->cap;
+  }
+
+  if (block->n_rows == 0) { return MSH_PLY_ASCII_FILE_EOF_ERR; }
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE MSH_PLY_INLINE const char*
+msh_ply__skip_spaces(const char* cp)
+{
+  while (*cp == ' ' || *cp == '\t' || *cp == '\r') { cp++; }
+  return cp;
+}
+
+MSH_PLY_PRIVATE MSH_PLY_INLINE const char*
+msh_ply__skip_token(const char* cp)
+{
+  cp = msh_ply__skip_spaces(cp);
+  while (*cp != ' ' && *cp != '\t' && *cp != '\r' && *cp != '\n') { cp++; }
+  return cp;
+}
+
+// Fallback for numbers that cannot be exactly converted by the fast path
+MSH_PLY_PRIVATE const char*
+msh_ply__parse_double_slow(const char* cp, double* value)
+{
+  char token[64];
+  const char* token_end = msh_ply__skip_token(cp);
+  size_t len            = (size_t)(token_end - cp);
+  if (len > sizeof(token) - 1) { len = sizeof(token) - 1; }
+  memcpy(token, cp, len);
+  token[len] = 0;
+  *value     = strtod(token, NULL);
+  return token_end;
+}
+
+// Parses a floating point number. Numbers whose significand fits within 53 bits and with small
+// exponents are converted exactly with a single multiplication/division (Clinger's fast path),
+// the rest is handled by strtod.
+MSH_PLY_PRIVATE const char*
+msh_ply__parse_double(const char* cp, double* value)
+{
+  static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                 1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                 1e18, 1e19, 1e20, 1e21, 1e22};
+  cp                = msh_ply__skip_spaces(cp);
+  const char* start = cp;
+
+  int32_t negative = 0;
+  if (*cp == '-')
+  {
+    negative = 1;
+    cp++;
+  }
+  else if (*cp == '+')
+  {
+    cp++;
+  }
+
+  uint64_t mantissa   = 0;
+  int32_t n_digits    = 0;
+  int32_t n_sig       = 0;
+  int32_t exponent    = 0;
+  int32_t is_truncated = 0;
+  while ((unsigned)(*cp - '0') < 10)
+  {
+    if (n_sig < 19)
+    {
+      mantissa = mantissa * 10 + (uint64_t)(*cp - '0');
+      n_sig += (mantissa != 0);
+    }
+    else
+    {
+      exponent++;
+      is_truncated |= (*cp != '0');
+    }
+    n_digits++;
+    cp++;
+  }
+  if (*cp == '.')
+  {
+    cp++;
+    while ((unsigned)(*cp - '0') < 10)
+    {
+      if (n_sig < 19)
+      {
+        mantissa = mantissa * 10 + (uint64_t)(*cp - '0');
+        n_sig += (mantissa != 0);
+        exponent--;
+      }
+      else
+      {
+        is_truncated |= (*cp != '0');
+      }
+      n_digits++;
+      cp++;
+    }
+  }
+  // Things like 'nan' or 'inf'
+  if (!n_digits) { return msh_ply__parse_double_slow(start, value); }
+
+  if (*cp == 'e' || *cp == 'E')
+  {
+    cp++;
+    int32_t exp_negative = 0;
+    if (*cp == '-')
+    {
+      exp_negative = 1;
+      cp++;
+    }
+    else if (*cp == '+')
+    {
+      cp++;
+    }
+    int32_t exp_value = 0;
+    while ((unsigned)(*cp - '0') < 10)
+    {
+      if (exp_value < 100000) { exp_value = exp_value * 10 + (*cp - '0'); }
+      cp++;
+    }
+    exponent += exp_negative ? -exp_value : exp_value;
+  }
+
+  if (is_truncated || mantissa > (1ull << 53) || exponent < -22 ||
+      exponent > 22)
+  {
+    return msh_ply__parse_double_slow(start, value);
+  }
+
+  double result = (double)mantissa;
+  if (exponent < 0) { result /= pow10[-exponent]; }
+  else
+  {
+    result *= pow10[exponent];
+  }
+  *value = negative ? -result : result;
+  return cp;
+}
+
+MSH_PLY_PRIVATE const char*
+msh_ply__parse_int(const char* cp, int64_t* value)
+{
+  cp                = msh_ply__skip_spaces(cp);
+  const char* start = cp;
+  int32_t negative  = 0;
+  if (*cp == '-')
+  {
+    negative = 1;
+    cp++;
+  }
+  else if (*cp == '+')
+  {
+    cp++;
+  }
+  uint64_t result = 0;
+  while ((unsigned)(*cp - '0') < 10)
+  {
+    result = result * 10 + (uint64_t)(*cp - '0');
+    cp++;
+  }
+  // Some files store integers as floating point numbers
+  if (*cp == '.' || *cp == 'e' || *cp == 'E')
+  {
+    double tmp = 0.0;
+    cp         = msh_ply__parse_double(start, &tmp);
+    *value     = (int64_t)tmp;
+    return cp;
+  }
+  *value = negative ? -(int64_t)result : (int64_t)result;
+  return cp;
+}
+
+// Scans ascii element starting at file 'offset', moving the 'offset' past its last row.
+// If requested, also computes the total sizes of the list properties.
+MSH_PLY_PRIVATE int32_t
+msh_ply__scan_element_ascii(msh_ply_t* pf,
+                            msh_ply_element_t* el,
+                            int64_t* offset,
+                            int32_t compute_sizes)
+{
+  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+  msh_ply__text_block_t block;
+  int32_t err_code =
+    msh_ply__text_block_init(&block, pf, NULL, *offset, MSH_PLY_BLOCK_SIZE);
+  if (err_code) { return err_code; }
+
+  int32_t rows_left = el->count;
+  while (rows_left > 0)
+  {
+    err_code = msh_ply__text_block_next(&block, rows_left);
+    if (err_code) { break; }
+    rows_left -= block.n_rows;
+    if (!compute_sizes) { continue; }
+
+    const char* cp = block.buf;
+    for (int32_t i = 0; i < block.n_rows; ++i)
+    {
+      for (int32_t j = 0; j < num_properties; ++j)
+      {
+        msh_ply_property_t* pr = &el->properties[j];
+        int64_t count          = 1;
+        if (pr->list_type == MSH_PLY_INVALID) { cp = msh_ply__skip_token(cp); }
+        else
+        {
+          cp = msh_ply__parse_int(cp, &count);
+          if (count < 0) { count = 0; }
+          for (int64_t k = 0; k < count; ++k) { cp = msh_ply__skip_token(cp); }
+        }
+        pr->total_byte_size += pr->list_byte_size + count * pr->byte_size;
+        pr->total_count += (int32_t)count;
+      }
+      cp = (const char*)memchr(cp, '\n', block.buf + block.n_bytes - cp) + 1;
+    }
+  }
+
+  *offset = block.offset + (int64_t)block.n_bytes;
+  msh_ply__text_block_term(&block);
+  return err_code;
+}
+// Computes offsets (of values, past the list count) and counts of all properties within a single
+// binary row starting at 'src'. Returns size of the row, or 0 if the row does not fit within
+// 'src_size' bytes.
+// Rows of elements with exactly one list property are located from a single list count. Returns
+// the index of such list property, or -1 if the element has no lists or more than one. The
+// offset of the list count within the row and the size of the row without list values are
+// stored in 'count_offset' and 'fixed_size', while 'offsets' receive positions of all properties
+// when the list is empty.
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_list_layout(const msh_ply_element_t* el,
+                         int32_t* count_offset,
+                         int32_t* fixed_size,
+                         int32_t* offsets)
+{
+  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+  int32_t list_idx       = -1;
+  *count_offset          = 0;
+  *fixed_size            = 0;
+  for (int32_t j = 0; j < num_properties; ++j)
+  {
+    const msh_ply_property_t* pr = &el->properties[j];
+    if (pr->list_type != MSH_PLY_INVALID)
+    {
+      if (list_idx >= 0) { return -1; }
+      list_idx      = j;
+      *count_offset = *fixed_size;
+      *fixed_size += pr->list_byte_size;
+      offsets[j] = *fixed_size;
+      continue;
+    }
+    offsets[j] = *fixed_size;
+    *fixed_size += pr->byte_size;
+  }
+  return list_idx;
+}
+
+MSH_PLY_PRIVATE size_t
+msh_ply__get_row_layout(const msh_ply_element_t* el,
+                        const uint8_t* src,
+                        size_t src_size,
+                        int8_t swap_endianness,
+                        int32_t* offsets,
+                        int32_t* counts)
+{
+  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+  size_t row_size        = 0;
+  for (int32_t j = 0; j < num_properties; ++j)
+  {
+    const msh_ply_property_t* pr = &el->properties[j];
+    int32_t count                = 1;
+    if (pr->list_type != MSH_PLY_INVALID)
+    {
+      if (row_size + pr->list_byte_size > src_size) { return 0; }
+      count = msh_ply__get_data_as_int((void*)(src + row_size),
+                                       pr->list_type,
+                                       swap_endianness);
+      if (count < 0) { count = 0; }
+      row_size += pr->list_byte_size;
+    }
+    offsets[j] = (int32_t)row_size;
+    counts[j]  = count;
+    row_size += (size_t)count * pr->byte_size;
+    if (row_size > src_size) { return 0; }
+  }
+  return row_size;
+}
+
+#define MSH_PLY__SPLIT_ROWS (1 << 16)
+
+// Binary counterpart of 'msh_ply__scan_element_ascii'. Rows are walked in large blocks, as the
+// position of a row is only known once the list counts of all previous rows were read.
+MSH_PLY_PRIVATE int32_t
+msh_ply__scan_element_binary(msh_ply_t* pf,
+                             msh_ply_element_t* el,
+                             int64_t* offset,
+                             int32_t compute_sizes)
+{
+  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+  if (num_properties > MSH_PLY_MAX_PROPERTIES) { return MSH_PLY_BINARY_PARSE_ERR; }
+
+  int8_t swap_endianness = (pf->_system_format != pf->format);
+  int32_t offsets[MSH_PLY_MAX_PROPERTIES];
+  int32_t counts[MSH_PLY_MAX_PROPERTIES];
+  int32_t count_offset = 0;
+  int32_t fixed_size   = 0;
+  int32_t list_idx     = msh_ply__get_list_layout(el, &count_offset, &fixed_size, offsets);
+  for (int32_t j = 0; j < num_properties; ++j) { counts[j] = 1; }
+
+  int32_t err_code  = MSH_PLY_NO_ERR;
+  size_t cap        = MSH_PLY_BLOCK_SIZE;
+  int32_t rows_left = el->count;
+  msh_ply__block_reader_t reader;
+  msh_ply__block_reader_init(&reader, pf, 0);
+  if (compute_sizes)
+  {
+    msh_ply_array_free_in(&pf->_arena, el->split_offsets);
+    msh_ply_array_free_in(&pf->_arena, el->split_totals);
+  }
+  while (rows_left > 0)
+  {
+    const uint8_t* src = NULL;
+    size_t src_size    = 0;
+    if (pf->_map)
+    {
+      if ((size_t)*offset >= pf->_map_size)
+      {
+        err_code = MSH_PLY_BINARY_PARSE_ERR;
+        break;
+      }
+      src      = pf->_map + *offset;
+      src_size = pf->_map_size - (size_t)*offset;
+    }
+    else
+    {
+      src = msh_ply__block_reader_next(&reader, *offset, cap, &src_size);
+      if (!src)
+      {
+        err_code = MSH_PLY_BINARY_PARSE_ERR;
+        break;
+      }
+    }
+
+    size_t pos     = 0;
+    int32_t n_rows = 0;
+    while (rows_left > 0)
+    {
+      size_t row_size = 0;
+      if (list_idx >= 0)
+      {
+        if ((size_t)fixed_size > src_size - pos) { break; }
+        int32_t count = msh_ply__get_data_as_int(src + pos + count_offset,
+                                                 el->properties[list_idx].list_type,
+                                                 swap_endianness);
+        counts[list_idx] = (count < 0) ? 0 : count;
+        row_size = fixed_size + (size_t)counts[list_idx] * el->properties[list_idx].byte_size;
+        if (row_size > src_size - pos) { break; }
+      }
+      else
+      {
+        row_size = msh_ply__get_row_layout(el,
+                                           src + pos,
+                                           src_size - pos,
+                                           swap_endianness,
+                                           offsets,
+                                           counts);
+      }
+      if (!row_size) { break; }
+      if (compute_sizes)
+      {
+        if ((el->count - rows_left) % MSH_PLY__SPLIT_ROWS == 0)
+        {
+          msh_ply_array_push_in(&pf->_arena, el->split_offsets, *offset + (int64_t)pos);
+          for (int32_t j = 0; j < num_properties; ++j)
+          {
+            msh_ply_array_push_in(&pf->_arena, el->split_totals, el->properties[j].total_count);
+          }
+        }
+        for (int32_t j = 0; j < num_properties; ++j)
+        {
+          msh_ply_property_t* pr = &el->properties[j];
+          pr->total_count += counts[j];
+          pr->total_byte_size +=
+            pr->list_byte_size + (size_t)counts[j] * pr->byte_size;
+        }
+      }
+      pos += row_size;
+      rows_left--;
+      n_rows++;
+    }
+    *offset += (int64_t)pos;
+
+    if (rows_left > 0 && n_rows == 0)
+    {
+      // Either the file ended early, or a single row did not fit within the block.
+      if (pf->_map || src_size < cap)
+      {
+        err_code = MSH_PLY_BINARY_PARSE_ERR;
+        break;
+      }
+      cap = 2 * cap;
+    }
+  }
+
+  msh_ply__block_reader_term(&reader);
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__can_precalculate_sizes(msh_ply_element_t* el)
+{
+  int32_t can_precalculate = 1;
+  for (size_t i = 0; i < msh_ply_array_len(el->properties); ++i)
+  {
+    msh_ply_property_t* pr = &el->properties[i];
+    if (pr->list_type != MSH_PLY_INVALID && pr->list_count == 0)
+    {
+      can_precalculate = 0;
+      break;
+    }
+  }
+
+  return can_precalculate;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__synchronize_list_sizes(msh_ply_t* pf)
+{
+  int32_t error_code = MSH_PLY_NO_ERR;
+  for (size_t k = 0; k < msh_ply_array_len(pf->descriptors); ++k)
+  {
+    msh_ply_desc_t* desc  = pf->descriptors[k];
+    msh_ply_element_t* el = NULL;
+    for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+    {
+      msh_ply_element_t* cur_el = &pf->elements[i];
+      if (!strcmp(desc->element_name, cur_el->name))
+      {
+        el = cur_el;
+        break;
+      }
+    }
+
+    if (el == NULL)
+    {
+      error_code = MSH_PLY_ELEMENT_NOT_FOUND_ERR;
+      return error_code;
+    }
+
+    // Scalar properties requested along with a list must not override the hint of that list
+    const char* names[MSH_PLY_MAX_REQ_PROPERTIES];
+    const char** property_names = msh_ply__get_names_to_read(pf, desc, names);
+    uint8_t list_size_hint      = desc->list_size_hint;
+    int32_t has_list            = 0;
+    for (int32_t i = 0; i < desc->num_properties; ++i)
+    {
+      int32_t found = 0;
+      for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
+      {
+        msh_ply_property_t* pr = &el->properties[j];
+        if (!strcmp(pr->name, property_names[i]))
+        {
+          if (pr->list_type != MSH_PLY_INVALID)
+          {
+            pr->list_count = list_size_hint;
+            has_list       = 1;
+            if (desc->list_data == NULL) { desc->list_type = pr->list_type; }
+          }
+          else
+          {
+            pr->list_count = 1;
+          }
+          found = 1;
+          break;
+        }
+      }
+      if (!found)
+      {
+        error_code = MSH_PLY_PROPERTY_NOT_FOUND_ERR;
+        return error_code;
+      }
+    }
+    if (!has_list) { desc->list_size_hint = 1; }
+  }
+
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_parse_contents(msh_ply_t* pf)
+{
+  int32_t err_code = MSH_PLY_NO_ERR;
+  err_code         = msh_ply__synchronize_list_sizes(pf);
+  if (err_code) { return err_code; }
+
+  int64_t offset = pf->_header_size;
+  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+  {
+    // If user did not ask for last element, we can skip reading it all together
+    int32_t can_skip = (i == msh_ply_array_len(pf->elements) - 1);
+    if (can_skip)
+    {
+      for (size_t j = 0; j < msh_ply_array_len(pf->descriptors); ++j)
+      {
+        if (!strcmp(pf->descriptors[j]->element_name, pf->elements[i].name))
+        {
+          can_skip = 0;
+          break;
+        }
+      }
+    }
+    if (can_skip) { continue; }
+
+    msh_ply_element_t* el  = &pf->elements[i];
+    int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+
+    if (el->count <= 0 || num_properties <= 0) { continue; }
+    el->file_anchor = offset;
+
+    // Determine if any of the properties in the element has list
+    int32_t can_precalculate_size = msh_ply__can_precalculate_sizes(el);
+    if (can_precalculate_size)
+    {
+      // This is a faster path, as we can just calculate the size required by element in one go.
+      int64_t elem_size = 0;
+      for (int32_t j = 0; j < num_properties; ++j)
+      {
+        msh_ply_property_t* pr = &el->properties[j];
+        pr->total_byte_size =
+          (size_t)pr->byte_size * pr->list_count * (size_t)el->count;
+        elem_size += pr->byte_size * pr->list_count;
+        if (pr->list_type != MSH_PLY_INVALID)
+        {
+          pr->total_byte_size += (size_t)pr->list_byte_size * el->count;
+          elem_size += pr->list_byte_size;
+        }
+        pr->total_count += pr->list_count * el->count;
+      }
+
+      if (pf->format != MSH_PLY_ASCII) { offset += el->count * elem_size; }
+      else
+      {
+        err_code = msh_ply__scan_element_ascii(pf, el, &offset, 0);
+        if (err_code) { return err_code; }
+      }
+    }
+    else
+    {
+      // There exists a list property. We need to calculate required size via pass through
+      if (pf->format == MSH_PLY_ASCII)
+      {
+        err_code = msh_ply__scan_element_ascii(pf, el, &offset, 1);
+      }
+      else
+      {
+        err_code = msh_ply__scan_element_binary(pf, el, &offset, 1);
+      }
+      if (err_code) { return err_code; }
+    }
+  }
+
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_element_count(const msh_ply_element_t* el, int32_t* count)
+{
+  int32_t err_code = MSH_PLY_NO_ERR;
+  *count           = el->count;
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_element_size(const msh_ply_element_t* el, size_t* size)
+{
+  int32_t err_code = MSH_PLY_NO_ERR;
+
+  *size = 0;
+  for (size_t i = 0; i < msh_ply_array_len(el->properties); ++i)
+  {
+    *size += el->properties[i].total_byte_size;
+  }
+  return err_code;
+}
+
+// Parses a value of 'type' and stores it at 'dst'. Returns NULL if the line has no more values.
+// Text that is not a number still counts as a value, so every value moves past some text.
+MSH_PLY_PRIVATE MSH_PLY_INLINE const char*
+msh_ply__ascii_to_value(uint8_t** dst, const char* src, const int32_t type)
+{
+  int64_t int_value   = 0;
+  double double_value = 0.0;
+  src                 = msh_ply__skip_spaces(src);
+  if (*src == '\n') { return NULL; }
+  const char* value_end = (type == MSH_PLY_FLOAT || type == MSH_PLY_DOUBLE)
+                            ? msh_ply__parse_double(src, &double_value)
+                            : msh_ply__parse_int(src, &int_value);
+  if (value_end == src) { value_end = msh_ply__skip_token(src); }
+  msh_ply__store_value(dst, type, int_value, double_value);
+  return value_end;
+}
+
+// Converts a single line of ascii text into a binary row. If list sizes are fixed, exactly
+// 'list_count' elements are written for list properties, regardless of what the line contains.
+// Returns pointer to the beginning of the next line, or NULL if the line ends before all of the
+// values of the row (including all elements its lists claim to have) are read.
+MSH_PLY_PRIVATE const char*
+msh_ply__parse_ascii_row(const msh_ply_element_t* el,
+                         const char* cp,
+                         uint8_t** dst)
+{
+  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+  for (int32_t j = 0; j < num_properties && cp; ++j)
+  {
+    const msh_ply_property_t* pr = &el->properties[j];
+    if (pr->list_type == MSH_PLY_INVALID)
+    {
+      cp = msh_ply__ascii_to_value(dst, cp, pr->type);
+      continue;
+    }
+
+    int64_t count = 0;
+    cp            = msh_ply__skip_spaces(cp);
+    if (*cp == '\n') { return NULL; }
+    cp = msh_ply__parse_int(cp, &count);
+    if (count < 0) { count = 0; }
+    int64_t n_written = pr->list_count ? pr->list_count : count;
+    msh_ply__store_value(dst, pr->list_type, n_written, 0.0);
+    for (int64_t k = 0; k < count && cp; ++k)
+    {
+      if (k < n_written) { cp = msh_ply__ascii_to_value(dst, cp, pr->type); }
+      else
+      {
+        cp = msh_ply__skip_spaces(cp);
+        cp = (*cp == '\n') ? NULL : msh_ply__skip_token(cp);
+      }
+    }
+    if (!cp) { return NULL; }
+    for (int64_t k = count; k < n_written; ++k)
+    {
+      memset(*dst, 0, pr->byte_size);
+      *dst += pr->byte_size;
+    }
+  }
+  if (!cp) { return NULL; }
+  while (*cp != '\n') { cp++; }
+  return cp + 1;
+}
+
+typedef struct msh_ply__ascii_chunk
+{
+  const msh_ply_element_t* el;
+  const char* text;
+  const char* text_end;
+  int32_t n_rows;
+  size_t fixed_row_size;   // Zero if rows have variable size
+
+  uint8_t* dst;
+  size_t dst_size;
+  size_t dst_cap;
+  int32_t err_code;
+} msh_ply__ascii_chunk_t;
+
+MSH_PLY_PRIVATE void
+msh_ply__parse_ascii_chunk(void* params)
+{
+  msh_ply__ascii_chunk_t* chunk = (msh_ply__ascii_chunk_t*)params;
+  const char* cp                = chunk->text;
+  uint8_t* dst                  = chunk->dst;
+
+  // Besides values read from the text, lists of fixed size can be padded with zeros.
+  size_t n_padded = 0;
+  for (size_t j = 0; j < msh_ply_array_len(chunk->el->properties); ++j)
+  {
+    n_padded += chunk->el->properties[j].list_count;
+  }
+
+  for (int32_t i = 0; i < chunk->n_rows; ++i)
+  {
+    if (!chunk->fixed_row_size)
+    {
+      // Each value read takes at least one character of text, and at most 8 bytes in binary.
+      const char* line_end =
+        (const char*)memchr(cp, '\n', (size_t)(chunk->text_end - cp));
+      size_t max_row_size  = ((size_t)(line_end - cp) + 1 + n_padded) * 8;
+      size_t dst_size      = (size_t)(dst - chunk->dst);
+      if (dst_size + max_row_size > chunk->dst_cap)
+      {
+        size_t new_cap = MSH_PLY_MAX(2 * chunk->dst_cap, dst_size + max_row_size);
+        uint8_t* new_dst = (uint8_t*)MSH_PLY_REALLOC(chunk->dst, new_cap);
+        if (!new_dst)
+        {
+          chunk->err_code = MSH_PLY_OUT_OF_MEMORY_ERR;
+          return;
+        }
+        chunk->dst     = new_dst;
+        chunk->dst_cap = new_cap;
+        dst            = chunk->dst + dst_size;
+      }
+    }
+    cp = msh_ply__parse_ascii_row(chunk->el, cp, &dst);
+    if (!cp)
+    {
+      chunk->err_code = MSH_PLY_ASCII_PARSE_ERR;
+      break;
+    }
+  }
+  chunk->dst_size = (size_t)(dst - chunk->dst);
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_element_data_ascii(msh_ply_t* pf,
+                                const msh_ply_element_t* el,
+                                void** storage)
+{
+  int32_t err_code       = MSH_PLY_NO_ERR;
+  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+
+  // Rows have fixed size if none of the list properties has variable length
+  size_t fixed_row_size = 0;
+  for (int32_t j = 0; j < num_properties; ++j)
+  {
+    const msh_ply_property_t* pr = &el->properties[j];
+    if (pr->list_type != MSH_PLY_INVALID && pr->list_count == 0)
+    {
+      fixed_row_size = 0;
+      break;
+    }
+    fixed_row_size += pr->list_byte_size + pr->list_count * pr->byte_size;
+  }
+
+  msh_ply__text_block_t block;
+  err_code = msh_ply__text_block_init(&block, pf, NULL, el->file_anchor, MSH_PLY_BLOCK_SIZE);
+  if (err_code) { return err_code; }
+
+  int32_t num_threads = msh_ply__get_num_threads(pf);
+  msh_ply__ascii_chunk_t chunks[MSH_PLY_MAX_THREADS];
+  uint8_t* dst      = (uint8_t*)*storage;
+  int32_t rows_left = el->count;
+  while (rows_left > 0)
+  {
+    err_code = msh_ply__text_block_next(&block, rows_left);
+    if (err_code) { break; }
+    rows_left -= block.n_rows;
+
+    // Split lines of the block between chunks of roughly equal byte size
+    int32_t n_chunks       = 0;
+    size_t chunk_size      = block.n_bytes / num_threads + 1;
+    const char* cp         = block.buf;
+    const char* block_end  = block.buf + block.n_bytes;
+    int32_t rows_remaining = block.n_rows;
+    while (rows_remaining > 0)
+    {
+      msh_ply__ascii_chunk_t* chunk = &chunks[n_chunks++];
+      chunk->el                     = el;
+      chunk->text                   = cp;
+      chunk->n_rows                 = 0;
+      chunk->fixed_row_size         = fixed_row_size;
+      chunk->dst                    = NULL;
+      chunk->dst_size               = 0;
+      chunk->dst_cap                = 0;
+      chunk->err_code               = MSH_PLY_NO_ERR;
+      const char* chunk_end         = cp + chunk_size;
+      if (n_chunks == num_threads) { chunk_end = block_end; }
+      while (rows_remaining > 0 && cp < chunk_end)
+      {
+        cp = (const char*)memchr(cp, '\n', block_end - cp) + 1;
+        chunk->n_rows++;
+        rows_remaining--;
+      }
+      chunk->text_end = cp;
+      if (fixed_row_size)
+      {
+        chunk->dst = dst;
+        dst += chunk->n_rows * fixed_row_size;
+      }
+    }
+
+    msh_ply__run_tasks(pf,
+                       msh_ply__parse_ascii_chunk,
+                       chunks,
+                       sizeof(msh_ply__ascii_chunk_t),
+                       n_chunks);
+
+    for (int32_t i = 0; i < n_chunks; ++i)
+    {
+      if (chunks[i].err_code) { err_code = chunks[i].err_code; }
+      if (fixed_row_size) { continue; }
+      // Merge per-chunk buffers
+      if (!err_code) { memcpy(dst, chunks[i].dst, chunks[i].dst_size); }
+      dst += chunks[i].dst_size;
+      MSH_PLY_FREE(chunks[i].dst);
+    }
+    if (err_code) { break; }
+  }
+
+  msh_ply__text_block_term(&block);
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_element_data_binary(msh_ply_t* pf,
+                                 const msh_ply_element_t* el,
+                                 void** storage,
+                                 size_t storage_size)
+{
+  int32_t err_code = MSH_PLY_NO_ERR;
+  if (msh_ply__read_bytes(pf, el->file_anchor, *storage, storage_size) != storage_size)
+  {
+    return MSH_PLY_BINARY_PARSE_ERR;
+  }
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_element_data(msh_ply_t* pf,
+                          const msh_ply_element_t* el,
+                          void** storage,
+                          size_t storage_size)
+{
+  int32_t err_code = MSH_PLY_NO_ERR;
+  if (pf->format == MSH_PLY_ASCII)
+  {
+    err_code = msh_ply__get_element_data_ascii(pf, el, storage);
+  }
+  else
+  {
+    err_code = msh_ply__get_element_data_binary(pf, el, storage, storage_size);
+  }
+
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_properties_byte_size(msh_ply_element_t* el,
+                                  const char** properties_names,
+                                  int32_t num_properties,
+                                  msh_ply_type_id_t type,
+                                  msh_ply_type_id_t list_type,
+                                  size_t* data_size,
+                                  size_t* list_size)
+{
+  int32_t n_found             = 0;
+  size_t total_data_byte_size = 0;
+  size_t total_list_byte_size = 0;
+  int32_t byte_size           = msh_ply__type_to_byte_size(type);
+  int32_t list_byte_size      = msh_ply__type_to_byte_size(list_type);
+  for (int32_t i = 0; i < num_properties; ++i)
+  {
+    for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
+    {
+      msh_ply_property_t* pr = &el->properties[j];
+      if (!strcmp(pr->name, properties_names[i]))
+      {
+        n_found++;
+        total_data_byte_size += pr->total_count * byte_size;
+        total_list_byte_size += list_byte_size;
+      }
+    }
+  }
+  if (n_found != num_properties) return MSH_PLY_PROPERTY_NOT_FOUND_ERR;
+
+  total_list_byte_size *= el->count;
+
+  *data_size = total_data_byte_size;
+  *list_size = total_list_byte_size;
+
+  return MSH_PLY_NO_ERR;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Row decoding
+//
+// Requested properties are first resolved into a read plan, describing where each of them lives
+// within a row of the element. Rows are then converted to the requested layout by
+// 'msh_ply__decode_rows'. Decoding does not modify any of the element state, so the same code
+// serves whole elements as well as chunks of rows.
+
+#define MSH_PLY__CONVERT_LOOP(TD, TS)                                          \
+  for (; i < count; ++i)                                                       \
+  {                                                                            \
+    TS value;                                                                  \
+    memcpy(&value, src + i * sizeof(TS), sizeof(TS));                          \
+    TD result = (TD)value;                                                     \
+    memcpy(dst + i * sizeof(TD), &result, sizeof(TD));                         \
+  }
+
+#define MSH_PLY__CONVERT_FROM(TS)                                              \
+  switch (dst_type)                                                            \
+  {                                                                            \
+    case MSH_PLY_INT8: MSH_PLY__CONVERT_LOOP(int8_t, TS); break;               \
+    case MSH_PLY_UINT8: MSH_PLY__CONVERT_LOOP(uint8_t, TS); break;             \
+    case MSH_PLY_INT16: MSH_PLY__CONVERT_LOOP(int16_t, TS); break;             \
+    case MSH_PLY_UINT16: MSH_PLY__CONVERT_LOOP(uint16_t, TS); break;           \
+    case MSH_PLY_INT32: MSH_PLY__CONVERT_LOOP(int32_t, TS); break;             \
+    case MSH_PLY_UINT32: MSH_PLY__CONVERT_LOOP(uint32_t, TS); break;           \
+    case MSH_PLY_FLOAT: MSH_PLY__CONVERT_LOOP(float, TS); break;               \
+    case MSH_PLY_DOUBLE: MSH_PLY__CONVERT_LOOP(double, TS); break;             \
+    default: break;                                                            \
+  }
+
+// Converts 'count' contiguous values of 'src_type' into 'dst_type'. Both buffers use system
+// byte order.
+MSH_PLY_PRIVATE void
+msh_ply__convert_block(uint8_t* dst,
+                       msh_ply_type_id_t dst_type,
+                       const uint8_t* src,
+                       msh_ply_type_id_t src_type,
+                       int32_t count)
+{
+  int32_t i = 0;
+  // Integers of the same size convert by reinterpreting their bits
+  if (dst_type == src_type ||
+      (dst_type == MSH_PLY_INT32 && src_type == MSH_PLY_UINT32) ||
+      (dst_type == MSH_PLY_UINT32 && src_type == MSH_PLY_INT32))
+  {
+    memcpy(dst, src, (size_t)count * msh_ply__type_to_byte_size(dst_type));
+    return;
+  }
+
+  if (src_type == MSH_PLY_UINT8 && dst_type == MSH_PLY_FLOAT)
+  {
+#if defined(MSH_PLY__AVX2)
+    for (; i + 8 <= count; i += 8)
+    {
+      __m128i bytes = _mm_loadl_epi64((const __m128i*)(src + i));
+      __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+      _mm256_storeu_ps((float*)(dst + 4 * i), values);
+    }
+#endif
+#if defined(MSH_PLY__SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+      __m128i lo    = _mm_unpacklo_epi8(bytes, zero);
+      __m128i hi    = _mm_unpackhi_epi8(bytes, zero);
+      float* out    = (float*)(dst + 4 * i);
+      _mm_storeu_ps(out + 0, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+      _mm_storeu_ps(out + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+      _mm_storeu_ps(out + 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+      _mm_storeu_ps(out + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+    }
+#endif
+  }
+  else if (src_type == MSH_PLY_DOUBLE && dst_type == MSH_PLY_FLOAT)
+  {
+#if defined(MSH_PLY__AVX2)
+    for (; i + 4 <= count; i += 4)
+    {
+      __m256d values = _mm256_loadu_pd((const double*)(src + 8 * i));
+      _mm_storeu_ps((float*)(dst + 4 * i), _mm256_cvtpd_ps(values));
+    }
+#endif
+#if defined(MSH_PLY__SSE2)
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd((const double*)(src + 8 * i)));
+      __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd((const double*)(src + 8 * i + 16)));
+      _mm_storeu_ps((float*)(dst + 4 * i), _mm_movelh_ps(lo, hi));
+    }
+#endif
+  }
+  else if (src_type == MSH_PLY_FLOAT && dst_type == MSH_PLY_DOUBLE)
+  {
+#if defined(MSH_PLY__AVX2)
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 values = _mm_loadu_ps((const float*)(src + 4 * i));
+      _mm256_storeu_pd((double*)(dst + 8 * i), _mm256_cvtps_pd(values));
+    }
+#endif
+#if defined(MSH_PLY__SSE2)
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 values = _mm_loadu_ps((const float*)(src + 4 * i));
+      _mm_storeu_pd((double*)(dst + 8 * i), _mm_cvtps_pd(values));
+      _mm_storeu_pd((double*)(dst + 8 * i + 16),
+                    _mm_cvtps_pd(_mm_movehl_ps(values, values)));
+    }
+#endif
+  }
+
+  // Remaining values, and all of the other type combinations
+  switch (src_type)
+  {
+    case MSH_PLY_INT8:
+    {
+      MSH_PLY__CONVERT_FROM(int8_t);
+      break;
+    }
+    case MSH_PLY_UINT8:
+    {
+      MSH_PLY__CONVERT_FROM(uint8_t);
+      break;
+    }
+    case MSH_PLY_INT16:
+    {
+      MSH_PLY__CONVERT_FROM(int16_t);
+      break;
+    }
+    case MSH_PLY_UINT16:
+    {
+      MSH_PLY__CONVERT_FROM(uint16_t);
+      break;
+    }
+    case MSH_PLY_INT32:
+    {
+      MSH_PLY__CONVERT_FROM(int32_t);
+      break;
+    }
+    case MSH_PLY_UINT32:
+    {
+      MSH_PLY__CONVERT_FROM(uint32_t);
+      break;
+    }
+    case MSH_PLY_FLOAT:
+    {
+      MSH_PLY__CONVERT_FROM(float);
+      break;
+    }
+    case MSH_PLY_DOUBLE:
+    {
+      MSH_PLY__CONVERT_FROM(double);
+      break;
+    }
+    default:
+      break;
+  }
+}
+#undef MSH_PLY__CONVERT_FROM
+#undef MSH_PLY__CONVERT_LOOP
+
+// Copies 'count' values placed 'stride' bytes apart into a contiguous array.
+MSH_PLY_PRIVATE void
+msh_ply__gather(uint8_t* dst,
+                const uint8_t* src,
+                size_t stride,
+                int32_t byte_size,
+                int32_t count)
+{
+  switch (byte_size)
+  {
+    case 1:
+      for (int32_t i = 0; i < count; ++i) { dst[i] = src[i * stride]; }
+      break;
+    case 2:
+      for (int32_t i = 0; i < count; ++i) { memcpy(dst + 2 * i, src + i * stride, 2); }
+      break;
+    case 4:
+      for (int32_t i = 0; i < count; ++i) { memcpy(dst + 4 * i, src + i * stride, 4); }
+      break;
+    case 8:
+      for (int32_t i = 0; i < count; ++i) { memcpy(dst + 8 * i, src + i * stride, 8); }
+      break;
+  }
+}
+
+// Copies 'count' contiguous values into places 'stride' bytes apart.
+MSH_PLY_PRIVATE void
+msh_ply__scatter(uint8_t* dst,
+                 size_t stride,
+                 const uint8_t* src,
+                 int32_t byte_size,
+                 int32_t count)
+{
+  switch (byte_size)
+  {
+    case 1:
+      for (int32_t i = 0; i < count; ++i) { dst[i * stride] = src[i]; }
+      break;
+    case 2:
+      for (int32_t i = 0; i < count; ++i) { memcpy(dst + i * stride, src + 2 * i, 2); }
+      break;
+    case 4:
+      for (int32_t i = 0; i < count; ++i) { memcpy(dst + i * stride, src + 4 * i, 4); }
+      break;
+    case 8:
+      for (int32_t i = 0; i < count; ++i) { memcpy(dst + i * stride, src + 8 * i, 8); }
+      break;
+  }
+}
+
+#define MSH_PLY__COLUMN_BLOCK_SIZE 256
+#define MSH_PLY__DECODE_BATCH_SIZE 1024
+#define MSH_PLY__SPARSE_READ_GAP   4096
+#define MSH_PLY__VAR_BATCH_SIZE    1024
+#define MSH_PLY__STAGE_SIZE        4096
+
+// Converts a column of 'count' values of 'src_type' placed 'src_stride' bytes apart, stored in
+// file byte order, into a column of 'dst_type' values placed 'dst_stride' bytes apart. Strided
+// values are gathered into small contiguous blocks, so that the bulk kernels can be used.
+MSH_PLY_PRIVATE void
+msh_ply__convert_column(uint8_t* dst,
+                        size_t dst_stride,
+                        msh_ply_type_id_t dst_type,
+                        const uint8_t* src,
+                        size_t src_stride,
+                        msh_ply_type_id_t src_type,
+                        int32_t count,
+                        int8_t swap_endianness)
+{
+  int32_t src_byte_size = msh_ply__type_to_byte_size(src_type);
+  int32_t dst_byte_size = msh_ply__type_to_byte_size(dst_type);
+  int32_t src_packed    = (src_stride == (size_t)src_byte_size);
+  int32_t dst_packed    = (dst_stride == (size_t)dst_byte_size);
+  if (src_packed && dst_packed && !swap_endianness)
+  {
+    msh_ply__convert_block(dst, dst_type, src, src_type, count);
+    return;
+  }
+
+  double src_block[MSH_PLY__COLUMN_BLOCK_SIZE];
+  double dst_block[MSH_PLY__COLUMN_BLOCK_SIZE];
+  for (int32_t i = 0; i < count; i += MSH_PLY__COLUMN_BLOCK_SIZE)
+  {
+    int32_t n = MSH_PLY_MIN(count - i, MSH_PLY__COLUMN_BLOCK_SIZE);
+    const uint8_t* src_values = src + (size_t)i * src_stride;
+    if (!src_packed || swap_endianness)
+    {
+      msh_ply__gather((uint8_t*)src_block, src_values, src_stride, src_byte_size, n);
+      if (swap_endianness)
+      {
+        msh_ply__swap_bytes((uint8_t*)src_block, src_byte_size, n);
+      }
+      src_values = (const uint8_t*)src_block;
+    }
+
+    uint8_t* dst_values = dst + (size_t)i * dst_stride;
+    if (dst_packed)
+    {
+      msh_ply__convert_block(dst_values, dst_type, src_values, src_type, n);
+    }
+    else
+    {
+      msh_ply__convert_block((uint8_t*)dst_block, dst_type, src_values, src_type, n);
+      msh_ply__scatter(dst_values, dst_stride, (uint8_t*)dst_block, dst_byte_size, n);
+    }
+  }
+}
+
+// Converts 'count' contiguous values of 'src_type' stored in file byte order into 'dst_type'
+// values stored in system byte order.
+MSH_PLY_PRIVATE void
+msh_ply__convert_values(uint8_t* dst,
+                        msh_ply_type_id_t dst_type,
+                        const uint8_t* src,
+                        msh_ply_type_id_t src_type,
+                        int32_t count,
+                        int8_t swap_endianness)
+{
+  if (dst_type == src_type)
+  {
+    int32_t byte_size = msh_ply__type_to_byte_size(dst_type);
+    memcpy(dst, src, (size_t)count * byte_size);
+    if (swap_endianness) { msh_ply__swap_bytes(dst, byte_size, count); }
+    return;
+  }
+  msh_ply__convert_column(dst,
+                          msh_ply__type_to_byte_size(dst_type),
+                          dst_type,
+                          src,
+                          msh_ply__type_to_byte_size(src_type),
+                          src_type,
+                          count,
+                          swap_endianness);
+}
+
+// Run of requested properties that are stored next to each other in a row, and share a type.
+typedef struct msh_ply__read_span
+{
+  int32_t src_offset;
+  int32_t dst_offset;
+  int32_t count;
+  int32_t dst_column;
+  msh_ply_type_id_t src_type;
+} msh_ply__read_span_t;
+
+typedef struct msh_ply__read_plan
+{
+  const msh_ply_element_t* el;
+  msh_ply_type_id_t type;
+  msh_ply_type_id_t list_type;
+  int8_t swap_endianness;
+  int32_t num_requested;
+  int32_t property_idx[MSH_PLY_MAX_REQ_PROPERTIES];
+
+  // Layout of fixed size rows. Only valid if 'src_row_size' is not zero. If 'column_stride' is
+  // not zero, each requested property is stored in its own array, 'column_stride' bytes after the
+  // previous one - rows are then 'dst_row_size' bytes apart within each array.
+  size_t src_row_size;
+  size_t dst_row_size;
+  size_t column_stride;
+  int32_t counts[MSH_PLY_MAX_PROPERTIES];
+  int32_t num_spans;
+  msh_ply__read_span_t spans[MSH_PLY_MAX_REQ_PROPERTIES];
+
+  // Layout of variable size rows of elements with a single list property. Such rows are located
+  // from a single list count. Only valid if 'list_idx' is not negative.
+  int32_t list_idx;
+  int32_t list_count_offset;
+  int32_t list_value_size;
+  int32_t list_fixed_size;
+  int32_t req_offsets[MSH_PLY_MAX_REQ_PROPERTIES];
+} msh_ply__read_plan_t;
+
+// Prepares reading of properties 'property_names' from the element 'el'. List properties are
+// assumed to have 'list_count' elements in every row only if 'use_list_hints' is set - otherwise
+// the list counts are read from each row.
+MSH_PLY_PRIVATE int32_t
+msh_ply__read_plan_init(msh_ply__read_plan_t* plan,
+                        const msh_ply_t* pf,
+                        const msh_ply_element_t* el,
+                        const char** property_names,
+                        int32_t num_requested_properties,
+                        msh_ply_type_id_t requested_type,
+                        msh_ply_type_id_t requested_list_type,
+                        int32_t use_list_hints)
+{
+  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+  // NOTE: There is no better fitting error for requests we cannot represent.
+  if (num_requested_properties > MSH_PLY_MAX_REQ_PROPERTIES ||
+      num_properties > MSH_PLY_MAX_PROPERTIES)
+  {
+    return MSH_PLY_PROPERTY_NOT_FOUND_ERR;
+  }
+
+  plan->el            = el;
+  plan->type          = requested_type;
+  plan->list_type     = requested_list_type;
+  plan->num_requested = num_requested_properties;
+  plan->swap_endianness =
+    pf->format != MSH_PLY_ASCII ? (pf->_system_format != pf->format) : 0;
+
+  for (int32_t i = 0; i < num_requested_properties; ++i)
+  {
+    plan->property_idx[i] = -1;
+    for (int32_t j = 0; j < num_properties; ++j)
+    {
+      if (!strcmp(el->properties[j].name, property_names[i]))
+      {
+        plan->property_idx[i] = j;
+        break;
+      }
+    }
+    if (plan->property_idx[i] < 0) { return MSH_PLY_PROPERTY_NOT_FOUND_ERR; }
+  }
+
+  int32_t var_offsets[MSH_PLY_MAX_PROPERTIES];
+  plan->list_idx =
+    msh_ply__get_list_layout(el, &plan->list_count_offset, &plan->list_fixed_size, var_offsets);
+  if (plan->list_idx >= 0)
+  {
+    plan->list_value_size = el->properties[plan->list_idx].byte_size;
+    for (int32_t i = 0; i < num_requested_properties; ++i)
+    {
+      plan->req_offsets[i] = var_offsets[plan->property_idx[i]];
+    }
+  }
+
+  // Precompute the layout if every row has the same size
+  int32_t src_offsets[MSH_PLY_MAX_PROPERTIES];
+  plan->src_row_size  = 0;
+  plan->dst_row_size  = 0;
+  plan->column_stride = 0;
+  plan->num_spans     = 0;
+  for (int32_t j = 0; j < num_properties; ++j)
+  {
+    const msh_ply_property_t* pr = &el->properties[j];
+    plan->counts[j]              = 1;
+    if (pr->list_type != MSH_PLY_INVALID)
+    {
+      if (!use_list_hints || pr->list_count == 0)
+      {
+        plan->src_row_size = 0;
+        return MSH_PLY_NO_ERR;
+      }
+      plan->counts[j] = pr->list_count;
+    }
+    src_offsets[j] = (int32_t)plan->src_row_size + pr->list_byte_size;
+    plan->src_row_size += pr->list_byte_size + plan->counts[j] * pr->byte_size;
+  }
+
+  int32_t byte_size = msh_ply__type_to_byte_size(requested_type);
+  for (int32_t i = 0; i < num_requested_properties; ++i)
+  {
+    int32_t j                    = plan->property_idx[i];
+    const msh_ply_property_t* pr = &el->properties[j];
+    msh_ply__read_span_t* prev =
+      plan->num_spans ? &plan->spans[plan->num_spans - 1] : NULL;
+    if (prev && pr->list_type == MSH_PLY_INVALID && prev->src_type == pr->type &&
+        prev->src_offset + prev->count * pr->byte_size == src_offsets[j])
+    {
+      prev->count += 1;
+    }
+    else
+    {
+      msh_ply__read_span_t* span = &plan->spans[plan->num_spans++];
+      span->src_offset           = src_offsets[j];
+      span->dst_offset           = (int32_t)plan->dst_row_size;
+      span->count                = plan->counts[j];
+      span->dst_column           = i;
+      span->src_type             = pr->type;
+    }
+    plan->dst_row_size += (size_t)plan->counts[j] * byte_size;
+  }
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__decode_rows_split(const msh_ply__read_plan_t* plan,
+                           const uint8_t* src,
+                           size_t src_size,
+                           int32_t n_rows,
+                           uint8_t* dst,
+                           size_t dst_cap,
+                           size_t* src_used,
+                           size_t* dst_used);
+
+// Decodes up to 'n_rows' rows from 'src' into 'dst' (and into 'dst_list', if it is not NULL).
+// Decoding stops early if the next row is not fully contained within 'src_size' bytes, or if its
+// values would not fit within 'dst_cap' bytes. Returns the number of decoded rows, while the number
+// of consumed and produced bytes is stored in 'src_used' and 'dst_used'.
+MSH_PLY_PRIVATE int32_t
+msh_ply__decode_rows(const msh_ply__read_plan_t* plan,
+                     const uint8_t* src,
+                     size_t src_size,
+                     int32_t n_rows,
+                     uint8_t* dst,
+                     size_t dst_cap,
+                     uint8_t* dst_list,
+                     size_t* src_used,
+                     size_t* dst_used)
+{
+  const msh_ply_element_t* el = plan->el;
+  int32_t byte_size           = msh_ply__type_to_byte_size(plan->type);
+  size_t src_pos              = 0;
+  size_t dst_pos              = 0;
+  int32_t i                   = 0;
+  if (plan->column_stride && !plan->src_row_size)
+  {
+    return msh_ply__decode_rows_split(plan, src, src_size, n_rows, dst, dst_cap, src_used,
+                                      dst_used);
+  }
+
+  if (plan->src_row_size)
+  {
+    size_t max_rows = src_size / plan->src_row_size;
+    if (plan->dst_row_size)
+    {
+      max_rows = MSH_PLY_MIN(max_rows, dst_cap / plan->dst_row_size);
+    }
+    if ((size_t)n_rows > max_rows) { n_rows = (int32_t)max_rows; }
+
+    // Spans that need no conversion are copied row by row. Others are converted column by
+    // column, over batches of rows that stay in cache. If no conversions are needed at all,
+    // the byte order of the whole batch is swapped at once. Separate arrays are always filled
+    // column by column.
+    int32_t swap_batch = plan->swap_endianness && !plan->column_stride;
+    for (int32_t k = 0; k < plan->num_spans; ++k)
+    {
+      if (plan->spans[k].src_type != plan->type) { swap_batch = 0; }
+    }
+    for (int32_t batch = 0; batch < n_rows; batch += MSH_PLY__DECODE_BATCH_SIZE)
+    {
+      int32_t n = MSH_PLY_MIN(n_rows - batch, MSH_PLY__DECODE_BATCH_SIZE);
+      const uint8_t* src_rows = src + (size_t)batch * plan->src_row_size;
+      uint8_t* dst_rows       = dst + (size_t)batch * plan->dst_row_size;
+      for (int32_t k = 0; k < plan->num_spans; ++k)
+      {
+        const msh_ply__read_span_t* span = &plan->spans[k];
+        if (span->src_type == plan->type && (!plan->swap_endianness || swap_batch) &&
+            !plan->column_stride)
+        {
+          size_t span_size = (size_t)span->count * byte_size;
+          for (int32_t r = 0; r < n; ++r)
+          {
+            memcpy(dst_rows + r * plan->dst_row_size + span->dst_offset,
+                   src_rows + r * plan->src_row_size + span->src_offset,
+                   span_size);
+          }
+          continue;
+        }
+        int32_t src_byte_size = msh_ply__type_to_byte_size(span->src_type);
+        for (int32_t c = 0; c < span->count; ++c)
+        {
+          uint8_t* column_dst =
+            plan->column_stride
+              ? dst_rows + (size_t)(span->dst_column + c) * plan->column_stride
+              : dst_rows + span->dst_offset + c * byte_size;
+          msh_ply__convert_column(column_dst,
+                                  plan->dst_row_size,
+                                  plan->type,
+                                  src_rows + span->src_offset + c * src_byte_size,
+                                  plan->src_row_size,
+                                  span->src_type,
+                                  n,
+                                  plan->swap_endianness);
+        }
+      }
+      if (swap_batch)
+      {
+        msh_ply__swap_bytes(dst_rows,
+                            byte_size,
+                            (int32_t)(n * plan->dst_row_size / byte_size));
+      }
+    }
+
+    if (dst_list)
+    {
+      for (i = 0; i < n_rows; ++i)
+      {
+        for (int32_t k = 0; k < plan->num_requested; ++k)
+        {
+          int32_t count = plan->counts[plan->property_idx[k]];
+          msh_ply__store_value(&dst_list, plan->list_type, count, count);
+        }
+      }
+    }
+    i       = n_rows;
+    src_pos = (size_t)n_rows * plan->src_row_size;
+    dst_pos = (size_t)n_rows * plan->dst_row_size;
+  }
+  else
+  {
+    // Rows of variable size are decoded in batches, in two passes. The first pass locates the
+    // requested values of each row, while the second one moves the values of the whole batch.
+    // Values that need conversion are staged, so that they are converted in bulk.
+    size_t value_offsets[MSH_PLY__VAR_BATCH_SIZE];
+    int32_t value_counts[MSH_PLY__VAR_BATCH_SIZE];
+    uint8_t stage[MSH_PLY__STAGE_SIZE];
+    int32_t offsets[MSH_PLY_MAX_PROPERTIES];
+    int32_t counts[MSH_PLY_MAX_PROPERTIES];
+    int32_t rows_per_batch = MSH_PLY__VAR_BATCH_SIZE / plan->num_requested;
+    int32_t swap_batch     = plan->swap_endianness;
+    int32_t stop           = 0;
+    for (int32_t k = 0; k < plan->num_requested; ++k)
+    {
+      if (el->properties[plan->property_idx[k]].type != plan->type) { swap_batch = 0; }
+    }
+    while (i < n_rows && !stop)
+    {
+      // First pass - row layout
+      int32_t n             = 0;
+      size_t batch_dst_size = 0;
+      while (n < rows_per_batch && i + n < n_rows)
+      {
+        size_t row_size           = 0;
+        size_t* row_offsets       = &value_offsets[n * plan->num_requested];
+        int32_t* row_counts       = &value_counts[n * plan->num_requested];
+        const uint8_t* row        = src + src_pos;
+        size_t row_bytes_left     = src_size - src_pos;
+        if (plan->list_idx >= 0)
+        {
+          if ((size_t)plan->list_fixed_size > row_bytes_left) { break; }
+          int32_t count = msh_ply__get_data_as_int(row + plan->list_count_offset,
+                                                   el->properties[plan->list_idx].list_type,
+                                                   plan->swap_endianness);
+          if (count < 0) { count = 0; }
+          row_size = plan->list_fixed_size + (size_t)count * plan->list_value_size;
+          if (row_size > row_bytes_left) { break; }
+          for (int32_t k = 0; k < plan->num_requested; ++k)
+          {
+            int32_t j      = plan->property_idx[k];
+            row_offsets[k] = src_pos + plan->req_offsets[k];
+            row_counts[k]  = (j == plan->list_idx) ? count : 1;
+            if (j > plan->list_idx) { row_offsets[k] += (size_t)count * plan->list_value_size; }
+          }
+        }
+        else
+        {
+          row_size =
+            msh_ply__get_row_layout(el, row, row_bytes_left, plan->swap_endianness, offsets, counts);
+          if (!row_size) { break; }
+          for (int32_t k = 0; k < plan->num_requested; ++k)
+          {
+            int32_t j      = plan->property_idx[k];
+            row_offsets[k] = src_pos + offsets[j];
+            row_counts[k]  = counts[j];
+          }
+        }
+
+        size_t dst_row_size = 0;
+        for (int32_t k = 0; k < plan->num_requested; ++k)
+        {
+          dst_row_size += (size_t)row_counts[k] * byte_size;
+        }
+        if (dst_pos + batch_dst_size + dst_row_size > dst_cap) { break; }
+        batch_dst_size += dst_row_size;
+        src_pos += row_size;
+        n++;
+      }
+      if (n < rows_per_batch && i + n < n_rows) { stop = 1; }
+
+      // Second pass - values. Values of the requested type are copied directly, and if their byte
+      // order needs to be swapped, it is swapped for the whole batch at once - unless there are
+      // values of other types as well, in which case they are swapped as part of conversion.
+      uint8_t* batch_dst  = dst + dst_pos;
+      uint8_t* stage_dst  = batch_dst;
+      size_t stage_size   = 0;
+      int32_t stage_count = 0;
+      msh_ply_type_id_t stage_type = MSH_PLY_INVALID;
+      for (int32_t v = 0, r = 0; r < n; ++r)
+      {
+        for (int32_t k = 0; k < plan->num_requested; ++k, ++v)
+        {
+          const msh_ply_property_t* pr = &el->properties[plan->property_idx[k]];
+          const uint8_t* values        = src + value_offsets[v];
+          int32_t count                = value_counts[v];
+          size_t src_values_size       = (size_t)count * pr->byte_size;
+          int32_t copy_directly = (pr->type == plan->type) && (!plan->swap_endianness || swap_batch);
+          if (stage_count && (copy_directly || pr->type != stage_type ||
+                              stage_size + src_values_size > MSH_PLY__STAGE_SIZE))
+          {
+            msh_ply__convert_values(stage_dst,
+                                    plan->type,
+                                    stage,
+                                    stage_type,
+                                    stage_count,
+                                    plan->swap_endianness);
+            stage_dst += (size_t)stage_count * byte_size;
+            stage_size  = 0;
+            stage_count = 0;
+          }
+          if (copy_directly)
+          {
+            memcpy(stage_dst, values, src_values_size);
+            stage_dst += src_values_size;
+          }
+          else if (src_values_size > MSH_PLY__STAGE_SIZE)
+          {
+            msh_ply__convert_values(stage_dst,
+                                    plan->type,
+                                    values,
+                                    pr->type,
+                                    count,
+                                    plan->swap_endianness);
+            stage_dst += (size_t)count * byte_size;
+          }
+          else
+          {
+            memcpy(stage + stage_size, values, src_values_size);
+            stage_size += src_values_size;
+            stage_count += count;
+            stage_type = pr->type;
+          }
+        }
+      }
+      if (stage_count)
+      {
+        msh_ply__convert_values(stage_dst,
+                                plan->type,
+                                stage,
+                                stage_type,
+                                stage_count,
+                                plan->swap_endianness);
+      }
+      if (swap_batch)
+      {
+        msh_ply__swap_bytes(batch_dst, byte_size, (int32_t)(batch_dst_size / byte_size));
+      }
+
+      if (dst_list)
+      {
+        for (int32_t v = 0; v < n * plan->num_requested; ++v)
+        {
+          msh_ply__store_value(&dst_list, plan->list_type, value_counts[v], value_counts[v]);
+        }
+      }
+      dst_pos += batch_dst_size;
+      i += n;
+    }
+  }
+
+  *src_used = src_pos;
+  *dst_used = dst_pos;
+  return i;
+}
+
+// Decodes rows of variable size into separate arrays of the requested properties. Rows are
+// decoded into a small interleaved tile that stays in cache, which is then scattered into the
+// arrays. Capacity 'dst_cap' and the produced bytes are counted within the first array.
+MSH_PLY_PRIVATE int32_t
+msh_ply__decode_rows_split(const msh_ply__read_plan_t* plan,
+                           const uint8_t* src,
+                           size_t src_size,
+                           int32_t n_rows,
+                           uint8_t* dst,
+                           size_t dst_cap,
+                           size_t* src_used,
+                           size_t* dst_used)
+{
+  uint8_t tile[MSH_PLY__STAGE_SIZE];
+  msh_ply__read_plan_t tile_plan = *plan;
+  int32_t byte_size              = msh_ply__type_to_byte_size(plan->type);
+  size_t row_size                = (size_t)plan->num_requested * byte_size;
+  int32_t tile_rows              = (int32_t)(sizeof(tile) / row_size);
+  tile_plan.column_stride        = 0;
+  tile_plan.dst_row_size         = row_size;
+  if ((size_t)n_rows > dst_cap / byte_size) { n_rows = (int32_t)(dst_cap / byte_size); }
+
+  size_t src_pos = 0;
+  int32_t i      = 0;
+  while (i < n_rows)
+  {
+    int32_t n_tile       = MSH_PLY_MIN(tile_rows, n_rows - i);
+    size_t tile_src_used = 0;
+    size_t tile_dst_used = 0;
+    int32_t n            = msh_ply__decode_rows(&tile_plan,
+                                                src + src_pos,
+                                                src_size - src_pos,
+                                                n_tile,
+                                                tile,
+                                                sizeof(tile),
+                                                NULL,
+                                                &tile_src_used,
+                                                &tile_dst_used);
+    for (int32_t k = 0; k < plan->num_requested; ++k)
+    {
+      uint8_t* column = dst + (size_t)k * plan->column_stride + (size_t)i * byte_size;
+      msh_ply__gather(column, tile + (size_t)k * byte_size, row_size, byte_size, n);
+    }
+    src_pos += tile_src_used;
+    i += n;
+    if (n < n_tile) { break; }
+  }
+
+  *src_used = src_pos;
+  *dst_used = (size_t)i * byte_size;
+  return i;
+}
+
+// Reads requested properties of 'n_rows' binary rows starting at file 'offset', and ending before
+// offset 'end' (0 if not known). Mapped rows are decoded in place, while others are streamed
+// through block sized buffers instead of loading the entire element. When the requested properties
+// only cover a narrow window of wide, fixed size rows, only that window is read from each row, so
+// the cost scales with the number of requested bytes rather than with the size of the element.
+MSH_PLY_PRIVATE int32_t
+msh_ply__read_rows_binary(msh_ply_t* pf,
+                          const msh_ply__read_plan_t* plan,
+                          int64_t offset,
+                          int64_t end,
+                          int32_t n_rows,
+                          uint8_t* dst,
+                          size_t dst_cap,
+                          uint8_t* dst_list)
+{
+  size_t src_used = 0;
+  size_t dst_used = 0;
+  if (pf->_map)
+  {
+    if ((size_t)offset > pf->_map_size) { return MSH_PLY_BINARY_PARSE_ERR; }
+    int32_t n_decoded = msh_ply__decode_rows(plan,
+                                             pf->_map + offset,
+                                             pf->_map_size - (size_t)offset,
+                                             n_rows,
+                                             dst,
+                                             dst_cap,
+                                             dst_list,
+                                             &src_used,
+                                             &dst_used);
+    return (n_decoded == n_rows) ? MSH_PLY_NO_ERR : MSH_PLY_BINARY_PARSE_ERR;
+  }
+
+  const msh_ply__read_plan_t* decode_plan = plan;
+  msh_ply__read_plan_t window_plan;
+  size_t row_stride = 0;
+  if (plan->src_row_size && plan->num_spans)
+  {
+    int32_t lo = (int32_t)plan->src_row_size;
+    int32_t hi = 0;
+    for (int32_t k = 0; k < plan->num_spans; ++k)
+    {
+      const msh_ply__read_span_t* span = &plan->spans[k];
+      int32_t span_size = span->count * msh_ply__type_to_byte_size(span->src_type);
+      lo                = MSH_PLY_MIN(lo, span->src_offset);
+      hi                = MSH_PLY_MAX(hi, span->src_offset + span_size);
+    }
+    if (plan->src_row_size - (size_t)(hi - lo) >= MSH_PLY__SPARSE_READ_GAP)
+    {
+      window_plan              = *plan;
+      window_plan.src_row_size = (size_t)(hi - lo);
+      for (int32_t k = 0; k < window_plan.num_spans; ++k)
+      {
+        window_plan.spans[k].src_offset -= lo;
+      }
+      decode_plan = &window_plan;
+      row_stride  = plan->src_row_size;
+      offset += lo;
+    }
+  }
+
+  size_t block_size = MSH_PLY_BLOCK_SIZE;
+  if (decode_plan->src_row_size)
+  {
+    size_t rows_per_block = block_size / decode_plan->src_row_size;
+    rows_per_block        = MSH_PLY_MAX(MSH_PLY_MIN(rows_per_block, (size_t)n_rows), 1);
+    block_size            = rows_per_block * decode_plan->src_row_size;
+  }
+  size_t list_row_size =
+    (size_t)plan->num_requested * msh_ply__type_to_byte_size(plan->list_type);
+
+  int32_t err_code = MSH_PLY_NO_ERR;
+  uint8_t* buf     = NULL;
+  msh_ply__block_reader_t reader;
+  msh_ply__block_reader_init(&reader, pf, end);
+  if (row_stride)
+  {
+    buf = (uint8_t*)MSH_PLY_MALLOC(block_size);
+    if (!buf) { return MSH_PLY_OUT_OF_MEMORY_ERR; }
+  }
+
+  int32_t row = 0;
+  while (!err_code && row < n_rows)
+  {
+    const uint8_t* src = buf;
+    size_t src_size    = 0;
+    if (row_stride)
+    {
+      int32_t n = (int32_t)MSH_PLY_MIN((size_t)(n_rows - row),
+                                       block_size / decode_plan->src_row_size);
+      for (int32_t r = 0; r < n; ++r)
+      {
+        int64_t row_offset = offset + (int64_t)((size_t)(row + r) * row_stride);
+        src_size += msh_ply__read_bytes(pf,
+                                        row_offset,
+                                        buf + src_size,
+                                        decode_plan->src_row_size);
+      }
+    }
+    else
+    {
+      src = msh_ply__block_reader_next(&reader, offset, block_size, &src_size);
+      if (!src)
+      {
+        err_code = MSH_PLY_BINARY_PARSE_ERR;
+        break;
+      }
+    }
+
+    int32_t n_decoded = msh_ply__decode_rows(decode_plan,
+                                             src,
+                                             src_size,
+                                             n_rows - row,
+                                             dst,
+                                             dst_cap,
+                                             dst_list,
+                                             &src_used,
+                                             &dst_used);
+    if (!n_decoded)
+    {
+      // Either the file is truncated, or a single row does not fit the block.
+      if (row_stride || src_size < block_size)
+      {
+        err_code = MSH_PLY_BINARY_PARSE_ERR;
+        break;
+      }
+      block_size *= 2;
+      continue;
+    }
+
+    row += n_decoded;
+    if (!row_stride) { offset += (int64_t)src_used; }
+    dst += dst_used;
+    dst_cap -= dst_used;
+    if (dst_list) { dst_list += n_decoded * list_row_size; }
+  }
+
+  msh_ply__block_reader_term(&reader);
+  MSH_PLY_FREE(buf);
+  return err_code;
+}
+
+// Reading of a range of rows of an element into the output of a single request. Rows are either
+// decoded according to 'plan', or copied as they are if their layout matches the request.
+typedef struct msh_ply__read_task
+{
+  msh_ply_t* pf;
+  const msh_ply__read_plan_t* plan;
+  int64_t offset;
+  int64_t end;   // End of the rows in the file, 0 if not known
+  int32_t n_rows;
+  int32_t raw_copy;
+  uint8_t* dst;
+  size_t dst_cap;
+  uint8_t* dst_list;
+  int32_t err_code;
+} msh_ply__read_task_t;
+
+MSH_PLY_PRIVATE void
+msh_ply__run_read_task(void* params)
+{
+  msh_ply__read_task_t* task = (msh_ply__read_task_t*)params;
+  if (task->raw_copy)
+  {
+    size_t n_read  = msh_ply__read_bytes(task->pf, task->offset, task->dst, task->dst_cap);
+    task->err_code = (n_read == task->dst_cap) ? MSH_PLY_NO_ERR : MSH_PLY_BINARY_PARSE_ERR;
+    return;
+  }
+  task->err_code = msh_ply__read_rows_binary(task->pf,
+                                             task->plan,
+                                             task->offset,
+                                             task->end,
+                                             task->n_rows,
+                                             task->dst,
+                                             task->dst_cap,
+                                             task->dst_list);
+}
+
+// Resolves the request of 'desc' into a read 'plan' and allocates the output arrays. Reading of
+// all rows of the element is described by 'task', which has no rows if the request was already
+// satisfied.
+MSH_PLY_PRIVATE int32_t
+msh_ply__prepare_read(msh_ply_t* pf,
+                      const msh_ply_desc_t* desc,
+                      msh_ply__read_plan_t* plan,
+                      msh_ply__read_task_t* task)
+{
+  void** data            = (void**)desc->data;
+  void** list_data       = (void**)desc->list_data;
+  int32_t** list_offsets = (int32_t**)desc->list_offsets;
+  if (data == NULL) { return MSH_PLY_NULL_DATA_PTR_ERR; }
+  msh_ply_element_t* el = msh_ply_find_element(pf, desc->element_name);
+  if (!el) { return MSH_PLY_ELEMENT_NOT_FOUND_ERR; }
+
+  const char* names[MSH_PLY_MAX_REQ_PROPERTIES];
+  const char** property_names = msh_ply__get_names_to_read(pf, desc, names);
+  int32_t err_code            = msh_ply__read_plan_init(plan,
+                                             pf,
+                                             el,
+                                             property_names,
+                                             desc->num_properties,
+                                             desc->data_type,
+                                             desc->list_type,
+                                             1);
+  if (err_code) { return err_code; }
+  size_t column_stride = 0;
+  if (desc->property_data)
+  {
+    if (desc->list_type != MSH_PLY_INVALID) { return MSH_PLY_SEPARATE_ARRAYS_ERR; }
+    for (int32_t k = 0; k < plan->num_requested; ++k)
+    {
+      const msh_ply_property_t* pr = &el->properties[plan->property_idx[k]];
+      if (pr->list_type != MSH_PLY_INVALID) { return MSH_PLY_SEPARATE_ARRAYS_ERR; }
+    }
+    // Rows of each array are a single value apart
+    int32_t byte_size   = msh_ply__type_to_byte_size(desc->data_type);
+    column_stride       = (size_t)el->count * byte_size;
+    plan->dst_row_size  = (size_t)byte_size;
+    plan->column_stride = column_stride;
+  }
+  *desc->data_count = el->count;
+
+  memset(task, 0, sizeof(*task));
+  task->pf     = pf;
+  task->plan   = plan;
+  task->offset = el->file_anchor;
+  task->n_rows = el->count;
+  if (list_offsets != NULL)
+  {
+    size_t offsets_size = ((size_t)el->count + 1) * sizeof(int32_t);
+    *list_offsets       = (int32_t*)msh_ply__alloc_output(pf, offsets_size);
+  }
+
+  // Check if data layouts agree - if so, we can just copy and return
+  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+  int8_t can_simply_copy = !plan->swap_endianness && !column_stride &&
+                           (desc->num_properties == num_properties);
+  for (int32_t i = 0; can_simply_copy && i < num_properties; ++i)
+  {
+    msh_ply_property_t* pr = &el->properties[i];
+    if (plan->property_idx[i] != i) { can_simply_copy = 0; }
+    if (pr->type != desc->data_type) { can_simply_copy = 0; }
+    if (pr->list_type != MSH_PLY_INVALID) { can_simply_copy = 0; }
+  }
+
+  msh_ply__get_element_size(el, &el->data_size);
+  task->end = el->file_anchor + (int64_t)el->data_size;
+  if (can_simply_copy)
+  {
+    // Mapped files can hand out the pointer to the file contents directly, as long as
+    // it is suitably aligned for the requested type.
+    uint8_t* mapped  = msh_ply__get_mapped_element_data(pf, el, el->data_size);
+    size_t alignment = (size_t)msh_ply__type_to_byte_size(desc->data_type);
+    if (mapped && ((uintptr_t)mapped % alignment) == 0)
+    {
+      *data        = mapped;
+      task->n_rows = 0;
+      return MSH_PLY_NO_ERR;
+    }
+
+    *data          = msh_ply__alloc_output(pf, el->data_size);
+    task->raw_copy = 1;
+    task->dst      = (uint8_t*)*data;
+    task->dst_cap  = el->data_size;
+    return MSH_PLY_NO_ERR;
+  }
+
+  size_t data_byte_size = 0;
+  size_t list_byte_size = 0;
+  msh_ply__get_properties_byte_size(el,
+                                    property_names,
+                                    desc->num_properties,
+                                    desc->data_type,
+                                    desc->list_type,
+                                    &data_byte_size,
+                                    &list_byte_size);
+  *data         = msh_ply__alloc_output(pf, data_byte_size);
+  task->dst     = (uint8_t*)*data;
+  task->dst_cap = data_byte_size;
+  if (column_stride)
+  {
+    for (int32_t k = 0; k < desc->num_properties; ++k)
+    {
+      desc->property_data[k] = task->dst + (size_t)k * column_stride;
+    }
+    task->dst_cap = column_stride;
+  }
+
+  // List counts are needed to compute the list offsets, even if they were not requested
+  if (list_data != NULL)
+  {
+    task->dst_list = (uint8_t*)msh_ply__alloc_output(pf, list_byte_size);
+    *list_data     = task->dst_list;
+  }
+  else if (list_offsets != NULL) { task->dst_list = (uint8_t*)MSH_PLY_MALLOC(list_byte_size); }
+  return MSH_PLY_NO_ERR;
+}
+
+// Fills the list offsets of 'desc' once all rows were read - offset of the first value of each
+// row within the data array, followed by the total number of values. List counts are released if
+// they were only needed to compute the offsets.
+MSH_PLY_PRIVATE void
+msh_ply__finish_read(const msh_ply_desc_t* desc,
+                     const msh_ply__read_plan_t* plan,
+                     const msh_ply__read_task_t* task,
+                     int32_t err_code)
+{
+  if (desc->list_offsets == NULL) { return; }
+  if (!err_code)
+  {
+    int32_t* offsets      = *(int32_t**)desc->list_offsets;
+    const uint8_t* counts = task->dst_list;
+    int32_t count_size    = msh_ply__type_to_byte_size(plan->list_type);
+    int32_t row_values    = 0;
+    for (int32_t k = 0; !counts && k < plan->num_requested; ++k)
+    {
+      row_values += plan->counts[plan->property_idx[k]];
+    }
+
+    offsets[0] = 0;
+    for (int32_t i = 0; i < plan->el->count; ++i)
+    {
+      int32_t n_values = row_values;
+      for (int32_t k = 0; counts && k < plan->num_requested; ++k)
+      {
+        n_values += msh_ply__get_data_as_int(counts, plan->list_type, 0);
+        counts += count_size;
+      }
+      offsets[i + 1] = offsets[i] + n_values;
+    }
+  }
+  if (desc->list_data == NULL) { MSH_PLY_FREE(task->dst_list); }
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_property_from_element(msh_ply_t* pf, const msh_ply_desc_t* desc)
+{
+  msh_ply__read_plan_t plan;
+  msh_ply__read_task_t task;
+  int32_t err_code = msh_ply__prepare_read(pf, desc, &plan, &task);
+  if (err_code) { return err_code; }
+
+  msh_ply_element_t* el = (msh_ply_element_t*)plan.el;
+  if (task.n_rows && pf->format != MSH_PLY_ASCII)
+  {
+    msh_ply__run_read_task(&task);
+    err_code = task.err_code;
+  }
+  else if (task.n_rows && task.raw_copy)
+  {
+    err_code = msh_ply__get_element_data(pf, el, (void**)desc->data, el->data_size);
+  }
+  else if (task.n_rows)
+  {
+    // ASCII elements are parsed in their entirety, and the requested properties are decoded
+    // from the parsed rows.
+    el->data = MSH_PLY_MALLOC(el->data_size);
+    err_code = msh_ply__get_element_data(pf, el, &el->data, el->data_size);
+    if (!err_code)
+    {
+      size_t src_used = 0;
+      size_t dst_used = 0;
+      int32_t n_rows  = msh_ply__decode_rows(&plan,
+                                            (const uint8_t*)el->data,
+                                            el->data_size,
+                                            el->count,
+                                            task.dst,
+                                            task.dst_cap,
+                                            task.dst_list,
+                                            &src_used,
+                                            &dst_used);
+      if (n_rows != el->count) { err_code = MSH_PLY_BINARY_PARSE_ERR; }
+    }
+    MSH_PLY_FREE(el->data);
+    el->data = NULL;
+  }
+
+  msh_ply__finish_read(desc, &plan, &task, err_code);
+  return err_code;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_get_property_from_element(msh_ply_t* pf, msh_ply_desc_t* desc)
+{
+  assert(pf);
+  assert(desc);
+  int32_t err_code = msh_ply__get_property_from_element(pf, desc);
+  if (!err_code) { msh_ply__dequantize(pf, desc, *desc->data_count); }
+  return err_code;
+}
+
+// Group of read tasks processed by a single worker. Tasks are dealt out to workers in turns.
+typedef struct msh_ply__read_worker
+{
+  msh_ply__read_task_t* tasks;
+  int32_t n_tasks;
+  int32_t first;
+  int32_t stride;
+} msh_ply__read_worker_t;
+
+MSH_PLY_PRIVATE void
+msh_ply__run_read_worker(void* params)
+{
+  msh_ply__read_worker_t* worker = (msh_ply__read_worker_t*)params;
+  for (int32_t i = worker->first; i < worker->n_tasks; i += worker->stride)
+  {
+    msh_ply__run_read_task(&worker->tasks[i]);
+  }
+}
+
+// Splits 'task' reading all rows of an element into tasks reading ranges of rows, which are
+// appended to 'tasks'. Ranges start at multiples of MSH_PLY__SPLIT_ROWS, so that rows of variable
+// size can be located using the checkpoints recorded by 'msh_ply__scan_element_binary'.
+MSH_PLY_PRIVATE void
+msh_ply__split_read_task(const msh_ply__read_task_t* task,
+                         int32_t num_threads,
+                         msh_ply_array(msh_ply__read_task_t) * tasks)
+{
+  const msh_ply__read_plan_t* plan = task->plan;
+  const msh_ply_element_t* el      = plan->el;
+  int32_t num_properties           = (int32_t)msh_ply_array_len(el->properties);
+  int32_t n_splits = (int32_t)(((int64_t)task->n_rows + MSH_PLY__SPLIT_ROWS - 1) /
+                               MSH_PLY__SPLIT_ROWS);
+  if (!plan->src_row_size && (int32_t)msh_ply_array_len(el->split_offsets) < n_splits)
+  {
+    n_splits = 1;
+  }
+  int32_t splits_per_task = (n_splits + num_threads - 1) / num_threads;
+  int32_t byte_size       = msh_ply__type_to_byte_size(plan->type);
+  size_t list_row_size =
+    (size_t)plan->num_requested * msh_ply__type_to_byte_size(plan->list_type);
+
+  for (int32_t i = 0; i < n_splits; i += splits_per_task)
+  {
+    msh_ply__read_task_t range = *task;
+    int64_t row                = (int64_t)i * MSH_PLY__SPLIT_ROWS;
+    int64_t n_rows             = (int64_t)splits_per_task * MSH_PLY__SPLIT_ROWS;
+    range.n_rows               = (int32_t)MSH_PLY_MIN(n_rows, task->n_rows - row);
+
+    size_t dst_offset = 0;
+    if (plan->src_row_size)
+    {
+      size_t dst_row_size = task->raw_copy ? plan->src_row_size : plan->dst_row_size;
+      range.offset += (int64_t)(row * plan->src_row_size);
+      range.end  = range.offset + (int64_t)((size_t)range.n_rows * plan->src_row_size);
+      dst_offset = (size_t)row * dst_row_size;
+      if (task->raw_copy) { range.dst_cap = (size_t)range.n_rows * dst_row_size; }
+    }
+    else if (plan->column_stride)
+    {
+      range.offset = el->split_offsets[i];
+      if (i + splits_per_task < n_splits) { range.end = el->split_offsets[i + splits_per_task]; }
+      dst_offset = (size_t)row * plan->dst_row_size;
+    }
+    else
+    {
+      range.offset = el->split_offsets[i];
+      if (i + splits_per_task < n_splits) { range.end = el->split_offsets[i + splits_per_task]; }
+      for (int32_t k = 0; k < plan->num_requested; ++k)
+      {
+        int32_t total = el->split_totals[i * num_properties + plan->property_idx[k]];
+        dst_offset += (size_t)total * byte_size;
+      }
+    }
+    range.dst += dst_offset;
+    if (!task->raw_copy) { range.dst_cap -= dst_offset; }
+    if (range.dst_list) { range.dst_list += (size_t)row * list_row_size; }
+    msh_ply_array_push(*tasks, range);
+  }
+}
+
+// Reads all descriptors of a binary file, decoding ranges of rows of all elements concurrently.
+MSH_PLY_PRIVATE int32_t
+msh_ply__read_parallel(msh_ply_t* pf, int32_t num_threads)
+{
+  int32_t err_code = MSH_PLY_NO_ERR;
+  size_t n_descriptors = msh_ply_array_len(pf->descriptors);
+  msh_ply__read_plan_t* plans =
+    (msh_ply__read_plan_t*)MSH_PLY_MALLOC(n_descriptors * sizeof(msh_ply__read_plan_t));
+  msh_ply__read_task_t* requests =
+    (msh_ply__read_task_t*)MSH_PLY_MALLOC(n_descriptors * sizeof(msh_ply__read_task_t));
+  if (!plans || !requests)
+  {
+    MSH_PLY_FREE(plans);
+    MSH_PLY_FREE(requests);
+    return MSH_PLY_BINARY_PARSE_ERR;
+  }
+
+  size_t n_prepared = 0;
+  msh_ply_array(msh_ply__read_task_t) tasks = NULL;
+  for (; n_prepared < n_descriptors; ++n_prepared)
+  {
+    msh_ply__read_task_t* request = &requests[n_prepared];
+    err_code = msh_ply__prepare_read(pf, pf->descriptors[n_prepared], &plans[n_prepared], request);
+    if (err_code) { break; }
+    if (request->n_rows) { msh_ply__split_read_task(request, num_threads, &tasks); }
+  }
+
+  int32_t n_tasks = (int32_t)msh_ply_array_len(tasks);
+  if (!err_code && n_tasks)
+  {
+    msh_ply__read_worker_t workers[MSH_PLY_MAX_THREADS];
+    int32_t n_workers = MSH_PLY_MIN(num_threads, n_tasks);
+    for (int32_t i = 0; i < n_workers; ++i)
+    {
+      workers[i].tasks   = tasks;
+      workers[i].n_tasks = n_tasks;
+      workers[i].first   = i;
+      workers[i].stride  = n_workers;
+    }
+    msh_ply__run_tasks(pf,
+                       msh_ply__run_read_worker,
+                       workers,
+                       sizeof(msh_ply__read_worker_t),
+                       n_workers);
+    for (int32_t i = 0; i < n_tasks && !err_code; ++i) { err_code = tasks[i].err_code; }
+  }
+
+  for (size_t i = 0; i < n_prepared; ++i)
+  {
+    msh_ply_desc_t* desc = pf->descriptors[i];
+    msh_ply__finish_read(desc, &plans[i], &requests[i], err_code);
+    if (!err_code) { msh_ply__dequantize(pf, desc, *desc->data_count); }
+  }
+  msh_ply_array_free(tasks);
+  MSH_PLY_FREE(requests);
+  MSH_PLY_FREE(plans);
+  return err_code;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_read(msh_ply_t* pf)
+{
+  int32_t error = MSH_PLY_NO_ERR;
+  if (!pf->_io.read_at) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  if (msh_ply_array_len(pf->descriptors) == 0) { return MSH_PLY_NO_REQUESTS; }
+
+  if (!pf->_parsed) { error = msh_ply_parse_header(pf); }
+  if (error) { return error; }
+
+  error = msh_ply_parse_contents(pf);
+  if (error) { return error; }
+
+  // Element offsets are known at this point, so lazy reading only needs to report the counts
+  size_t n_descriptors = msh_ply_array_len(pf->descriptors);
+  while (msh_ply_array_len(pf->_loaded) < n_descriptors)
+  {
+    msh_ply_array_push_in(&pf->_arena, pf->_loaded, (uint8_t)0);
+  }
+  if (pf->_lazy)
+  {
+    for (size_t i = 0; i < n_descriptors; ++i)
+    {
+      msh_ply_desc_t* desc  = pf->descriptors[i];
+      msh_ply_element_t* el = msh_ply_find_element(pf, desc->element_name);
+      *desc->data_count     = el->count;
+    }
+    return MSH_PLY_NO_ERR;
+  }
+
+  // NOTE: ASCII elements are already parsed by multiple threads, one element at a time.
+  // Compressed files can only be inflated by one thread, so decoding them in parallel won't help.
+  int32_t num_threads = msh_ply__get_num_threads(pf);
+  if (pf->format != MSH_PLY_ASCII && num_threads > 1 && pf->_io.read_at != msh_ply__gz_read_at)
+  {
+    error = msh_ply__read_parallel(pf, num_threads);
+  }
+  else
+  {
+    for (size_t i = 0; i < n_descriptors && !error; ++i)
+    {
+      error = msh_ply_get_property_from_element(pf, pf->descriptors[i]);
+    }
+  }
+  if (!error) { memset(pf->_loaded, 1, n_descriptors); }
+  return error;
+}
+
+MSH_PLY_DEF void
+msh_ply_set_lazy_read(msh_ply_t* pf, int32_t lazy)
+{
+  if (!pf) { return; }
+  pf->_lazy = lazy;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_load(msh_ply_t* pf, msh_ply_desc_t* desc)
+{
+  if (!pf || !pf->_io.read_at) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  size_t i = 0;
+  while (i < msh_ply_array_len(pf->_loaded) && pf->descriptors[i] != desc) { ++i; }
+  if (i == msh_ply_array_len(pf->_loaded)) { return MSH_PLY_LAZY_LOAD_ERR; }
+  if (pf->_loaded[i]) { return MSH_PLY_NO_ERR; }
+
+  int32_t err_code = msh_ply_get_property_from_element(pf, desc);
+  if (!err_code) { pf->_loaded[i] = 1; }
+  return err_code;
+}
+
+// Computes file offset of the first row of element 'el', by skipping all of the preceding elements.
+MSH_PLY_PRIVATE int32_t
+msh_ply__find_element_offset(msh_ply_t* pf,
+                             const msh_ply_element_t* el,
+                             int64_t* offset)
+{
+  int32_t err_code = MSH_PLY_NO_ERR;
+  *offset          = pf->_header_size;
+  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+  {
+    msh_ply_element_t* cur_el = &pf->elements[i];
+    if (cur_el == el) { break; }
+    if (cur_el->count <= 0) { continue; }
+
+    size_t row_size   = 0;
+    int32_t has_lists = 0;
+    for (size_t j = 0; j < msh_ply_array_len(cur_el->properties); ++j)
+    {
+      msh_ply_property_t* pr = &cur_el->properties[j];
+      if (pr->list_type != MSH_PLY_INVALID) { has_lists = 1; }
+      row_size += pr->byte_size;
+    }
+
+    if (pf->format == MSH_PLY_ASCII)
+    {
+      err_code = msh_ply__scan_element_ascii(pf, cur_el, offset, 0);
+    }
+    else if (!has_lists)
+    {
+      *offset += (int64_t)(row_size * cur_el->count);
+    }
+    else
+    {
+      err_code = msh_ply__scan_element_binary(pf, cur_el, offset, 0);
+    }
+    if (err_code) { break; }
+  }
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__get_cursor(msh_ply_t* pf,
+                    const msh_ply_desc_t* desc,
+                    const msh_ply_element_t* el,
+                    msh_ply__cursor_t** cursor)
+{
+  for (size_t i = 0; i < msh_ply_array_len(pf->_cursors); ++i)
+  {
+    if (pf->_cursors[i].desc == desc)
+    {
+      *cursor = &pf->_cursors[i];
+      return MSH_PLY_NO_ERR;
+    }
+  }
+
+  msh_ply__cursor_t new_cursor = {desc, 0, 0, NULL};
+  int32_t err_code = msh_ply__find_element_offset(pf, el, &new_cursor.offset);
+  if (err_code) { return err_code; }
+  msh_ply_array_push_in(&pf->_arena, pf->_cursors, new_cursor);
+  *cursor = msh_ply_array_back(pf->_cursors);
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__read_chunk_binary(msh_ply_t* pf,
+                           const msh_ply__read_plan_t* plan,
+                           msh_ply__cursor_t* cursor,
+                           int32_t n_rows,
+                           uint8_t* dst,
+                           size_t dst_cap,
+                           uint8_t* dst_list,
+                           int32_t* n_read)
+{
+  const msh_ply_element_t* el = plan->el;
+  int32_t err_code            = MSH_PLY_NO_ERR;
+
+  // Variable size rows are read with a guess of their size, which is increased if needed.
+  size_t row_size = plan->src_row_size;
+  if (!row_size)
+  {
+    for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
+    {
+      const msh_ply_property_t* pr = &el->properties[j];
+      row_size += pr->list_byte_size;
+      row_size += (pr->list_type != MSH_PLY_INVALID ? 4 : 1) * pr->byte_size;
+    }
+  }
+  size_t block_size = (size_t)n_rows * row_size;
+  size_t src_used   = 0;
+  size_t dst_used   = 0;
+  *n_read           = 0;
+  for (;;)
+  {
+    const uint8_t* src = NULL;
+    size_t src_size    = 0;
+    if (pf->_map)
+    {
+      if ((size_t)cursor->offset < pf->_map_size)
+      {
+        src      = pf->_map + cursor->offset;
+        src_size = pf->_map_size - (size_t)cursor->offset;
+      }
+    }
+    else
+    {
+      src = msh_ply__block_reader_next(cursor->reader, cursor->offset, block_size, &src_size);
+      if (!src)
+      {
+        err_code = MSH_PLY_BINARY_PARSE_ERR;
+        break;
+      }
+    }
+
+    *n_read = msh_ply__decode_rows(plan,
+                                   src,
+                                   src_size,
+                                   n_rows,
+                                   dst,
+                                   dst_cap,
+                                   dst_list,
+                                   &src_used,
+                                   &dst_used);
+    if (*n_read > 0) { break; }
+
+    // Nothing was decoded - figure out whether the row did not fit the source or the destination.
+    int32_t offsets[MSH_PLY_MAX_PROPERTIES];
+    int32_t counts[MSH_PLY_MAX_PROPERTIES];
+    if (msh_ply__get_row_layout(el,
+                                src,
+                                src_size,
+                                plan->swap_endianness,
+                                offsets,
+                                counts))
+    {
+      err_code = MSH_PLY_CHUNK_BUFFER_TOO_SMALL_ERR;
+      break;
+    }
+    if (pf->_map || src_size < block_size)
+    {
+      err_code = MSH_PLY_BINARY_PARSE_ERR;
+      break;
+    }
+    block_size *= 2;
+  }
+
+  cursor->offset += (int64_t)src_used;
+  cursor->row += *n_read;
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__read_chunk_ascii(msh_ply_t* pf,
+                          const msh_ply__read_plan_t* plan,
+                          msh_ply__cursor_t* cursor,
+                          int32_t n_rows,
+                          uint8_t* dst,
+                          size_t dst_cap,
+                          uint8_t* dst_list,
+                          int32_t* n_read)
+{
+  // Lines are converted to binary rows first, and only then decoded into the requested layout.
+  msh_ply__text_block_t block;
+  size_t block_size = MSH_PLY_MIN((size_t)MSH_PLY_BLOCK_SIZE,
+                                  MSH_PLY_MAX((size_t)n_rows * 128, (size_t)4096));
+  int32_t err_code =
+    msh_ply__text_block_init(&block, pf, cursor->reader, cursor->offset, block_size);
+  if (!err_code) { err_code = msh_ply__text_block_next(&block, n_rows); }
+  *n_read = 0;
+
+  msh_ply__ascii_chunk_t chunk;
+  chunk.el             = plan->el;
+  chunk.text           = block.buf;
+  chunk.text_end       = block.buf ? block.buf + block.n_bytes : NULL;
+  chunk.n_rows         = block.n_rows;
+  chunk.fixed_row_size = 0;
+  chunk.dst            = NULL;
+  chunk.dst_size       = 0;
+  chunk.dst_cap        = 0;
+  chunk.err_code       = MSH_PLY_NO_ERR;
+  if (!err_code)
+  {
+    msh_ply__parse_ascii_chunk(&chunk);
+    err_code = chunk.err_code;
+  }
+
+  if (!err_code)
+  {
+    size_t src_used = 0;
+    size_t dst_used = 0;
+    *n_read         = msh_ply__decode_rows(plan,
+                                   chunk.dst,
+                                   chunk.dst_size,
+                                   block.n_rows,
+                                   dst,
+                                   dst_cap,
+                                   dst_list,
+                                   &src_used,
+                                   &dst_used);
+    if (*n_read == 0) { err_code = MSH_PLY_CHUNK_BUFFER_TOO_SMALL_ERR; }
+
+    // Only consume text of the rows that were actually decoded
+    const char* cp = block.buf;
+    for (int32_t i = 0; i < *n_read; ++i)
+    {
+      cp = (const char*)memchr(cp, '\n', block.buf + block.n_bytes - cp) + 1;
+    }
+    cursor->offset += (int64_t)(cp - block.buf);
+    cursor->row += *n_read;
+  }
+
+  MSH_PLY_FREE(chunk.dst);
+  msh_ply__text_block_term(&block);
+  return err_code;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_read_chunk(msh_ply_t* pf, msh_ply_desc_t* desc, int32_t max_rows)
+{
+  if (!pf || !pf->_io.read_at) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  int32_t err_code = msh_ply__validate_descriptor(desc);
+  if (err_code) { return err_code; }
+  if (desc->property_data) { return MSH_PLY_SEPARATE_ARRAYS_ERR; }
+  *desc->data_count = 0;
+  if (!*(void**)desc->data) { return MSH_PLY_NULL_DATA_PTR_ERR; }
+
+  if (!pf->_parsed) { err_code = msh_ply_parse_header(pf); }
+  if (err_code) { return err_code; }
+
+  msh_ply_element_t* el = msh_ply_find_element(pf, desc->element_name);
+  if (!el) { return MSH_PLY_ELEMENT_NOT_FOUND_ERR; }
+
+  const char* names[MSH_PLY_MAX_REQ_PROPERTIES];
+  msh_ply__read_plan_t plan;
+  err_code = msh_ply__read_plan_init(&plan,
+                                     pf,
+                                     el,
+                                     msh_ply__get_names_to_read(pf, desc, names),
+                                     desc->num_properties,
+                                     desc->data_type,
+                                     desc->list_type,
+                                     0);
+  if (err_code) { return err_code; }
+
+  msh_ply__cursor_t* cursor = NULL;
+  err_code                  = msh_ply__get_cursor(pf, desc, el, &cursor);
+  if (err_code) { return err_code; }
+
+  int32_t n_rows = MSH_PLY_MIN(max_rows, el->count - cursor->row);
+  if (n_rows <= 0) { return MSH_PLY_NO_ERR; }
+
+  // Following chunks are read ahead while the user processes the current one
+  if (!cursor->reader && !pf->_map)
+  {
+    cursor->reader = (msh_ply__block_reader_t*)MSH_PLY_MALLOC(sizeof(msh_ply__block_reader_t));
+    if (!cursor->reader) { return MSH_PLY_OUT_OF_MEMORY_ERR; }
+    int64_t end = 0;
+    if (pf->format != MSH_PLY_ASCII && plan.src_row_size)
+    {
+      end = cursor->offset + (int64_t)((size_t)(el->count - cursor->row) * plan.src_row_size);
+    }
+    msh_ply__block_reader_init(cursor->reader, pf, end);
+  }
+
+  // Caller's buffer has space for 'max_rows' rows, with 'list_size_hint' values per list.
+  size_t dst_cap    = 0;
+  int32_t byte_size = msh_ply__type_to_byte_size(desc->data_type);
+  for (int32_t i = 0; i < desc->num_properties; ++i)
+  {
+    const msh_ply_property_t* pr = &el->properties[plan.property_idx[i]];
+    int32_t count = (pr->list_type != MSH_PLY_INVALID) ? desc->list_size_hint : 1;
+    dst_cap += (size_t)count * byte_size;
+  }
+  dst_cap *= (size_t)max_rows;
+
+  uint8_t* dst      = *(uint8_t**)desc->data;
+  uint8_t* dst_list = desc->list_data ? *(uint8_t**)desc->list_data : NULL;
+  if (pf->format == MSH_PLY_ASCII)
+  {
+    err_code = msh_ply__read_chunk_ascii(pf,
+                                         &plan,
+                                         cursor,
+                                         n_rows,
+                                         dst,
+                                         dst_cap,
+                                         dst_list,
+                                         desc->data_count);
+  }
+  else
+  {
+    err_code = msh_ply__read_chunk_binary(pf,
+                                          &plan,
+                                          cursor,
+                                          n_rows,
+                                          dst,
+                                          dst_cap,
+                                          dst_list,
+                                          desc->data_count);
+  }
+  if (!err_code) { msh_ply__dequantize(pf, desc, *desc->data_count); }
+
+  // Nothing else will be read through the reader once all rows were read
+  if (cursor->reader && (err_code || cursor->row >= el->count))
+  {
+    msh_ply__block_reader_term(cursor->reader);
+    MSH_PLY_FREE(cursor->reader);
+    cursor->reader = NULL;
+  }
+  return err_code;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Spatial index
+//
+// Sidecar index splits rows of an element into blocks of a fixed number of rows, and stores file
+// offset and bounding box of each block. Region queries read only the blocks whose boxes overlap
+// the query box. Consecutive blocks are read together, with the same read ahead as chunks.
+//
+// Index file holds 'msh_ply__index_header_t' followed by 'msh_ply__index_block_t' of each block,
+// in system byte order.
+
+#define MSH_PLY__INDEX_MAGIC   "MSHPLYIX"
+#define MSH_PLY__INDEX_VERSION 1
+#define MSH_PLY__INDEX_READ_SIZE (1 << 22)
+
+// Reads 'n_rows' rows starting at 'cursor' into 'dst', which has space for all of them.
+MSH_PLY_PRIVATE int32_t
+msh_ply__read_rows_at(msh_ply_t* pf,
+                      const msh_ply__read_plan_t* plan,
+                      msh_ply__cursor_t* cursor,
+                      int32_t n_rows,
+                      uint8_t* dst,
+                      size_t dst_row_size)
+{
+  int32_t err_code = MSH_PLY_NO_ERR;
+  while (n_rows > 0 && !err_code)
+  {
+    int32_t n_read = 0;
+    size_t dst_cap = (size_t)n_rows * dst_row_size;
+    if (pf->format == MSH_PLY_ASCII)
+    {
+      err_code =
+        msh_ply__read_chunk_ascii(pf, plan, cursor, n_rows, dst, dst_cap, NULL, &n_read);
+    }
+    else
+    {
+      err_code =
+        msh_ply__read_chunk_binary(pf, plan, cursor, n_rows, dst, dst_cap, NULL, &n_read);
+    }
+    if (!err_code && n_read <= 0) { err_code = MSH_PLY_BINARY_PARSE_ERR; }
+    dst += (size_t)n_read * dst_row_size;
+    n_rows -= n_read;
+  }
+  return err_code;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__write_index(const char* filename,
+                     const msh_ply__index_header_t* header,
+                     const msh_ply__index_block_t* blocks)
+{
+  FILE* fp = fopen(filename, "wb");
+  if (!fp) { return MSH_PLY_FILE_OPEN_ERR; }
+  int32_t err_code = MSH_PLY_NO_ERR;
+  if (fwrite(header, sizeof(*header), 1, fp) != 1) { err_code = MSH_PLY_FILE_WRITE_ERR; }
+  if (!err_code && header->n_blocks &&
+      fwrite(blocks, sizeof(*blocks), (size_t)header->n_blocks, fp) != (size_t)header->n_blocks)
+  {
+    err_code = MSH_PLY_FILE_WRITE_ERR;
+  }
+  if (fclose(fp) != 0 && !err_code) { err_code = MSH_PLY_FILE_WRITE_ERR; }
+  return err_code;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_build_index(msh_ply_t* pf,
+                    const char* index_filename,
+                    const char* element_name,
+                    const char** position_names,
+                    int32_t block_rows)
+{
+  if (!pf || !pf->_io.read_at) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  if (!index_filename) { return MSH_PLY_FILE_OPEN_ERR; }
+  if (!element_name) { return MSH_PLY_NULL_ELEMENT_NAME_ERR; }
+  if (!position_names) { return MSH_PLY_NULL_PROPERTY_NAMES_ERR; }
+  for (int32_t c = 0; c < 3; ++c)
+  {
+    if (!position_names[c]) { return MSH_PLY_NULL_PROPERTY_NAME_ERR; }
+  }
+  if (block_rows <= 0) { block_rows = MSH_PLY_INDEX_BLOCK_ROWS; }
+
+  int32_t err_code = MSH_PLY_NO_ERR;
+  if (!pf->_parsed) { err_code = msh_ply_parse_header(pf); }
+  if (err_code) { return err_code; }
+  msh_ply_element_t* el = msh_ply_find_element(pf, element_name);
+  if (!el) { return MSH_PLY_ELEMENT_NOT_FOUND_ERR; }
+
+  // Positions are read through a descriptor, so that quantized positions get dequantized.
+  float* positions = NULL;
+  int32_t n_rows   = 0;
+  msh_ply_desc_t desc;
+  memset(&desc, 0, sizeof(desc));
+  desc.element_name   = (char*)element_name;
+  desc.property_names = position_names;
+  desc.num_properties = 3;
+  desc.data_type      = MSH_PLY_FLOAT;
+  desc.data           = &positions;
+  desc.data_count     = &n_rows;
+
+  const char* names[MSH_PLY_MAX_REQ_PROPERTIES];
+  msh_ply__read_plan_t plan;
+  err_code = msh_ply__read_plan_init(&plan,
+                                     pf,
+                                     el,
+                                     msh_ply__get_names_to_read(pf, &desc, names),
+                                     3,
+                                     MSH_PLY_FLOAT,
+                                     MSH_PLY_INVALID,
+                                     0);
+  if (err_code) { return err_code; }
+
+  msh_ply__index_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MSH_PLY__INDEX_MAGIC, sizeof(header.magic));
+  header.version    = MSH_PLY__INDEX_VERSION;
+  header.block_rows = block_rows;
+  header.n_rows     = el->count;
+  header.n_blocks   = (int32_t)(((int64_t)el->count + block_rows - 1) / block_rows);
+  header.file_size  = (int64_t)msh_ply__get_file_size(pf);
+  strncpy(header.element_name, element_name, 63);
+  for (int32_t c = 0; c < 3; ++c) { strncpy(header.names[c], position_names[c], 31); }
+
+  // Offsets of blocks of rows of variable size are only known once we get to them, so these
+  // are read one block at a time.
+  int32_t blocks_per_read = 1;
+  if (pf->format != MSH_PLY_ASCII && plan.src_row_size)
+  {
+    size_t block_size = (size_t)block_rows * plan.src_row_size;
+    blocks_per_read   = (int32_t)MSH_PLY_MAX((size_t)1, MSH_PLY__INDEX_READ_SIZE / block_size);
+  }
+  int32_t read_rows = (int32_t)MSH_PLY_MIN((int64_t)blocks_per_read * block_rows, el->count);
+  size_t n_blocks   = (size_t)MSH_PLY_MAX(header.n_blocks, 1);
+  msh_ply__index_block_t* blocks =
+    (msh_ply__index_block_t*)msh_ply__arena_alloc(&pf->_arena, n_blocks * sizeof(*blocks));
+  positions = (float*)MSH_PLY_MALLOC((size_t)MSH_PLY_MAX(read_rows, 1) * 3 * sizeof(float));
+  msh_ply__block_reader_t reader;
+  msh_ply__cursor_t cursor = {NULL, 0, 0, NULL};
+  if (!blocks || !positions) { err_code = MSH_PLY_BINARY_PARSE_ERR; }
+  if (!err_code) { err_code = msh_ply__find_element_offset(pf, el, &cursor.offset); }
+  if (!err_code && !pf->_map)
+  {
+    int64_t end = 0;
+    if (pf->format != MSH_PLY_ASCII && plan.src_row_size)
+    {
+      end = cursor.offset + (int64_t)((size_t)el->count * plan.src_row_size);
+    }
+    msh_ply__block_reader_init(&reader, pf, end);
+    cursor.reader = &reader;
+  }
+
+  for (int32_t b = 0; b < header.n_blocks && !err_code; b += blocks_per_read)
+  {
+    int64_t offset = cursor.offset;
+    n_rows      = MSH_PLY_MIN(read_rows, el->count - cursor.row);
+    err_code    = msh_ply__read_rows_at(pf,
+                                     &plan,
+                                     &cursor,
+                                     n_rows,
+                                     (uint8_t*)positions,
+                                     3 * sizeof(float));
+    if (err_code) { break; }
+    msh_ply__dequantize(pf, &desc, n_rows);
+
+    for (int32_t i = 0; i < n_rows; ++i)
+    {
+      msh_ply__index_block_t* block = &blocks[b + i / block_rows];
+      if (i % block_rows == 0)
+      {
+        block->offset = (int64_t)offset + (int64_t)i * (int64_t)plan.src_row_size;
+        for (int32_t c = 0; c < 3; ++c)
+        {
+          block->min[c] = INFINITY;
+          block->max[c] = -INFINITY;
+        }
+      }
+      for (int32_t c = 0; c < 3; ++c)
+      {
+        float v = positions[3 * i + c];
+        if (v < block->min[c]) { block->min[c] = v; }
+        if (v > block->max[c]) { block->max[c] = v; }
+      }
+    }
+  }
+  if (cursor.reader) { msh_ply__block_reader_term(cursor.reader); }
+  MSH_PLY_FREE(positions);
+
+  if (!err_code) { err_code = msh_ply__write_index(index_filename, &header, blocks); }
+  if (err_code)
+  {
+    msh_ply__arena_free(&pf->_arena, blocks);
+    return err_code;
+  }
+  msh_ply__arena_free(&pf->_arena, pf->_index_blocks);
+  pf->_index        = header;
+  pf->_index_blocks = blocks;
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_load_index(msh_ply_t* pf, const char* index_filename)
+{
+  if (!pf || !pf->_io.read_at) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  int32_t err_code = MSH_PLY_NO_ERR;
+  if (!pf->_parsed) { err_code = msh_ply_parse_header(pf); }
+  if (err_code) { return err_code; }
+
+  FILE* fp = index_filename ? fopen(index_filename, "rb") : NULL;
+  if (!fp) { return MSH_PLY_FILE_OPEN_ERR; }
+  msh_ply__index_header_t header;
+  msh_ply__index_block_t* blocks = NULL;
+  if (fread(&header, sizeof(header), 1, fp) != 1) { err_code = MSH_PLY_INVALID_INDEX_ERR; }
+
+  // Index needs to describe the element as it is in this very file
+  const msh_ply_element_t* el = NULL;
+  if (!err_code)
+  {
+    header.element_name[63] = 0;
+    el = msh_ply_find_element(pf, header.element_name);
+  }
+  if (!err_code &&
+      (memcmp(header.magic, MSH_PLY__INDEX_MAGIC, sizeof(header.magic)) ||
+       header.version != MSH_PLY__INDEX_VERSION || header.block_rows <= 0 || !el ||
+       header.n_rows != el->count || header.file_size != (int64_t)msh_ply__get_file_size(pf)))
+  {
+    err_code = MSH_PLY_INVALID_INDEX_ERR;
+  }
+  if (!err_code &&
+      (int64_t)header.n_blocks != ((int64_t)el->count + header.block_rows - 1) / header.block_rows)
+  {
+    err_code = MSH_PLY_INVALID_INDEX_ERR;
+  }
+  if (!err_code)
+  {
+    size_t n_blocks = (size_t)header.n_blocks;
+    size_t blocks_size = MSH_PLY_MAX(n_blocks, 1) * sizeof(*blocks);
+    blocks = (msh_ply__index_block_t*)msh_ply__arena_alloc(&pf->_arena, blocks_size);
+    if (!blocks || fread(blocks, sizeof(*blocks), n_blocks, fp) != n_blocks)
+    {
+      err_code = MSH_PLY_INVALID_INDEX_ERR;
+    }
+  }
+  fclose(fp);
+
+  if (err_code)
+  {
+    msh_ply__arena_free(&pf->_arena, blocks);
+    return err_code;
+  }
+  msh_ply__arena_free(&pf->_arena, pf->_index_blocks);
+  pf->_index        = header;
+  pf->_index_blocks = blocks;
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__block_overlaps(const msh_ply__index_block_t* block,
+                        const float* aabb_min,
+                        const float* aabb_max)
+{
+  for (int32_t c = 0; c < 3; ++c)
+  {
+    if (block->min[c] > aabb_max[c] || block->max[c] < aabb_min[c]) { return 0; }
+  }
+  return 1;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_read_region(msh_ply_t* pf,
+                    const float* aabb_min,
+                    const float* aabb_max,
+                    msh_ply_desc_t* desc)
+{
+  if (!pf || !pf->_io.read_at) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  int32_t err_code = msh_ply__validate_descriptor(desc);
+  if (err_code) { return err_code; }
+  if (desc->list_type != MSH_PLY_INVALID) { return MSH_PLY_INVALID_LIST_TYPE_ERR; }
+  if (desc->property_data) { return MSH_PLY_SEPARATE_ARRAYS_ERR; }
+  if (!pf->_index_blocks || strcmp(desc->element_name, pf->_index.element_name))
+  {
+    return MSH_PLY_INVALID_INDEX_ERR;
+  }
+  msh_ply_element_t* el = msh_ply_find_element(pf, desc->element_name);
+  if (!el) { return MSH_PLY_ELEMENT_NOT_FOUND_ERR; }
+
+  const char* names[MSH_PLY_MAX_REQ_PROPERTIES];
+  msh_ply__read_plan_t plan;
+  err_code = msh_ply__read_plan_init(&plan,
+                                     pf,
+                                     el,
+                                     msh_ply__get_names_to_read(pf, desc, names),
+                                     desc->num_properties,
+                                     desc->data_type,
+                                     MSH_PLY_INVALID,
+                                     0);
+  if (err_code) { return err_code; }
+
+  const msh_ply__index_block_t* blocks = pf->_index_blocks;
+  int32_t n_blocks                     = pf->_index.n_blocks;
+  int32_t block_rows                   = pf->_index.block_rows;
+  int64_t n_rows                       = 0;
+  for (int32_t b = 0; b < n_blocks; ++b)
+  {
+    if (!msh_ply__block_overlaps(&blocks[b], aabb_min, aabb_max)) { continue; }
+    n_rows += MSH_PLY_MIN(block_rows, el->count - b * block_rows);
+  }
+  size_t row_size = (size_t)desc->num_properties * msh_ply__type_to_byte_size(desc->data_type);
+  uint8_t* dst    = (uint8_t*)msh_ply__alloc_output(pf, (size_t)MSH_PLY_MAX(n_rows, 1) * row_size);
+  if (!dst) { return MSH_PLY_BINARY_PARSE_ERR; }
+  *(uint8_t**)desc->data = dst;
+  *desc->data_count      = (int32_t)n_rows;
+
+  // Runs of consecutive overlapping blocks are read in large reads
+  int32_t max_read_rows = block_rows;
+  if (plan.src_row_size)
+  {
+    size_t rows   = MSH_PLY__INDEX_READ_SIZE / plan.src_row_size;
+    max_read_rows = (int32_t)MSH_PLY_MAX((size_t)block_rows, rows);
+  }
+  msh_ply__block_reader_t reader;
+  for (int32_t b = 0; b < n_blocks && !err_code;)
+  {
+    if (!msh_ply__block_overlaps(&blocks[b], aabb_min, aabb_max))
+    {
+      b++;
+      continue;
+    }
+    int32_t e = b + 1;
+    while (e < n_blocks && msh_ply__block_overlaps(&blocks[e], aabb_min, aabb_max)) { e++; }
+
+    msh_ply__cursor_t cursor = {NULL, b * block_rows, (int64_t)blocks[b].offset, NULL};
+    if (!pf->_map)
+    {
+      msh_ply__block_reader_init(&reader, pf, e < n_blocks ? (int64_t)blocks[e].offset : 0);
+      cursor.reader = &reader;
+    }
+    int32_t run_rows = (int32_t)MSH_PLY_MIN((int64_t)e * block_rows, el->count) - b * block_rows;
+    while (run_rows > 0 && !err_code)
+    {
+      int32_t count = MSH_PLY_MIN(run_rows, max_read_rows);
+      err_code      = msh_ply__read_rows_at(pf, &plan, &cursor, count, dst, row_size);
+      dst += (size_t)count * row_size;
+      run_rows -= count;
+    }
+    if (cursor.reader) { msh_ply__block_reader_term(cursor.reader); }
+    b = e;
+  }
+
+  if (!err_code) { msh_ply__dequantize(pf, desc, *desc->data_count); }
+  return err_code;
+}
+#endif /* MSH_PLY_ENCODER_ONLY */
+
+// ENCODER
+
+#ifndef MSH_PLY_DECODER_ONLY
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__add_element(msh_ply_t* pf,
+                     const char* element_name,
+                     const int32_t element_count)
+{
+  msh_ply_element_t el = msh_ply__element_zero_init();
+  strncpy(&el.name[0], element_name, 63);
+  el.name[63]   = '\0';
+  el.count      = element_count;
+  el.properties = NULL;
+  msh_ply_array_push_in(&pf->_arena, pf->elements, el);
+  return MSH_PLY_NO_ERR;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ASCII formatting helpers
+//
+// Values are formatted straight into memory, without going through printf. Floating point values
+// are printed with the fewest digits that still parse back to the same value, using the Grisu2
+// algorithm (F. Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers").
+// Grisu2 output always round-trips, though for a small fraction of doubles it is one digit
+// longer than the shortest possible one.
+
+// Upper bound on the length of a single formatted value, including the separator.
+#define MSH_PLY__MAX_VALUE_TEXT_LEN 32
+
+MSH_PLY_PRIVATE char*
+msh_ply__format_uint(char* dst, uint32_t value)
+{
+  static const char pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+  char tmp[10];
+  char* cp = tmp + sizeof(tmp);
+  while (value >= 100)
+  {
+    uint32_t r = value % 100;
+    value /= 100;
+    cp -= 2;
+    memcpy(cp, pairs + 2 * r, 2);
+  }
+  if (value >= 10)
+  {
+    cp -= 2;
+    memcpy(cp, pairs + 2 * value, 2);
+  }
+  else
+  {
+    *(--cp) = (char)('0' + value);
+  }
+  size_t len = (size_t)(tmp + sizeof(tmp) - cp);
+  memcpy(dst, cp, len);
+  return dst + len;
+}
+
+MSH_PLY_PRIVATE char*
+msh_ply__format_int(char* dst, int32_t value)
+{
+  if (value < 0)
+  {
+    *dst++ = '-';
+    return msh_ply__format_uint(dst, 0u - (uint32_t)value);
+  }
+  return msh_ply__format_uint(dst, (uint32_t)value);
+}
+
+// Floating point number with 64 bit significand, f * 2^e
+typedef struct msh_ply__diy_fp
+{
+  uint64_t f;
+  int32_t e;
+} msh_ply__diy_fp_t;
+
+MSH_PLY_PRIVATE msh_ply__diy_fp_t
+msh_ply__diy_fp(uint64_t f, int32_t e)
+{
+  msh_ply__diy_fp_t x;
+  x.f = f;
+  x.e = e;
+  return x;
+}
+
+// Product of 'a' and 'b', with significand rounded to its upper 64 bits.
+MSH_PLY_PRIVATE msh_ply__diy_fp_t
+msh_ply__diy_fp_mul(msh_ply__diy_fp_t a, msh_ply__diy_fp_t b)
+{
+  const uint64_t mask = 0xffffffffull;
+  uint64_t a_hi       = a.f >> 32;
+  uint64_t a_lo       = a.f & mask;
+  uint64_t b_hi       = b.f >> 32;
+  uint64_t b_lo       = b.f & mask;
+  uint64_t hi_hi      = a_hi * b_hi;
+  uint64_t hi_lo      = a_hi * b_lo;
+  uint64_t lo_hi      = a_lo * b_hi;
+  uint64_t lo_lo      = a_lo * b_lo;
+  uint64_t mid = (lo_lo >> 32) + (hi_lo & mask) + (lo_hi & mask) + (1ull << 31);
+  return msh_ply__diy_fp(hi_hi + (hi_lo >> 32) + (lo_hi >> 32) + (mid >> 32),
+                         a.e + b.e + 64);
+}
+
+// Shifts the significand of non-zero 'x' until its highest bit is set.
+MSH_PLY_PRIVATE msh_ply__diy_fp_t
+msh_ply__diy_fp_normalize(msh_ply__diy_fp_t x)
+{
+  static const int32_t shifts[] = {32, 16, 8, 4, 2, 1};
+  for (int32_t i = 0; i < 6; ++i)
+  {
+    if (!(x.f >> (64 - shifts[i])))
+    {
+      x.f <<= shifts[i];
+      x.e -= shifts[i];
+    }
+  }
+  return x;
+}
+
+// Returns cached power of ten 10^-k, such that multiplying a normalized number with exponent 'e'
+// by it gives a number with exponent within [-60, -32].
+MSH_PLY_PRIVATE msh_ply__diy_fp_t
+msh_ply__cached_power(int32_t e, int32_t* k)
+{
+  // Normalized powers 10^-348, 10^-340, ..., 10^340
+  static const uint64_t significands[] = {
+    0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+    0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+    0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+    0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+    0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+    0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+    0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+    0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+    0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+    0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+    0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+    0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+    0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+    0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+    0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+    0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+    0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+    0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+    0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+    0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+    0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+    0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+    0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+    0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+    0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+    0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+    0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+    0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+    0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull
+  };
+  static const int16_t exponents[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007,  -980,
+     -954,  -927,  -901,  -874,  -847,  -821,  -794,  -768,  -741,  -715,
+     -688,  -661,  -635,  -608,  -582,  -555,  -529,  -502,  -475,  -449,
+     -422,  -396,  -369,  -343,  -316,  -289,  -263,  -236,  -210,  -183,
+     -157,  -130,  -103,   -77,   -50,   -24,     3,    30,    56,    83,
+      109,   136,   162,   189,   216,   242,   269,   295,   322,   348,
+      375,   402,   428,   455,   481,   508,   534,   561,   588,   614,
+      641,   667,   694,   720,   747,   774,   800,   827,   853,   880,
+      907,   933,   960,   986,  1013,  1039,  1066
+  };
+  double dk   = (-61 - e) * 0.30102999566398114 + 347;
+  int32_t ik  = (int32_t)dk;
+  if (dk - ik > 0.0) { ik++; }
+  int32_t idx = (ik >> 3) + 1;
+  *k          = 348 - idx * 8;
+  return msh_ply__diy_fp(significands[idx], exponents[idx]);
+}
+
+// Moves the last digit closer to the exact value, while it stays within the rounding interval.
+MSH_PLY_PRIVATE void
+msh_ply__grisu_round(char* digits,
+                     int32_t len,
+                     uint64_t delta,
+                     uint64_t rest,
+                     uint64_t ten_kappa,
+                     uint64_t wp_w)
+{
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+  {
+    digits[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+// Generates digits of the upper boundary 'mp', until they land within 'delta' of it.
+MSH_PLY_PRIVATE int32_t
+msh_ply__grisu_digits(msh_ply__diy_fp_t w,
+                      msh_ply__diy_fp_t mp,
+                      uint64_t delta,
+                      char* digits,
+                      int32_t* k)
+{
+  static const uint64_t pow10[] = {1ull,
+                                   10ull,
+                                   100ull,
+                                   1000ull,
+                                   10000ull,
+                                   100000ull,
+                                   1000000ull,
+                                   10000000ull,
+                                   100000000ull,
+                                   1000000000ull,
+                                   10000000000ull,
+                                   100000000000ull,
+                                   1000000000000ull,
+                                   10000000000000ull,
+                                   100000000000000ull,
+                                   1000000000000000ull,
+                                   10000000000000000ull,
+                                   100000000000000000ull,
+                                   1000000000000000000ull,
+                                   10000000000000000000ull};
+  const int32_t shift = -mp.e;
+  const uint64_t one  = 1ull << shift;
+  const uint64_t wp_w = mp.f - w.f;
+  uint32_t p1         = (uint32_t)(mp.f >> shift);
+  uint64_t p2         = mp.f & (one - 1);
+  int32_t kappa       = 1;
+  while (kappa < 10 && p1 >= pow10[kappa]) { kappa++; }
+
+  int32_t len = 0;
+  while (kappa > 0)
+  {
+    uint32_t d = (uint32_t)(p1 / pow10[kappa - 1]);
+    p1         = (uint32_t)(p1 % pow10[kappa - 1]);
+    if (d || len) { digits[len++] = (char)('0' + d); }
+    kappa--;
+    uint64_t rest = ((uint64_t)p1 << shift) + p2;
+    if (rest <= delta)
+    {
+      *k += kappa;
+      msh_ply__grisu_round(digits, len, delta, rest, pow10[kappa] << shift, wp_w);
+      return len;
+    }
+  }
+  for (;;)
+  {
+    p2 *= 10;
+    delta *= 10;
+    uint32_t d = (uint32_t)(p2 >> shift);
+    if (d || len) { digits[len++] = (char)('0' + d); }
+    p2 &= one - 1;
+    kappa--;
+    if (p2 < delta)
+    {
+      *k += kappa;
+      uint64_t scale = (-kappa < 20) ? pow10[-kappa] : 0;
+      msh_ply__grisu_round(digits, len, delta, p2, one, wp_w * scale);
+      return len;
+    }
+  }
+}
+
+// Computes shortest digits of positive 'v', such that v ~= digits * 10^k. 'hidden_bit' is the
+// implicit leading bit of the significand of normal numbers. Returns number of digits.
+MSH_PLY_PRIVATE int32_t
+msh_ply__grisu2(msh_ply__diy_fp_t v, uint64_t hidden_bit, char* digits, int32_t* k)
+{
+  // Values halfway between 'v' and its neighbours.
+  msh_ply__diy_fp_t plus =
+    msh_ply__diy_fp_normalize(msh_ply__diy_fp((v.f << 1) + 1, v.e - 1));
+  msh_ply__diy_fp_t minus = (v.f == hidden_bit)
+                              ? msh_ply__diy_fp((v.f << 2) - 1, v.e - 2)
+                              : msh_ply__diy_fp((v.f << 1) - 1, v.e - 1);
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  msh_ply__diy_fp_t c_mk = msh_ply__cached_power(plus.e, k);
+  msh_ply__diy_fp_t w  = msh_ply__diy_fp_mul(msh_ply__diy_fp_normalize(v), c_mk);
+  msh_ply__diy_fp_t wp = msh_ply__diy_fp_mul(plus, c_mk);
+  msh_ply__diy_fp_t wm = msh_ply__diy_fp_mul(minus, c_mk);
+  // Products may be off by one unit, so the interval is narrowed to stay on the safe side.
+  wm.f++;
+  wp.f--;
+  return msh_ply__grisu_digits(w, wp, wp.f - wm.f, digits, k);
+}
+
+// Lays out 'len' digits of number digits * 10^k, in fixed notation when that is short enough.
+MSH_PLY_PRIVATE char*
+msh_ply__format_digits(char* dst, const char* digits, int32_t len, int32_t k)
+{
+  int32_t point = len + k;
+  if (k >= 0 && point <= 21)
+  {
+    // 1234e2 -> 123400
+    memcpy(dst, digits, (size_t)len);
+    memset(dst + len, '0', (size_t)k);
+    return dst + point;
+  }
+  if (point > 0 && point <= 21)
+  {
+    // 1234e-2 -> 12.34
+    memcpy(dst, digits, (size_t)point);
+    dst[point] = '.';
+    memcpy(dst + point + 1, digits + point, (size_t)(len - point));
+    return dst + len + 1;
+  }
+  if (point > -6 && point <= 0)
+  {
+    // 1234e-6 -> 0.001234
+    dst[0] = '0';
+    dst[1] = '.';
+    memset(dst + 2, '0', (size_t)(-point));
+    memcpy(dst + 2 - point, digits, (size_t)len);
+    return dst + 2 - point + len;
+  }
+  // 1234e-10 -> 1.234e-7
+  *dst++ = digits[0];
+  if (len > 1)
+  {
+    *dst++ = '.';
+    memcpy(dst, digits + 1, (size_t)(len - 1));
+    dst += len - 1;
+  }
+  *dst++           = 'e';
+  int32_t exponent = point - 1;
+  if (exponent < 0)
+  {
+    *dst++   = '-';
+    exponent = -exponent;
+  }
+  return msh_ply__format_uint(dst, (uint32_t)exponent);
+}
+
+// Formats value made of 'sign' bit, 'biased_exponent' and 'fraction' bits of an IEEE-754 number
+// with 'n_fraction_bits' bits of fraction and exponent 'bias'.
+MSH_PLY_PRIVATE char*
+msh_ply__format_ieee(char* dst,
+                     int32_t sign,
+                     int32_t biased_exponent,
+                     uint64_t fraction,
+                     int32_t n_fraction_bits,
+                     int32_t max_exponent,
+                     int32_t bias)
+{
+  if (biased_exponent == max_exponent)
+  {
+    if (sign && !fraction) { *dst++ = '-'; }
+    memcpy(dst, fraction ? "nan" : "inf", 3);
+    return dst + 3;
+  }
+  if (sign) { *dst++ = '-'; }
+  if (!biased_exponent && !fraction)
+  {
+    *dst++ = '0';
+    return dst;
+  }
+
+  uint64_t hidden_bit = 1ull << n_fraction_bits;
+  msh_ply__diy_fp_t v =
+    biased_exponent
+      ? msh_ply__diy_fp(fraction | hidden_bit, biased_exponent - bias - n_fraction_bits)
+      : msh_ply__diy_fp(fraction, 1 - bias - n_fraction_bits);
+  char digits[24];
+  int32_t k   = 0;
+  int32_t len = msh_ply__grisu2(v, hidden_bit, digits, &k);
+  return msh_ply__format_digits(dst, digits, len, k);
+}
+
+MSH_PLY_PRIVATE char*
+msh_ply__format_float(char* dst, float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return msh_ply__format_ieee(dst,
+                              (int32_t)(bits >> 31),
+                              (int32_t)((bits >> 23) & 0xff),
+                              bits & 0x7fffff,
+                              23,
+                              0xff,
+                              127);
+}
+
+MSH_PLY_PRIVATE char*
+msh_ply__format_double(char* dst, double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return msh_ply__format_ieee(dst,
+                              (int32_t)(bits >> 63),
+                              (int32_t)((bits >> 52) & 0x7ff),
+                              bits & 0xfffffffffffffull,
+                              52,
+                              0x7ff,
+                              1023);
+}
+
+#define MSH_PLY__FORMAT_VALUES(T, fmt_fn, fmt_type)                            \
+  for (int32_t i = 0; i < count; ++i)                                          \
+  {                                                                            \
+    T value;                                                                   \
+    memcpy(&value, src + i * sizeof(T), sizeof(T));                            \
+    dst    = fmt_fn(dst, (fmt_type)value);                                     \
+    *dst++ = ' ';                                                              \
+  }
+
+// Formats 'count' values of 'type' stored at 'src', each followed by a space. Needs room for
+// MSH_PLY__MAX_VALUE_TEXT_LEN characters per value. Returns the end of the text.
+MSH_PLY_PRIVATE char*
+msh_ply__format_values(char* dst,
+                       const uint8_t* src,
+                       msh_ply_type_id_t type,
+                       int32_t count)
+{
+  switch (type)
+  {
+    case MSH_PLY_UINT8: MSH_PLY__FORMAT_VALUES(uint8_t, msh_ply__format_uint, uint32_t); break;
+    case MSH_PLY_UINT16: MSH_PLY__FORMAT_VALUES(uint16_t, msh_ply__format_uint, uint32_t); break;
+    case MSH_PLY_UINT32: MSH_PLY__FORMAT_VALUES(uint32_t, msh_ply__format_uint, uint32_t); break;
+    case MSH_PLY_INT8: MSH_PLY__FORMAT_VALUES(int8_t, msh_ply__format_int, int32_t); break;
+    case MSH_PLY_INT16: MSH_PLY__FORMAT_VALUES(int16_t, msh_ply__format_int, int32_t); break;
+    case MSH_PLY_INT32: MSH_PLY__FORMAT_VALUES(int32_t, msh_ply__format_int, int32_t); break;
+    case MSH_PLY_FLOAT: MSH_PLY__FORMAT_VALUES(float, msh_ply__format_float, float); break;
+    case MSH_PLY_DOUBLE: MSH_PLY__FORMAT_VALUES(double, msh_ply__format_double, double); break;
+    default: break;
+  }
+  return dst;
+}
+#undef MSH_PLY__FORMAT_VALUES
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__add_property_to_element(msh_ply_t* pf,
+                                 const char* element_name,
+                                 const char** property_names,
+                                 int32_t num_properties,
+                                 const msh_ply_type_id_t data_type,
+                                 const msh_ply_type_id_t list_type,
+                                 void** data,
+                                 void** list_data,
+                                 int32_t element_count,
+                                 int32_t size_hint)
+{
+  // Check if list type is integral type
+  if (list_type == MSH_PLY_FLOAT || list_type == MSH_PLY_DOUBLE)
+  {
+    return MSH_PLY_INVALID_LIST_TYPE_ERR;
+  }
+  int8_t swap_endianness =
+    pf->format != MSH_PLY_ASCII ? (pf->_system_format != pf->format) : 0;
+
+  // Find / Create element
+  msh_ply_element_t* el = msh_ply_find_element(pf, element_name);
+  if (!el)
+  {
+    msh_ply__add_element(pf, element_name, element_count);
+    el = msh_ply_array_back(pf->elements);
+  }
+  if (el)
+  {
+    if (el->count != element_count)
+    {
+      return MSH_PLY_CONFLICTING_NUMBER_OF_ELEMENTS_ERR;
+    }
+
+    int32_t init_offset =
+      0;   // Helper variable for storing initial list offsets.
+    for (int32_t i = 0; i < num_properties; ++i)
+    {
+      msh_ply_property_t pr;
+      strncpy(&pr.name[0], property_names[i], 31);
+      pr.name[31] = '\0';
+
+      if (data == NULL) { return MSH_PLY_NULL_DATA_PTR_ERR; }
+
+      pr.type           = data_type;
+      pr.list_type      = list_type;
+      pr.byte_size      = msh_ply__type_to_byte_size(pr.type);
+      pr.list_byte_size = msh_ply__type_to_byte_size(pr.list_type);
+      pr.list_count     = (list_type == MSH_PLY_INVALID) ? 1 : size_hint;
+      pr.data           = *data;
+      pr.list_data      = (list_data != NULL) ? *list_data : NULL;
+      pr.offset         = pr.byte_size * i;
+      pr.stride         = pr.byte_size * num_properties;
+      pr.list_offset    = pr.list_byte_size * i;
+      pr.list_stride    = pr.list_byte_size * num_properties;
+      pr.total_byte_size =
+        (pr.list_byte_size + pr.list_count * pr.byte_size) * el->count;
+
+      if (pr.list_count == 0)   // No hint was present
+      {
+        pr.total_byte_size = 0;
+        for (int32_t j = 0; j < element_count; ++j)
+        {
+          // NOTE(maciej): list type needs to be dereferenced to correct type
+          int32_t offset = (pr.list_offset + j * pr.list_stride);
+          int32_t list_count =
+            msh_ply__get_data_as_int((uint8_t*)(*list_data) + offset,
+                                     list_type,
+                                     swap_endianness);
+          pr.total_byte_size += pr.list_byte_size + list_count * pr.byte_size;
+          if (
+            j ==
+            0)   // We care only about initial offset, so first element of list counts
+          {
+            pr.offset = init_offset;
+            init_offset += list_count * pr.byte_size;
+          }
+        }
+      }
+      else
+      {
+        pr.stride *= pr.list_count;
+      }
+      msh_ply_array_push_in(&pf->_arena, el->properties, pr);
+    }
+  }
+  else
+  {
+    return MSH_PLY_ELEMENT_NOT_FOUND_ERR;
+  }
+
+  return MSH_PLY_NO_ERR;
+}
+
+MSH_PLY_DEF int32_t
+msh_ply_add_property_to_element(msh_ply_t* pf, const msh_ply_desc_t* desc)
+{
+  if (!pf) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  int32_t desc_err = msh_ply__validate_descriptor(desc);
+  if (desc_err) { return desc_err; }
+  return msh_ply__add_property_to_element(pf,
+                                          desc->element_name,
+                                          desc->property_names,
+                                          desc->num_properties,
+                                          desc->data_type,
+                                          desc->list_type,
+                                          (void**)desc->data,
+                                          (void**)desc->list_data,
+                                          *desc->data_count,
+                                          desc->list_size_hint);
+}
+
+MSH_PLY_PRIVATE int32_t
+msh_ply__calculate_list_property_stride(const msh_ply_property_t* pr,
+                                        msh_ply_array(msh_ply_property_t)
+                                          el_properties,
+                                        int8_t swap_endianness)
+{
+  int32_t stride                          = 0;
+  int32_t offsets[MSH_PLY_MAX_PROPERTIES] = {0};
+  for (size_t l = 0; l < msh_ply_array_len(el_properties); ++l)
+  {
+    msh_ply_property_t* qr = &el_properties[l];
+    offsets[l]             = qr->list_offset;
+  }
+
+  for (size_t l = 0; l < msh_ply_array_len(el_properties); ++l)
+  {
+    msh_ply_property_t* qr = &el_properties[l];
+
+    if (pr->data == qr->data)
+    {
+      int32_t list_count =
+        msh_ply__get_data_as_int((uint8_t*)qr->list_data + offsets[l],
+                                 qr->list_type,
+                                 swap_endianness);
+      stride += list_count * qr->byte_size;
+      offsets[l] += qr->list_stride;
     }
-    default:
-      break;
   }
+  return ((stride > 0) ? stride : 0);
 }
-#undef MSH_PLY__COPY_DATA_AS_TYPE
 
-#ifndef MSH_PLY_ENCODER_ONLY
+////////////////////////////////////////////////////////////////////////////////
+// Gzip encoder
+//
+// Files opened with 'z' in their mode are written as gzip. The header goes into its own gzip
+// member, as a stored (uncompressed) deflate block, so that 'msh_ply_close' can still patch the
+// element counts in place. Element data follow in the second member, compressed with LZ77 over
+// hash chains, whose length grows with the compression level, and dynamic Huffman codes. Blocks
+// that would not get any smaller are stored instead.
+
+#define MSH_PLY__DEFLATE_WINDOW_SIZE (1 << 15)
+#define MSH_PLY__DEFLATE_INPUT_SIZE  (1 << 18)
+#define MSH_PLY__DEFLATE_BUF_SIZE    (MSH_PLY__DEFLATE_WINDOW_SIZE + MSH_PLY__DEFLATE_INPUT_SIZE)
+#define MSH_PLY__DEFLATE_HASH_BITS   15
+#define MSH_PLY__DEFLATE_MAX_SYMBOLS (1 << 15)
+#define MSH_PLY__DEFLATE_OUT_SIZE    (1 << 20)
+#define MSH_PLY__DEFLATE_MIN_MATCH   3
+#define MSH_PLY__DEFLATE_MAX_MATCH   258
+
+struct msh_ply__deflate
+{
+  FILE* fp;
+  int32_t max_chain;     // Number of earlier positions tried for each match, 0 stores data as is
+  int32_t nice_length;   // Match length that ends the search
+  int32_t lazy;          // Whether to check for a longer match at the next byte
+
+  // Window followed by the input that was not compressed yet. 'buf_offset' is the position of
+  // buf[0] in the stream (modulo 2^32), which the hash chains refer to.
+  uint8_t* buf;
+  size_t buf_size;
+  size_t pos;
+  size_t block_start;
+  uint32_t buf_offset;
+  uint32_t* head;   // Last position with a given hash of the next 3 bytes
+  uint32_t* prev;   // Previous position with the same hash, indexed by position modulo window
+
+  // Symbols of the current block. Distance of 0 marks a literal.
+  uint16_t* sym_values;
+  uint16_t* sym_dists;
+  int32_t n_symbols;
+  uint32_t lit_freq[286];
+  uint32_t dist_freq[30];
+  uint64_t n_extra_bits;
+
+  uint8_t* out;
+  size_t out_size;
+  uint64_t bits;
+  int32_t n_bits;
+
+  uint32_t crc;
+  uint32_t in_size;
+  uint32_t crc_table[8][256];
+  uint8_t length_codes[256];   // Length symbol (minus 257) of each match length (minus 3)
+  uint8_t dist_codes[512];     // Distance symbol, see 'msh_ply__deflate_dist_code'
+  int32_t err_code;
+};
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__parse_ply_cmd(char* line, msh_ply_t* pf)
+MSH_PLY_PRIVATE void
+msh_ply__crc32_init(uint32_t table[8][256])
 {
-  char cmd_str[MSH_PLY_MAX_STR_LEN];
-  if (sscanf(line, "%s", cmd_str))
+  for (uint32_t i = 0; i < 256; ++i)
   {
-    if (!strcmp(cmd_str, "ply"))
+    uint32_t c = i;
+    for (int32_t k = 0; k < 8; ++k) { c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1); }
+    table[0][i] = c;
+  }
+  for (uint32_t i = 0; i < 256; ++i)
+  {
+    for (int32_t k = 1; k < 8; ++k)
     {
-      pf->valid = true;
-      return MSH_PLY_NO_ERR;
+      table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
     }
   }
-  return MSH_PLY_INVALID_FILE_ERR;
 }
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__parse_format_cmd(char* line, msh_ply_t* pf)
+// Updates 'crc' with 'size' bytes of 'data', eight of them at a time.
+MSH_PLY_PRIVATE uint32_t
+msh_ply__crc32(const uint32_t table[8][256], uint32_t crc, const uint8_t* data, size_t size)
 {
-  char cmd[MSH_PLY_MAX_STR_LEN];
-  char frmt_str[MSH_PLY_MAX_STR_LEN];
-  char frmt_ver_str[MSH_PLY_MAX_STR_LEN];
-  if (sscanf(line, "%s %s %s", &cmd[0], &frmt_str[0], &frmt_ver_str[0]) != 3)
+  uint32_t c = ~crc;
+  for (; size >= 8; size -= 8, data += 8)
   {
-    return MSH_PLY_FORMAT_CMD_ERR;
+    uint32_t a = c ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                      ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+    uint32_t b = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) |
+                 ((uint32_t)data[7] << 24);
+    c = table[7][a & 0xff] ^ table[6][(a >> 8) & 0xff] ^ table[5][(a >> 16) & 0xff] ^
+        table[4][a >> 24] ^ table[3][b & 0xff] ^ table[2][(b >> 8) & 0xff] ^
+        table[1][(b >> 16) & 0xff] ^ table[0][b >> 24];
   }
-  if (!strcmp("ascii", frmt_str)) { pf->format = (int32_t)MSH_PLY_ASCII; }
-  else if (!strcmp("binary_little_endian", frmt_str))
+  for (size_t i = 0; i < size; ++i) { c = table[0][(c ^ data[i]) & 0xff] ^ (c >> 8); }
+  return ~c;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__deflate_flush_out(msh_ply__deflate_t* z)
+{
+  if (z->out_size && fwrite(z->out, z->out_size, 1, z->fp) != 1)
   {
-    pf->format = (int32_t)MSH_PLY_LITTLE_ENDIAN;
+    z->err_code = MSH_PLY_FILE_WRITE_ERR;
   }
-  else if (!strcmp("binary_big_endian", frmt_str))
+  z->out_size = 0;
+}
+
+MSH_PLY_PRIVATE MSH_PLY_INLINE void
+msh_ply__deflate_put_bits(msh_ply__deflate_t* z, uint32_t value, int32_t n)
+{
+  z->bits |= (uint64_t)value << z->n_bits;
+  z->n_bits += n;
+  if (z->n_bits >= 32)
   {
-    pf->format = (int32_t)MSH_PLY_BIG_ENDIAN;
+    uint8_t* dst = z->out + z->out_size;
+    dst[0]       = (uint8_t)z->bits;
+    dst[1]       = (uint8_t)(z->bits >> 8);
+    dst[2]       = (uint8_t)(z->bits >> 16);
+    dst[3]       = (uint8_t)(z->bits >> 24);
+    z->out_size += 4;
+    z->bits >>= 32;
+    z->n_bits -= 32;
+    if (z->out_size >= MSH_PLY__DEFLATE_OUT_SIZE) { msh_ply__deflate_flush_out(z); }
   }
-  else
+}
+
+// Pads the bits to a whole byte and moves them to the output.
+MSH_PLY_PRIVATE void
+msh_ply__deflate_align(msh_ply__deflate_t* z)
+{
+  while (z->n_bits > 0)
   {
-    return MSH_PLY_INVALID_FORMAT_ERR;
+    z->out[z->out_size++] = (uint8_t)z->bits;
+    z->bits >>= 8;
+    z->n_bits -= 8;
   }
-  pf->format_version = atoi(frmt_ver_str);
-  return MSH_PLY_NO_ERR;
+  z->bits   = 0;
+  z->n_bits = 0;
 }
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__parse_element_cmd(char* line, msh_ply_t* pf)
+MSH_PLY_PRIVATE void
+msh_ply__deflate_put_bytes(msh_ply__deflate_t* z, const uint8_t* data, size_t size)
 {
-  char cmd[MSH_PLY_MAX_STR_LEN];
-  msh_ply_element_t el = msh_ply__element_zero_init();
-  int32_t el_count     = 0;
-  el.properties        = NULL;
-  if (sscanf(line, "%s %s %d", &cmd[0], &el.name[0], &el_count) != 3)
+  while (size)
   {
-    return MSH_PLY_ELEMENT_CMD_ERR;
+    if (z->out_size >= MSH_PLY__DEFLATE_OUT_SIZE) { msh_ply__deflate_flush_out(z); }
+    size_t n = MSH_PLY_MIN(size, MSH_PLY__DEFLATE_OUT_SIZE - z->out_size);
+    memcpy(z->out + z->out_size, data, n);
+    z->out_size += n;
+    data += n;
+    size -= n;
   }
-  el.count = el_count;
-  msh_ply_array_push(pf->elements, el);
-  return MSH_PLY_NO_ERR;
 }
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__parse_property_cmd(char* line, msh_ply_t* pf)
+MSH_PLY_PRIVATE int
+msh_ply__compare_uint64(const void* a, const void* b)
 {
-  char cmd[MSH_PLY_MAX_STR_LEN];
-  char type_str[MSH_PLY_MAX_STR_LEN];
-  char list_str[MSH_PLY_MAX_STR_LEN];
-  char list_type_str[MSH_PLY_MAX_STR_LEN];
-  int32_t valid_format = 0;
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
 
-  msh_ply_element_t* el = msh_ply_array_back(pf->elements);
-  msh_ply_property_t pr = msh_ply__property_zero_init();
-  // Try to parse regular property format
-  if (sscanf(line, "%s %s %s", &cmd[0], &type_str[0], (char*)&pr.name) == 3)
+// Computes Huffman code lengths of 'n_symbols' symbols with frequencies 'freq', no longer than
+// 'max_length' bits. Frequencies are halved until the code fits. At least two symbols always get a
+// code, as some decoders reject codes with just one.
+MSH_PLY_PRIVATE void
+msh_ply__deflate_code_lengths(const uint32_t* freq,
+                              int32_t n_symbols,
+                              int32_t max_length,
+                              uint8_t* lengths)
+{
+  uint64_t leaves[286];
+  int32_t parents[2 * 286];
+  uint64_t weights[2 * 286];
+  int32_t n_leaves = 0;
+  for (int32_t i = 0; i < n_symbols; ++i)
   {
-    msh_ply__string_to_property_type(type_str, &pr.type, &pr.byte_size);
-    pr.list_type      = MSH_PLY_INVALID;
-    pr.list_byte_size = 0;
-    pr.list_count     = 1;
-    valid_format      = 1;
+    if (freq[i]) { leaves[n_leaves++] = ((uint64_t)freq[i] << 16) | (uint64_t)i; }
   }
-
-  // Try to parse list property format
-  cmd[0]           = 0;
-  type_str[0]      = 0;
-  list_str[0]      = 0;
-  list_type_str[0] = 0;
-  if (sscanf(line,
-             "%s %s %s %s %s",
-             &cmd[0],
-             &list_str[0],
-             &list_type_str[0],
-             &type_str[0],
-             (char*)&pr.name) == 5)
+  for (int32_t i = 0; n_leaves < 2; ++i)
   {
-    if (strcmp(list_str, "list")) { return MSH_PLY_PROPERTY_CMD_ERR; }
-    msh_ply__string_to_property_type(type_str, &pr.type, &pr.byte_size);
-    msh_ply__string_to_property_type(list_type_str,
-                                     &pr.list_type,
-                                     &pr.list_byte_size);
-    pr.list_count = 0;
-    valid_format  = 1;
+    if (!freq[i]) { leaves[n_leaves++] = (1ull << 16) | (uint64_t)i; }
   }
-  pr.total_byte_size = 0;
-  pr.total_count     = 0;
-  // Both failed
-  if (!valid_format) { return MSH_PLY_PROPERTY_CMD_ERR; }
+  qsort(leaves, (size_t)n_leaves, sizeof(uint64_t), msh_ply__compare_uint64);
+  memset(lengths, 0, (size_t)n_symbols);
 
-  // Either succeded
-  msh_ply_array_push(el->properties, pr);
+  for (int32_t shift = 0;; ++shift)
+  {
+    // Leaves are nodes [0, n_leaves) sorted by weight, and internal nodes are created in order of
+    // increasing weight, so two lightest nodes are always at the front of one of the two queues.
+    for (int32_t i = 0; i < n_leaves; ++i)
+    {
+      weights[i] = ((leaves[i] >> 16) >> shift) | 1;
+    }
+    int32_t next_leaf = 0;
+    int32_t next_node = n_leaves;
+    int32_t n_nodes   = n_leaves;
+    for (int32_t k = 0; k < n_leaves - 1; ++k)
+    {
+      int32_t children[2];
+      for (int32_t c = 0; c < 2; ++c)
+      {
+        if (next_leaf < n_leaves &&
+            (next_node >= n_nodes || weights[next_leaf] <= weights[next_node]))
+        {
+          children[c] = next_leaf++;
+        }
+        else
+        {
+          children[c] = next_node++;
+        }
+      }
+      weights[n_nodes]     = weights[children[0]] + weights[children[1]];
+      parents[children[0]] = n_nodes;
+      parents[children[1]] = n_nodes;
+      n_nodes++;
+    }
 
-  return MSH_PLY_NO_ERR;
+    // Root is the last node, and parents always come after their children.
+    int32_t depths[2 * 286];
+    int32_t max_depth    = 0;
+    depths[n_nodes - 1] = 0;
+    for (int32_t i = n_nodes - 2; i >= 0; --i)
+    {
+      depths[i] = depths[parents[i]] + 1;
+      if (i < n_leaves) { max_depth = MSH_PLY_MAX(max_depth, depths[i]); }
+    }
+    if (max_depth > max_length) { continue; }
+    for (int32_t i = 0; i < n_leaves; ++i)
+    {
+      lengths[leaves[i] & 0xffff] = (uint8_t)depths[i];
+    }
+    return;
+  }
 }
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__parse_command(char* cmd, char* line, msh_ply_t* pf)
+// Assigns canonical codes to 'lengths', bit reversed so that they can be written LSB first.
+MSH_PLY_PRIVATE void
+msh_ply__deflate_codes(const uint8_t* lengths, int32_t n_symbols, uint16_t* codes)
 {
-  if (!strcmp(cmd, "ply")) { return msh_ply__parse_ply_cmd(line, pf); }
-  if (!strcmp(cmd, "format")) { return msh_ply__parse_format_cmd(line, pf); }
-  if (!strcmp(cmd, "element")) { return msh_ply__parse_element_cmd(line, pf); }
-  if (!strcmp(cmd, "property"))
+  int32_t counts[16] = {0};
+  uint32_t next[16];
+  for (int32_t i = 0; i < n_symbols; ++i) { counts[lengths[i]]++; }
+  counts[0]     = 0;
+  uint32_t code = 0;
+  for (int32_t l = 1; l < 16; ++l)
   {
-    return msh_ply__parse_property_cmd(line, pf);
+    code    = (code + (uint32_t)counts[l - 1]) << 1;
+    next[l] = code;
+  }
+  for (int32_t i = 0; i < n_symbols; ++i)
+  {
+    int32_t l = lengths[i];
+    if (!l) { continue; }
+    uint32_t c = next[l]++;
+    uint32_t r = 0;
+    for (int32_t b = 0; b < l; ++b) { r |= ((c >> b) & 1) << (l - 1 - b); }
+    codes[i] = (uint16_t)r;
   }
-  return MSH_PLY_UNRECOGNIZED_CMD_ERR;
 }
 
-MSH_PLY_DEF int32_t
-msh_ply_parse_header(msh_ply_t* pf)
+MSH_PLY_PRIVATE MSH_PLY_INLINE int32_t
+msh_ply__deflate_dist_code(const msh_ply__deflate_t* z, uint32_t dist)
 {
-  int32_t line_no = 0;
-  char line[MSH_PLY_MAX_STR_LEN];
-  int32_t err_code = 0;
-  while (fgets(&line[0], MSH_PLY_MAX_STR_LEN, pf->_fp))
+  return (dist <= 256) ? z->dist_codes[dist - 1] : z->dist_codes[256 + ((dist - 1) >> 7)];
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__deflate_reset_block(msh_ply__deflate_t* z)
+{
+  memset(z->lit_freq, 0, sizeof(z->lit_freq));
+  memset(z->dist_freq, 0, sizeof(z->dist_freq));
+  z->n_symbols    = 0;
+  z->n_extra_bits = 0;
+  z->block_start  = z->pos;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__deflate_write_stored(msh_ply__deflate_t* z, int32_t is_final)
+{
+  const uint8_t* data = z->buf + z->block_start;
+  size_t size         = z->pos - z->block_start;
+  do
   {
-    line_no++;
-    char cmd[MSH_PLY_MAX_STR_LEN];
-    if (sscanf(line, "%s", cmd) != (unsigned)1)
+    size_t n = MSH_PLY_MIN(size, (size_t)0xffff);
+    msh_ply__deflate_put_bits(z, (is_final && n == size) ? 1 : 0, 1);
+    msh_ply__deflate_put_bits(z, 0, 2);
+    msh_ply__deflate_align(z);
+    msh_ply__deflate_put_bits(z, (uint32_t)n, 16);
+    msh_ply__deflate_put_bits(z, (uint32_t)(~n & 0xffff), 16);
+    msh_ply__deflate_align(z);
+    msh_ply__deflate_put_bytes(z, data, n);
+    data += n;
+    size -= n;
+  } while (size);
+}
+
+// Writes symbols of the current block with dynamic Huffman codes, or stores the block if that is
+// smaller.
+MSH_PLY_PRIVATE void
+msh_ply__deflate_write_block(msh_ply__deflate_t* z, int32_t is_final)
+{
+  static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                           2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const uint16_t length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,
+                                           15, 17, 19, 23, 27, 31, 35, 43, 51,  59,
+                                           67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                         6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+  static const uint16_t dist_base[30] = {1,    2,    3,    4,    5,    7,     9,     13,
+                                         17,   25,   33,   49,   65,   97,    129,   193,
+                                         257,  385,  513,  769,  1025, 1537,  2049,  3073,
+                                         4097, 6145, 8193, 12289, 16385, 24577};
+  static const uint8_t order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                    11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+  if (!z->n_symbols && !is_final) { return; }
+  if (!z->n_symbols)
+  {
+    // Empty final block, with fixed codes, where end of block is seven zero bits.
+    msh_ply__deflate_put_bits(z, 1, 1);
+    msh_ply__deflate_put_bits(z, 1, 2);
+    msh_ply__deflate_put_bits(z, 0, 7);
+    return;
+  }
+
+  uint8_t lengths[286 + 30];
+  uint8_t* lit_lengths  = lengths;
+  uint8_t* dist_lengths = lengths + 286;
+  z->lit_freq[256]      = 1;
+  msh_ply__deflate_code_lengths(z->lit_freq, 286, 15, lit_lengths);
+  msh_ply__deflate_code_lengths(z->dist_freq, 30, 15, dist_lengths);
+  int32_t n_lit  = 286;
+  int32_t n_dist = 30;
+  while (n_lit > 257 && !lit_lengths[n_lit - 1]) { n_lit--; }
+  while (n_dist > 1 && !dist_lengths[n_dist - 1]) { n_dist--; }
+
+  // Code lengths are run length encoded, and then Huffman coded themselves.
+  uint8_t all_lengths[286 + 30];
+  memcpy(all_lengths, lit_lengths, (size_t)n_lit);
+  memcpy(all_lengths + n_lit, dist_lengths, (size_t)n_dist);
+  int32_t n_lengths = n_lit + n_dist;
+  uint8_t runs[286 + 30];
+  uint8_t run_extras[286 + 30];
+  int32_t n_runs        = 0;
+  uint32_t cl_freq[19]  = {0};
+  uint64_t header_bits = 3 + 5 + 5 + 4;
+  for (int32_t i = 0; i < n_lengths;)
+  {
+    uint8_t value = all_lengths[i];
+    int32_t run   = 1;
+    while (i + run < n_lengths && all_lengths[i + run] == value) { run++; }
+    if (value == 0 && run >= 3)
     {
-      return MSH_PLY_LINE_PARSE_ERR;
+      run                = MSH_PLY_MIN(run, 138);
+      runs[n_runs]       = (run <= 10) ? 17 : 18;
+      run_extras[n_runs] = (uint8_t)((run <= 10) ? run - 3 : run - 11);
+      header_bits += (run <= 10) ? 3 : 7;
     }
-    if (!strcmp(cmd, "end_header")) break;
-    if (!strcmp(cmd, "comment")) continue;
-    if (!strcmp(cmd, "obj_info")) continue;
-    err_code = msh_ply__parse_command(cmd, line, pf);
-    if (err_code) break;
+    else if (value != 0 && run >= 4)
+    {
+      // First length is written as is, and the rest are repeats of it.
+      run                = MSH_PLY_MIN(run - 1, 6) + 1;
+      runs[n_runs]       = value;
+      run_extras[n_runs] = 0;
+      cl_freq[value]++;
+      n_runs++;
+      runs[n_runs]       = 16;
+      run_extras[n_runs] = (uint8_t)(run - 1 - 3);
+      header_bits += 2;
+    }
+    else
+    {
+      run                = 1;
+      runs[n_runs]       = value;
+      run_extras[n_runs] = 0;
+    }
+    cl_freq[runs[n_runs]]++;
+    n_runs++;
+    i += run;
   }
-  pf->_header_size = ftell(pf->_fp);
-  if (err_code == MSH_PLY_NO_ERR) { pf->_parsed = 1; }
-  return err_code;
+  uint8_t cl_lengths[19];
+  msh_ply__deflate_code_lengths(cl_freq, 19, 7, cl_lengths);
+  int32_t n_cl = 19;
+  while (n_cl > 4 && !cl_lengths[order[n_cl - 1]]) { n_cl--; }
+
+  uint64_t n_bits = header_bits + 3 * (uint64_t)n_cl + z->n_extra_bits;
+  for (int32_t i = 0; i < 19; ++i) { n_bits += (uint64_t)cl_freq[i] * cl_lengths[i]; }
+  for (int32_t i = 0; i < 286; ++i) { n_bits += (uint64_t)z->lit_freq[i] * lit_lengths[i]; }
+  for (int32_t i = 0; i < 30; ++i) { n_bits += (uint64_t)z->dist_freq[i] * dist_lengths[i]; }
+  size_t block_size = z->pos - z->block_start;
+  uint64_t stored_bits = 8 * ((uint64_t)block_size + 5 * (block_size / 0xffff + 1)) + 7;
+  if (stored_bits <= n_bits)
+  {
+    msh_ply__deflate_write_stored(z, is_final);
+    return;
+  }
+
+  uint16_t lit_codes[286];
+  uint16_t dist_codes[30];
+  uint16_t cl_codes[19];
+  msh_ply__deflate_codes(lit_lengths, 286, lit_codes);
+  msh_ply__deflate_codes(dist_lengths, 30, dist_codes);
+  msh_ply__deflate_codes(cl_lengths, 19, cl_codes);
+
+  msh_ply__deflate_put_bits(z, is_final ? 1 : 0, 1);
+  msh_ply__deflate_put_bits(z, 2, 2);
+  msh_ply__deflate_put_bits(z, (uint32_t)(n_lit - 257), 5);
+  msh_ply__deflate_put_bits(z, (uint32_t)(n_dist - 1), 5);
+  msh_ply__deflate_put_bits(z, (uint32_t)(n_cl - 4), 4);
+  for (int32_t i = 0; i < n_cl; ++i) { msh_ply__deflate_put_bits(z, cl_lengths[order[i]], 3); }
+  for (int32_t i = 0; i < n_runs; ++i)
+  {
+    uint8_t r = runs[i];
+    msh_ply__deflate_put_bits(z, cl_codes[r], cl_lengths[r]);
+    if (r == 16) { msh_ply__deflate_put_bits(z, run_extras[i], 2); }
+    if (r == 17) { msh_ply__deflate_put_bits(z, run_extras[i], 3); }
+    if (r == 18) { msh_ply__deflate_put_bits(z, run_extras[i], 7); }
+  }
+
+  for (int32_t i = 0; i < z->n_symbols; ++i)
+  {
+    uint32_t value = z->sym_values[i];
+    uint32_t dist  = z->sym_dists[i];
+    if (!dist)
+    {
+      msh_ply__deflate_put_bits(z, lit_codes[value], lit_lengths[value]);
+      continue;
+    }
+    int32_t lc = z->length_codes[value - MSH_PLY__DEFLATE_MIN_MATCH];
+    msh_ply__deflate_put_bits(z, lit_codes[257 + lc], lit_lengths[257 + lc]);
+    if (length_extra[lc])
+    {
+      msh_ply__deflate_put_bits(z, value - length_base[lc], length_extra[lc]);
+    }
+    int32_t dc = msh_ply__deflate_dist_code(z, dist);
+    msh_ply__deflate_put_bits(z, dist_codes[dc], dist_lengths[dc]);
+    if (dist_extra[dc]) { msh_ply__deflate_put_bits(z, dist - dist_base[dc], dist_extra[dc]); }
+  }
+  msh_ply__deflate_put_bits(z, lit_codes[256], lit_lengths[256]);
+}
+
+MSH_PLY_PRIVATE MSH_PLY_INLINE void
+msh_ply__deflate_insert(msh_ply__deflate_t* z, size_t pos)
+{
+  const uint8_t* p = z->buf + pos;
+  uint32_t key     = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2];
+  uint32_t h       = (key * 2654435761u) >> (32 - MSH_PLY__DEFLATE_HASH_BITS);
+  uint32_t abs_pos = z->buf_offset + (uint32_t)pos;
+  if (z->head[h] == abs_pos) { return; }
+  z->prev[abs_pos & (MSH_PLY__DEFLATE_WINDOW_SIZE - 1)] = z->head[h];
+  z->head[h]                                             = abs_pos;
 }
 
+// Finds the longest match of the bytes at 'pos' within the window. Returns its length, or 0.
 MSH_PLY_PRIVATE int32_t
-msh_ply__calculate_elem_size_ascii(msh_ply_t* pf, msh_ply_element_t* el)
+msh_ply__deflate_find_match(msh_ply__deflate_t* z, size_t pos, uint32_t* match_dist)
 {
-  char line[MSH_PLY_MAX_STR_LEN];
-  while (fgets(&line[0], MSH_PLY_MAX_STR_LEN, pf->_fp))
+  const uint8_t* p  = z->buf + pos;
+  uint32_t abs_pos  = z->buf_offset + (uint32_t)pos;
+  size_t max_length = MSH_PLY_MIN(z->buf_size - pos, (size_t)MSH_PLY__DEFLATE_MAX_MATCH);
+  int32_t best      = 0;
+  uint32_t cand     = z->prev[abs_pos & (MSH_PLY__DEFLATE_WINDOW_SIZE - 1)];
+  uint32_t dist     = abs_pos - cand;
+  for (int32_t chain = z->max_chain; chain > 0; --chain)
   {
-    char* cp_up  = &line[0];
-    char* cp_low = &line[0];
-
-    for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
+    // Positions older than the window or the buffer, or stale entries, end the chain.
+    if (dist == 0 || dist > MSH_PLY__DEFLATE_WINDOW_SIZE || dist > pos) { break; }
+    const uint8_t* q = p - dist;
+    if (q[best] == p[best] && q[0] == p[0] && q[1] == p[1])
     {
-      msh_ply_property_t* pr = &el->properties[j];
-      while (*cp_up != ' ' && *cp_up != '\n') { cp_up++; }
-      char tmp_cp_up = *cp_up;
-      *cp_up         = 0;   //Fake string end;
-
-      if (pr->list_type != MSH_PLY_INVALID)
+      size_t length = 2;
+      while (length + 8 <= max_length)
       {
-        switch (pr->list_type)
-        {
-          case MSH_PLY_INT8:
-          case MSH_PLY_INT16:
-          case MSH_PLY_INT32:
-          case MSH_PLY_UINT8:
-          case MSH_PLY_UINT16:
-          case MSH_PLY_UINT32:
-            pr->list_count = (int32_t)atoi(cp_low);
-            break;
-          case MSH_PLY_FLOAT:
-          case MSH_PLY_DOUBLE:
-            pr->list_count = (int32_t)atof(cp_low);
-            break;
-          default:
-            pr->list_count = 1;
-            break;
-        }
-
-        // skip
-        *cp_up = tmp_cp_up;
-        cp_low = cp_up;
-        cp_up++;
-        for (int32_t k = 0; k < pr->list_count; ++k)
-        {
-          while (*cp_up != ' ' && *cp_up != '\n') { cp_up++; }
-          cp_up++;
-        }
+        uint64_t a, b;
+        memcpy(&a, p + length, 8);
+        memcpy(&b, q + length, 8);
+        if (a != b) { break; }
+        length += 8;
       }
-
-      // fixup pointers
-      *cp_up = tmp_cp_up;
-      if (*cp_up != '\n')
+      while (length < max_length && p[length] == q[length]) { length++; }
+      if ((int32_t)length > best)
       {
-        cp_up++;
-        cp_low = cp_up;
+        best        = (int32_t)length;
+        *match_dist = dist;
+        if (best >= z->nice_length || length == max_length) { break; }
       }
-      pr->total_byte_size +=
-        pr->list_byte_size + pr->list_count * pr->byte_size;
-      pr->total_count += pr->list_count;
     }
+    uint32_t next      = z->prev[cand & (MSH_PLY__DEFLATE_WINDOW_SIZE - 1)];
+    uint32_t next_dist = abs_pos - next;
+    if (next_dist <= dist) { break; }
+    cand = next;
+    dist = next_dist;
   }
-  return MSH_PLY_NO_ERR;
+  return (best >= MSH_PLY__DEFLATE_MIN_MATCH) ? best : 0;
+}
+
+// Compresses buffered input. Unless this is the end of the stream, last few bytes are left for
+// the next call, so that matches can extend past the end of the buffer.
+MSH_PLY_PRIVATE void
+msh_ply__deflate_compress(msh_ply__deflate_t* z, int32_t is_final)
+{
+  size_t end = z->buf_size;
+  if (!is_final) { end = (end > MSH_PLY__DEFLATE_MAX_MATCH) ? end - MSH_PLY__DEFLATE_MAX_MATCH : 0; }
+
+  if (!z->max_chain)
+  {
+    z->pos = MSH_PLY_MAX(z->pos, end);
+    if (z->pos > z->block_start || is_final) { msh_ply__deflate_write_stored(z, is_final); }
+    msh_ply__deflate_reset_block(z);
+  }
+  uint32_t next_dist  = 0;
+  int32_t next_length = 0;
+  int32_t has_next    = 0;
+  while (z->pos < end)
+  {
+    size_t pos     = z->pos;
+    uint32_t dist  = next_dist;
+    int32_t length = has_next ? next_length : 0;
+    size_t hashed  = pos + 1;
+    if (!has_next && z->buf_size - pos >= MSH_PLY__DEFLATE_MIN_MATCH)
+    {
+      msh_ply__deflate_insert(z, pos);
+      length = msh_ply__deflate_find_match(z, pos, &dist);
+    }
+    has_next = 0;
+
+    // With lazy matching, the match is put off by a byte if a longer one starts there.
+    if (length && z->lazy && length < z->nice_length &&
+        z->buf_size - pos > MSH_PLY__DEFLATE_MIN_MATCH)
+    {
+      msh_ply__deflate_insert(z, pos + 1);
+      next_length = msh_ply__deflate_find_match(z, pos + 1, &next_dist);
+      has_next    = (next_length > length);
+      length      = has_next ? 0 : length;
+      hashed      = pos + 2;
+    }
+    int32_t s = z->n_symbols++;
+    if (length)
+    {
+      z->sym_values[s] = (uint16_t)length;
+      z->sym_dists[s]  = (uint16_t)dist;
+      int32_t lc       = z->length_codes[length - MSH_PLY__DEFLATE_MIN_MATCH];
+      int32_t dc       = msh_ply__deflate_dist_code(z, dist);
+      z->lit_freq[257 + lc]++;
+      z->dist_freq[dc]++;
+      z->n_extra_bits += (uint64_t)((lc >= 8 && lc < 28) ? (lc - 4) / 4 : 0);
+      z->n_extra_bits += (uint64_t)((dc >= 4) ? (dc - 2) / 2 : 0);
+      size_t match_end = pos + (size_t)length;
+      size_t hash_end  = MSH_PLY_MIN(match_end, z->buf_size - (MSH_PLY__DEFLATE_MIN_MATCH - 1));
+      for (size_t i = hashed; i < hash_end; ++i) { msh_ply__deflate_insert(z, i); }
+      z->pos = match_end;
+    }
+    else
+    {
+      z->sym_values[s] = z->buf[pos];
+      z->sym_dists[s]  = 0;
+      z->lit_freq[z->buf[pos]]++;
+      z->pos = pos + 1;
+    }
+    if (z->n_symbols == MSH_PLY__DEFLATE_MAX_SYMBOLS)
+    {
+      msh_ply__deflate_write_block(z, 0);
+      msh_ply__deflate_reset_block(z);
+    }
+  }
+  if (z->max_chain)
+  {
+    msh_ply__deflate_write_block(z, is_final);
+    msh_ply__deflate_reset_block(z);
+  }
+
+  // Only the window needs to stay in the buffer.
+  if (z->pos > MSH_PLY__DEFLATE_WINDOW_SIZE)
+  {
+    size_t shift = z->pos - MSH_PLY__DEFLATE_WINDOW_SIZE;
+    memmove(z->buf, z->buf + shift, z->buf_size - shift);
+    z->buf_size -= shift;
+    z->pos -= shift;
+    z->block_start -= shift;
+    z->buf_offset += (uint32_t)shift;
+  }
+}
+
+// Writes gzip member header, with no name, time or flags.
+MSH_PLY_PRIVATE void
+msh_ply__deflate_member_header(msh_ply__deflate_t* z)
+{
+  static const uint8_t header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+  msh_ply__deflate_put_bytes(z, header, sizeof(header));
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__deflate_member_trailer(msh_ply__deflate_t* z, uint32_t crc, uint32_t size)
+{
+  msh_ply__deflate_put_bits(z, crc & 0xffff, 16);
+  msh_ply__deflate_put_bits(z, crc >> 16, 16);
+  msh_ply__deflate_put_bits(z, size & 0xffff, 16);
+  msh_ply__deflate_put_bits(z, size >> 16, 16);
+}
+
+// Writes 'data' as a complete gzip member made of stored blocks.
+MSH_PLY_PRIVATE void
+msh_ply__deflate_stored_member(msh_ply__deflate_t* z, const uint8_t* data, size_t size)
+{
+  msh_ply__deflate_member_header(z);
+  size_t left = size;
+  do
+  {
+    size_t n = MSH_PLY_MIN(left, (size_t)0xffff);
+    msh_ply__deflate_put_bits(z, (n == left) ? 1 : 0, 8);
+    msh_ply__deflate_put_bits(z, (uint32_t)n, 16);
+    msh_ply__deflate_put_bits(z, (uint32_t)(~n & 0xffff), 16);
+    msh_ply__deflate_align(z);
+    msh_ply__deflate_put_bytes(z, data + size - left, n);
+    left -= n;
+  } while (left);
+  uint32_t crc = msh_ply__crc32((const uint32_t(*)[256])z->crc_table, 0, data, size);
+  msh_ply__deflate_member_trailer(z, crc, (uint32_t)size);
+  msh_ply__deflate_align(z);
+  msh_ply__deflate_flush_out(z);
+}
+
+MSH_PLY_PRIVATE msh_ply__deflate_t*
+msh_ply__deflate_create(FILE* fp, int32_t level)
+{
+  static const int32_t max_chains[10]   = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+  static const int32_t nice_lengths[10] = {0, 16, 32, 64, 96, 128, 160, 192, 258, 258};
+  static const uint16_t length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,
+                                           15, 17, 19, 23, 27, 31, 35, 43, 51,  59,
+                                           67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint16_t dist_base[30]   = {1,    2,    3,    4,    5,    7,     9,     13,
+                                           17,   25,   33,   49,   65,   97,    129,   193,
+                                           257,  385,  513,  769,  1025, 1537,  2049,  3073,
+                                           4097, 6145, 8193, 12289, 16385, 24577};
+
+  msh_ply__deflate_t* z = (msh_ply__deflate_t*)MSH_PLY_MALLOC(sizeof(msh_ply__deflate_t));
+  if (!z) { return NULL; }
+  memset(z, 0, sizeof(*z));
+  z->fp          = fp;
+  level          = MSH_PLY_MAX(0, MSH_PLY_MIN(level, 9));
+  z->max_chain   = max_chains[level];
+  z->nice_length = nice_lengths[level];
+  z->lazy        = (level >= 4);
+  z->buf         = (uint8_t*)MSH_PLY_MALLOC(MSH_PLY__DEFLATE_BUF_SIZE);
+  z->head = (uint32_t*)MSH_PLY_MALLOC(sizeof(uint32_t) << MSH_PLY__DEFLATE_HASH_BITS);
+  z->prev = (uint32_t*)MSH_PLY_MALLOC(sizeof(uint32_t) * MSH_PLY__DEFLATE_WINDOW_SIZE);
+  z->sym_values = (uint16_t*)MSH_PLY_MALLOC(sizeof(uint16_t) * MSH_PLY__DEFLATE_MAX_SYMBOLS);
+  z->sym_dists  = (uint16_t*)MSH_PLY_MALLOC(sizeof(uint16_t) * MSH_PLY__DEFLATE_MAX_SYMBOLS);
+  z->out        = (uint8_t*)MSH_PLY_MALLOC(MSH_PLY__DEFLATE_OUT_SIZE + 8);
+  if (!z->buf || !z->head || !z->prev || !z->sym_values || !z->sym_dists || !z->out)
+  {
+    z->err_code = MSH_PLY_FILE_WRITE_ERR;
+    return z;
+  }
+  // Positions are compared by their distance, so an empty table needs to be far away.
+  z->buf_offset = 0x80000000u;
+  memset(z->head, 0, sizeof(uint32_t) << MSH_PLY__DEFLATE_HASH_BITS);
+  memset(z->prev, 0, sizeof(uint32_t) * MSH_PLY__DEFLATE_WINDOW_SIZE);
+  msh_ply__crc32_init(z->crc_table);
+  for (int32_t lc = 0, length = 3; length <= MSH_PLY__DEFLATE_MAX_MATCH; ++length)
+  {
+    if (lc < 28 && length >= length_base[lc + 1]) { lc++; }
+    z->length_codes[length - 3] = (uint8_t)lc;
+  }
+  for (int32_t dc = 0, dist = 1; dist <= MSH_PLY__DEFLATE_WINDOW_SIZE; ++dist)
+  {
+    if (dc < 29 && dist >= dist_base[dc + 1]) { dc++; }
+    if (dist <= 256) { z->dist_codes[dist - 1] = (uint8_t)dc; }
+    else { z->dist_codes[256 + ((dist - 1) >> 7)] = (uint8_t)dc; }
+  }
+  return z;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__deflate_destroy(msh_ply__deflate_t* z)
+{
+  if (!z) { return; }
+  MSH_PLY_FREE(z->buf);
+  MSH_PLY_FREE(z->head);
+  MSH_PLY_FREE(z->prev);
+  MSH_PLY_FREE(z->sym_values);
+  MSH_PLY_FREE(z->sym_dists);
+  MSH_PLY_FREE(z->out);
+  MSH_PLY_FREE(z);
 }
 
-// NOTE(maciej): This is less than stellar, as it is actually reading file line by line.
-// Should replace it with buffered reading / read the whole file and parse it
 MSH_PLY_PRIVATE int32_t
-msh_ply__calculate_elem_size_binary(msh_ply_t* pf, msh_ply_element_t* el)
+msh_ply__deflate_write(msh_ply__deflate_t* z, const void* data, size_t size)
 {
-  for (size_t i = 0; i < el->count; ++i)
+  const uint8_t* src = (const uint8_t*)data;
+  if (z->err_code) { return z->err_code; }
+  z->crc = msh_ply__crc32((const uint32_t(*)[256])z->crc_table, z->crc, src, size);
+  z->in_size += (uint32_t)size;
+  while (size && !z->err_code)
   {
-    for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
-    {
-      msh_ply_property_t* pr = &el->properties[j];
-      if (pr->list_type == MSH_PLY_INVALID)
-      {
-        pr->total_count += 1;
-        pr->total_byte_size += pr->byte_size;
-        double dummy_data = 0;
-        size_t read_count = fread(&dummy_data, pr->byte_size, 1, pf->_fp);
-        if (read_count != 1) { return MSH_PLY_BINARY_PARSE_ERR; }
-      }
-      else
-      {
-        int32_t count                                = 1;
-        double dummy_data[MSH_PLY_MAX_LIST_ELEMENTS] = {0};
-
-        size_t read_count = fread(&count, pr->list_byte_size, 1, pf->_fp);
-        if (read_count != 1) { return MSH_PLY_BINARY_PARSE_ERR; }
+    size_t n = MSH_PLY_MIN(size, MSH_PLY__DEFLATE_BUF_SIZE - z->buf_size);
+    memcpy(z->buf + z->buf_size, src, n);
+    z->buf_size += n;
+    src += n;
+    size -= n;
+    if (z->buf_size == MSH_PLY__DEFLATE_BUF_SIZE) { msh_ply__deflate_compress(z, 0); }
+  }
+  return z->err_code;
+}
 
-        read_count = fread(&dummy_data[0], pr->byte_size, count, pf->_fp);
-        if (read_count != (size_t)count) { return MSH_PLY_BINARY_PARSE_ERR; }
+// Compresses the rest of the input and ends the member.
+MSH_PLY_PRIVATE int32_t
+msh_ply__deflate_finish(msh_ply__deflate_t* z)
+{
+  if (z->err_code) { return z->err_code; }
+  msh_ply__deflate_compress(z, 1);
+  msh_ply__deflate_align(z);
+  msh_ply__deflate_member_trailer(z, z->crc, z->in_size);
+  msh_ply__deflate_align(z);
+  msh_ply__deflate_flush_out(z);
+  return z->err_code;
+}
 
-        pr->total_count += count;
-        pr->total_byte_size += pr->list_byte_size + count * pr->byte_size;
-      }
-    }
+MSH_PLY_PRIVATE void
+msh_ply__append_header_text(msh_ply_t* pf, const char* text)
+{
+  for (const char* c = text; *c; ++c)
+  {
+    msh_ply_array_push_in(&pf->_arena, pf->_header_text, *c);
   }
-  return MSH_PLY_NO_ERR;
 }
 
+// Writes the header text at the current file position - as is, or as a separate gzip member.
 MSH_PLY_PRIVATE int32_t
-msh_ply__can_precalculate_sizes(msh_ply_element_t* el)
+msh_ply__write_header_text(msh_ply_t* pf)
 {
-  int32_t can_precalculate = 1;
-  for (size_t i = 0; i < msh_ply_array_len(el->properties); ++i)
+  size_t size = msh_ply_array_len(pf->_header_text);
+  if (pf->_deflate)
   {
-    msh_ply_property_t* pr = &el->properties[i];
-    if (pr->list_type != MSH_PLY_INVALID && pr->list_count == 0)
-    {
-      can_precalculate = 0;
-      break;
-    }
+    msh_ply__deflate_stored_member(pf->_deflate, (const uint8_t*)pf->_header_text, size);
+    return pf->_deflate->err_code;
   }
+  if (fwrite(pf->_header_text, size, 1, pf->_fp) != 1) { return MSH_PLY_FILE_WRITE_ERR; }
+  return MSH_PLY_NO_ERR;
+}
 
-  return can_precalculate;
+// Writes element data, compressing them if needed.
+MSH_PLY_PRIVATE int32_t
+msh_ply__write_bytes(const msh_ply_t* pf, const void* data, size_t size)
+{
+  if (!size) { return MSH_PLY_NO_ERR; }
+  if (pf->_deflate) { return msh_ply__deflate_write(pf->_deflate, data, size); }
+  if (fwrite(data, size, 1, pf->_fp) != 1) { return MSH_PLY_FILE_WRITE_ERR; }
+  return MSH_PLY_NO_ERR;
 }
 
 MSH_PLY_PRIVATE int32_t
-msh_ply__synchronize_list_sizes(msh_ply_t* pf)
+msh_ply__write_header(msh_ply_t* pf)
 {
-  int32_t error_code = MSH_PLY_NO_ERR;
-  for (size_t k = 0; k < msh_ply_array_len(pf->descriptors); ++k)
+  if (!pf->_fp) { return MSH_PLY_INVALID_FILE_ERR; }
+  else
   {
-    msh_ply_desc_t* desc  = pf->descriptors[k];
-    msh_ply_element_t* el = NULL;
-    for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+    char* format_string = NULL;
+    switch (pf->format)
     {
-      msh_ply_element_t* cur_el = &pf->elements[i];
-      if (!strcmp(desc->element_name, cur_el->name))
+      case MSH_PLY_ASCII:
       {
-        el = cur_el;
+        format_string = (char*)"ascii";
+        break;
+      }
+      case MSH_PLY_LITTLE_ENDIAN:
+      {
+        format_string = (char*)"binary_little_endian";
+        break;
+      }
+      case MSH_PLY_BIG_ENDIAN:
+      {
+        format_string = (char*)"binary_big_endian";
         break;
       }
+      default:
+      {
+        return MSH_PLY_INVALID_FORMAT_ERR;
+      }
     }
 
-    if (el == NULL)
+    // Header is formatted in memory first, so that element counts can be patched in the same text.
+    char line[MSH_PLY_MAX_STR_LEN];
+    snprintf(line,
+             MSH_PLY_MAX_STR_LEN,
+             "ply\nformat %s %2.1f\n",
+             format_string,
+             (float)pf->format_version);
+    msh_ply__append_header_text(pf, line);
+    if (pf->_reordered)
     {
-      error_code = MSH_PLY_ELEMENT_NOT_FOUND_ERR;
-      return error_code;
+      const msh_ply__spatial_order_t* so = &pf->_spatial_order;
+      snprintf(line,
+               MSH_PLY_MAX_STR_LEN,
+               "comment spatial_order %s %s %s %s %s\n",
+               so->element_name,
+               so->curve == MSH_PLY_CURVE_MORTON ? "morton" : "hilbert",
+               so->names[0],
+               so->names[1],
+               so->names[2]);
+      msh_ply__append_header_text(pf, line);
     }
-
-    for (int32_t i = 0; i < desc->num_properties; ++i)
+    for (size_t i = 0; i < msh_ply_array_len(pf->_quantized); ++i)
     {
-      int32_t found = 0;
-      for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
+      int32_t k = pf->_quantized[i]->quantizer;
+      if (k < 0) { continue; }
+      const msh_ply__quantizer_t* q = &pf->_quantizers[k];
+      if (q->is_normal)
+      {
+        snprintf(line,
+                 MSH_PLY_MAX_STR_LEN,
+                 "comment octahedral %s %s %s %s %d\n",
+                 q->element_name,
+                 q->names[0],
+                 q->names[1],
+                 q->names[2],
+                 q->bits);
+      }
+      else
+      {
+        snprintf(line,
+                 MSH_PLY_MAX_STR_LEN,
+                 "comment quantized %s %s %s %s %d %.9g %.9g %.9g %.9g %.9g %.9g\n",
+                 q->element_name,
+                 q->names[0],
+                 q->names[1],
+                 q->names[2],
+                 q->bits,
+                 q->min[0],
+                 q->min[1],
+                 q->min[2],
+                 q->max[0],
+                 q->max[1],
+                 q->max[2]);
+      }
+      msh_ply__append_header_text(pf, line);
+    }
+    for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+    {
+      msh_ply_element_t* el = &pf->elements[i];
+      if (pf->_stream_element < 0)
+      {
+        snprintf(line, MSH_PLY_MAX_STR_LEN, "element %s %d\n", el->name, (int32_t)el->count);
+        msh_ply__append_header_text(pf, line);
+      }
+      else
+      {
+        // Element count is not known yet - leave space for it, to be filled in at the end.
+        snprintf(line, MSH_PLY_MAX_STR_LEN, "element %s ", el->name);
+        msh_ply__append_header_text(pf, line);
+        el->count_offset = (long)msh_ply_array_len(pf->_header_text);
+        msh_ply__append_header_text(pf, "0000000000\n");
+      }
+      for (size_t j = 0; j < msh_ply_array_len(el->properties); j++)
       {
         msh_ply_property_t* pr = &el->properties[j];
-        if (!strcmp(pr->name, desc->property_names[i]))
+        char* pr_type_str      = NULL;
+        msh_ply__property_type_to_string(pr->type, &pr_type_str);
+
+        if (pr->list_type == MSH_PLY_INVALID)
         {
-          if (pr->list_type != MSH_PLY_INVALID)
-          {
-            pr->list_count = desc->list_size_hint;
-            if (desc->list_data == NULL) { desc->list_type = pr->list_type; }
-          }
-          else
-          {
-            pr->list_count       = 1;
-            desc->list_size_hint = 1;
-          }
-          found = 1;
-          break;
+          snprintf(line, MSH_PLY_MAX_STR_LEN, "property %s %s\n", pr_type_str, pr->name);
         }
-      }
-      if (!found)
-      {
-        error_code = MSH_PLY_PROPERTY_NOT_FOUND_ERR;
-        return error_code;
+        else
+        {
+          char* pr_list_type_str = NULL;
+          msh_ply__property_type_to_string(pr->list_type, &pr_list_type_str);
+          snprintf(line,
+                   MSH_PLY_MAX_STR_LEN,
+                   "property list %s %s %s\n",
+                   pr_list_type_str,
+                   pr_type_str,
+                   pr->name);
+        }
+        msh_ply__append_header_text(pf, line);
       }
     }
-  }
+    msh_ply__append_header_text(pf, "end_header\n");
 
+    // Element data of compressed files follow in a gzip member of their own.
+    if (pf->_compression_level >= 0)
+    {
+      pf->_deflate = msh_ply__deflate_create(pf->_fp, pf->_compression_level);
+      if (!pf->_deflate) { return MSH_PLY_FILE_WRITE_ERR; }
+    }
+    int32_t err_code = msh_ply__write_header_text(pf);
+    if (err_code) { return err_code; }
+    if (pf->_deflate) { msh_ply__deflate_member_header(pf->_deflate); }
+  }
   return MSH_PLY_NO_ERR;
 }
 
-MSH_PLY_DEF int32_t
-msh_ply_parse_contents(msh_ply_t* pf)
+// Staging buffer for binary output, flushed to the file whenever it fills up
+typedef struct msh_ply__write_buffer
 {
-  int32_t err_code = MSH_PLY_NO_ERR;
-  err_code         = msh_ply__synchronize_list_sizes(pf);
-  if (err_code) { return err_code; }
+  uint8_t* data;
+  size_t size;
+  size_t cap;
+  int32_t err_code;
+} msh_ply__write_buffer_t;
 
-  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+MSH_PLY_PRIVATE void
+msh_ply__write_buffer_flush(msh_ply_t* pf, msh_ply__write_buffer_t* buf)
+{
+  int32_t err_code = msh_ply__write_bytes(pf, buf->data, buf->size);
+  if (err_code) { buf->err_code = err_code; }
+  buf->size = 0;
+}
+
+// Returns pointer to 'n_bytes' of space at the end of the buffer.
+MSH_PLY_PRIVATE uint8_t*
+msh_ply__write_buffer_reserve(msh_ply_t* pf,
+                              msh_ply__write_buffer_t* buf,
+                              size_t n_bytes)
+{
+  if (buf->size + n_bytes > buf->cap) { msh_ply__write_buffer_flush(pf, buf); }
+  if (n_bytes > buf->cap)
   {
-    // If user did not ask for last element, we can skip reading it all together
-    int32_t can_skip = (i == msh_ply_array_len(pf->elements) - 1);
-    if (can_skip)
+    uint8_t* new_data = (uint8_t*)MSH_PLY_REALLOC(buf->data, n_bytes);
+    if (!new_data)
     {
-      for (size_t j = 0; j < msh_ply_array_len(pf->descriptors); ++j)
+      buf->err_code = MSH_PLY_FILE_WRITE_ERR;
+      return NULL;
+    }
+    buf->data = new_data;
+    buf->cap  = n_bytes;
+  }
+  uint8_t* dst = buf->data + buf->size;
+  buf->size += n_bytes;
+  return dst;
+}
+
+MSH_PLY_PRIVATE void
+msh_ply__write_values(msh_ply_t* pf,
+                      msh_ply__write_buffer_t* buf,
+                      const uint8_t* src,
+                      msh_ply_type_id_t type,
+                      int32_t count)
+{
+  int32_t byte_size = msh_ply__type_to_byte_size(type);
+  uint8_t* dst = msh_ply__write_buffer_reserve(pf, buf, (size_t)count * byte_size);
+  if (!dst) { return; }
+  memcpy(dst, src, (size_t)count * byte_size);
+  if (pf->_system_format != pf->format)
+  {
+    msh_ply__swap_bytes(dst, byte_size, count);
+  }
+}
+
+typedef struct msh_ply__row_source
+{
+  const msh_ply_desc_t* desc;
+  const uint8_t* data;
+  const uint8_t* list_data;
+} msh_ply__row_source_t;
+
+// Moves 'sources' past 'n_rows' rows.
+MSH_PLY_PRIVATE void
+msh_ply__advance_row_sources(msh_ply__row_source_t* sources,
+                             int32_t n_sources,
+                             int32_t n_rows)
+{
+  for (int32_t s = 0; s < n_sources; ++s)
+  {
+    msh_ply__row_source_t* source = &sources[s];
+    const msh_ply_desc_t* desc    = source->desc;
+    size_t byte_size = (size_t)msh_ply__type_to_byte_size(desc->data_type);
+    size_t n_values  = (size_t)n_rows * desc->num_properties;
+    if (desc->list_type != MSH_PLY_INVALID)
+    {
+      if (desc->list_size_hint) { n_values *= desc->list_size_hint; }
+      else
       {
-        if (!strcmp(pf->descriptors[j]->element_name, pf->elements[i].name))
+        int32_t list_byte_size = msh_ply__type_to_byte_size(desc->list_type);
+        size_t n_lists         = n_values;
+        n_values               = 0;
+        for (size_t i = 0; i < n_lists; ++i)
         {
-          can_skip = 0;
-          break;
+          n_values += msh_ply__get_data_as_int((void*)source->list_data,
+                                               desc->list_type,
+                                               0);
+          source->list_data += list_byte_size;
         }
       }
     }
-    if (can_skip) { continue; }
+    source->data += n_values * byte_size;
+  }
+}
 
-    msh_ply_element_t* el  = &pf->elements[i];
-    int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+// Rows of ASCII elements are formatted in ranges of this many rows, which are then written with a
+// single call to fwrite.
+#define MSH_PLY__TEXT_TASK_ROWS (1 << 15)
 
-    if (el->count <= 0 || num_properties <= 0) { continue; }
-    el->file_anchor = ftell(pf->_fp);
+// Formatting of a range of 'n_rows' rows of element 'el', which starts at 'sources'.
+typedef struct msh_ply__text_task
+{
+  const msh_ply_element_t* el;
+  msh_ply__row_source_t sources[MSH_PLY_MAX_PROPERTIES];
+  int32_t n_sources;
+  int32_t n_rows;
+  char* text;
+  size_t size;
+  size_t cap;
+  int32_t err_code;
+} msh_ply__text_task_t;
 
-    // Determine if any of the properties in the element has list
-    int32_t can_precalculate_size = msh_ply__can_precalculate_sizes(el);
-    if (can_precalculate_size)
+// Runs a text task. On return, task's sources point past its last row.
+MSH_PLY_PRIVATE void
+msh_ply__format_rows(void* params)
+{
+  msh_ply__text_task_t* task  = (msh_ply__text_task_t*)params;
+  const msh_ply_element_t* el = task->el;
+  task->size                  = 0;
+
+  for (int32_t i = 0; i < task->n_rows; ++i)
+  {
+    int32_t k = 0;
+    for (int32_t s = 0; s < task->n_sources; ++s)
     {
-      // This is a faster path, as we can just calculate the size required by element in one go.
-      int32_t elem_size = 0;
-      for (int32_t j = 0; j < num_properties; ++j)
+      msh_ply__row_source_t* source = &task->sources[s];
+      const msh_ply_desc_t* desc    = source->desc;
+      for (int32_t j = 0; j < desc->num_properties; ++j)
       {
-        msh_ply_property_t* pr = &el->properties[j];
-        pr->total_byte_size    = pr->byte_size * pr->list_count * el->count;
-        elem_size += pr->byte_size * pr->list_count;
+        const msh_ply_property_t* pr = &el->properties[k++];
+        int32_t count                = 1;
         if (pr->list_type != MSH_PLY_INVALID)
         {
-          pr->total_byte_size += pr->list_byte_size * el->count;
-          elem_size += pr->list_byte_size;
+          count = desc->list_size_hint;
+          if (!count)
+          {
+            count = msh_ply__get_data_as_int((void*)source->list_data,
+                                             pr->list_type,
+                                             0);
+            source->list_data += pr->list_byte_size;
+          }
         }
-        pr->total_count += pr->list_count * el->count;
-      }
 
-      if (pf->format != MSH_PLY_ASCII)
-      {
-        fseek(pf->_fp, el->count * elem_size, SEEK_CUR);
-      }
-      else
-      {
-        char line[MSH_PLY_MAX_STR_LEN];
-        for (size_t j = 0; j < el->count; ++j)
+        size_t max_size = ((size_t)count + 2) * MSH_PLY__MAX_VALUE_TEXT_LEN;
+        if (task->size + max_size > task->cap)
         {
-          char* ret = fgets(&line[0], MSH_PLY_MAX_STR_LEN, pf->_fp);
-          if (!ret)
+          size_t new_cap = MSH_PLY_MAX(2 * task->cap, task->size + max_size);
+          char* new_text = (char*)MSH_PLY_REALLOC(task->text, new_cap);
+          if (!new_text)
           {
-            if (ferror(pf->_fp)) { return MSH_PLY_ASCII_FILE_READ_ERR; }
-            if (feof(pf->_fp)) { return MSH_PLY_ASCII_FILE_EOF_ERR; }
+            task->err_code = MSH_PLY_FILE_WRITE_ERR;
+            return;
           }
+          task->text = new_text;
+          task->cap  = new_cap;
         }
+
+        char* dst = task->text + task->size;
+        if (pr->list_type != MSH_PLY_INVALID)
+        {
+          dst    = msh_ply__format_int(dst, count);
+          *dst++ = ' ';
+        }
+        dst = msh_ply__format_values(dst, source->data, pr->type, count);
+        source->data += (size_t)count * pr->byte_size;
+        task->size = (size_t)(dst - task->text);
       }
     }
-    else
-    {
-      // There exists a list property. We need to calculate required size via pass through
-      if (pf->format == MSH_PLY_ASCII)
-      {
-        err_code = msh_ply__calculate_elem_size_ascii(pf, el);
-      }
-      else
-      {
-        err_code = msh_ply__calculate_elem_size_binary(pf, el);
-      }
-    }
+    // Every row has at least one value, so we end it in place of the last separator
+    if (task->size) { task->text[task->size - 1] = '\n'; }
   }
-
-  return err_code;
 }
 
+// Formats rows into text in memory and writes them in large blocks. When more threads are
+// available, consecutive row ranges are formatted in parallel, and written in order.
 MSH_PLY_PRIVATE int32_t
-msh_ply__get_element_count(const msh_ply_element_t* el, int32_t* count)
+msh_ply__write_rows_ascii(msh_ply_t* pf,
+                          const msh_ply_element_t* el,
+                          msh_ply__row_source_t* sources,
+                          int32_t n_sources,
+                          int32_t n_rows)
 {
-  int32_t err_code = MSH_PLY_NO_ERR;
-  *count           = el->count;
-  return err_code;
-}
+  int32_t n_tasks  = msh_ply__get_num_threads(pf);
+  int32_t max_tasks = (n_rows + MSH_PLY__TEXT_TASK_ROWS - 1) / MSH_PLY__TEXT_TASK_ROWS;
+  if (n_tasks > max_tasks) { n_tasks = max_tasks; }
+  msh_ply__text_task_t* tasks =
+    (msh_ply__text_task_t*)MSH_PLY_MALLOC(n_tasks * sizeof(msh_ply__text_task_t));
+  if (!tasks) { return MSH_PLY_FILE_WRITE_ERR; }
+  for (int32_t t = 0; t < n_tasks; ++t)
+  {
+    tasks[t].text     = NULL;
+    tasks[t].cap      = 0;
+    tasks[t].err_code = MSH_PLY_NO_ERR;
+  }
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__get_element_size(const msh_ply_element_t* el, size_t* size)
-{
   int32_t err_code = MSH_PLY_NO_ERR;
-
-  *size = 0;
-  for (size_t i = 0; i < msh_ply_array_len(el->properties); ++i)
+  while (n_rows > 0 && !err_code)
   {
-    *size += el->properties[i].total_byte_size;
-  }
-  return err_code;
-}
+    int32_t n_batch_tasks = 0;
+    while (n_batch_tasks < n_tasks && n_rows > 0)
+    {
+      msh_ply__text_task_t* task = &tasks[n_batch_tasks++];
+      task->el                   = el;
+      task->n_sources            = n_sources;
+      task->n_rows               = MSH_PLY_MIN(n_rows, MSH_PLY__TEXT_TASK_ROWS);
+      memcpy(task->sources, sources, n_sources * sizeof(msh_ply__row_source_t));
+      n_rows -= task->n_rows;
+      // Only the starts of the following tasks need to be found up front
+      if (n_batch_tasks < n_tasks && n_rows > 0)
+      {
+        msh_ply__advance_row_sources(sources, n_sources, task->n_rows);
+      }
+    }
 
-// NOTE(maciej): this works better with an assignment
-#define MSH_PLY__CONVERT_AND_ASSIGN(D, C, T, conv_funct)                       \
-  do {                                                                         \
-    T n        = (T)conv_funct(C);                                             \
-    *((T*)(D)) = n;                                                            \
-    (D) += sizeof(T);                                                          \
-  } while (0)
+    msh_ply__run_tasks(pf,
+                       msh_ply__format_rows,
+                       tasks,
+                       sizeof(msh_ply__text_task_t),
+                       n_batch_tasks);
 
-MSH_PLY_PRIVATE MSH_PLY_INLINE void
-msh_ply__ascii_to_value(char** dst, char* src, const int32_t type)
-{
-  switch (type)
-  {
-    case MSH_PLY_INT8:
-      MSH_PLY__CONVERT_AND_ASSIGN(*dst, src, int8_t, atoi);
-      break;
-    case MSH_PLY_INT16:
-      MSH_PLY__CONVERT_AND_ASSIGN(*dst, src, int16_t, atoi);
-      break;
-    case MSH_PLY_INT32:
-      MSH_PLY__CONVERT_AND_ASSIGN(*dst, src, int32_t, atoi);
-      break;
-    case MSH_PLY_UINT8:
-      MSH_PLY__CONVERT_AND_ASSIGN(*dst, src, uint8_t, atoi);
-      break;
-    case MSH_PLY_UINT16:
-      MSH_PLY__CONVERT_AND_ASSIGN(*dst, src, uint16_t, atoi);
-      break;
-    case MSH_PLY_UINT32:
-      MSH_PLY__CONVERT_AND_ASSIGN(*dst, src, uint32_t, atoi);
-      break;
-    case MSH_PLY_FLOAT:
-      MSH_PLY__CONVERT_AND_ASSIGN(*dst, src, float, atof);
-      break;
-    case MSH_PLY_DOUBLE:
-      MSH_PLY__CONVERT_AND_ASSIGN(*dst, src, double, atof);
-      break;
+    for (int32_t t = 0; t < n_batch_tasks && !err_code; ++t)
+    {
+      msh_ply__text_task_t* task = &tasks[t];
+      err_code                   = task->err_code;
+      if (!err_code) { err_code = msh_ply__write_bytes(pf, task->text, task->size); }
+    }
+    memcpy(sources,
+           tasks[n_batch_tasks - 1].sources,
+           n_sources * sizeof(msh_ply__row_source_t));
   }
+
+  for (int32_t t = 0; t < n_tasks; ++t) { MSH_PLY_FREE(tasks[t].text); }
+  MSH_PLY_FREE(tasks);
+  return err_code;
 }
 
+// Writes 'n_rows' rows of element 'el', taking data from the beginning of the arrays of every
+// descriptor that describes it.
 MSH_PLY_PRIVATE int32_t
-msh_ply__get_element_data_ascii(msh_ply_t* pf,
-                                const msh_ply_element_t* el,
-                                void** storage)
+msh_ply__write_rows(msh_ply_t* pf, const msh_ply_element_t* el, int32_t n_rows)
 {
-  int32_t err_code       = MSH_PLY_NO_ERR;
-  int32_t num_properties = (int32_t)msh_ply_array_len(el->properties);
+  msh_ply__row_source_t sources[MSH_PLY_MAX_PROPERTIES];
+  int32_t n_sources    = 0;
+  size_t n_properties  = 0;
+  for (size_t i = 0; i < msh_ply_array_len(pf->descriptors); ++i)
+  {
+    const msh_ply_desc_t* desc = pf->descriptors[i];
+    if (strcmp(desc->element_name, el->name)) { continue; }
+    if (n_sources >= MSH_PLY_MAX_PROPERTIES) { return MSH_PLY_PROPERTY_NOT_FOUND_ERR; }
+    msh_ply__row_source_t* source = &sources[n_sources++];
+    source->desc                  = desc;
+    source->data                  = *(const uint8_t**)desc->data;
+    source->list_data =
+      desc->list_data ? *(const uint8_t**)desc->list_data : NULL;
+    if (!source->data) { return MSH_PLY_NULL_DATA_PTR_ERR; }
+    // Variable length lists cannot be written without their sizes
+    if (desc->list_type != MSH_PLY_INVALID && !desc->list_size_hint &&
+        !source->list_data)
+    {
+      return MSH_PLY_NULL_DATA_PTR_ERR;
+    }
+    n_properties += (size_t)desc->num_properties;
+  }
+  // Every property of the element needs to come from a descriptor
+  if (n_properties != msh_ply_array_len(el->properties))
+  {
+    return MSH_PLY_WRITE_REQUIRED_PROPERTY_IS_MISSING;
+  }
 
-  fseek(pf->_fp, el->file_anchor, SEEK_SET);
-  char* dest = (char*)*storage;
-  for (size_t i = 0; i < el->count; ++i)
+  if (pf->format == MSH_PLY_ASCII)
   {
-    char line[MSH_PLY_MAX_STR_LEN];
-    fgets(line, MSH_PLY_MAX_STR_LEN, pf->_fp);
-    char* cp_up  = &line[0];
-    char* cp_low = &line[0];
+    int32_t err_code = msh_ply__write_rows_ascii(pf, el, sources, n_sources, n_rows);
+    if (!err_code && ferror(pf->_fp)) { err_code = MSH_PLY_FILE_WRITE_ERR; }
+    return err_code;
+  }
 
-    for (int32_t j = 0; j < num_properties; ++j)
+  msh_ply__write_buffer_t buf = {NULL, 0, 0, MSH_PLY_NO_ERR};
+  buf.cap                     = 1 << 20;
+  buf.data                    = (uint8_t*)MSH_PLY_MALLOC(buf.cap);
+  if (!buf.data) { return MSH_PLY_FILE_WRITE_ERR; }
+
+  for (int32_t i = 0; i < n_rows && !buf.err_code; ++i)
+  {
+    int32_t k = 0;
+    for (int32_t s = 0; s < n_sources; ++s)
     {
-      msh_ply_property_t* pr = &el->properties[j];
-      while (*cp_up != ' ' && *cp_up != '\n') { cp_up++; }
-      char tmp_cp_up = *cp_up;
-      *cp_up         = 0;                     // fake string end;
-      if (pr->list_type == MSH_PLY_INVALID)   // regular property
+      msh_ply__row_source_t* source = &sources[s];
+      const msh_ply_desc_t* desc    = source->desc;
+      for (int32_t j = 0; j < desc->num_properties; ++j)
       {
-        msh_ply__ascii_to_value(&dest, cp_low, pr->type);
-      }
-      else   // list property
-      {
-        msh_ply__ascii_to_value(&dest, cp_low, pr->list_type);
-        if (!pr->list_count)
-        {
-          pr->list_count = msh_ply__get_data_as_int(dest - pr->list_byte_size,
-                                                    pr->list_type,
-                                                    0);
-        }
-        *cp_up = tmp_cp_up;
-        cp_low = cp_up;
-        cp_up++;
-        for (int32_t k = 0; k < pr->list_count; ++k)
+        const msh_ply_property_t* pr = &el->properties[k++];
+        int32_t count                = 1;
+        if (pr->list_type != MSH_PLY_INVALID)
         {
-          while (*cp_up != ' ' && *cp_up != '\n') { cp_up++; }
-          tmp_cp_up = *cp_up;
-          *cp_up    = 0;   // fake string end;
-          msh_ply__ascii_to_value(&dest, cp_low, pr->type);
-          *cp_up = tmp_cp_up;
-          cp_low = cp_up;
-          cp_up++;
+          count = desc->list_size_hint;
+          if (!count)
+          {
+            count = msh_ply__get_data_as_int((void*)source->list_data,
+                                             pr->list_type,
+                                             0);
+            source->list_data += pr->list_byte_size;
+          }
+          uint8_t list_value[8];
+          uint8_t* list_ptr = list_value;
+          msh_ply__store_value(&list_ptr, pr->list_type, count, count);
+          msh_ply__write_values(pf, &buf, list_value, pr->list_type, 1);
         }
-      }
-
-      // fixup pointers
-      *cp_up = tmp_cp_up;
-      if (*cp_up != '\n')
-      {
-        cp_up++;
-        cp_low = cp_up;
+        msh_ply__write_values(pf, &buf, source->data, pr->type, count);
+        source->data += (size_t)count * pr->byte_size;
       }
     }
   }
 
-  return err_code;
+  msh_ply__write_buffer_flush(pf, &buf);
+  MSH_PLY_FREE(buf.data);
+  if (ferror(pf->_fp)) { buf.err_code = MSH_PLY_FILE_WRITE_ERR; }
+  return buf.err_code;
 }
-#undef MSH_PLY_CONVERT_AND_ASSIGN
 
 MSH_PLY_PRIVATE int32_t
-msh_ply__get_element_data_binary(msh_ply_t* pf,
-                                 const msh_ply_element_t* el,
-                                 void** storage,
-                                 size_t storage_size)
+msh_ply__write_data_ascii(msh_ply_t* pf)
 {
-  int32_t err_code = MSH_PLY_NO_ERR;
-  fseek(pf->_fp, el->file_anchor, SEEK_SET);
-  if (fread(*storage, storage_size, 1, pf->_fp) != 1)
+  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
   {
-    return MSH_PLY_BINARY_PARSE_ERR;
+    const msh_ply_element_t* el = &pf->elements[i];
+    int32_t error               = msh_ply__write_rows(pf, el, el->count);
+    if (error) { return error; }
   }
-  return err_code;
+  return MSH_PLY_NO_ERR;
 }
 
+// Writes 'size' bytes of 'data' at file 'offset', without going through the buffer of 'fp'. Safe
+// to call from multiple threads at once, as long as the written ranges do not overlap.
 MSH_PLY_PRIVATE int32_t
-msh_ply__get_element_data(msh_ply_t* pf,
-                          const msh_ply_element_t* el,
-                          void** storage,
-                          size_t storage_size)
+msh_ply__write_at(FILE* fp, const void* data, size_t size, int64_t offset)
 {
-  int32_t err_code = MSH_PLY_NO_ERR;
-  if (pf->format == MSH_PLY_ASCII)
-  {
-    err_code = msh_ply__get_element_data_ascii(pf, el, storage);
-  }
-  else
+  const uint8_t* src = (const uint8_t*)data;
+  while (size)
   {
-    err_code = msh_ply__get_element_data_binary(pf, el, storage, storage_size);
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE file   = (HANDLE)_get_osfhandle(_fileno(fp));
+    DWORD n_bytes = (DWORD)MSH_PLY_MIN(size, (size_t)1 << 30);
+    DWORD written = 0;
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset     = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    if (!WriteFile(file, src, n_bytes, &written, &overlapped) || !written)
+    {
+      return MSH_PLY_FILE_WRITE_ERR;
+    }
+#else
+    ssize_t written = pwrite(fileno(fp), src, size, (off_t)offset);
+    if (written <= 0) { return MSH_PLY_FILE_WRITE_ERR; }
+#endif
+    src += written;
+    size -= (size_t)written;
+    offset += (int64_t)written;
   }
-
-  return err_code;
+  return MSH_PLY_NO_ERR;
 }
 
+// Sets the size of the file 'fp' ahead of writing its contents out of order.
 MSH_PLY_PRIVATE int32_t
-msh_ply__get_properties_byte_size(msh_ply_element_t* el,
-                                  const char** properties_names,
-                                  int32_t num_properties,
-                                  msh_ply_type_id_t type,
-                                  msh_ply_type_id_t list_type,
-                                  size_t* data_size,
-                                  size_t* list_size)
+msh_ply__resize_file(FILE* fp, int64_t size)
 {
-  int32_t n_found             = 0;
-  size_t total_data_byte_size = 0;
-  size_t total_list_byte_size = 0;
-  int32_t byte_size           = msh_ply__type_to_byte_size(type);
-  int32_t list_byte_size      = msh_ply__type_to_byte_size(list_type);
-  for (int32_t i = 0; i < num_properties; ++i)
+  if (fflush(fp)) { return MSH_PLY_FILE_WRITE_ERR; }
+#if defined(_WIN32) || defined(_WIN64)
+  if (_chsize_s(_fileno(fp), size)) { return MSH_PLY_FILE_WRITE_ERR; }
+#else
+  if (ftruncate(fileno(fp), (off_t)size)) { return MSH_PLY_FILE_WRITE_ERR; }
+#endif
+  return MSH_PLY_NO_ERR;
+}
+
+// Copies 'n_rows' values of 'size' bytes, placed 'src_stride' bytes apart, to places 'dst_stride'
+// bytes apart. Common sizes get copies of fixed size, which compile to plain moves.
+MSH_PLY_PRIVATE void
+msh_ply__copy_rows(uint8_t* dst,
+                   size_t dst_stride,
+                   const uint8_t* src,
+                   size_t src_stride,
+                   size_t size,
+                   int32_t n_rows)
+{
+  switch (size)
   {
-    for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
-    {
-      msh_ply_property_t* pr = &el->properties[j];
-      if (!strcmp(pr->name, properties_names[i]))
+    case 1:
+      for (int32_t i = 0; i < n_rows; ++i) { dst[i * dst_stride] = src[i * src_stride]; }
+      break;
+    case 4:
+      for (int32_t i = 0; i < n_rows; ++i)
       {
-        n_found++;
-        total_data_byte_size += pr->total_count * byte_size;
-        total_list_byte_size += list_byte_size;
+        memcpy(dst + i * dst_stride, src + i * src_stride, 4);
       }
-    }
+      break;
+    case 8:
+      for (int32_t i = 0; i < n_rows; ++i)
+      {
+        memcpy(dst + i * dst_stride, src + i * src_stride, 8);
+      }
+      break;
+    case 12:
+      for (int32_t i = 0; i < n_rows; ++i)
+      {
+        memcpy(dst + i * dst_stride, src + i * src_stride, 12);
+      }
+      break;
+    default:
+      for (int32_t i = 0; i < n_rows; ++i)
+      {
+        memcpy(dst + i * dst_stride, src + i * src_stride, size);
+      }
+      break;
   }
-  if (n_found != num_properties) return MSH_PLY_PROPERTY_NOT_FOUND_ERR;
-
-  total_list_byte_size *= el->count;
-
-  *data_size = total_data_byte_size;
-  *list_size = total_list_byte_size;
-
-  return MSH_PLY_NO_ERR;
 }
 
+// Encodes 'n_rows' rows of element 'el' starting at row 'first_row' into 'dst'. Rows have fixed
+// size 'row_size', so that each property is encoded for all rows at once.
 MSH_PLY_PRIVATE void
-msh_ply__data_assign_cast(void* dst,
-                          void* src,
-                          int32_t type_dst,
-                          int32_t type_src,
-                          int32_t count)
+msh_ply__encode_fixed_rows(const msh_ply_t* pf,
+                           const msh_ply_element_t* el,
+                           size_t row_size,
+                           int32_t first_row,
+                           int32_t n_rows,
+                           uint8_t* dst)
 {
-  static double data = 0;
-  for (int32_t c = 0; c < count; c++)
+  int8_t swap_endianness = (pf->_system_format != pf->format);
+  size_t dst_offset      = 0;
+  for (size_t k = 0; k < msh_ply_array_len(el->properties); ++k)
   {
-    switch (type_src)
+    const msh_ply_property_t* pr = &el->properties[k];
+    if (pr->list_type != MSH_PLY_INVALID)
     {
-      // intermediate store
-      case MSH_PLY_UINT8:
-        data = (double)(*((uint8_t*)(src) + c));
-        break;
-      case MSH_PLY_UINT16:
-        data = (double)(*((uint16_t*)(src) + c));
-        break;
-      case MSH_PLY_UINT32:
-        data = (double)(*((uint32_t*)(src) + c));
-        break;
-      case MSH_PLY_INT8:
-        data = (double)(*((int8_t*)(src) + c));
-        break;
-      case MSH_PLY_INT16:
-        data = (double)(*((int16_t*)(src) + c));
-        break;
-      case MSH_PLY_INT32:
-        data = (double)(*((int32_t*)(src) + c));
-        break;
-      case MSH_PLY_FLOAT:
-        data = (double)(*((float*)(src) + c));
-        break;
-      case MSH_PLY_DOUBLE:
-        data = (double)(*((double*)(src) + c));
-        break;
-      default:
-        data = (double)(*((uint8_t*)(src) + c));
-        break;
+      uint8_t list_value[8];
+      uint8_t* list_ptr = list_value;
+      msh_ply__store_value(&list_ptr, pr->list_type, pr->list_count, pr->list_count);
+      if (swap_endianness) { msh_ply__swap_bytes(list_value, pr->list_byte_size, 1); }
+      for (int32_t i = 0; i < n_rows; ++i)
+      {
+        memcpy(dst + i * row_size + dst_offset, list_value, pr->list_byte_size);
+      }
+      dst_offset += pr->list_byte_size;
     }
 
-    // write
-    switch (type_dst)
+    size_t value_size = (size_t)pr->list_count * pr->byte_size;
+    const uint8_t* src = (const uint8_t*)pr->data + pr->offset + (size_t)first_row * pr->stride;
+    msh_ply__copy_rows(dst + dst_offset, row_size, src, pr->stride, value_size, n_rows);
+    if (swap_endianness && pr->byte_size > 1)
     {
-      case MSH_PLY_UINT8:
-        *((uint8_t*)(dst) + c) = (uint8_t)data;
-        break;
-      case MSH_PLY_UINT16:
-        *((uint16_t*)(dst) + c) = (uint16_t)data;
-        break;
-      case MSH_PLY_UINT32:
-        *((uint32_t*)(dst) + c) = (uint32_t)data;
-        break;
-      case MSH_PLY_INT8:
-        *((int8_t*)(dst) + c) = (int8_t)data;
-        break;
-      case MSH_PLY_INT16:
-        *((int16_t*)(dst) + c) = (int16_t)data;
-        break;
-      case MSH_PLY_INT32:
-        *((int32_t*)(dst) + c) = (int32_t)data;
-        break;
-      case MSH_PLY_FLOAT:
-        *((float*)(dst) + c) = (float)data;
-        break;
-      case MSH_PLY_DOUBLE:
-        *((double*)(dst) + c) = (double)data;
-        break;
-      default:
-        *((uint8_t*)(dst) + c) = (uint8_t)data;
-        break;
+      for (int32_t i = 0; i < n_rows; ++i)
+      {
+        msh_ply__swap_bytes(dst + i * row_size + dst_offset, pr->byte_size, pr->list_count);
+      }
     }
+    dst_offset += value_size;
   }
 }
 
-// TODO(maciej): This is gigantic function, I should break it down
-MSH_PLY_PRIVATE int32_t
-msh_ply__get_property_from_element(msh_ply_t* pf,
-                                   const char* element_name,
-                                   const char** property_names,
-                                   int32_t num_requested_properties,
-                                   msh_ply_type_id_t requested_type,
-                                   msh_ply_type_id_t requested_list_type,
-                                   void** data,
-                                   void** list_data,
-                                   int32_t* data_count)
+// Fixed size rows are encoded in chunks of about this many bytes.
+#define MSH_PLY__WRITE_CHUNK_SIZE (1 << 22)
+
+// Encoding of chunks 'first', 'first + stride', ... of an element with fixed size rows. Each chunk
+// is written straight to its place in the file, at 'offset' plus the offset of its first row.
+typedef struct msh_ply__encode_task
 {
-  // TODO(maciej): Errors!
-  int8_t swap_endianness =
-    pf->format != MSH_PLY_ASCII ? (pf->_system_format != pf->format) : 0;
-  int32_t num_properties = -1;
-  msh_ply_element_t* el  = msh_ply_find_element(pf, element_name);
+  const msh_ply_t* pf;
+  const msh_ply_element_t* el;
+  size_t row_size;
+  int32_t chunk_rows;
+  int32_t first;
+  int32_t stride;
+  int64_t offset;
+  int32_t err_code;
+} msh_ply__encode_task_t;
 
-  if (!el) { return MSH_PLY_ELEMENT_NOT_FOUND_ERR; }
-  else
+MSH_PLY_PRIVATE void
+msh_ply__run_encode_task(void* params)
+{
+  msh_ply__encode_task_t* task = (msh_ply__encode_task_t*)params;
+  const msh_ply_element_t* el  = task->el;
+  uint8_t* chunk = (uint8_t*)MSH_PLY_MALLOC((size_t)task->chunk_rows * task->row_size);
+  if (!chunk)
   {
-    num_properties = (int32_t)msh_ply_array_len(el->properties);
-    if (el->data == NULL)
-    {
-      // Check if data layouts agree - if so, we can just copy and return
-      int8_t can_simply_copy = 1;
-      if (swap_endianness) { can_simply_copy = 0; }
-      if (num_requested_properties != num_properties) { can_simply_copy = 0; }
-      if (can_simply_copy)
-      {
-        for (int32_t i = 0; i < num_properties; ++i)
-        {
-          msh_ply_property_t* pr = &el->properties[i];
-          const char* a          = pr->name;
-          const char* b          = property_names[i];
-          if (strcmp(a, b)) { can_simply_copy = 0; }
-          if (pr->type != requested_type) { can_simply_copy = 0; }
-          if (pr->list_type != MSH_PLY_INVALID) { can_simply_copy = 0; }
-        }
-      }
-
-      if (can_simply_copy)
-      {
-        msh_ply__get_element_size(el, &el->data_size);
-        *data_count = el->count;
-        *data       = MSH_PLY_MALLOC(el->data_size);
-        msh_ply__get_element_data(pf, el, &*data, el->data_size);
-        return MSH_PLY_NO_ERR;
-      }
+    task->err_code = MSH_PLY_FILE_WRITE_ERR;
+    return;
+  }
+  int64_t row = (int64_t)task->first * task->chunk_rows;
+  for (; row < el->count && !task->err_code; row += (int64_t)task->stride * task->chunk_rows)
+  {
+    int32_t n_rows = (int32_t)MSH_PLY_MIN((int64_t)task->chunk_rows, el->count - row);
+    msh_ply__encode_fixed_rows(task->pf, el, task->row_size, (int32_t)row, n_rows, chunk);
+    task->err_code = msh_ply__write_at(task->pf->_fp,
+                                       chunk,
+                                       (size_t)n_rows * task->row_size,
+                                       task->offset + row * (int64_t)task->row_size);
+  }
+  MSH_PLY_FREE(chunk);
+}
 
-      // If we can't simply copy the data, we will copy everything from the file and parse that
-      // NOTE(maciej): Maybe this is a source of slowdown - possibly a huge read here
-      msh_ply__get_element_size(el, &el->data_size);
-      el->data = MSH_PLY_MALLOC(el->data_size);
-      msh_ply__get_element_data(pf, el, &el->data, el->data_size);
-    }
-
-    // Initialize output
-    *data_count                 = el->count;
-    uint8_t* dst_data           = NULL;
-    uint8_t* dst_list           = NULL;
-    size_t data_byte_size       = 0;
-    size_t list_byte_size       = 0;
-    int32_t requested_byte_size = msh_ply__type_to_byte_size(requested_type);
-    int32_t requested_list_byte_size =
-      msh_ply__type_to_byte_size(requested_list_type);
-    msh_ply__get_properties_byte_size(el,
-                                      property_names,
-                                      num_requested_properties,
-                                      requested_type,
-                                      requested_list_type,
-                                      &data_byte_size,
-                                      &list_byte_size);
-    if (data != NULL)
-    {
-      *data    = MSH_PLY_MALLOC(data_byte_size);
-      dst_data = (uint8_t*)*data;
-    }
-    else
+// Writes element 'el' with fixed size rows of 'row_size' bytes. If 'offset' is not negative, rows
+// are encoded by multiple threads and written at 'offset' of the pre-sized file. Otherwise they
+// are encoded chunk by chunk, and appended to the file in order.
+MSH_PLY_PRIVATE int32_t
+msh_ply__write_fixed_rows(const msh_ply_t* pf,
+                          const msh_ply_element_t* el,
+                          size_t row_size,
+                          int64_t offset,
+                          int32_t num_threads)
+{
+  int32_t chunk_rows = (int32_t)MSH_PLY_MAX(MSH_PLY__WRITE_CHUNK_SIZE / row_size, 1);
+  chunk_rows         = MSH_PLY_MIN(chunk_rows, el->count);
+  if (offset >= 0)
+  {
+    msh_ply__encode_task_t tasks[MSH_PLY_MAX_THREADS];
+    int32_t n_chunks = (el->count + chunk_rows - 1) / chunk_rows;
+    int32_t n_tasks  = MSH_PLY_MIN(num_threads, n_chunks);
+    for (int32_t i = 0; i < n_tasks; ++i)
     {
-      return MSH_PLY_NULL_DATA_PTR_ERR;
+      tasks[i].pf         = pf;
+      tasks[i].el         = el;
+      tasks[i].row_size   = row_size;
+      tasks[i].chunk_rows = chunk_rows;
+      tasks[i].first      = i;
+      tasks[i].stride     = n_tasks;
+      tasks[i].offset     = offset;
+      tasks[i].err_code   = MSH_PLY_NO_ERR;
     }
-    if (list_data != NULL)
+    msh_ply__run_tasks(pf,
+                       msh_ply__run_encode_task,
+                       tasks,
+                       sizeof(msh_ply__encode_task_t),
+                       n_tasks);
+    for (int32_t i = 0; i < n_tasks; ++i)
     {
-      *list_data = MSH_PLY_MALLOC(list_byte_size);
-      dst_list   = (uint8_t*)*list_data;
+      if (tasks[i].err_code) { return tasks[i].err_code; }
     }
-    uint8_t* src = (uint8_t*)el->data;
+    return MSH_PLY_NO_ERR;
+  }
 
-    // Check if need to cast
-    int32_t need_cast                                       = 0;
-    int8_t requested_group_size[MSH_PLY_MAX_REQ_PROPERTIES] = {0};
+  uint8_t* chunk = (uint8_t*)MSH_PLY_MALLOC((size_t)chunk_rows * row_size);
+  if (!chunk) { return MSH_PLY_FILE_WRITE_ERR; }
+  int32_t err_code = MSH_PLY_NO_ERR;
+  for (int32_t row = 0; row < el->count && !err_code; row += chunk_rows)
+  {
+    int32_t n_rows = MSH_PLY_MIN(chunk_rows, el->count - row);
+    msh_ply__encode_fixed_rows(pf, el, row_size, row, n_rows, chunk);
+    err_code = msh_ply__write_bytes(pf, chunk, (size_t)n_rows * row_size);
+  }
+  MSH_PLY_FREE(chunk);
+  return err_code;
+}
 
-    for (int32_t i = 0; i < num_properties; ++i)
+// Writes data of all elements. Elements with rows of fixed size are encoded in chunks, while the
+// others are encoded row by row. When more threads are available and the file is not compressed,
+// the file is sized up front, and the chunks are encoded in parallel and written to their places
+// with positional writes.
+int32_t
+msh_ply__write_data_binary(const msh_ply_t* pf)
+{
+  int8_t swap_endianness = (pf->_system_format != pf->format);
+  int32_t num_threads    = msh_ply__get_num_threads(pf);
+  int64_t offset         = -1;
+  if (num_threads > 1 && !pf->_deflate)
+  {
+    offset       = (int64_t)msh_ply_array_len(pf->_header_text);
+    int64_t size = offset;
+    for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
     {
-      msh_ply_property_t* pr = &el->properties[i];
-
-      for (int32_t j = 0; j < num_requested_properties; ++j)
+      const msh_ply_element_t* el = &pf->elements[i];
+      for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
       {
-        if (!strcmp(pr->name, property_names[j]))
-        {
-          if (pr->type != requested_type) need_cast = 1;
-          if (pr->list_type != MSH_PLY_INVALID &&
-              pr->list_type != requested_list_type)
-            need_cast = 1;
-        }
+        size += (int64_t)el->properties[j].total_byte_size;
       }
     }
+    int32_t err_code = msh_ply__resize_file(pf->_fp, size);
+    if (err_code) { return err_code; }
+  }
 
-    int32_t num_groups = 0;
-    for (int32_t i = 0; i < num_properties; ++i)
+  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+  {
+    msh_ply_element_t* el = &pf->elements[i];
+    size_t buffer_size    = 0;
+    size_t row_size       = 0;
+    int32_t fixed_rows    = 1;
+    for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
     {
-      msh_ply_property_t* pr = &el->properties[i];
-      int32_t k              = i;
-
-      for (int32_t j = 0; j < num_requested_properties; ++j)
+      const msh_ply_property_t* pr = &el->properties[j];
+      buffer_size += pr->total_byte_size;
+      if (pr->list_type != MSH_PLY_INVALID)
       {
-        if (!strcmp(pr->name, property_names[j])) { num_groups++; }
-
-        while (!strcmp(pr->name, property_names[j]))
-        {
-          requested_group_size[k] += 1;
-          j++;
-          i++;
-          if (i >= num_properties || j >= num_requested_properties) { break; }
-          pr = &el->properties[i];
-        }
+        if (!pr->list_count) { fixed_rows = 0; }
+        row_size += pr->list_byte_size;
       }
+      row_size += (size_t)pr->list_count * pr->byte_size;
+    }
+    if (el->count <= 0 || !buffer_size) { continue; }
+
+    if (fixed_rows)
+    {
+      int32_t err_code = msh_ply__write_fixed_rows(pf, el, row_size, offset, num_threads);
+      if (err_code) { return err_code; }
+      if (offset >= 0) { offset += (int64_t)buffer_size; }
+      continue;
     }
 
-    // TODO(maciej): Make into a struct?
-    int32_t precalc_dst_row_size      = 0;
-    int32_t precalc_dst_list_row_size = 0;
-    int32_t precalc_src_row_size      = 0;
-    int32_t precalc_dst_stride        = 0;
+    uint8_t* dst       = (uint8_t*)MSH_PLY_MALLOC(buffer_size);
+    int64_t dst_offset = 0;
 
-    int32_t can_precalculate = msh_ply__can_precalculate_sizes(el);
-    if (can_precalculate)
+    for (size_t j = 0; j < el->count; ++j)
     {
-      // Determine data row sizes
-      for (int32_t j = 0; j < num_properties; ++j)
+      for (size_t k = 0; k < msh_ply_array_len(el->properties); ++k)
       {
-        msh_ply_property_t* pr = &el->properties[j];
-
-        if (requested_group_size[j])
+        msh_ply_property_t* pr = &el->properties[k];
+        if (pr->list_type == MSH_PLY_INVALID)
+        {
+          msh_ply__data_assign(dst + dst_offset,
+                               (uint8_t*)pr->data + pr->offset,
+                               pr->type,
+                               1);
+          pr->offset += pr->stride;
+          dst_offset += pr->byte_size;
+        }
+        else
         {
-          if (pr->list_type == MSH_PLY_INVALID)
+          // figure out stride. Lists without a size hint keep their count per row.
+          int32_t list_count = pr->list_count;
+          if (!list_count)
           {
-            precalc_dst_stride = requested_group_size[j] * requested_byte_size;
+            pr->stride =
+              msh_ply__calculate_list_property_stride(pr,
+                                                      el->properties,
+                                                      swap_endianness);
+            list_count = msh_ply__get_data_as_int((uint8_t*)pr->list_data +
+                                                    pr->list_offset,
+                                                  pr->list_type,
+                                                  swap_endianness);
+
+            msh_ply__data_assign(dst + dst_offset,
+                                 (uint8_t*)pr->list_data + pr->list_offset,
+                                 pr->list_type,
+                                 1);
+            pr->list_offset += pr->list_stride;
+            dst_offset += pr->list_byte_size;
           }
           else
           {
-            precalc_dst_stride = pr->list_count * requested_byte_size;
+            uint8_t* dst_ptr = dst + dst_offset;
+            msh_ply__store_value(&dst_ptr, pr->list_type, list_count, list_count);
+            dst_offset += pr->list_byte_size;
           }
-          precalc_dst_list_row_size += requested_list_byte_size;
-          precalc_dst_row_size += precalc_dst_stride;
-          pr->offset      = precalc_src_row_size + pr->list_byte_size;
-          pr->list_offset = precalc_src_row_size;
+
+          msh_ply__data_assign(dst + dst_offset,
+                               (uint8_t*)pr->data + pr->offset,
+                               pr->type,
+                               list_count);
+          pr->offset += pr->stride;
+          dst_offset += pr->byte_size * list_count;
         }
-        precalc_src_row_size +=
-          pr->list_byte_size + pr->list_count * pr->byte_size;
       }
     }
 
-    // Create separate list for just requested properties
-    typedef struct ply_property_read_helper
-    {
-      int32_t offset;
-      int32_t type;
-      int32_t list_count;
-      int32_t list_type;
-      int32_t list_offset;
-    } ply_property_read_helper_t;
-
-    ply_property_read_helper_t requested_properties[MSH_PLY_MAX_REQ_PROPERTIES];
-    for (int32_t i = 0; i < MSH_PLY_MAX_REQ_PROPERTIES; ++i)
+    // NOTE(maciej): Can someone explain why below is faster than a single call to fwrite..?
+    size_t block_size       = 32 * 65536;
+    size_t remaining_buffer = buffer_size;
+    uint8_t* mem            = dst;
+    int32_t err_code        = MSH_PLY_NO_ERR;
+    if (offset >= 0)
     {
-      ply_property_read_helper_t prh = {0, 0, 0, 0, 0};
-      requested_properties[i]        = prh;
+      err_code = msh_ply__write_at(pf->_fp, dst, buffer_size, offset);
+      offset += (int64_t)buffer_size;
+      remaining_buffer = 0;
     }
-
-    int32_t pr_count = 0;
-    for (int32_t i = 0; i < num_properties; ++i)
+    while (!err_code)
     {
-      msh_ply_property_t* pr = &el->properties[i];
-      if (requested_group_size[i])
-      {
-        requested_properties[pr_count].offset      = pr->offset;
-        requested_properties[pr_count].list_count  = pr->list_count;
-        requested_properties[pr_count].list_offset = pr->list_offset;
-        requested_properties[pr_count].type        = pr->type;
-        requested_properties[pr_count].list_type   = pr->list_type;
-        if (pr->list_type == MSH_PLY_INVALID)
-        {
-          requested_properties[pr_count].list_count = requested_group_size[i];
-        }
-        pr_count += requested_group_size[i];
-      }
+      if (remaining_buffer < block_size) break;
+      err_code = msh_ply__write_bytes(pf, mem, block_size);
+      mem += block_size;
+      remaining_buffer -= block_size;
     }
+    if (!err_code) { err_code = msh_ply__write_bytes(pf, mem, remaining_buffer); }
 
-    // Start copying
-    for (size_t i = 0; i < el->count; ++i)
-    {
-      int32_t dst_row_size      = 0;
-      int32_t dst_list_row_size = 0;
-      int32_t dst_offset        = 0;
-      int32_t dst_list_offset   = 0;
-      int32_t dst_stride        = 0;
-      int32_t src_row_size      = 0;
+    MSH_PLY_FREE(dst);
+    if (err_code) { return err_code; }
+  }
 
-      // Calculate the required data to read
-      if (can_precalculate)
-      {
-        dst_row_size      = precalc_dst_row_size;
-        dst_list_row_size = precalc_dst_list_row_size;
-        dst_stride        = precalc_dst_stride;
-        src_row_size      = precalc_src_row_size;
-      }
-      else
-      {
-        pr_count = 0;
-        for (int32_t j = 0; j < num_properties; ++j)
-        {
-          msh_ply_property_t* pr = &el->properties[j];
-          pr->list_count         = 1;
+  // Anything written later (like the patched header) goes through the file position again
+  if (offset >= 0 && fseek(pf->_fp, 0, SEEK_END)) { return MSH_PLY_FILE_WRITE_ERR; }
+  return MSH_PLY_NO_ERR;
+}
 
-          if (pr->list_type != MSH_PLY_INVALID)
-          {
-            pr->list_count = msh_ply__get_data_as_int(src + src_row_size,
-                                                      pr->list_type,
-                                                      swap_endianness);
-          }
-          dst_stride = pr->list_count * requested_byte_size;
+////////////////////////////////////////////////////////////////////////////////
+// Quantization
+//
+// Quantized properties are written through internal descriptors, which replace the user's
+// descriptors that contain them. Each user descriptor is split into runs of properties - either
+// three quantized properties, or the properties around them, which are copied as they are. Values
+// are converted into these descriptors right before they are written.
 
-          if (requested_group_size[j])
-          {
-            dst_list_row_size += requested_list_byte_size;
-            dst_row_size += pr->list_count * requested_byte_size;
-            pr->offset      = src_row_size + pr->list_byte_size;
-            pr->list_offset = src_row_size;
-
-            requested_properties[pr_count].offset      = pr->offset;
-            requested_properties[pr_count].list_count  = pr->list_count;
-            requested_properties[pr_count].list_offset = pr->list_offset;
-            pr_count++;
-          }
-          src_row_size += pr->list_byte_size + pr->list_count * pr->byte_size;
-        }
-      }
+MSH_PLY_DEF int32_t
+msh_ply_set_quantization(msh_ply_t* pf, const msh_ply_quantization_t* quantization)
+{
+  if (!pf || !pf->_fp) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  if (!quantization) { return MSH_PLY_NULL_DESCRIPTOR_ERR; }
+  if (!quantization->element_name) { return MSH_PLY_NULL_ELEMENT_NAME_ERR; }
 
-      // TODO(maciej): Maybe make casting a separate function
-      if (need_cast)
+  for (int32_t is_normal = 0; is_normal < 2; ++is_normal)
+  {
+    const char* const* names =
+      is_normal ? quantization->normal_names : quantization->position_names;
+    if (!names[0] && !names[1] && !names[2]) { continue; }
+
+    msh_ply__quantizer_t q;
+    memset(&q, 0, sizeof(q));
+    q.is_normal = is_normal;
+    q.bits      = is_normal ? quantization->normal_bits : quantization->position_bits;
+    if (is_normal && q.bits == 0) { q.bits = 8; }
+    if (is_normal ? (q.bits < 2 || q.bits > 16) : (q.bits < 1 || q.bits > 32))
+    {
+      return MSH_PLY_INVALID_DATA_TYPE_ERR;
+    }
+    strncpy(q.element_name, quantization->element_name, 63);
+    for (int32_t c = 0; c < 3; ++c)
+    {
+      if (!names[c]) { return MSH_PLY_NULL_PROPERTY_NAME_ERR; }
+      strncpy(q.names[c], names[c], 31);
+      if (!is_normal)
       {
-        for (int32_t j = 0; j < num_groups; ++j)
-        {
-          ply_property_read_helper_t* prh = &requested_properties[j];
-          if (dst_data)
-          {
-            void* dst_ptr = (dst_data + dst_offset);
-            void* src_ptr = (src + prh->offset);
-            msh_ply__data_assign_cast(dst_ptr,
-                                      src_ptr,
-                                      requested_type,
-                                      prh->type,
-                                      prh->list_count);
-            dst_offset += dst_stride;
-            if (swap_endianness)
-            {
-              msh_ply__swap_bytes((uint8_t*)dst_ptr,
-                                  requested_byte_size,
-                                  prh->list_count);
-            }
-          }
-
-          if (dst_list)
-          {
-            void* dst_ptr = (dst_list + dst_list_offset);
-            void* src_ptr = (src + prh->list_offset);
-            msh_ply__data_assign_cast(dst_ptr,
-                                      src_ptr,
-                                      requested_list_type,
-                                      prh->list_type,
-                                      1);
-            dst_list_offset += requested_list_byte_size;
-            if (swap_endianness)
-            {
-              msh_ply__swap_bytes((uint8_t*)dst_ptr,
-                                  requested_list_byte_size,
-                                  1);
-            }
-          }
-        }
+        q.min[c] = quantization->bbox_min[c];
+        q.max[c] = quantization->bbox_max[c];
       }
-      else
-      {
-        for (int32_t j = 0; j < num_groups; ++j)
-        {
-          ply_property_read_helper_t* prh = &requested_properties[j];
-          if (dst_data)
-          {
-            void* dst_ptr = (dst_data + dst_offset);
-            void* src_ptr = (src + prh->offset);
-            msh_ply__data_assign(dst_ptr, src_ptr, prh->type, prh->list_count);
-            dst_offset += dst_stride;
-            if (swap_endianness)
-            {
-              msh_ply__swap_bytes((uint8_t*)dst_ptr,
-                                  requested_byte_size,
-                                  prh->list_count);
-            }
-          }
+    }
+    msh_ply_array_push_in(&pf->_arena, pf->_quantizers, q);
+  }
+  return MSH_PLY_NO_ERR;
+}
 
-          if (dst_list)
-          {
-            void* dst_ptr = (dst_list + dst_list_offset);
-            void* src_ptr = (src + prh->list_offset);
-            msh_ply__data_assign(dst_ptr, src_ptr, prh->list_type, 1);
-            dst_list_offset += requested_list_byte_size;
-            if (swap_endianness)
-            {
-              msh_ply__swap_bytes((uint8_t*)dst_ptr,
-                                  requested_list_byte_size,
-                                  1);
-            }
-          }
-        }
-      }
+// Returns index of the quantizer whose first property is 'i'-th property of 'desc', or -1.
+MSH_PLY_PRIVATE int32_t
+msh_ply__find_quantizer(const msh_ply_t* pf, const msh_ply_desc_t* desc, int32_t i)
+{
+  for (size_t k = 0; k < msh_ply_array_len(pf->_quantizers); ++k)
+  {
+    const msh_ply__quantizer_t* q = &pf->_quantizers[k];
+    if (!strcmp(q->element_name, desc->element_name) &&
+        !strcmp(q->names[0], desc->property_names[i]))
+    {
+      return (int32_t)k;
+    }
+  }
+  return -1;
+}
 
-      src += src_row_size;
-      if (dst_data) dst_data += dst_row_size;
-      if (dst_list) dst_list += dst_list_row_size;
+MSH_PLY_PRIVATE int32_t
+msh_ply__add_quantized_desc(msh_ply_t* pf,
+                            const msh_ply_desc_t* source,
+                            int32_t first,
+                            int32_t num_properties,
+                            int32_t quantizer)
+{
+  msh_ply__quantized_desc_t* qd =
+    (msh_ply__quantized_desc_t*)MSH_PLY_MALLOC(sizeof(msh_ply__quantized_desc_t));
+  if (!qd) { return MSH_PLY_FILE_WRITE_ERR; }
+  memset(qd, 0, sizeof(*qd));
+  qd->source    = source;
+  qd->first     = first;
+  qd->quantizer = quantizer;
+
+  msh_ply_type_id_t type = source->data_type;
+  if (quantizer >= 0)
+  {
+    const msh_ply__quantizer_t* q = &pf->_quantizers[quantizer];
+    if (q->is_normal) { type = q->bits <= 8 ? MSH_PLY_INT8 : MSH_PLY_INT16; }
+    else
+    {
+      type = q->bits <= 16 ? MSH_PLY_UINT16 : MSH_PLY_UINT32;
     }
+    num_properties = q->is_normal ? 2 : 3;
   }
-  free(el->data);
-  el->data=NULL;
+  qd->desc.element_name   = source->element_name;
+  qd->desc.property_names = source->property_names + first;
+  qd->desc.num_properties = (int16_t)num_properties;
+  qd->desc.data_type      = type;
+  qd->desc.list_type      = MSH_PLY_INVALID;
+  qd->desc.data           = &qd->data;
+  qd->desc.data_count     = source->data_count;
+  msh_ply_array_push(pf->_quantized, qd);
   return MSH_PLY_NO_ERR;
 }
 
-MSH_PLY_DEF int32_t
-msh_ply_get_property_from_element(msh_ply_t* pf, msh_ply_desc_t* desc)
+MSH_PLY_PRIVATE void
+msh_ply__free_quantized(msh_ply_t* pf)
 {
-  assert(pf);
-  assert(desc);
-  return msh_ply__get_property_from_element(pf,
-                                            desc->element_name,
-                                            desc->property_names,
-                                            desc->num_properties,
-                                            desc->data_type,
-                                            desc->list_type,
-                                            (void**)desc->data,
-                                            (void**)desc->list_data,
-                                            desc->data_count);
+  for (size_t i = 0; i < msh_ply_array_len(pf->_quantized); ++i)
+  {
+    MSH_PLY_FREE(pf->_quantized[i]->data);
+    MSH_PLY_FREE(pf->_quantized[i]);
+  }
+  msh_ply_array_free(pf->_quantized);
+  pf->_quantized = 0;
 }
 
-MSH_PLY_DEF int32_t
-msh_ply_read(msh_ply_t* pf)
+// Replaces descriptors that contain quantized properties with the internal ones.
+MSH_PLY_PRIVATE int32_t
+msh_ply__split_quantized_descriptors(msh_ply_t* pf)
 {
-  int32_t error = MSH_PLY_NO_ERR;
-  if (!pf->_fp) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
-  if (msh_ply_array_len(pf->descriptors) == 0) { return MSH_PLY_NO_REQUESTS; }
+  if (!pf->_quantizers || pf->_quantized) { return MSH_PLY_NO_ERR; }
 
-  if (!pf->_parsed) { error = msh_ply_parse_header(pf); }
-  if (error) { return error; }
+  int32_t err_code = MSH_PLY_NO_ERR;
+  msh_ply_array(msh_ply_desc_t*) descriptors = 0;
+  for (size_t i = 0; i < msh_ply_array_len(pf->descriptors) && !err_code; ++i)
+  {
+    msh_ply_desc_t* desc = pf->descriptors[i];
+    int32_t is_quantized = 0;
+    for (int32_t j = 0; j < desc->num_properties; ++j)
+    {
+      if (msh_ply__find_quantizer(pf, desc, j) >= 0) { is_quantized = 1; }
+    }
+    if (!is_quantized)
+    {
+      msh_ply_array_push_in(&pf->_arena, descriptors, desc);
+      continue;
+    }
+    if (desc->list_type != MSH_PLY_INVALID ||
+        (desc->data_type != MSH_PLY_FLOAT && desc->data_type != MSH_PLY_DOUBLE))
+    {
+      err_code = MSH_PLY_QUANTIZATION_ERR;
+      break;
+    }
 
-  error = msh_ply_parse_contents(pf);
-  if (error) { return error; }
+    size_t first_added = msh_ply_array_len(pf->_quantized);
+    int32_t copy_start = 0;
+    for (int32_t j = 0; j < desc->num_properties && !err_code; ++j)
+    {
+      int32_t k = msh_ply__find_quantizer(pf, desc, j);
+      if (k < 0) { continue; }
+      const msh_ply__quantizer_t* q = &pf->_quantizers[k];
+      if (j + 2 >= desc->num_properties || strcmp(desc->property_names[j + 1], q->names[1]) ||
+          strcmp(desc->property_names[j + 2], q->names[2]))
+      {
+        err_code = MSH_PLY_QUANTIZATION_ERR;
+        break;
+      }
+      if (j > copy_start)
+      {
+        err_code = msh_ply__add_quantized_desc(pf, desc, copy_start, j - copy_start, -1);
+      }
+      if (!err_code) { err_code = msh_ply__add_quantized_desc(pf, desc, j, 3, k); }
+      copy_start = j + 3;
+      j += 2;
+    }
+    if (!err_code && copy_start < desc->num_properties)
+    {
+      int32_t n_copied = desc->num_properties - copy_start;
+      err_code         = msh_ply__add_quantized_desc(pf, desc, copy_start, n_copied, -1);
+    }
+    for (size_t k = first_added; !err_code && k < msh_ply_array_len(pf->_quantized); ++k)
+    {
+      msh_ply_array_push_in(&pf->_arena, descriptors, &pf->_quantized[k]->desc);
+    }
+  }
 
-  for (size_t i = 0; i < msh_ply_array_len(pf->descriptors); ++i)
+  if (err_code)
   {
-    msh_ply_desc_t* desc = pf->descriptors[i];
-    error                = msh_ply_get_property_from_element(pf, desc);
-    if (error) { return error; }
+    msh_ply__free_quantized(pf);
+    msh_ply_array_free_in(&pf->_arena, descriptors);
+    return err_code;
   }
-  return error;
+  msh_ply_array_free_in(&pf->_arena, pf->descriptors);
+  pf->descriptors = descriptors;
+  return MSH_PLY_NO_ERR;
 }
-#endif /* MSH_PLY_ENCODER_ONLY */
-
-// ENCODER
 
-#ifndef MSH_PLY_DECODER_ONLY
+MSH_PLY_PRIVATE double
+msh_ply__load_real(const uint8_t* src, msh_ply_type_id_t type)
+{
+  if (type == MSH_PLY_FLOAT)
+  {
+    float value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+  }
+  double value;
+  memcpy(&value, src, sizeof(value));
+  return value;
+}
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__add_element(msh_ply_t* pf,
-                     const char* element_name,
-                     const int32_t element_count)
+// Rounds 'value' to the nearest integer within [-max_value, max_value] (or [0, max_value] if
+// 'is_unsigned'). NaNs become zero.
+MSH_PLY_PRIVATE int64_t
+msh_ply__round_clamped(double value, int64_t max_value, int32_t is_unsigned)
 {
-  msh_ply_element_t el = msh_ply__element_zero_init();
-  strncpy(&el.name[0], element_name, 63);
-  el.name[63]   = '\0';
-  el.count      = element_count;
-  el.properties = NULL;
-  msh_ply_array_push(pf->elements, el);
-  return MSH_PLY_NO_ERR;
+  int64_t min_value = is_unsigned ? 0 : -max_value;
+  if (!(value > (double)min_value)) { return (value != value) ? 0 : min_value; }
+  if (value >= (double)max_value) { return max_value; }
+  return (int64_t)(value + (value < 0 ? -0.5 : 0.5));
 }
 
+// Stores 'value' as integer of 'type' at 'dst'.
 MSH_PLY_PRIVATE void
-msh_ply__fprint_data_at_offset(const msh_ply_t* pf,
-                               const void* data,
-                               const int32_t offset,
-                               const int32_t type)
+msh_ply__store_int(uint8_t* dst, msh_ply_type_id_t type, int64_t value)
 {
   switch (type)
   {
-    case MSH_PLY_UINT8:
-      fprintf(pf->_fp, "%d ", *(uint8_t*)((uint8_t*)data + offset));
-      break;
-    case MSH_PLY_UINT16:
-      fprintf(pf->_fp, "%d ", *(uint16_t*)((uint8_t*)data + offset));
-      break;
-    case MSH_PLY_UINT32:
-      fprintf(pf->_fp, "%d ", *(uint32_t*)((uint8_t*)data + offset));
-      break;
     case MSH_PLY_INT8:
-      fprintf(pf->_fp, "%d ", *(int8_t*)((uint8_t*)data + offset));
+    {
+      int8_t x = (int8_t)value;
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case MSH_PLY_UINT8:
+    {
+      uint8_t x = (uint8_t)value;
+      memcpy(dst, &x, sizeof(x));
       break;
+    }
     case MSH_PLY_INT16:
-      fprintf(pf->_fp, "%d ", *(int16_t*)((uint8_t*)data + offset));
+    {
+      int16_t x = (int16_t)value;
+      memcpy(dst, &x, sizeof(x));
       break;
+    }
+    case MSH_PLY_UINT16:
+    {
+      uint16_t x = (uint16_t)value;
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
     case MSH_PLY_INT32:
-      fprintf(pf->_fp, "%d ", *(int32_t*)((uint8_t*)data + offset));
+    {
+      int32_t x = (int32_t)value;
+      memcpy(dst, &x, sizeof(x));
       break;
-    case MSH_PLY_FLOAT:
-      fprintf(pf->_fp, "%f ", *(float*)((uint8_t*)data + offset));
+    }
+    case MSH_PLY_UINT32:
+    {
+      uint32_t x = (uint32_t)value;
+      memcpy(dst, &x, sizeof(x));
       break;
-    case MSH_PLY_DOUBLE:
-      fprintf(pf->_fp, "%f ", *(double*)((uint8_t*)data + offset));
+    }
+    default:
       break;
   }
 }
 
+// Converts 'n_rows' rows of the user's descriptors of element 'element_name' into the internal
+// descriptors. Negative 'n_rows' converts rows given by the user's 'data_count'.
 MSH_PLY_PRIVATE int32_t
-msh_ply__add_property_to_element(msh_ply_t* pf,
-                                 const char* element_name,
-                                 const char** property_names,
-                                 int32_t num_properties,
-                                 const msh_ply_type_id_t data_type,
-                                 const msh_ply_type_id_t list_type,
-                                 void** data,
-                                 void** list_data,
-                                 int32_t element_count,
-                                 int32_t size_hint)
+msh_ply__quantize_rows(msh_ply_t* pf, const char* element_name, int32_t n_rows)
 {
-  // Check if list type is integral type
-  if (list_type == MSH_PLY_FLOAT || list_type == MSH_PLY_DOUBLE)
-  {
-    return MSH_PLY_INVALID_LIST_TYPE_ERR;
-  }
-  int8_t swap_endianness =
-    pf->format != MSH_PLY_ASCII ? (pf->_system_format != pf->format) : 0;
-
-  // Find / Create element
-  msh_ply_element_t* el = msh_ply_find_element(pf, element_name);
-  if (!el)
-  {
-    msh_ply__add_element(pf, element_name, element_count);
-    el = msh_ply_array_back(pf->elements);
-  }
-  if (el)
+  for (size_t i = 0; i < msh_ply_array_len(pf->_quantized); ++i)
   {
-    if (el->count != element_count)
+    msh_ply__quantized_desc_t* qd = pf->_quantized[i];
+    const msh_ply_desc_t* source  = qd->source;
+    if (element_name && strcmp(source->element_name, element_name)) { continue; }
+
+    int32_t rows = n_rows >= 0 ? n_rows : *source->data_count;
+    if (rows <= 0) { continue; }
+    const uint8_t* src = *(const uint8_t**)source->data;
+    if (!src) { return MSH_PLY_NULL_DATA_PTR_ERR; }
+
+    int32_t src_size = msh_ply__type_to_byte_size(source->data_type);
+    int32_t dst_size = msh_ply__type_to_byte_size(qd->desc.data_type);
+    size_t src_row   = (size_t)source->num_properties * src_size;
+    size_t dst_row   = (size_t)qd->desc.num_properties * dst_size;
+    if (qd->capacity < (size_t)rows * dst_row)
     {
-      return MSH_PLY_CONFLICTING_NUMBER_OF_ELEMENTS_ERR;
+      void* data = MSH_PLY_REALLOC(qd->data, (size_t)rows * dst_row);
+      if (!data) { return MSH_PLY_FILE_WRITE_ERR; }
+      qd->data     = data;
+      qd->capacity = (size_t)rows * dst_row;
     }
 
-    int32_t init_offset =
-      0;   // Helper variable for storing initial list offsets.
-    for (int32_t i = 0; i < num_properties; ++i)
+    uint8_t* dst = (uint8_t*)qd->data;
+    src += (size_t)qd->first * src_size;
+    if (qd->quantizer < 0)
     {
-      msh_ply_property_t pr;
-      strncpy(&pr.name[0], property_names[i], 31);
-      pr.name[31] = '\0';
-
-      if (data == NULL) { return MSH_PLY_NULL_DATA_PTR_ERR; }
-
-      pr.type           = data_type;
-      pr.list_type      = list_type;
-      pr.byte_size      = msh_ply__type_to_byte_size(pr.type);
-      pr.list_byte_size = msh_ply__type_to_byte_size(pr.list_type);
-      pr.list_count     = (list_type == MSH_PLY_INVALID) ? 1 : size_hint;
-      pr.data           = *data;
-      pr.list_data      = (list_data != NULL) ? *list_data : NULL;
-      pr.offset         = pr.byte_size * i;
-      pr.stride         = pr.byte_size * num_properties;
-      pr.list_offset    = pr.list_byte_size * i;
-      pr.list_stride    = pr.list_byte_size * num_properties;
-      pr.total_byte_size =
-        (pr.list_byte_size + pr.list_count * pr.byte_size) * el->count;
+      for (int32_t r = 0; r < rows; ++r)
+      {
+        memcpy(dst + (size_t)r * dst_row, src + (size_t)r * src_row, dst_row);
+      }
+      continue;
+    }
 
-      if (pr.list_count == 0)   // No hint was present
+    const msh_ply__quantizer_t* q = &pf->_quantizers[qd->quantizer];
+    for (int32_t r = 0; r < rows; ++r, src += src_row, dst += dst_row)
+    {
+      double v[3];
+      int64_t result[3];
+      for (int32_t c = 0; c < 3; ++c)
       {
-        pr.total_byte_size = 0;
-        for (int32_t j = 0; j < element_count; ++j)
+        v[c] = msh_ply__load_real(src + c * src_size, source->data_type);
+      }
+      if (q->is_normal)
+      {
+        // Octahedral encoding - normal is projected onto the octahedron |x| + |y| + |z| = 1, and
+        // its lower half is folded over the upper one.
+        int64_t max_value = ((int64_t)1 << (q->bits - 1)) - 1;
+        double norm       = 0.0;
+        for (int32_t c = 0; c < 3; ++c) { norm += v[c] < 0 ? -v[c] : v[c]; }
+        double u = norm > 0 ? v[0] / norm : 0.0;
+        double w = norm > 0 ? v[1] / norm : 0.0;
+        if (norm > 0 && v[2] < 0)
         {
-          // NOTE(maciej): list type needs to be dereferenced to correct type
-          int32_t offset = (pr.list_offset + j * pr.list_stride);
-          int32_t list_count =
-            msh_ply__get_data_as_int((uint8_t*)(*list_data) + offset,
-                                     list_type,
-                                     swap_endianness);
-          pr.total_byte_size += pr.list_byte_size + list_count * pr.byte_size;
-          if (
-            j ==
-            0)   // We care only about initial offset, so first element of list counts
-          {
-            pr.offset = init_offset;
-            init_offset += list_count * pr.byte_size;
-          }
+          double fu = (1.0 - (w < 0 ? -w : w)) * (u >= 0 ? 1.0 : -1.0);
+          double fw = (1.0 - (u < 0 ? -u : u)) * (w >= 0 ? 1.0 : -1.0);
+          u         = fu;
+          w         = fw;
         }
+        result[0] = msh_ply__round_clamped(u * (double)max_value, max_value, 0);
+        result[1] = msh_ply__round_clamped(w * (double)max_value, max_value, 0);
       }
       else
       {
-        pr.stride *= pr.list_count;
+        int64_t max_value = (int64_t)(((uint64_t)1 << q->bits) - 1);
+        for (int32_t c = 0; c < 3; ++c)
+        {
+          double extent = (double)q->max[c] - q->min[c];
+          double scale  = extent > 0 ? (double)max_value / extent : 0.0;
+          result[c]     = msh_ply__round_clamped((v[c] - q->min[c]) * scale, max_value, 1);
+        }
+      }
+      for (int32_t c = 0; c < qd->desc.num_properties; ++c)
+      {
+        msh_ply__store_int(dst + c * dst_size, qd->desc.data_type, result[c]);
       }
-      msh_ply_array_push(el->properties, pr);
     }
   }
-  else
+  return MSH_PLY_NO_ERR;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Spatial ordering
+//
+// Rows of the ordered element are sorted by the position of their points along a space filling
+// curve, over the bounding box of all points quantized to 21 bits per axis. Descriptors of the
+// element are replaced with internal ones, which hold reordered copies of the user's data, and
+// lists of indices into the element are remapped to the new order in the same way.
+
+MSH_PLY_DEF int32_t
+msh_ply_set_spatial_order(msh_ply_t* pf, const msh_ply_spatial_order_t* order)
+{
+  if (!pf || !pf->_fp) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  if (!order) { return MSH_PLY_NULL_DESCRIPTOR_ERR; }
+  if (!order->element_name) { return MSH_PLY_NULL_ELEMENT_NAME_ERR; }
+  if (order->curve < MSH_PLY_CURVE_NONE || order->curve > MSH_PLY_CURVE_HILBERT)
   {
-    return MSH_PLY_ELEMENT_NOT_FOUND_ERR;
+    return MSH_PLY_SPATIAL_ORDER_ERR;
+  }
+  if (order->index_element_name && !order->index_property_name)
+  {
+    return MSH_PLY_NULL_PROPERTY_NAME_ERR;
   }
 
+  msh_ply__spatial_order_t* so = &pf->_spatial_order;
+  memset(so, 0, sizeof(*so));
+  for (int32_t c = 0; c < 3; ++c)
+  {
+    if (!order->position_names[c]) { return MSH_PLY_NULL_PROPERTY_NAME_ERR; }
+    strncpy(so->names[c], order->position_names[c], 31);
+  }
+  strncpy(so->element_name, order->element_name, 63);
+  if (order->index_element_name)
+  {
+    strncpy(so->index_element_name, order->index_element_name, 63);
+    strncpy(so->index_name, order->index_property_name, 31);
+  }
+  so->curve = order->curve;
   return MSH_PLY_NO_ERR;
 }
 
-MSH_PLY_DEF int32_t
-msh_ply_add_property_to_element(msh_ply_t* pf, const msh_ply_desc_t* desc)
+// Spreads the lower 21 bits of 'v' apart, so that there are two zero bits between each of them.
+MSH_PLY_PRIVATE uint64_t
+msh_ply__spread_bits(uint64_t v)
 {
-  if (!pf) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
-  int32_t desc_err = msh_ply__validate_descriptor(desc);
-  if (desc_err) { return desc_err; }
-  return msh_ply__add_property_to_element(pf,
-                                          desc->element_name,
-                                          desc->property_names,
-                                          desc->num_properties,
-                                          desc->data_type,
-                                          desc->list_type,
-                                          (void**)desc->data,
-                                          (void**)desc->list_data,
-                                          *desc->data_count,
-                                          desc->list_size_hint);
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
 }
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__calculate_list_property_stride(const msh_ply_property_t* pr,
-                                        msh_ply_array(msh_ply_property_t)
-                                          el_properties,
-                                        int8_t swap_endianness)
+// Computes distance along the curve of a point with 21 bit coordinates 'p'. Hilbert coordinates
+// are first converted to the transposed Hilbert index, as described in J. Skilling, "Programming
+// the Hilbert curve", and then interleaved in the same way as Morton codes.
+MSH_PLY_PRIVATE uint64_t
+msh_ply__curve_key(msh_ply_curve_t curve, uint32_t* p)
 {
-  int32_t stride                          = 0;
-  int32_t offsets[MSH_PLY_MAX_PROPERTIES] = {0};
-  for (size_t l = 0; l < msh_ply_array_len(el_properties); ++l)
+  if (curve == MSH_PLY_CURVE_MORTON)
+  {
+    return msh_ply__spread_bits(p[0]) | msh_ply__spread_bits(p[1]) << 1 |
+           msh_ply__spread_bits(p[2]) << 2;
+  }
+
+  const uint32_t m = 1u << 20;
+  for (uint32_t q = m; q > 1; q >>= 1)
+  {
+    uint32_t mask = q - 1;
+    for (int32_t i = 0; i < 3; ++i)
+    {
+      if (p[i] & q) { p[0] ^= mask; }
+      else
+      {
+        uint32_t t = (p[0] ^ p[i]) & mask;
+        p[0] ^= t;
+        p[i] ^= t;
+      }
+    }
+  }
+  p[1] ^= p[0];
+  p[2] ^= p[1];
+  uint32_t t = 0;
+  for (uint32_t q = m; q > 1; q >>= 1)
+  {
+    if (p[2] & q) { t ^= q - 1; }
+  }
+  return msh_ply__spread_bits(p[0] ^ t) << 2 | msh_ply__spread_bits(p[1] ^ t) << 1 |
+         msh_ply__spread_bits(p[2] ^ t);
+}
+
+// Sorts 'n' keys along with their rows, with least significant digit first radix sort. Digits
+// shared by all keys are skipped.
+MSH_PLY_PRIVATE int32_t
+msh_ply__sort_keys(uint64_t* keys, int32_t* rows, int32_t n)
+{
+  uint64_t* tmp_keys = (uint64_t*)MSH_PLY_MALLOC((size_t)n * sizeof(uint64_t));
+  int32_t* tmp_rows  = (int32_t*)MSH_PLY_MALLOC((size_t)n * sizeof(int32_t));
+  if (!tmp_keys || !tmp_rows)
   {
-    msh_ply_property_t* qr = &el_properties[l];
-    offsets[l]             = qr->list_offset;
+    MSH_PLY_FREE(tmp_keys);
+    MSH_PLY_FREE(tmp_rows);
+    return MSH_PLY_FILE_WRITE_ERR;
   }
 
-  for (size_t l = 0; l < msh_ply_array_len(el_properties); ++l)
+  uint64_t* src_keys = keys;
+  int32_t* src_rows  = rows;
+  uint64_t* dst_keys = tmp_keys;
+  int32_t* dst_rows  = tmp_rows;
+  for (int32_t shift = 0; shift < 64; shift += 8)
   {
-    msh_ply_property_t* qr = &el_properties[l];
+    int32_t offsets[256] = {0};
+    for (int32_t i = 0; i < n; ++i) { offsets[(src_keys[i] >> shift) & 0xff]++; }
+    if (offsets[(src_keys[0] >> shift) & 0xff] == n) { continue; }
 
-    if (pr->data == qr->data)
+    int32_t total = 0;
+    for (int32_t d = 0; d < 256; ++d)
     {
-      int32_t list_count =
-        msh_ply__get_data_as_int((uint8_t*)qr->list_data + offsets[l],
-                                 qr->list_type,
-                                 swap_endianness);
-      stride += list_count * qr->byte_size;
-      offsets[l] += qr->list_stride;
+      int32_t count = offsets[d];
+      offsets[d]    = total;
+      total += count;
     }
+    for (int32_t i = 0; i < n; ++i)
+    {
+      int32_t dst   = offsets[(src_keys[i] >> shift) & 0xff]++;
+      dst_keys[dst] = src_keys[i];
+      dst_rows[dst] = src_rows[i];
+    }
+    uint64_t* swap_keys = src_keys;
+    int32_t* swap_rows  = src_rows;
+    src_keys            = dst_keys;
+    src_rows            = dst_rows;
+    dst_keys            = swap_keys;
+    dst_rows            = swap_rows;
   }
-  return ((stride > 0) ? stride : 0);
+  if (src_rows != rows) { memcpy(rows, src_rows, (size_t)n * sizeof(int32_t)); }
+
+  MSH_PLY_FREE(tmp_keys);
+  MSH_PLY_FREE(tmp_rows);
+  return MSH_PLY_NO_ERR;
 }
 
+// Computes the order of the rows of the element, from the descriptor holding its positions.
+// 'order[i]' is set to the row of the user's data that is written as i-th row.
 MSH_PLY_PRIVATE int32_t
-msh_ply__write_header(const msh_ply_t* pf)
+msh_ply__compute_spatial_order(msh_ply_t* pf, int32_t** order, int32_t* n_rows)
 {
-  if (!pf->_fp) { return MSH_PLY_INVALID_FILE_ERR; }
-  else
+  const msh_ply__spatial_order_t* so = &pf->_spatial_order;
+  const msh_ply_desc_t* desc         = NULL;
+  int32_t idx[3]                     = {-1, -1, -1};
+  for (size_t i = 0; i < msh_ply_array_len(pf->descriptors) && !desc; ++i)
   {
-    char* format_string = NULL;
-    switch (pf->format)
+    const msh_ply_desc_t* cur = pf->descriptors[i];
+    if (strcmp(cur->element_name, so->element_name)) { continue; }
+    for (int32_t j = 0; j < cur->num_properties; ++j)
     {
-      case MSH_PLY_ASCII:
-      {
-        format_string = (char*)"ascii";
-        break;
-      }
-      case MSH_PLY_LITTLE_ENDIAN:
-      {
-        format_string = (char*)"binary_little_endian";
-        break;
-      }
-      case MSH_PLY_BIG_ENDIAN:
+      for (int32_t c = 0; c < 3; ++c)
       {
-        format_string = (char*)"binary_big_endian";
-        break;
-      }
-      default:
-      {
-        return MSH_PLY_INVALID_FORMAT_ERR;
+        if (!strcmp(cur->property_names[j], so->names[c])) { idx[c] = j; }
       }
     }
+    if (idx[0] >= 0 && idx[1] >= 0 && idx[2] >= 0) { desc = cur; }
+  }
+  if (!desc) { return MSH_PLY_PROPERTY_NOT_FOUND_ERR; }
+  if (desc->data_type != MSH_PLY_FLOAT && desc->data_type != MSH_PLY_DOUBLE)
+  {
+    return MSH_PLY_SPATIAL_ORDER_ERR;
+  }
 
-    fprintf(pf->_fp,
-            "ply\nformat %s %2.1f\n",
-            format_string,
-            (float)pf->format_version);
-    for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+  *n_rows = *desc->data_count;
+  int32_t n = *n_rows;
+  *order    = (int32_t*)MSH_PLY_MALLOC((size_t)MSH_PLY_MAX(n, 1) * sizeof(int32_t));
+  if (!*order) { return MSH_PLY_FILE_WRITE_ERR; }
+  if (n <= 1)
+  {
+    if (n == 1) { (*order)[0] = 0; }
+    return MSH_PLY_NO_ERR;
+  }
+  const uint8_t* data = *(const uint8_t**)desc->data;
+  if (!data) { return MSH_PLY_NULL_DATA_PTR_ERR; }
+  uint64_t* keys = (uint64_t*)MSH_PLY_MALLOC((size_t)n * sizeof(uint64_t));
+  if (!keys) { return MSH_PLY_FILE_WRITE_ERR; }
+
+  int32_t byte_size = msh_ply__type_to_byte_size(desc->data_type);
+  size_t row_size   = (size_t)desc->num_properties * byte_size;
+  double min[3]     = {0.0, 0.0, 0.0};
+  double max[3]     = {0.0, 0.0, 0.0};
+  for (int32_t i = 0; i < n; ++i)
+  {
+    for (int32_t c = 0; c < 3; ++c)
     {
-      msh_ply_element_t* el = &pf->elements[i];
-      fprintf(pf->_fp, "element %s %d\n", el->name, (int32_t)el->count);
-      for (size_t j = 0; j < msh_ply_array_len(el->properties); j++)
-      {
-        msh_ply_property_t* pr = &el->properties[j];
-        char* pr_type_str      = NULL;
-        msh_ply__property_type_to_string(pr->type, &pr_type_str);
+      double v = msh_ply__load_real(data + i * row_size + idx[c] * byte_size, desc->data_type);
+      if (i == 0 || v < min[c]) { min[c] = v; }
+      if (i == 0 || v > max[c]) { max[c] = v; }
+    }
+  }
 
-        if (pr->list_type == MSH_PLY_INVALID)
-        {
-          fprintf(pf->_fp, "property %s %s\n", pr_type_str, pr->name);
-        }
-        else
-        {
-          char* pr_list_type_str = NULL;
-          msh_ply__property_type_to_string(pr->list_type, &pr_list_type_str);
-          fprintf(pf->_fp,
-                  "property list %s %s %s\n",
-                  pr_list_type_str,
-                  pr_type_str,
-                  pr->name);
-        }
-      }
+  const int64_t max_value = (1 << 21) - 1;
+  double scale[3];
+  for (int32_t c = 0; c < 3; ++c)
+  {
+    scale[c] = (max[c] > min[c]) ? (double)max_value / (max[c] - min[c]) : 0.0;
+  }
+  for (int32_t i = 0; i < n; ++i)
+  {
+    uint32_t p[3];
+    for (int32_t c = 0; c < 3; ++c)
+    {
+      double v = msh_ply__load_real(data + i * row_size + idx[c] * byte_size, desc->data_type);
+      p[c]     = (uint32_t)msh_ply__round_clamped((v - min[c]) * scale[c], max_value, 1);
     }
-    fprintf(pf->_fp, "end_header\n");
+    keys[i]     = msh_ply__curve_key(so->curve, p);
+    (*order)[i] = i;
   }
-  return MSH_PLY_NO_ERR;
+  int32_t err_code = msh_ply__sort_keys(keys, *order, n);
+  MSH_PLY_FREE(keys);
+  return err_code;
 }
 
-MSH_PLY_PRIVATE int32_t
-msh_ply__write_data_ascii(const msh_ply_t* pf)
+MSH_PLY_PRIVATE void
+msh_ply__free_reordered(msh_ply_t* pf)
 {
-  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+  for (size_t i = 0; i < msh_ply_array_len(pf->_reordered); ++i)
   {
-    msh_ply_element_t* el = &pf->elements[i];
+    MSH_PLY_FREE(pf->_reordered[i]->data);
+    MSH_PLY_FREE(pf->_reordered[i]);
+  }
+  msh_ply_array_free(pf->_reordered);
+  pf->_reordered = 0;
+}
 
-    for (size_t j = 0; j < el->count; ++j)
+// Adds a copy of descriptor 'source', with a buffer of 'size' bytes for its data.
+MSH_PLY_PRIVATE msh_ply_desc_t*
+msh_ply__add_reordered_desc(msh_ply_t* pf, const msh_ply_desc_t* source, size_t size)
+{
+  msh_ply__reordered_desc_t* rd =
+    (msh_ply__reordered_desc_t*)MSH_PLY_MALLOC(sizeof(msh_ply__reordered_desc_t));
+  if (!rd) { return NULL; }
+  rd->desc      = *source;
+  rd->data      = MSH_PLY_MALLOC(MSH_PLY_MAX(size, 1));
+  rd->desc.data = &rd->data;
+  msh_ply_array_push(pf->_reordered, rd);
+  return rd->data ? &rd->desc : NULL;
+}
+
+// Copies values of list descriptor 'desc' into 'dst', replacing indices of property 'index_name'
+// with positions of the rows they refer to in the new order.
+MSH_PLY_PRIVATE void
+msh_ply__remap_indices(const msh_ply_desc_t* desc,
+                       const char* index_name,
+                       const int32_t* remap,
+                       int32_t n_remapped,
+                       uint8_t* dst)
+{
+  const uint8_t* src       = *(const uint8_t**)desc->data;
+  const uint8_t* list_data = desc->list_data ? *(const uint8_t**)desc->list_data : NULL;
+  int32_t byte_size        = msh_ply__type_to_byte_size(desc->data_type);
+  int32_t list_byte_size   = msh_ply__type_to_byte_size(desc->list_type);
+  for (int32_t i = 0; i < *desc->data_count; ++i)
+  {
+    for (int32_t j = 0; j < desc->num_properties; ++j)
     {
-      for (size_t k = 0; k < msh_ply_array_len(el->properties); ++k)
+      int32_t count = desc->list_size_hint;
+      if (!count)
       {
-        msh_ply_property_t* pr = &el->properties[k];
-        if (pr->list_type == MSH_PLY_INVALID)
-        {
-          msh_ply__fprint_data_at_offset(pf, pr->data, pr->offset, pr->type);
-          pr->offset += pr->stride;
-        }
-        else
+        count = msh_ply__get_data_as_int((void*)list_data, desc->list_type, 0);
+        list_data += list_byte_size;
+      }
+      size_t size = (size_t)count * byte_size;
+      memcpy(dst, src, size);
+      for (int32_t k = 0; !strcmp(desc->property_names[j], index_name) && k < count; ++k)
+      {
+        int32_t index = msh_ply__get_data_as_int((void*)(src + k * byte_size), desc->data_type, 0);
+        if (index >= 0 && index < n_remapped)
         {
-          // figure out stride.
-          int32_t list_count = 0;
-          if (pr->list_count != 0)
-          {
-            list_count = pr->list_count;
-            msh_ply__fprint_data_at_offset(pf, &list_count, 0, pr->list_type);
-          }
-          else
-          {
-            pr->stride =
-              msh_ply__calculate_list_property_stride(pr, el->properties, 0);
-            list_count = msh_ply__get_data_as_int((uint8_t*)pr->list_data +
-                                                    pr->list_offset,
-                                                  pr->list_type,
-                                                  0);
-            msh_ply__fprint_data_at_offset(pf,
-                                           pr->list_data,
-                                           pr->list_offset,
-                                           pr->list_type);
-          }
-          pr->list_offset += pr->list_stride;
-
-          for (int32_t l = 0; l < list_count; ++l)
-          {
-            int32_t cur_offset = pr->offset + l * pr->byte_size;
-            msh_ply__fprint_data_at_offset(pf, pr->data, cur_offset, pr->type);
-          }
-          pr->offset += pr->stride;
+          msh_ply__store_int(dst + k * byte_size, desc->data_type, remap[index]);
         }
       }
-      fprintf(pf->_fp, "\n");
+      src += size;
+      dst += size;
     }
   }
-  return MSH_PLY_NO_ERR;
 }
 
-// TODO(maciej): Test if splitting into completly separate functions helps
-// TODO(maciej): Check if writing data to file directly ends up being faster...
-int32_t
-msh_ply__write_data_binary(const msh_ply_t* pf)
+// Returns a copy of descriptor 'desc' with its rows reordered or its indices remapped, or 'desc'
+// itself if it is not affected by the ordering. Returns NULL and sets 'err_code' on failure.
+MSH_PLY_PRIVATE msh_ply_desc_t*
+msh_ply__reorder_descriptor(msh_ply_t* pf,
+                            msh_ply_desc_t* desc,
+                            const int32_t* order,
+                            const int32_t* remap,
+                            int32_t n_rows,
+                            int32_t* err_code)
 {
-  int8_t swap_endianness = (pf->_system_format != pf->format);
-
-  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+  const msh_ply__spatial_order_t* so = &pf->_spatial_order;
+  const uint8_t* src                 = *(const uint8_t**)desc->data;
+  size_t byte_size = (size_t)msh_ply__type_to_byte_size(desc->data_type);
+  if (!strcmp(desc->element_name, so->element_name))
   {
-    msh_ply_element_t* el = &pf->elements[i];
-    size_t buffer_size    = 0;
-    for (size_t j = 0; j < msh_ply_array_len(el->properties); ++j)
+    if (desc->list_type != MSH_PLY_INVALID || *desc->data_count != n_rows)
     {
-      buffer_size += el->properties[j].total_byte_size;
+      *err_code = MSH_PLY_SPATIAL_ORDER_ERR;
+      return NULL;
     }
+    if (!src && n_rows)
+    {
+      *err_code = MSH_PLY_NULL_DATA_PTR_ERR;
+      return NULL;
+    }
+    size_t row_size         = (size_t)desc->num_properties * byte_size;
+    msh_ply_desc_t* ordered = msh_ply__add_reordered_desc(pf, desc, (size_t)n_rows * row_size);
+    if (!ordered)
+    {
+      *err_code = MSH_PLY_FILE_WRITE_ERR;
+      return NULL;
+    }
+    uint8_t* dst = *(uint8_t**)ordered->data;
+    for (int32_t i = 0; i < n_rows; ++i)
+    {
+      memcpy(dst + (size_t)i * row_size, src + (size_t)order[i] * row_size, row_size);
+    }
+    return ordered;
+  }
 
-    uint8_t* dst       = (uint8_t*)MSH_PLY_MALLOC(buffer_size);
-    int64_t dst_offset = 0;
+  if (!so->index_name[0] || strcmp(desc->element_name, so->index_element_name) ||
+      desc->list_type == MSH_PLY_INVALID || desc->data_type == MSH_PLY_FLOAT ||
+      desc->data_type == MSH_PLY_DOUBLE)
+  {
+    return desc;
+  }
+  int32_t has_indices = 0;
+  for (int32_t j = 0; j < desc->num_properties; ++j)
+  {
+    if (!strcmp(desc->property_names[j], so->index_name)) { has_indices = 1; }
+  }
+  if (!has_indices) { return desc; }
+  if (!src || (!desc->list_size_hint && !desc->list_data))
+  {
+    *err_code = MSH_PLY_NULL_DATA_PTR_ERR;
+    return NULL;
+  }
 
-    for (size_t j = 0; j < el->count; ++j)
+  size_t n_values = 0;
+  if (desc->list_size_hint)
+  {
+    n_values = (size_t)*desc->data_count * desc->num_properties * desc->list_size_hint;
+  }
+  else
+  {
+    const uint8_t* list_data = *(const uint8_t**)desc->list_data;
+    int32_t list_byte_size   = msh_ply__type_to_byte_size(desc->list_type);
+    size_t n_lists           = (size_t)*desc->data_count * desc->num_properties;
+    for (size_t i = 0; i < n_lists; ++i, list_data += list_byte_size)
     {
-      for (size_t k = 0; k < msh_ply_array_len(el->properties); ++k)
-      {
-        msh_ply_property_t* pr = &el->properties[k];
-        if (pr->list_type == MSH_PLY_INVALID)
-        {
-          msh_ply__data_assign(dst + dst_offset,
-                               (uint8_t*)pr->data + pr->offset,
-                               pr->type,
-                               1);
-          pr->offset += pr->stride;
-          dst_offset += pr->byte_size;
-        }
-        else
-        {
-          // figure out stride
-          if (!pr->list_count)
-          {
-            pr->stride =
-              msh_ply__calculate_list_property_stride(pr,
-                                                      el->properties,
-                                                      swap_endianness);
-            pr->list_count = msh_ply__get_data_as_int((uint8_t*)pr->list_data +
-                                                        pr->list_offset,
-                                                      pr->list_type,
-                                                      swap_endianness);
+      n_values += msh_ply__get_data_as_int((void*)list_data, desc->list_type, 0);
+    }
+  }
+  msh_ply_desc_t* remapped = msh_ply__add_reordered_desc(pf, desc, n_values * byte_size);
+  if (!remapped)
+  {
+    *err_code = MSH_PLY_FILE_WRITE_ERR;
+    return NULL;
+  }
+  msh_ply__remap_indices(desc, so->index_name, remap, n_rows, *(uint8_t**)remapped->data);
+  return remapped;
+}
 
-            msh_ply__data_assign(dst + dst_offset,
-                                 (uint8_t*)pr->list_data + pr->list_offset,
-                                 pr->list_type,
-                                 1);
-            pr->list_offset += pr->list_stride;
-            dst_offset += pr->list_byte_size;
-          }
-          else
-          {
-            switch (pr->list_type)
-            {
-              case MSH_PLY_UINT8:
-              {
-                uint8_t* dst_ptr = (uint8_t*)dst + dst_offset;
-                *dst_ptr         = (uint8_t)pr->list_count;
-                break;
-              }
-              case MSH_PLY_UINT16:
-              {
-                uint16_t* dst_ptr = (uint16_t*)dst + dst_offset;
-                *dst_ptr          = (uint16_t)pr->list_count;
-                break;
-              }
-              case MSH_PLY_UINT32:
-              {
-                uint32_t* dst_ptr = (uint32_t*)dst + dst_offset;
-                *dst_ptr          = (uint32_t)pr->list_count;
-                break;
-              }
-              case MSH_PLY_INT8:
-              {
-                int8_t* dst_ptr = (int8_t*)dst + dst_offset;
-                *dst_ptr        = (int8_t)pr->list_count;
-                break;
-              }
-              case MSH_PLY_INT16:
-              {
-                int16_t* dst_ptr = (int16_t*)dst + dst_offset;
-                *dst_ptr         = (int16_t)pr->list_count;
-                break;
-              }
-              case MSH_PLY_INT32:
-              {
-                int32_t* dst_ptr = (int32_t*)dst + dst_offset;
-                *dst_ptr         = (int32_t)pr->list_count;
-                break;
-              }
-              default:
-              {
-                uint8_t* dst_ptr = (uint8_t*)dst + dst_offset;
-                *dst_ptr         = (uint8_t)pr->list_count;
-                break;
-              }
-            }
-            dst_offset += pr->list_byte_size;
-          }
+// Replaces descriptors of the ordered element, and descriptors holding indices into it, with
+// reordered copies.
+MSH_PLY_PRIVATE int32_t
+msh_ply__apply_spatial_order(msh_ply_t* pf)
+{
+  if (pf->_spatial_order.curve == MSH_PLY_CURVE_NONE || pf->_reordered) { return MSH_PLY_NO_ERR; }
 
-          msh_ply__data_assign(dst + dst_offset,
-                               (uint8_t*)pr->data + pr->offset,
-                               pr->type,
-                               pr->list_count);
-          pr->offset += pr->stride;
-          dst_offset += pr->byte_size * pr->list_count;
-        }
-      }
-    }
+  int32_t* order   = NULL;
+  int32_t* remap   = NULL;
+  int32_t n_rows   = 0;
+  int32_t err_code = msh_ply__compute_spatial_order(pf, &order, &n_rows);
+  if (!err_code)
+  {
+    remap = (int32_t*)MSH_PLY_MALLOC((size_t)MSH_PLY_MAX(n_rows, 1) * sizeof(int32_t));
+    if (!remap) { err_code = MSH_PLY_FILE_WRITE_ERR; }
+  }
+  for (int32_t i = 0; !err_code && i < n_rows; ++i) { remap[order[i]] = i; }
 
-    // NOTE(maciej): Can someone explain why below is faster than a single call to fwrite..?
-    size_t block_size       = 32 * 65536;
-    size_t remaining_buffer = buffer_size;
-    uint8_t* mem            = dst;
-    while (true)
-    {
-      if (remaining_buffer < block_size) break;
-      fwrite(mem, block_size, 1, pf->_fp);
-      mem += block_size;
-      remaining_buffer -= block_size;
-    }
-    fwrite(mem, remaining_buffer, 1, pf->_fp);
+  msh_ply_array(msh_ply_desc_t*) descriptors = 0;
+  for (size_t i = 0; i < msh_ply_array_len(pf->descriptors) && !err_code; ++i)
+  {
+    msh_ply_desc_t* desc =
+      msh_ply__reorder_descriptor(pf, pf->descriptors[i], order, remap, n_rows, &err_code);
+    if (desc) { msh_ply_array_push_in(&pf->_arena, descriptors, desc); }
+  }
+  MSH_PLY_FREE(order);
+  MSH_PLY_FREE(remap);
 
-    MSH_PLY_FREE(dst);
+  if (err_code)
+  {
+    msh_ply__free_reordered(pf);
+    msh_ply_array_free_in(&pf->_arena, descriptors);
+    return err_code;
   }
+  msh_ply_array_free_in(&pf->_arena, pf->descriptors);
+  pf->descriptors = descriptors;
   return MSH_PLY_NO_ERR;
 }
 
 MSH_PLY_PRIVATE int32_t
-msh_ply__write_data(const msh_ply_t* pf)
+msh_ply__write_data(msh_ply_t* pf)
 {
   int32_t error = MSH_PLY_NO_ERR;
   if (pf->format == MSH_PLY_ASCII) { error = msh_ply__write_data_ascii(pf); }
@@ -2510,6 +9624,11 @@ msh_ply_write(msh_ply_t* pf)
 
   if (msh_ply_array_len(pf->descriptors) == 0) { return MSH_PLY_NO_REQUESTS; }
 
+  error = msh_ply__apply_spatial_order(pf);
+  if (!error) { error = msh_ply__split_quantized_descriptors(pf); }
+  if (!error) { error = msh_ply__quantize_rows(pf, NULL, -1); }
+  if (error) { return error; }
+
   if (msh_ply_array_len(pf->elements) == 0)
   {
     for (size_t i = 0; i < msh_ply_array_len(pf->descriptors); ++i)
@@ -2526,6 +9645,85 @@ msh_ply_write(msh_ply_t* pf)
 
   return error;
 }
+
+MSH_PLY_DEF int32_t
+msh_ply_write_rows(msh_ply_t* pf, const char* element_name, int32_t n_rows)
+{
+  int32_t error = MSH_PLY_NO_ERR;
+  if (!pf || !pf->_fp) { return MSH_PLY_FILE_NOT_OPEN_ERR; }
+  if (!element_name) { return MSH_PLY_NULL_ELEMENT_NAME_ERR; }
+  if (msh_ply_array_len(pf->descriptors) == 0) { return MSH_PLY_NO_REQUESTS; }
+
+  // First call defines the elements and writes the header with placeholder counts
+  if (pf->_stream_element < 0)
+  {
+    error = msh_ply__split_quantized_descriptors(pf);
+    if (error) { return error; }
+    if (msh_ply_array_len(pf->elements) == 0)
+    {
+      for (size_t i = 0; i < msh_ply_array_len(pf->descriptors); ++i)
+      {
+        msh_ply_desc_t* desc = pf->descriptors[i];
+        error                = msh_ply__add_property_to_element(pf,
+                                                 desc->element_name,
+                                                 desc->property_names,
+                                                 desc->num_properties,
+                                                 desc->data_type,
+                                                 desc->list_type,
+                                                 (void**)desc->data,
+                                                 (void**)desc->list_data,
+                                                 0,
+                                                 desc->list_size_hint);
+        if (error) { return error; }
+      }
+    }
+    pf->_stream_element = 0;
+    error               = msh_ply__write_header(pf);
+    if (error) { return error; }
+  }
+
+  int32_t element_idx = -1;
+  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+  {
+    if (!strcmp(pf->elements[i].name, element_name))
+    {
+      element_idx = (int32_t)i;
+      break;
+    }
+  }
+  if (element_idx < 0) { return MSH_PLY_ELEMENT_NOT_FOUND_ERR; }
+  if (element_idx < pf->_stream_element) { return MSH_PLY_ELEMENT_ORDER_ERR; }
+  pf->_stream_element = element_idx;
+  if (n_rows <= 0) { return MSH_PLY_NO_ERR; }
+
+  msh_ply_element_t* el = &pf->elements[element_idx];
+  error                 = msh_ply__quantize_rows(pf, element_name, n_rows);
+  if (!error) { error = msh_ply__write_rows(pf, el, n_rows); }
+  if (!error) { el->count += n_rows; }
+  return error;
+}
+
+// Fills in the element counts and rewrites the header, which keeps its size.
+MSH_PLY_PRIVATE void
+msh_ply__patch_element_counts(msh_ply_t* pf)
+{
+  char count[16];
+  for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
+  {
+    msh_ply_element_t* el = &pf->elements[i];
+    snprintf(count, sizeof(count), "%010d", el->count);
+    memcpy(pf->_header_text + el->count_offset, count, 10);
+  }
+  fseek(pf->_fp, 0, SEEK_SET);
+  msh_ply__write_header_text(pf);
+}
+
+MSH_PLY_DEF void
+msh_ply_set_compression_level(msh_ply_t* pf, int32_t level)
+{
+  if (!pf || pf->_compression_level < 0) { return; }
+  pf->_compression_level = MSH_PLY_MAX(0, MSH_PLY_MIN(level, 9));
+}
 #endif /* MSH_PLY_DECODER_ONLY */
 
 MSH_PLY_DEF void
@@ -2598,6 +9796,52 @@ msh_ply_print_header(msh_ply_t* pf)
   }
 }
 
+MSH_PLY_PRIVATE msh_ply_t*
+msh_ply__create(FILE* fp)
+{
+  msh_ply_t* pf          = (msh_ply_t*)MSH_PLY_MALLOC(sizeof(msh_ply_t));
+  if (!pf) { return NULL; }
+  pf->valid              = 0;
+  pf->format             = -1;
+  pf->format_version     = 0;
+  pf->elements           = 0;
+  pf->descriptors        = 0;
+  pf->_cursors           = 0;
+  pf->_fp                = fp;
+  pf->_map               = NULL;
+  pf->_map_size          = 0;
+  pf->_header_size       = 0;
+  pf->_parsed            = 0;
+  pf->_lazy              = 0;
+  pf->_loaded            = 0;
+  pf->_num_threads       = 0;
+  pf->_run_tasks         = NULL;
+  pf->_run_tasks_data    = NULL;
+  pf->_stream_element    = -1;
+  pf->_compression_level = -1;
+  pf->_deflate           = NULL;
+  pf->_header_text       = 0;
+  pf->_quantizers        = 0;
+  pf->_quantized         = 0;
+  pf->_reordered         = 0;
+  pf->_index_blocks      = NULL;
+  pf->_output_alloc      = NULL;
+  pf->_output_alloc_data = NULL;
+  memset(&pf->_spatial_order, 0, sizeof(pf->_spatial_order));
+  memset(&pf->_arena, 0, sizeof(pf->_arena));
+  memset(&pf->_index, 0, sizeof(pf->_index));
+  memset(&pf->_io, 0, sizeof(pf->_io));
+
+  // Endianness check
+  int32_t n = 1;
+  if (*(char*)&n == 1) { pf->_system_format = MSH_PLY_LITTLE_ENDIAN; }
+  else
+  {
+    pf->_system_format = MSH_PLY_BIG_ENDIAN;
+  }
+  return pf;
+}
+
 MSH_PLY_DEF msh_ply_t*
 msh_ply_open(const char* filename, const char* mode)
 {
@@ -2609,6 +9853,10 @@ msh_ply_open(const char* filename, const char* mode)
   {
     mode_str = "rb";
   }   // We always wanna read file as binary for ftell.
+  else if (strchr(mode, 'z'))
+  {
+    mode_str = "wb";
+  }
   else
   {
     mode_str = mode;
@@ -2617,51 +9865,84 @@ msh_ply_open(const char* filename, const char* mode)
 
   if (fp)
   {
-    pf                 = (msh_ply_t*)MSH_PLY_MALLOC(sizeof(msh_ply_t));
-    pf->valid          = 0;
-    pf->format         = -1;
-    pf->format_version = 0;
-    pf->elements       = 0;
-    pf->descriptors    = 0;
-    pf->_fp            = fp;
-    pf->_parsed        = 0;
-
-    // Endianness check
-    int32_t n = 1;
-    if (*(char*)&n == 1) { pf->_system_format = MSH_PLY_LITTLE_ENDIAN; }
-    else
-    {
-      pf->_system_format = MSH_PLY_BIG_ENDIAN;
-    }
+    pf = msh_ply__create(fp);
+    if (!pf) { fclose(fp); }
+  }
+  if (pf && mode[0] == 'r')
+  {
+    pf->_io.read_at   = msh_ply__file_read_at;
+    pf->_io.size      = msh_ply__file_size;
+    pf->_io.user_data = fp;
+  }
+  if (pf && mode[0] == 'r' && strchr(mode, 'm'))
+  {
+    // NOTE: Failure to map is not fatal - we simply fall back to stdio reading.
+    msh_ply__map_file(pf, filename);
   }
-  if (mode[0] == 'w')
+  if (pf && mode[0] == 'w')
   {
     pf->format_version = 1;
     pf->format         = MSH_PLY_ASCII;
     if (strlen(mode) > 1 && mode[1] == 'b') { pf->format = pf->_system_format; }
+    if (strchr(mode, 'z')) { pf->_compression_level = 6; }
   }
   return pf;
 }
 
+MSH_PLY_DEF msh_ply_t*
+msh_ply_open_io(const msh_ply_io_t* io)
+{
+  if (!io || !io->read_at) { return NULL; }
+  msh_ply_t* pf = msh_ply__create(NULL);
+  if (pf) { pf->_io = *io; }
+  return pf;
+}
+
 MSH_PLY_DEF void
 msh_ply_close(msh_ply_t* pf)
 {
+#ifndef MSH_PLY_DECODER_ONLY
+  if (pf->_fp && pf->_deflate) { msh_ply__deflate_finish(pf->_deflate); }
+  if (pf->_fp && pf->_stream_element >= 0) { msh_ply__patch_element_counts(pf); }
+  msh_ply__deflate_destroy(pf->_deflate);
+  if (pf->_header_text) { msh_ply_array_free_in(&pf->_arena, pf->_header_text); }
+  msh_ply__free_quantized(pf);
+  msh_ply__free_reordered(pf);
+#endif
+  if (pf->_cursors)
+  {
+    for (size_t i = 0; i < msh_ply_array_len(pf->_cursors); ++i)
+    {
+      msh_ply__block_reader_t* reader = pf->_cursors[i].reader;
+      if (reader) { msh_ply__block_reader_term(reader); }
+      MSH_PLY_FREE(reader);
+    }
+  }
+  if (pf->_io.close) { pf->_io.close(pf->_io.user_data); }
   if (pf->_fp)
   {
     fclose(pf->_fp);
     pf->_fp = NULL;
   }
+  msh_ply__unmap_file(pf);
 
   if (pf->elements)
   {
     for (size_t i = 0; i < msh_ply_array_len(pf->elements); ++i)
     {
       msh_ply_element_t* el = &pf->elements[i];
-      if (el->properties) { msh_ply_array_free(el->properties); }
+      if (el->properties) { msh_ply_array_free_in(&pf->_arena, el->properties); }
+      if (el->split_offsets) { msh_ply_array_free_in(&pf->_arena, el->split_offsets); }
+      if (el->split_totals) { msh_ply_array_free_in(&pf->_arena, el->split_totals); }
     }
-    msh_ply_array_free(pf->elements);
+    msh_ply_array_free_in(&pf->_arena, pf->elements);
   }
-  if (pf->descriptors) msh_ply_array_free(pf->descriptors);
+  if (pf->descriptors) msh_ply_array_free_in(&pf->_arena, pf->descriptors);
+  if (pf->_cursors) msh_ply_array_free_in(&pf->_arena, pf->_cursors);
+  if (pf->_quantizers) msh_ply_array_free_in(&pf->_arena, pf->_quantizers);
+  if (pf->_loaded) msh_ply_array_free_in(&pf->_arena, pf->_loaded);
+  msh_ply__arena_free(&pf->_arena, pf->_index_blocks);
+  msh_ply__arena_release(&pf->_arena);
   MSH_PLY_FREE(pf);
 }
 
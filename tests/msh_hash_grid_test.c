@@ -2,23 +2,27 @@
 #define MSH_STD_INCLUDE_LIBC_HEADERS
 #define MSH_STD_IMPLEMENTATION
 #define MSH_VEC_MATH_IMPLEMENTATION
+#define MSH_CONTAINERS_IMPLEMENTATION
+#define MSH_JOBS_IMPLEMENTATION
 #define MSH_HASH_GRID_IMPLEMENTATION
 #include "msh/msh_std.h"
+#include "msh/msh_containers.h"
 #include "msh/msh_vec_math.h"
+#include "msh/msh_jobs.h"
 #include "msh/msh_hash_grid.h"
 
 msh_vec3_t
 generate_random_point_within_sphere_shell( msh_rand_ctx_t* rand_gen, msh_vec3_t center,
-                                           real32_t radius_a, real32_t radius_b )
+                                           float radius_a, float radius_b )
 {
   assert( radius_a > radius_b );
   assert( radius_a >= 0.0f );
   assert( radius_b >= 0.0f );
 
-  real32_t x = 2.0f * msh_rand_nextf( rand_gen ) - 1.0f;
-  real32_t y = 2.0f * msh_rand_nextf( rand_gen ) - 1.0f;
-  real32_t z = 2.0f * msh_rand_nextf( rand_gen ) - 1.0f;
-  real32_t s = msh_rand_nextf( rand_gen ) * (radius_a - radius_b) + radius_b ;
+  float x = 2.0f * msh_rand_nextf( rand_gen ) - 1.0f;
+  float y = 2.0f * msh_rand_nextf( rand_gen ) - 1.0f;
+  float z = 2.0f * msh_rand_nextf( rand_gen ) - 1.0f;
+  float s = msh_rand_nextf( rand_gen ) * (radius_a - radius_b) + radius_b ;
   msh_vec3_t pt = msh_vec3( x, y, z );
   pt = msh_vec3_scalar_mul( msh_vec3_normalize( pt ), s );
   pt = msh_vec3_add( pt, center );
@@ -26,7 +30,7 @@ generate_random_point_within_sphere_shell( msh_rand_ctx_t* rand_gen, msh_vec3_t
 }
 
 msh_vec3_t
-generate_random_point_within_sphere( msh_rand_ctx_t* rand_gen, msh_vec3_t center, real32_t radius )
+generate_random_point_within_sphere( msh_rand_ctx_t* rand_gen, msh_vec3_t center, float radius )
 {
   return generate_random_point_within_sphere_shell( rand_gen, center, radius, 0.0f );
 }
@@ -40,7 +44,7 @@ knn_search_test()
 
   // generate knn pts around origin 
   size_t knn = 10;
-  real32_t radius_a = 0.3;
+  float radius_a = 0.3;
   for( size_t i = 0; i < knn; ++i )
   {
     msh_vec3_t pt = generate_random_point_within_sphere( &rand_gen, msh_vec3_zeros(), radius_a );
@@ -48,8 +52,8 @@ knn_search_test()
   }
 
   // generate 1000 points around in a shell
-  real32_t radius_b = 0.6;
-  real32_t radius_c = 0.4;
+  float radius_b = 0.6;
+  float radius_c = 0.4;
   for( size_t i = 0; i < 1000; ++i )
   {
     msh_vec3_t pt = generate_random_point_within_sphere_shell( &rand_gen, msh_vec3_zeros(), 
@@ -59,13 +63,13 @@ knn_search_test()
 
   // setup the hash grid
   msh_hash_grid_t hg = {0};
-  msh_hash_grid_init_3d( &hg, (real32_t*)&pts[0], msh_array_len(pts), 0.1 );
+  msh_hash_grid_init_3d( &hg, (float*)&pts[0], msh_array_len(pts), 0.1 );
 
   msh_hash_grid_search_desc_t search_opts = 
   {
     .n_query_pts = 1,
     .k = knn,
-    .distances_sq = malloc( sizeof(real32_t) * knn ),
+    .distances_sq = malloc( sizeof(float) * knn ),
     .indices = malloc( sizeof(int32_t) * knn ),
   };
 
@@ -89,7 +93,7 @@ radius_search_test()
   
   // randomly generate 10 points in a volume of a sphere with 0.1 radius around origin
   size_t n_pts_a = 10;
-  real32_t radius_a = 0.1;
+  float radius_a = 0.1;
   for( size_t i = 0; i < n_pts_a; ++i )
   {
     msh_vec3_t pt = generate_random_point_within_sphere( &rand_gen, msh_vec3_zeros(), radius_a );
@@ -98,7 +102,7 @@ radius_search_test()
 
   // randomly generate 100 points in a volume of a sphere with 0.3 radius around pt. 3.0, 3.0, 3.0
   size_t n_pts_b = 100;
-  real32_t radius_b = 0.3;
+  float radius_b = 0.3;
   for( size_t i = 0; i < n_pts_b; ++i )
   {
     msh_vec3_t pt = generate_random_point_within_sphere( &rand_gen, msh_vec3(3.0f, 3.0f, 3.0f), 
@@ -108,8 +112,8 @@ radius_search_test()
 
 
   // now randomly generate 1000 points in a volume that is a difference of two spheres
-  real32_t radius_c = 0.5;
-  real32_t radius_d = 0.6;
+  float radius_c = 0.5;
+  float radius_d = 0.6;
   for( size_t i = 0; i < 1000; ++i )
   {
     msh_vec3_t pt = generate_random_point_within_sphere_shell( &rand_gen, msh_vec3_zeros(), 
@@ -132,14 +136,14 @@ radius_search_test()
 
   // setup the hash grid
   msh_hash_grid_t hg = {0};
-  msh_hash_grid_init_3d( &hg, (real32_t*)&pts[0], msh_array_len(pts), radius_a );
+  msh_hash_grid_init_3d( &hg, (float*)&pts[0], msh_array_len(pts), radius_a );
 
   size_t max_n_neigh = msh_max( n_pts_a, n_pts_b);
   msh_hash_grid_search_desc_t search_opts = 
   {
     .n_query_pts = 1,
     .max_n_neigh = max_n_neigh,
-    .distances_sq = malloc( sizeof(real32_t) * max_n_neigh ),
+    .distances_sq = malloc( sizeof(float) * max_n_neigh ),
     .indices = malloc( sizeof(int32_t) * max_n_neigh ),
     .sort = 1
   };
@@ -167,11 +171,453 @@ radius_search_test()
   }
 }
 
+void
+construction_test( int32_t dim )
+{
+  msh_rand_ctx_t rand_gen = {0};
+  msh_rand_init( &rand_gen, 12346ULL );
+  msh_array( float ) pts = {0};
+
+  // generate points in a unit cube, with a dense cluster so that some bins hold many points
+  size_t n_pts = 20000;
+  for( size_t i = 0; i < n_pts; ++i )
+  {
+    float scale = ( i % 4 == 0 ) ? 0.05f : 1.0f;
+    for( int32_t j = 0; j < dim; ++j ) { msh_array_push( pts, scale * msh_rand_nextf( &rand_gen ) ); }
+  }
+
+  // build the same grid sequentially and with multiple threads
+  msh_hash_grid_t hg_a = {0};
+  msh_hash_grid_t hg_b = {0};
+  hg_a._num_threads = 1;
+  hg_b._num_threads = 4;
+  if( dim == 2 )
+  {
+    msh_hash_grid_init_2d( &hg_a, pts, n_pts, 0.01f );
+    msh_hash_grid_init_2d( &hg_b, pts, n_pts, 0.01f );
+  }
+  else
+  {
+    msh_hash_grid_init_3d( &hg_a, pts, n_pts, 0.01f );
+    msh_hash_grid_init_3d( &hg_b, pts, n_pts, 0.01f );
+  }
+  assert( hg_a._n_pts == n_pts );
+  assert( hg_a.max_n_pts_in_bin == hg_b.max_n_pts_in_bin );
+  assert( msh_hg_map_len( hg_a.bin_table ) == msh_hg_map_len( hg_b.bin_table ) );
+  assert( !memcmp( hg_a.data_buffer, hg_b.data_buffer, n_pts * sizeof(msh_hg_v3i_t) ) );
+
+  // every point is stored once, in the bin it falls into, with bins in Morton order
+  uint8_t* is_stored = calloc( n_pts, 1 );
+  uint64_t prev_cell_key = 0;
+  uint32_t max_n_pts_in_bin = 0;
+  assert( hg_a._use_morton );
+  for( size_t i = 0; i < msh_hg_map_len( hg_a.bin_table ); ++i )
+  {
+    msh_hg__bin_info_t bin = hg_a.offsets[i];
+    max_n_pts_in_bin = msh_max( max_n_pts_in_bin, bin.length );
+    for( uint32_t j = bin.offset; j < bin.offset + bin.length; ++j )
+    {
+      msh_hg_v3i_t pt = hg_a.data_buffer[j];
+      uint64_t ix = (uint64_t)( ( pt.x - hg_a.min_pt.x ) * hg_a._inv_cell_size );
+      uint64_t iy = (uint64_t)( ( pt.y - hg_a.min_pt.y ) * hg_a._inv_cell_size );
+      uint64_t iz = (uint64_t)( ( pt.z - hg_a.min_pt.z ) * hg_a._inv_cell_size );
+      uint64_t bin_idx  = msh_hash_grid__bin_pt( &hg_a, ix, iy, iz );
+      uint64_t cell_key = msh_hash_grid__cell_key( &hg_a, ix, iy, iz );
+      uint64_t* bin_table_idx = msh_hg_map_get( hg_a.bin_table, bin_idx );
+      assert( bin_table_idx && *bin_table_idx == i );
+      assert( msh_hash_grid__cell_key_to_bin( &hg_a, cell_key ) == bin_idx );
+      assert( i == 0 || j != bin.offset || cell_key > prev_cell_key );
+      assert( j == bin.offset || pt.i > hg_a.data_buffer[j - 1].i );
+      assert( pt.x == pts[ dim * pt.i ] && pt.y == pts[ dim * pt.i + 1 ] );
+      assert( !is_stored[pt.i] );
+      is_stored[pt.i] = 1;
+      prev_cell_key = cell_key;
+    }
+  }
+  assert( max_n_pts_in_bin == hg_a.max_n_pts_in_bin );
+  for( size_t i = 0; i < n_pts; ++i ) { assert( is_stored[i] ); }
+
+  free( is_stored );
+  msh_hash_grid_term( &hg_a );
+  msh_hash_grid_term( &hg_b );
+  msh_array_free( pts );
+}
+
+int32_t
+int32_compare( const void* a, const void* b )
+{
+  return *(int32_t*)a - *(int32_t*)b;
+}
+
+void
+check_against_brute_force( msh_hash_grid_t* hg, msh_rand_ctx_t* rand_gen,
+                           float* pts, uint8_t* is_alive, size_t n_pts )
+{
+  enum { MAX_N_NEIGH = 4096 };
+  float* dists_sq  = malloc( sizeof(float) * MAX_N_NEIGH );
+  int32_t* indices = malloc( sizeof(int32_t) * MAX_N_NEIGH );
+  int32_t* ref_indices = malloc( sizeof(int32_t) * MAX_N_NEIGH );
+
+  for( size_t q = 0; q < 20; ++q )
+  {
+    float query[3] = { 1.4f * msh_rand_nextf( rand_gen ) - 0.2f,
+                       1.4f * msh_rand_nextf( rand_gen ) - 0.2f,
+                       1.4f * msh_rand_nextf( rand_gen ) - 0.2f };
+    float radius = 0.1f;
+    size_t n_ref = 0;
+    float min_dist_sq = MSH_F32_MAX;
+    for( size_t i = 0; i < n_pts; ++i )
+    {
+      if( !is_alive[i] ) { continue; }
+      float* pt = pts + 3 * i;
+      float dist_sq = msh_sq( pt[0] - query[0] ) + msh_sq( pt[1] - query[1] ) +
+                      msh_sq( pt[2] - query[2] );
+      if( dist_sq < radius * radius ) { ref_indices[n_ref++] = i; }
+      min_dist_sq = msh_min( min_dist_sq, dist_sq );
+    }
+
+    msh_hash_grid_search_desc_t search_opts =
+    {
+      .query_pts = query,
+      .n_query_pts = 1,
+      .max_n_neigh = MAX_N_NEIGH,
+      .distances_sq = dists_sq,
+      .indices = indices,
+      .radius = radius
+    };
+    size_t n_neigh = msh_hash_grid_radius_search( hg, &search_opts );
+    assert( n_neigh == n_ref );
+    qsort( indices, n_neigh, sizeof(int32_t), int32_compare );
+    assert( !memcmp( indices, ref_indices, n_neigh * sizeof(int32_t) ) );
+
+    search_opts.k = 1;
+    n_neigh = msh_hash_grid_knn_search( hg, &search_opts );
+    assert( n_neigh == 1 && dists_sq[0] == min_dist_sq );
+  }
+
+  free( dists_sq );
+  free( indices );
+  free( ref_indices );
+}
+
+void
+incremental_update_test()
+{
+  msh_rand_ctx_t rand_gen = {0};
+  msh_rand_init( &rand_gen, 12346ULL );
+
+  size_t n_init_pts = 5000;
+  size_t max_n_pts  = 20000;
+  float* pts = malloc( 3 * max_n_pts * sizeof(float) );
+  uint8_t* is_alive = malloc( max_n_pts );
+  for( size_t i = 0; i < 3 * n_init_pts; ++i ) { pts[i] = msh_rand_nextf( &rand_gen ); }
+  memset( is_alive, 1, n_init_pts );
+
+  msh_hash_grid_t hg = {0};
+  msh_hash_grid_init_3d( &hg, pts, n_init_pts, 0.05f );
+  size_t n_pts = n_init_pts;
+
+  // each frame changes a few percent of the points, some of which end up outside the grid
+  for( size_t frame = 0; frame < 30; ++frame )
+  {
+    for( size_t j = 0; j < 300; ++j )
+    {
+      uint32_t op = msh_rand_range( &rand_gen, 0, 3 );
+      int32_t idx = msh_rand_range( &rand_gen, 0, n_pts - 1 );
+      float extent = ( msh_rand_nextf( &rand_gen ) < 0.1f ) ? 1.4f : 1.0f;
+      float pt[3] = { extent * msh_rand_nextf( &rand_gen ), extent * msh_rand_nextf( &rand_gen ),
+                      extent * msh_rand_nextf( &rand_gen ) };
+      if( op == 0 && n_pts < max_n_pts )
+      {
+        int32_t new_idx = msh_hash_grid_insert( &hg, pt );
+        assert( new_idx == (int32_t)n_pts );
+        memcpy( pts + 3 * n_pts, pt, sizeof(pt) );
+        is_alive[n_pts++] = 1;
+      }
+      else if( op == 1 )
+      {
+        msh_hash_grid_remove( &hg, idx );
+        is_alive[idx] = 0;
+      }
+      else if( is_alive[idx] )
+      {
+        // move most points only slightly, so that they tend to stay in their bin
+        if( op == 2 ) { for( int32_t k = 0; k < 3; ++k ) { pt[k] = pts[ 3 * idx + k ] + 0.001f; } }
+        msh_hash_grid_update( &hg, idx, pt );
+        memcpy( pts + 3 * idx, pt, sizeof(pt) );
+      }
+    }
+    check_against_brute_force( &hg, &rand_gen, pts, is_alive, n_pts );
+    if( frame % 10 == 9 )
+    {
+      msh_hash_grid_compact( &hg );
+      check_against_brute_force( &hg, &rand_gen, pts, is_alive, n_pts );
+    }
+  }
+
+  msh_hash_grid_term( &hg );
+  free( pts );
+  free( is_alive );
+}
+
+// Runs radius and knn searches for both 'search_opts', which should only differ in how the queries
+// get processed, and checks that each query gets the same neighbors from both.
+void
+compare_searches( const msh_hash_grid_t* hg, msh_hash_grid_search_desc_t search_opts[2] )
+{
+  size_t n_query_pts = search_opts[0].n_query_pts;
+  size_t k = search_opts[0].max_n_neigh;
+  float* dists_sq[2];
+  int32_t* indices[2];
+  size_t* n_neighbors[2];
+  size_t total_num_neighbors[2];
+  for( int32_t i = 0; i < 2; ++i )
+  {
+    msh_hash_grid_search_desc_t* opts = &search_opts[i];
+    dists_sq[i]    = malloc( 2 * n_query_pts * k * sizeof(float) );
+    indices[i]     = malloc( 2 * n_query_pts * k * sizeof(int32_t) );
+    n_neighbors[i] = malloc( 2 * n_query_pts * sizeof(size_t) );
+    opts->distances_sq = dists_sq[i];
+    opts->indices      = indices[i];
+    opts->n_neighbors  = n_neighbors[i];
+    total_num_neighbors[i] = msh_hash_grid_radius_search( hg, opts );
+
+    opts->distances_sq += n_query_pts * k;
+    opts->indices      += n_query_pts * k;
+    opts->n_neighbors  += n_query_pts;
+    total_num_neighbors[i] += msh_hash_grid_knn_search( hg, opts );
+  }
+
+  assert( total_num_neighbors[0] == total_num_neighbors[1] );
+  for( size_t i = 0; i < 2 * n_query_pts; ++i )
+  {
+    assert( n_neighbors[0][i] == n_neighbors[1][i] );
+    assert( !memcmp( indices[0] + i * k, indices[1] + i * k, n_neighbors[0][i] * sizeof(int32_t) ) );
+  }
+
+  for( int32_t i = 0; i < 2; ++i )
+  {
+    free( dists_sq[i] );
+    free( indices[i] );
+    free( n_neighbors[i] );
+  }
+}
+
+void
+query_reorder_test()
+{
+  msh_rand_ctx_t rand_gen = {0};
+  msh_rand_init( &rand_gen, 12346ULL );
+
+  size_t n_pts = 20000;
+  size_t n_query_pts = 2000;
+  float* pts = malloc( 3 * n_pts * sizeof(float) );
+  float* query_pts = malloc( 3 * n_query_pts * sizeof(float) );
+  for( size_t i = 0; i < 3 * n_pts; ++i ) { pts[i] = msh_rand_nextf( &rand_gen ); }
+  for( size_t i = 0; i < 3 * n_query_pts; ++i )
+  {
+    query_pts[i] = 1.2f * msh_rand_nextf( &rand_gen ) - 0.1f;
+  }
+
+  msh_hash_grid_t hg = {0};
+  msh_hash_grid_init_3d( &hg, pts, n_pts, 0.02f );
+
+  // processing queries in grid order must not change what is reported for each query
+  msh_hash_grid_search_desc_t search_opts[2] =
+  {
+    { .query_pts = query_pts, .n_query_pts = n_query_pts, .radius = 0.02f, .max_n_neigh = 8,
+      .sort = 1, .reorder = 0 },
+    { .query_pts = query_pts, .n_query_pts = n_query_pts, .radius = 0.02f, .max_n_neigh = 8,
+      .sort = 1, .reorder = 1 }
+  };
+  compare_searches( &hg, search_opts );
+
+  msh_hash_grid_term( &hg );
+  free( pts );
+  free( query_pts );
+}
+
+void
+job_system_test()
+{
+  msh_rand_ctx_t rand_gen = {0};
+  msh_rand_init( &rand_gen, 12347ULL );
+
+  // prime, so no batch size divides it and the last batch is a partial one
+  size_t n_pts = 20000;
+  size_t n_query_pts = 5003;
+  float* pts = malloc( 3 * n_pts * sizeof(float) );
+  float* query_pts = malloc( 3 * n_query_pts * sizeof(float) );
+  for( size_t i = 0; i < 3 * n_pts; ++i ) { pts[i] = msh_rand_nextf( &rand_gen ); }
+  for( size_t i = 0; i < 3 * n_query_pts; ++i ) { query_pts[i] = msh_rand_nextf( &rand_gen ); }
+
+  msh_hash_grid_t hg = {0};
+  msh_hash_grid_init_3d( &hg, pts, n_pts, 0.02f );
+
+  msh_jobs_ctx_t work_ctx = {0};
+  msh_jobs_init_ctx( &work_ctx, 3 );
+
+  // running the queries as batches on the job system must give the same results as running them
+  // on the calling thread / OpenMP
+  for( int32_t reorder = 0; reorder < 2; ++reorder )
+  {
+    msh_hash_grid_search_desc_t search_opts[2] =
+    {
+      { .query_pts = query_pts, .n_query_pts = n_query_pts, .radius = 0.02f, .max_n_neigh = 8,
+        .sort = 1, .reorder = reorder },
+      { .query_pts = query_pts, .n_query_pts = n_query_pts, .radius = 0.02f, .max_n_neigh = 8,
+        .sort = 1, .reorder = reorder, .work_ctx = &work_ctx }
+    };
+    compare_searches( &hg, search_opts );
+  }
+
+  // the first query lands in the first batch, check it against brute force
+  enum { MAX_N_NEIGH = 64 };
+  float* dists_sq = malloc( n_query_pts * MAX_N_NEIGH * sizeof(float) );
+  int32_t* indices = malloc( n_query_pts * MAX_N_NEIGH * sizeof(int32_t) );
+  size_t* n_neighbors = malloc( n_query_pts * sizeof(size_t) );
+  float radius = 0.05f;
+  size_t n_ref = 0;
+  float min_dist_sq = MSH_F32_MAX;
+  for( size_t i = 0; i < n_pts; ++i )
+  {
+    float dist_sq = msh_sq( pts[3 * i + 0] - query_pts[0] ) +
+                    msh_sq( pts[3 * i + 1] - query_pts[1] ) +
+                    msh_sq( pts[3 * i + 2] - query_pts[2] );
+    if( dist_sq < radius * radius ) { n_ref++; }
+    min_dist_sq = msh_min( min_dist_sq, dist_sq );
+  }
+  assert( n_ref > 0 && n_ref < MAX_N_NEIGH );
+
+  msh_hash_grid_search_desc_t search_opts =
+  {
+    .query_pts = query_pts,
+    .n_query_pts = n_query_pts,
+    .distances_sq = dists_sq,
+    .indices = indices,
+    .n_neighbors = n_neighbors,
+    .radius = radius,
+    .max_n_neigh = MAX_N_NEIGH,
+    .sort = 1,
+    .work_ctx = &work_ctx
+  };
+  memset( n_neighbors, 0xff, n_query_pts * sizeof(size_t) );
+  msh_hash_grid_radius_search( &hg, &search_opts );
+  assert( n_neighbors[0] == n_ref );
+
+  search_opts.k = 1;
+  memset( n_neighbors, 0xff, n_query_pts * sizeof(size_t) );
+  msh_hash_grid_knn_search( &hg, &search_opts );
+  assert( n_neighbors[0] == 1 && dists_sq[0] == min_dist_sq );
+
+  free( dists_sq );
+  free( indices );
+  free( n_neighbors );
+  msh_jobs_term_ctx( &work_ctx );
+  msh_hash_grid_term( &hg );
+  free( pts );
+  free( query_pts );
+}
+
+void
+sort_neighbors( float* dists_sq, int32_t* indices, size_t n )
+{
+  for( size_t i = 1; i < n; ++i )
+  {
+    for( size_t j = i; j > 0 && indices[j - 1] > indices[j]; --j )
+    {
+      int32_t idx = indices[j - 1]; indices[j - 1] = indices[j]; indices[j] = idx;
+      float dist_sq = dists_sq[j - 1]; dists_sq[j - 1] = dists_sq[j]; dists_sq[j] = dist_sq;
+    }
+  }
+}
+
+void
+bin_scan_test()
+{
+  msh_rand_ctx_t rand_gen = {0};
+  msh_rand_init( &rand_gen, 12348ULL );
+
+  // cell 'k' of a row of cells gets 'k' points (and the first one a single point in the corner),
+  // so bins have every size from 1 up to past two AVX-512 registers, with all possible tails
+  enum { N_CELLS = 41, MAX_N_NEIGH = 64 };
+  float cell_size = 0.1f;
+  size_t n_pts = 1 + N_CELLS * (N_CELLS - 1) / 2;
+  float* pts = malloc( 3 * n_pts * sizeof(float) );
+  size_t n = 0;
+  pts[n++] = 0.0f; pts[n++] = 0.0f; pts[n++] = 0.0f;
+  for( int32_t k = 1; k < N_CELLS; ++k )
+  {
+    for( int32_t j = 0; j < k; ++j )
+    {
+      pts[n++] = cell_size * (k + 0.4f + 0.2f * msh_rand_nextf( &rand_gen ));
+      pts[n++] = cell_size * (0.4f + 0.2f * msh_rand_nextf( &rand_gen ));
+      pts[n++] = cell_size * (0.4f + 0.2f * msh_rand_nextf( &rand_gen ));
+    }
+  }
+
+  msh_hash_grid_t hg = {0};
+  msh_hash_grid_init_3d( &hg, pts, n_pts, 0.5f * cell_size );
+
+  // whatever the bin scan uses, it has to find the same neighbors as the plain scan of the bin
+  float dists_sq[2][MAX_N_NEIGH];
+  int32_t indices[2][MAX_N_NEIGH];
+  for( int32_t k = 0; k < N_CELLS; ++k )
+  {
+    float query_pts[2][3] =
+    {
+      { cell_size * (k + 0.5f), 0.5f * cell_size, 0.5f * cell_size },
+      { cell_size * (k + 0.45f), 0.45f * cell_size, 0.5f * cell_size }
+    };
+    uint64_t bin_idx = 0;
+    msh_hg_v3i_t center = msh_hash_grid__make_pt( &hg, query_pts[0], 0 );
+    int32_t found = msh_hash_grid__locate_bin( &hg, &center, &bin_idx );
+    assert( found );
+    msh_hg__bin_info_t bi = hg.offsets[ *msh_hg_map_get( hg.bin_table, bin_idx ) ];
+    assert( bi.length == (uint32_t)msh_max( k, 1 ) );
+
+    // whole bin, part of it, and a full storage which tightens the threshold of the later points
+    float radii[3] = { cell_size, 0.08f * cell_size, cell_size };
+    int32_t caps[3] = { MAX_N_NEIGH, MAX_N_NEIGH, 3 };
+    for( int32_t q = 0; q < 2; ++q )
+    {
+      for( int32_t t = 0; t < 3; ++t )
+      {
+        float radius_sq = msh_sq( radii[t] );
+        msh_hash_grid_dist_storage_t storage[2];
+        msh_hash_grid_dist_storage_init( &storage[0], caps[t], dists_sq[0], indices[0] );
+        msh_hash_grid_dist_storage_init( &storage[1], caps[t], dists_sq[1], indices[1] );
+        msh_hash_grid__find_neighbors_in_bin( &hg, bin_idx, radius_sq, query_pts[q], &storage[0] );
+        msh_hash_grid__find_neighbors_in_range( &hg, &hg.data_buffer[bi.offset], bi.length,
+                                                radius_sq, query_pts[q], &storage[1] );
+
+        assert( storage[0].len == storage[1].len );
+        assert( storage[0].len == msh_min( bi.length, (uint32_t)caps[t] ) || t == 1 );
+        sort_neighbors( dists_sq[0], indices[0], storage[0].len );
+        sort_neighbors( dists_sq[1], indices[1], storage[1].len );
+        for( size_t i = 0; i < storage[0].len; ++i )
+        {
+          assert( indices[0][i] == indices[1][i] );
+          assert( fabsf( dists_sq[0][i] - dists_sq[1][i] ) <= 1e-6f * dists_sq[1][i] );
+        }
+      }
+    }
+  }
+
+  msh_hash_grid_term( &hg );
+  free( pts );
+}
+
 int
 main()
 {
   printf( "Running msh_hash_grid.h tests!\n" );
 
+  printf( "| Testing msh_hash_grid_init\n" );
+  construction_test( 2 );
+  construction_test( 3 );
+  printf( "|    -> Passed!\n" );
+
   printf( "| Testing msh_hash_grid_radius_search\n" );
   radius_search_test();
   printf( "|    -> Passed!\n" );
@@ -180,5 +626,21 @@ main()
   knn_search_test();
   printf( "|    -> Passed!\n" );
 
+  printf( "| Testing scanning of bins\n" );
+  bin_scan_test();
+  printf( "|    -> Passed!\n" );
+
+  printf( "| Testing msh_hash_grid_search_desc_t.reorder\n" );
+  query_reorder_test();
+  printf( "|    -> Passed!\n" );
+
+  printf( "| Testing msh_hash_grid_search_desc_t.work_ctx\n" );
+  job_system_test();
+  printf( "|    -> Passed!\n" );
+
+  printf( "| Testing msh_hash_grid_insert/remove/update\n" );
+  incremental_update_test();
+  printf( "|    -> Passed!\n" );
+
   return 1;
 }
\ No newline at end of file
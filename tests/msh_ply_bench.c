@@ -0,0 +1,382 @@
+/* Throughput benchmark for msh_ply.h */
+// Compile with gcc:
+//  gcc -O2 -I . tests/msh_ply_bench.c -o bin/msh_ply_bench -lm
+// Run with optional number of rows (e.g. 1000000 to 100000000) and number of repetitions:
+//  bin/msh_ply_bench [n_rows] [n_repeats]
+// Synthetic files are generated in the working directory, and removed afterwards. Each case is
+// written and read 'n_repeats' times and the best time is reported. Files of the endianness
+// opposite to the system's one can not be written by msh_ply, so they are only read.
+
+#define MSH_STD_INCLUDE_LIBC_HEADERS
+#define MSH_STD_IMPLEMENTATION
+#include "msh_std.h"
+
+#define MSH_PLY_INCLUDE_LIBC_HEADERS
+#define MSH_PLY_IMPLEMENTATION
+#include "msh_ply.h"
+
+#define BENCH_FILENAME         "msh_ply_bench.ply"
+#define BENCH_SWAPPED_FILENAME "msh_ply_bench_swapped.ply"
+
+typedef enum bench_layout
+{
+  BENCH_NARROW_ROWS,      // x y z
+  BENCH_WIDE_ROWS,        // x y z nx ny nz u v, red green blue alpha, quality
+  BENCH_FIXED_LISTS,      // Triangles, read with a list size hint
+  BENCH_VARIABLE_LISTS,   // Polygons of 3 to 6 vertices
+  BENCH_NUM_LAYOUTS
+} bench_layout_t;
+
+static const char* bench_layout_names[BENCH_NUM_LAYOUTS] = {"narrow rows",
+                                                            "wide rows",
+                                                            "fixed lists",
+                                                            "variable lists"};
+
+static const char* bench_type_names[MSH_PLY_N_TYPES] =
+  {"", "char", "uchar", "short", "ushort", "int", "uint", "float", "double"};
+
+typedef struct bench_data
+{
+  int32_t n_rows;
+  float* floats;
+  uint8_t* colors;
+  double* quality;
+  int32_t* indices;
+  uint8_t* list_sizes;
+} bench_data_t;
+
+void
+bench_data_init(bench_data_t* data, bench_layout_t layout, int32_t n_rows)
+{
+  msh_rand_ctx_t rand_gen;
+  msh_rand_init(&rand_gen, 12346ULL);
+  memset(data, 0, sizeof(*data));
+  data->n_rows = n_rows;
+  if (layout == BENCH_NARROW_ROWS || layout == BENCH_WIDE_ROWS)
+  {
+    int32_t n_floats = (layout == BENCH_NARROW_ROWS) ? 3 : 8;
+    data->floats     = (float*)malloc((size_t)n_rows * n_floats * sizeof(float));
+    for (size_t i = 0; i < (size_t)n_rows * n_floats; ++i)
+    {
+      data->floats[i] = 200.0f * msh_rand_nextf(&rand_gen) - 100.0f;
+    }
+  }
+  if (layout == BENCH_WIDE_ROWS)
+  {
+    data->colors  = (uint8_t*)malloc((size_t)n_rows * 4);
+    data->quality = (double*)malloc((size_t)n_rows * sizeof(double));
+    for (size_t i = 0; i < (size_t)n_rows * 4; ++i) { data->colors[i] = (uint8_t)(i * 7); }
+    for (int32_t i = 0; i < n_rows; ++i) { data->quality[i] = msh_rand_nextf(&rand_gen); }
+  }
+  if (layout == BENCH_FIXED_LISTS || layout == BENCH_VARIABLE_LISTS)
+  {
+    size_t n_indices = 0;
+    data->list_sizes = (uint8_t*)malloc((size_t)n_rows);
+    for (int32_t i = 0; i < n_rows; ++i)
+    {
+      int32_t size        = (layout == BENCH_FIXED_LISTS) ? 3 : msh_rand_range(&rand_gen, 3, 6);
+      data->list_sizes[i] = (uint8_t)size;
+      n_indices += size;
+    }
+    data->indices = (int32_t*)malloc(n_indices * sizeof(int32_t));
+    for (size_t i = 0; i < n_indices; ++i) { data->indices[i] = (int32_t)(i / 3); }
+  }
+}
+
+void
+bench_data_term(bench_data_t* data)
+{
+  free(data->floats);
+  free(data->colors);
+  free(data->quality);
+  free(data->indices);
+  free(data->list_sizes);
+  memset(data, 0, sizeof(*data));
+}
+
+int32_t
+bench_descriptors(bench_layout_t layout, bench_data_t* data, msh_ply_desc_t* descriptors)
+{
+  static const char* narrow_names[]  = {"x", "y", "z"};
+  static const char* wide_names[]    = {"x", "y", "z", "nx", "ny", "nz", "u", "v"};
+  static const char* color_names[]   = {"red", "green", "blue", "alpha"};
+  static const char* quality_names[] = {"quality"};
+  static const char* face_names[]    = {"vertex_indices"};
+  memset(descriptors, 0, 3 * sizeof(msh_ply_desc_t));
+  switch (layout)
+  {
+    case BENCH_NARROW_ROWS:
+    case BENCH_WIDE_ROWS:
+    {
+      int32_t is_wide               = (layout == BENCH_WIDE_ROWS);
+      descriptors[0].element_name   = (char*)"vertex";
+      descriptors[0].property_names = is_wide ? wide_names : narrow_names;
+      descriptors[0].num_properties = is_wide ? 8 : 3;
+      descriptors[0].data_type      = MSH_PLY_FLOAT;
+      descriptors[0].data           = &data->floats;
+      descriptors[0].data_count     = &data->n_rows;
+      if (!is_wide) { return 1; }
+      descriptors[1]                = descriptors[0];
+      descriptors[1].property_names = color_names;
+      descriptors[1].num_properties = 4;
+      descriptors[1].data_type      = MSH_PLY_UINT8;
+      descriptors[1].data           = &data->colors;
+      descriptors[2]                = descriptors[0];
+      descriptors[2].property_names = quality_names;
+      descriptors[2].num_properties = 1;
+      descriptors[2].data_type      = MSH_PLY_DOUBLE;
+      descriptors[2].data           = &data->quality;
+      return 3;
+    }
+    default:
+    {
+      descriptors[0].element_name   = (char*)"face";
+      descriptors[0].property_names = face_names;
+      descriptors[0].num_properties = 1;
+      descriptors[0].data_type      = MSH_PLY_INT32;
+      descriptors[0].list_type      = MSH_PLY_UINT8;
+      descriptors[0].data           = &data->indices;
+      descriptors[0].data_count     = &data->n_rows;
+      if (layout == BENCH_FIXED_LISTS) { descriptors[0].list_size_hint = 3; }
+      else { descriptors[0].list_data = &data->list_sizes; }
+      return 1;
+    }
+  }
+}
+
+void
+bench_check(int32_t err, const char* what)
+{
+  if (!err) { return; }
+  fprintf(stderr, "%s failed: %s\n", what, msh_ply_error_msg(err));
+  exit(EXIT_FAILURE);
+}
+
+double
+bench_write(bench_layout_t layout, bench_data_t* data, const char* mode)
+{
+  msh_ply_desc_t descriptors[3];
+  int32_t n_descriptors = bench_descriptors(layout, data, descriptors);
+
+  uint64_t start = msh_time_now();
+  msh_ply_t* pf  = msh_ply_open(BENCH_FILENAME, mode);
+  if (!pf) { bench_check(MSH_PLY_FILE_OPEN_ERR, "Writing"); }
+  for (int32_t i = 0; i < n_descriptors; ++i) { msh_ply_add_descriptor(pf, &descriptors[i]); }
+  int32_t err = msh_ply_write(pf);
+  msh_ply_close(pf);
+  uint64_t end = msh_time_now();
+  bench_check(err, "Writing");
+  return msh_time_diff_sec(end, start);
+}
+
+double
+bench_read(bench_layout_t layout, const char* filename, int32_t n_rows)
+{
+  bench_data_t data = {0};
+  msh_ply_desc_t descriptors[3];
+  int32_t n_descriptors = bench_descriptors(layout, &data, descriptors);
+
+  uint64_t start = msh_time_now();
+  msh_ply_t* pf  = msh_ply_open(filename, "rb");
+  if (!pf) { bench_check(MSH_PLY_FILE_OPEN_ERR, "Reading"); }
+  for (int32_t i = 0; i < n_descriptors; ++i) { msh_ply_add_descriptor(pf, &descriptors[i]); }
+  int32_t err = msh_ply_read(pf);
+  msh_ply_close(pf);
+  uint64_t end = msh_time_now();
+  bench_check(err, "Reading");
+  if (data.n_rows != n_rows)
+  {
+    bench_check(MSH_PLY_CONFLICTING_NUMBER_OF_ELEMENTS_ERR, "Reading");
+  }
+  bench_data_term(&data);
+  return msh_time_diff_sec(end, start);
+}
+
+void
+bench_swap_bytes(uint8_t* bytes, int32_t size)
+{
+  for (int32_t i = 0; i < size / 2; ++i)
+  {
+    uint8_t tmp         = bytes[i];
+    bytes[i]            = bytes[size - 1 - i];
+    bytes[size - 1 - i] = tmp;
+  }
+}
+
+// Writes a copy of binary file 'src_filename' in the opposite endianness. Rows are walked with
+// the layout given by the header.
+void
+bench_swap_endianness(const char* src_filename, const char* dst_filename)
+{
+  static const int32_t type_sizes[MSH_PLY_N_TYPES] = {0, 1, 1, 2, 2, 4, 4, 4, 8};
+  msh_ply_info_t info;
+  bench_check(msh_ply_probe(src_filename, &info), "Probing");
+
+  FILE* fp = fopen(src_filename, "rb");
+  if (!fp) { bench_check(MSH_PLY_FILE_OPEN_ERR, "Converting"); }
+  fseek(fp, 0, SEEK_END);
+  size_t size  = (size_t)ftell(fp) - info.header_size;
+  uint8_t* buf = (uint8_t*)malloc(size);
+  fseek(fp, info.header_size, SEEK_SET);
+  if (fread(buf, 1, size, fp) != size) { bench_check(MSH_PLY_BINARY_PARSE_ERR, "Converting"); }
+  fclose(fp);
+
+  uint8_t* cp = buf;
+  for (int32_t i = 0; i < info.num_elements; ++i)
+  {
+    const msh_ply_info_element_t* el          = &info.elements[i];
+    const msh_ply_info_property_t* properties = &info.properties[el->first_property];
+    for (int32_t row = 0; row < el->count; ++row)
+    {
+      for (int32_t j = 0; j < el->num_properties; ++j)
+      {
+        int64_t count = 1;
+        if (properties[j].list_type != MSH_PLY_INVALID)
+        {
+          int32_t count_size = type_sizes[properties[j].list_type];
+          if (count_size == 1) { count = *cp; }
+          else if (count_size == 2) { count = *(uint16_t*)cp; }
+          else { count = *(uint32_t*)cp; }
+          bench_swap_bytes(cp, count_size);
+          cp += count_size;
+        }
+        int32_t value_size = type_sizes[properties[j].type];
+        for (int64_t k = 0; k < count; ++k, cp += value_size)
+        {
+          bench_swap_bytes(cp, value_size);
+        }
+      }
+    }
+  }
+
+  fp = fopen(dst_filename, "wb");
+  if (!fp) { bench_check(MSH_PLY_FILE_OPEN_ERR, "Converting"); }
+  int32_t is_little = (info.format == MSH_PLY_LITTLE_ENDIAN);
+  fprintf(fp, "ply\nformat %s 1.0\n", is_little ? "binary_big_endian" : "binary_little_endian");
+  for (int32_t i = 0; i < info.num_elements; ++i)
+  {
+    const msh_ply_info_element_t* el = &info.elements[i];
+    fprintf(fp, "element %s %d\n", el->name, el->count);
+    for (int32_t j = 0; j < el->num_properties; ++j)
+    {
+      const msh_ply_info_property_t* pr = &info.properties[el->first_property + j];
+      if (pr->list_type == MSH_PLY_INVALID)
+      {
+        fprintf(fp, "property %s %s\n", bench_type_names[pr->type], pr->name);
+      }
+      else
+      {
+        fprintf(fp,
+                "property list %s %s %s\n",
+                bench_type_names[pr->list_type],
+                bench_type_names[pr->type],
+                pr->name);
+      }
+    }
+  }
+  fprintf(fp, "end_header\n");
+  fwrite(buf, 1, size, fp);
+  fclose(fp);
+  free(buf);
+}
+
+size_t
+bench_file_size(const char* filename)
+{
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) { return 0; }
+  fseek(fp, 0, SEEK_END);
+  size_t size = (size_t)ftell(fp);
+  fclose(fp);
+  return size;
+}
+
+void
+bench_report(const char* layout_name,
+             const char* format_name,
+             int32_t n_rows,
+             size_t file_size,
+             double write_sec,
+             double read_sec)
+{
+  double mb    = (double)file_size / (1024.0 * 1024.0);
+  double mrows = (double)n_rows / 1e6;
+  printf("| %-15s| %-21s| %10d | %9.1f |", layout_name, format_name, n_rows, mb);
+  if (write_sec > 0.0) { printf(" %10.1f | %13.2f |", mb / write_sec, mrows / write_sec); }
+  else { printf(" %10s | %13s |", "-", "-"); }
+  printf(" %10.1f | %12.2f |\n", mb / read_sec, mrows / read_sec);
+}
+
+int
+main(int argc, char** argv)
+{
+  int32_t n_rows    = (argc > 1) ? atoi(argv[1]) : 1000000;
+  int32_t n_repeats = (argc > 2) ? atoi(argv[2]) : 3;
+  if (n_rows < 1 || n_repeats < 1)
+  {
+    fprintf(stderr, "Usage: %s [n_rows] [n_repeats]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int32_t n                = 1;
+  int32_t is_little        = (*(char*)&n == 1);
+  const char* native_name  = is_little ? "binary_little_endian" : "binary_big_endian";
+  const char* swapped_name = is_little ? "binary_big_endian" : "binary_little_endian";
+
+  printf("Running msh_ply.h benchmark (best of %d)!\n", n_repeats);
+  printf("| %-15s| %-21s| %10s | %9s | %10s | %13s | %10s | %12s |\n",
+         "Layout",
+         "Format",
+         "Rows",
+         "Size MB",
+         "Write MB/s",
+         "Write Mrows/s",
+         "Read MB/s",
+         "Read Mrows/s");
+  for (int32_t layout = 0; layout < BENCH_NUM_LAYOUTS; ++layout)
+  {
+    bench_data_t data;
+    bench_data_init(&data, (bench_layout_t)layout, n_rows);
+    const char* modes[2]        = {"w", "wb"};
+    const char* format_names[2] = {"ascii", native_name};
+    for (int32_t f = 0; f < 2; ++f)
+    {
+      double write_sec = 1e30;
+      double read_sec  = 1e30;
+      for (int32_t r = 0; r < n_repeats; ++r)
+      {
+        write_sec = msh_min(write_sec, bench_write((bench_layout_t)layout, &data, modes[f]));
+      }
+      for (int32_t r = 0; r < n_repeats; ++r)
+      {
+        read_sec = msh_min(read_sec, bench_read((bench_layout_t)layout, BENCH_FILENAME, n_rows));
+      }
+      bench_report(bench_layout_names[layout],
+                   format_names[f],
+                   n_rows,
+                   bench_file_size(BENCH_FILENAME),
+                   write_sec,
+                   read_sec);
+    }
+
+    // Native binary file written last is converted to the other endianness
+    bench_swap_endianness(BENCH_FILENAME, BENCH_SWAPPED_FILENAME);
+    double read_sec = 1e30;
+    for (int32_t r = 0; r < n_repeats; ++r)
+    {
+      double sec = bench_read((bench_layout_t)layout, BENCH_SWAPPED_FILENAME, n_rows);
+      read_sec   = msh_min(read_sec, sec);
+    }
+    bench_report(bench_layout_names[layout],
+                 swapped_name,
+                 n_rows,
+                 bench_file_size(BENCH_SWAPPED_FILENAME),
+                 0.0,
+                 read_sec);
+    bench_data_term(&data);
+  }
+
+  remove(BENCH_FILENAME);
+  remove(BENCH_SWAPPED_FILENAME);
+  return 0;
+}
@@ -0,0 +1,1890 @@
+/* Poor man's tests for msh_ply.h */
+// Compile with gcc:
+//  gcc -I . tests/msh_ply_test.c -o bin/msh_ply_test -lm
+
+#define MSH_PLY_INCLUDE_LIBC_HEADERS
+#define MSH_PLY_IMPLEMENTATION
+#include "msh_ply.h"
+
+#define MSH_PLY_TEST_FILENAME "msh_ply_test.ply"
+
+typedef struct test_mesh
+{
+  float* vertices;
+  int32_t* faces;
+  int32_t n_vertices;
+  int32_t n_faces;
+} test_mesh_t;
+
+void
+test_mesh_init(test_mesh_t* mesh, int32_t n_vertices, int32_t n_faces)
+{
+  mesh->n_vertices = n_vertices;
+  mesh->n_faces    = n_faces;
+  mesh->vertices   = (float*)malloc(3 * n_vertices * sizeof(float));
+  mesh->faces      = (int32_t*)malloc(3 * n_faces * sizeof(int32_t));
+  for (int32_t i = 0; i < 3 * n_vertices; ++i)
+  {
+    mesh->vertices[i] = 0.25f * i - 100.0f;
+  }
+  for (int32_t i = 0; i < 3 * n_faces; ++i) { mesh->faces[i] = i % n_vertices; }
+}
+
+void
+test_mesh_term(test_mesh_t* mesh)
+{
+  free(mesh->vertices);
+  free(mesh->faces);
+}
+
+static const char* test_mesh_vertex_names[] = {"x", "y", "z"};
+static const char* test_mesh_face_names[]   = {"vertex_indices"};
+
+// Fills descriptors of vertex positions and triangles that read into, or write from 'mesh'
+void
+test_mesh_descriptors(test_mesh_t* mesh, msh_ply_desc_t descriptors[2])
+{
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = test_mesh_vertex_names,
+    .num_properties = 3,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = &mesh->vertices,
+    .data_count     = &mesh->n_vertices};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"face",
+    .property_names = test_mesh_face_names,
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &mesh->faces,
+    .data_count     = &mesh->n_faces,
+    .list_size_hint = 3};
+}
+
+void
+test_mesh_check(const test_mesh_t* mesh, const test_mesh_t* ref)
+{
+  assert(mesh->n_vertices == ref->n_vertices);
+  assert(mesh->n_faces == ref->n_faces);
+  assert(!memcmp(mesh->vertices, ref->vertices, 3 * ref->n_vertices * sizeof(float)));
+  assert(!memcmp(mesh->faces, ref->faces, 3 * ref->n_faces * sizeof(int32_t)));
+}
+
+void
+test_mesh_write(test_mesh_t* mesh, const char* filename, const char* mode)
+{
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(mesh, descriptors);
+
+  msh_ply_t* pf = msh_ply_open(filename, mode);
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  int32_t err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+}
+
+// Reads the mesh back from 'filename' and checks that it matches 'ref'
+void
+test_mesh_read_back(const test_mesh_t* ref, const char* filename, const char* mode,
+                    int32_t num_threads)
+{
+  test_mesh_t mesh = {0};
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(&mesh, descriptors);
+
+  msh_ply_t* pf = msh_ply_open(filename, mode);
+  assert(pf);
+  msh_ply_set_num_threads(pf, num_threads);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  int32_t err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  test_mesh_check(&mesh, ref);
+  test_mesh_term(&mesh);
+}
+
+void
+mapped_read_test()
+{
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 1024, 512);
+  test_mesh_write(&ref, MSH_PLY_TEST_FILENAME, "wb");
+
+  test_mesh_t mesh = {0};
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(&mesh, descriptors);
+
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "rm");
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  int32_t err = msh_ply_read(pf);
+  assert(!err);
+  test_mesh_check(&mesh, &ref);
+
+  // Faces need conversion from a list, so they are never served from the mapping.
+  assert(!msh_ply_is_mapped_data(pf, mesh.faces));
+  if (!msh_ply_is_mapped_data(pf, mesh.vertices)) { free(mesh.vertices); }
+  free(mesh.faces);
+  msh_ply_close(pf);
+
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+serial_task_runner(msh_ply_task_fn_t fn,
+                   void* params,
+                   size_t params_size,
+                   int32_t n_tasks,
+                   void* user_data)
+{
+  *(int32_t*)user_data += n_tasks;
+  for (int32_t i = 0; i < n_tasks; ++i) { fn((uint8_t*)params + i * params_size); }
+}
+
+void
+parallel_read_test()
+{
+  // Elements are large enough to be split into multiple ranges of rows
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 200000, 150000);
+  test_mesh_write(&ref, MSH_PLY_TEST_FILENAME, "wb");
+
+  // Faces are read without the size hint, so ranges of rows have variable size
+  test_mesh_t mesh     = {0};
+  uint8_t* face_sizes  = NULL;
+  msh_ply_desc_t descriptors[2];
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"z", "x"},
+    .num_properties = 2,
+    .data_type      = MSH_PLY_DOUBLE,
+    .data           = &mesh.vertices,
+    .data_count     = &mesh.n_vertices};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"face",
+    .property_names = (const char*[]){"vertex_indices"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &mesh.faces,
+    .list_data      = &face_sizes,
+    .data_count     = &mesh.n_faces};
+
+  int32_t n_tasks = 0;
+  msh_ply_t* pf   = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  msh_ply_set_num_threads(pf, 4);
+  msh_ply_set_task_runner(pf, serial_task_runner, &n_tasks);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  int32_t err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  assert(n_tasks == 4);
+  assert(mesh.n_vertices == ref.n_vertices);
+  assert(mesh.n_faces == ref.n_faces);
+  double* vertices = (double*)mesh.vertices;
+  for (int32_t i = 0; i < ref.n_vertices; ++i)
+  {
+    assert(vertices[2 * i + 0] == (double)ref.vertices[3 * i + 2]);
+    assert(vertices[2 * i + 1] == (double)ref.vertices[3 * i + 0]);
+  }
+  for (int32_t i = 0; i < ref.n_faces; ++i) { assert(face_sizes[i] == 3); }
+  assert(!memcmp(mesh.faces, ref.faces, 3 * ref.n_faces * sizeof(int32_t)));
+
+  free(mesh.vertices);
+  free(mesh.faces);
+  free(face_sizes);
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+polygon_read_test(const char* mode)
+{
+  // Faces alternate between triangles and quads
+  int32_t n_faces      = 3001;
+  uint8_t* face_sizes  = (uint8_t*)malloc(n_faces);
+  int32_t* faces       = (int32_t*)malloc(4 * n_faces * sizeof(int32_t));
+  int32_t n_values     = 0;
+  for (int32_t i = 0; i < n_faces; ++i)
+  {
+    face_sizes[i] = 3 + (i % 2);
+    for (int32_t j = 0; j < face_sizes[i]; ++j, ++n_values) { faces[n_values] = n_values; }
+  }
+  msh_ply_desc_t desc = {.element_name   = (char*)"face",
+                         .property_names = (const char*[]){"vertex_indices"},
+                         .num_properties = 1,
+                         .data_type      = MSH_PLY_INT32,
+                         .list_type      = MSH_PLY_UINT8,
+                         .data           = &faces,
+                         .list_data      = &face_sizes,
+                         .data_count     = &n_faces};
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  msh_ply_add_descriptor(pf, &desc);
+  int32_t err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  // Only offsets are requested, and values are converted to doubles
+  double* values    = NULL;
+  int32_t* offsets  = NULL;
+  int32_t n_read    = 0;
+  desc.data_type    = MSH_PLY_DOUBLE;
+  desc.data         = &values;
+  desc.list_data    = NULL;
+  desc.list_offsets = &offsets;
+  desc.data_count   = &n_read;
+  pf                = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  msh_ply_add_descriptor(pf, &desc);
+  err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  assert(n_read == n_faces);
+  assert(offsets[0] == 0 && offsets[n_faces] == n_values);
+  for (int32_t i = 0; i < n_faces; ++i)
+  {
+    assert(offsets[i + 1] - offsets[i] == face_sizes[i]);
+  }
+  for (int32_t i = 0; i < n_values; ++i) { assert(values[i] == (double)faces[i]); }
+
+  free(values);
+  free(offsets);
+  free(faces);
+  free(face_sizes);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+typedef struct memory_file
+{
+  uint8_t* data;
+  size_t size;
+  int32_t n_reads;
+  int32_t closed;
+} memory_file_t;
+
+size_t
+memory_file_read_at(void* user_data, uint64_t offset, void* dst, size_t size)
+{
+  memory_file_t* file = (memory_file_t*)user_data;
+  file->n_reads++;
+  if (offset >= file->size) { return 0; }
+  size_t n_read = MSH_PLY_MIN(size, file->size - (size_t)offset);
+  memcpy(dst, file->data + offset, n_read);
+  return n_read;
+}
+
+uint64_t
+memory_file_size(void* user_data)
+{
+  return ((memory_file_t*)user_data)->size;
+}
+
+void
+memory_file_close(void* user_data)
+{
+  ((memory_file_t*)user_data)->closed = 1;
+}
+
+void
+io_backend_read_test(const char* mode)
+{
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 20000, 10000);
+  test_mesh_write(&ref, MSH_PLY_TEST_FILENAME, mode);
+
+  memory_file_t file = {0};
+  FILE* fp           = fopen(MSH_PLY_TEST_FILENAME, "rb");
+  assert(fp);
+  fseek(fp, 0, SEEK_END);
+  file.size = (size_t)ftell(fp);
+  file.data = (uint8_t*)malloc(file.size);
+  fseek(fp, 0, SEEK_SET);
+  size_t n_read = fread(file.data, 1, file.size, fp);
+  assert(n_read == file.size);
+  fclose(fp);
+  remove(MSH_PLY_TEST_FILENAME);
+
+  test_mesh_t mesh = {0};
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(&mesh, descriptors);
+
+  msh_ply_io_t io = {.read_at   = memory_file_read_at,
+                     .size      = memory_file_size,
+                     .close     = memory_file_close,
+                     .user_data = &file};
+  msh_ply_t* pf   = msh_ply_open_io(&io);
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  int32_t err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  assert(file.n_reads > 0 && file.closed);
+  test_mesh_check(&mesh, &ref);
+
+  test_mesh_term(&mesh);
+  free(file.data);
+  test_mesh_term(&ref);
+}
+
+void
+chunked_read_test()
+{
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 1000, 700);
+  test_mesh_write(&ref, MSH_PLY_TEST_FILENAME, "w");
+
+  // Buffers are sized for a single chunk only
+  const int32_t max_rows = 64;
+  test_mesh_t mesh       = {0};
+  mesh.vertices          = (float*)malloc(3 * max_rows * sizeof(float));
+  mesh.faces             = (int32_t*)malloc(3 * max_rows * sizeof(int32_t));
+  uint8_t* face_sizes    = (uint8_t*)malloc(max_rows * sizeof(uint8_t));
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(&mesh, descriptors);
+  descriptors[1].list_data = &face_sizes;
+
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+  assert(pf);
+
+  // Elements can be streamed in any order
+  int32_t n_faces = 0;
+  while (!msh_ply_read_chunk(pf, &descriptors[1], max_rows) && mesh.n_faces)
+  {
+    assert(mesh.n_faces <= max_rows);
+    for (int32_t i = 0; i < mesh.n_faces; ++i) { assert(face_sizes[i] == 3); }
+    assert(!memcmp(mesh.faces,
+                   ref.faces + 3 * n_faces,
+                   3 * mesh.n_faces * sizeof(int32_t)));
+    n_faces += mesh.n_faces;
+  }
+  assert(n_faces == ref.n_faces);
+
+  int32_t n_vertices = 0;
+  while (!msh_ply_read_chunk(pf, &descriptors[0], max_rows) && mesh.n_vertices)
+  {
+    assert(mesh.n_vertices <= max_rows);
+    assert(!memcmp(mesh.vertices,
+                   ref.vertices + 3 * n_vertices,
+                   3 * mesh.n_vertices * sizeof(float)));
+    n_vertices += mesh.n_vertices;
+  }
+  assert(n_vertices == ref.n_vertices);
+  msh_ply_close(pf);
+
+  free(face_sizes);
+  test_mesh_term(&mesh);
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+streamed_write_test(const char* mode)
+{
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 1000, 700);
+
+  // Rows are handed over in batches, by moving the data pointers along the reference mesh
+  const int32_t batch_size = 96;
+  test_mesh_t batch        = {0};
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(&batch, descriptors);
+
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  for (int32_t i = 0; i < ref.n_vertices; i += batch_size)
+  {
+    int32_t n_rows = ref.n_vertices - i < batch_size ? ref.n_vertices - i : batch_size;
+    batch.vertices = ref.vertices + 3 * i;
+    int32_t err    = msh_ply_write_rows(pf, "vertex", n_rows);
+    assert(!err);
+  }
+  for (int32_t i = 0; i < ref.n_faces; i += batch_size)
+  {
+    int32_t n_rows = ref.n_faces - i < batch_size ? ref.n_faces - i : batch_size;
+    batch.faces    = ref.faces + 3 * i;
+    int32_t err    = msh_ply_write_rows(pf, "face", n_rows);
+    assert(!err);
+  }
+  // Elements cannot be revisited once rows of the next element were written
+  assert(msh_ply_write_rows(pf, "vertex", 1) == MSH_PLY_ELEMENT_ORDER_ERR);
+  msh_ply_close(pf);
+
+  test_mesh_read_back(&ref, MSH_PLY_TEST_FILENAME, "r", 1);
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+ascii_write_test()
+{
+  // Values use all of their bits, so they only survive the text if printed with enough digits
+  int32_t n_vertices = 100000;
+  float* vertices    = (float*)malloc(3 * n_vertices * sizeof(float));
+  double* quality    = (double*)malloc(n_vertices * sizeof(double));
+  uint8_t* sizes     = (uint8_t*)malloc(n_vertices);
+  int32_t* indices   = (int32_t*)malloc(4 * n_vertices * sizeof(int32_t));
+  uint32_t state     = 12345;
+  int32_t n_indices  = 0;
+  for (int32_t i = 0; i < n_vertices; ++i)
+  {
+    for (int32_t j = 0; j < 3; ++j)
+    {
+      state         = state * 1664525u + 1013904223u;
+      uint32_t bits = (state & 0x807fffffu) | ((100u + (state >> 8) % 56u) << 23);
+      memcpy(&vertices[3 * i + j], &bits, sizeof(bits));
+    }
+    quality[i] = (double)vertices[3 * i] / 3.0;
+    sizes[i]   = (uint8_t)(i % 5);
+    for (int32_t j = 0; j < sizes[i]; ++j, ++n_indices) { indices[n_indices] = n_indices - i; }
+  }
+  vertices[0] = -0.0f;
+  quality[1]  = 1e-300;
+
+  msh_ply_desc_t descriptors[3];
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"x", "y", "z"},
+    .num_properties = 3,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = &vertices,
+    .data_count     = &n_vertices};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"quality"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_DOUBLE,
+    .data           = &quality,
+    .data_count     = &n_vertices};
+  descriptors[2] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"neighbours"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &indices,
+    .list_data      = &sizes,
+    .data_count     = &n_vertices};
+
+  // Rows are formatted by multiple tasks, each starting in the middle of the lists
+  int32_t n_tasks = 0;
+  msh_ply_t* pf   = msh_ply_open(MSH_PLY_TEST_FILENAME, "w");
+  assert(pf);
+  msh_ply_set_num_threads(pf, 4);
+  msh_ply_set_task_runner(pf, serial_task_runner, &n_tasks);
+  for (int32_t i = 0; i < 3; ++i) { msh_ply_add_descriptor(pf, &descriptors[i]); }
+  int32_t err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+  assert(n_tasks > 1);
+
+  float* read_vertices   = NULL;
+  double* read_quality   = NULL;
+  uint8_t* read_sizes    = NULL;
+  int32_t* read_indices  = NULL;
+  int32_t n_read         = 0;
+  descriptors[0].data       = &read_vertices;
+  descriptors[1].data       = &read_quality;
+  descriptors[2].data       = &read_indices;
+  descriptors[2].list_data  = &read_sizes;
+  for (int32_t i = 0; i < 3; ++i) { descriptors[i].data_count = &n_read; }
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+  assert(pf);
+  for (int32_t i = 0; i < 3; ++i) { msh_ply_add_descriptor(pf, &descriptors[i]); }
+  err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  assert(n_read == n_vertices);
+  assert(!memcmp(read_vertices, vertices, 3 * n_vertices * sizeof(float)));
+  assert(!memcmp(read_quality, quality, n_vertices * sizeof(double)));
+  assert(!memcmp(read_sizes, sizes, n_vertices));
+  assert(!memcmp(read_indices, indices, n_indices * sizeof(int32_t)));
+
+  free(read_vertices);
+  free(read_quality);
+  free(read_sizes);
+  free(read_indices);
+  free(vertices);
+  free(quality);
+  free(sizes);
+  free(indices);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+// Reads the element written by 'ascii_block_read_test', splitting its blocks into 'num_threads'
+// ranges of rows if 'n_tasks' is not NULL
+void
+ascii_block_read(int32_t num_threads,
+                 int32_t* n_tasks,
+                 float** vertices,
+                 double** quality,
+                 uint8_t** sizes,
+                 int32_t** indices,
+                 int32_t* n_read)
+{
+  msh_ply_desc_t descriptors[3];
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"x", "y", "z"},
+    .num_properties = 3,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = vertices,
+    .data_count     = n_read};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"quality"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_DOUBLE,
+    .data           = quality,
+    .data_count     = n_read};
+  descriptors[2] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"neighbours"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = indices,
+    .list_data      = sizes,
+    .data_count     = n_read};
+
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+  assert(pf);
+  msh_ply_set_num_threads(pf, num_threads);
+  if (n_tasks) { msh_ply_set_task_runner(pf, serial_task_runner, n_tasks); }
+  for (int32_t i = 0; i < 3; ++i) { msh_ply_add_descriptor(pf, &descriptors[i]); }
+  int32_t err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+}
+
+void
+ascii_block_read_test()
+{
+  // Element data spans more than one block, and lines vary in length, so the block boundaries,
+  // as well as the ranges of rows split between the tasks, fall in the middle of the lines.
+  int32_t n_vertices = 300000;
+  float* vertices    = (float*)malloc(3 * n_vertices * sizeof(float));
+  double* quality    = (double*)malloc(n_vertices * sizeof(double));
+  uint8_t* sizes     = (uint8_t*)malloc(n_vertices);
+  int32_t* indices   = (int32_t*)malloc(5 * n_vertices * sizeof(int32_t));
+  uint32_t state     = 4321;
+  int32_t n_indices  = 0;
+
+  FILE* fp = fopen(MSH_PLY_TEST_FILENAME, "wb");
+  assert(fp);
+  fprintf(fp,
+          "ply\nformat ascii 1.0\nelement vertex %d\n"
+          "property float x\nproperty float y\nproperty float z\nproperty double quality\n"
+          "property list uchar int neighbours\nend_header\n",
+          n_vertices);
+  size_t block_end      = MSH_PLY_BLOCK_SIZE;
+  size_t n_bytes        = 0;
+  int32_t n_split_lines = 0;
+  for (int32_t i = 0; i < n_vertices; ++i)
+  {
+    char line[256];
+    int32_t len = 0;
+    for (int32_t j = 0; j < 3; ++j)
+    {
+      state               = state * 1664525u + 1013904223u;
+      vertices[3 * i + j] = (float)((int32_t)(state >> 8) - (1 << 23)) / (float)(1 << (state % 16));
+      len += snprintf(line + len, sizeof(line) - len, "%.9g ", vertices[3 * i + j]);
+    }
+    quality[i] = (double)vertices[3 * i + 1] / 7.0;
+    sizes[i]   = (uint8_t)(state % 6);
+    len += snprintf(line + len, sizeof(line) - len, "%.17g %d", quality[i], sizes[i]);
+    for (int32_t j = 0; j < sizes[i]; ++j, ++n_indices)
+    {
+      indices[n_indices] = (int32_t)(state ^ (0x9e3779b9u * j));
+      len += snprintf(line + len, sizeof(line) - len, " %d", indices[n_indices]);
+    }
+    // Some of the lines end with windows line breaks
+    len += snprintf(line + len, sizeof(line) - len, (i % 7) ? "\n" : "\r\n");
+    fwrite(line, 1, len, fp);
+
+    if (n_bytes < block_end && n_bytes + len > block_end)
+    {
+      n_split_lines++;
+      block_end = n_bytes + MSH_PLY_BLOCK_SIZE;
+    }
+    n_bytes += len;
+  }
+  fclose(fp);
+  assert(n_split_lines > 0);
+
+  float* serial_vertices = NULL;
+  double* serial_quality = NULL;
+  uint8_t* serial_sizes  = NULL;
+  int32_t* serial_lists  = NULL;
+  int32_t n_serial       = 0;
+  ascii_block_read(1, NULL, &serial_vertices, &serial_quality, &serial_sizes, &serial_lists,
+                   &n_serial);
+
+  float* read_vertices  = NULL;
+  double* read_quality  = NULL;
+  uint8_t* read_sizes   = NULL;
+  int32_t* read_indices = NULL;
+  int32_t n_read        = 0;
+  int32_t n_tasks       = 0;
+  ascii_block_read(4, &n_tasks, &read_vertices, &read_quality, &read_sizes, &read_indices,
+                   &n_read);
+  assert(n_tasks > 4);
+
+  assert(n_serial == n_vertices && n_read == n_vertices);
+  assert(!memcmp(serial_vertices, vertices, 3 * n_vertices * sizeof(float)));
+  assert(!memcmp(serial_quality, quality, n_vertices * sizeof(double)));
+  assert(!memcmp(serial_sizes, sizes, n_vertices));
+  assert(!memcmp(serial_lists, indices, n_indices * sizeof(int32_t)));
+  assert(!memcmp(read_vertices, serial_vertices, 3 * n_vertices * sizeof(float)));
+  assert(!memcmp(read_quality, serial_quality, n_vertices * sizeof(double)));
+  assert(!memcmp(read_sizes, serial_sizes, n_vertices));
+  assert(!memcmp(read_indices, serial_lists, n_indices * sizeof(int32_t)));
+
+  free(serial_vertices);
+  free(serial_quality);
+  free(serial_sizes);
+  free(serial_lists);
+  free(read_vertices);
+  free(read_quality);
+  free(read_sizes);
+  free(read_indices);
+  free(vertices);
+  free(quality);
+  free(sizes);
+  free(indices);
+
+  // Lists that claim more values than their lines hold are reported, not read past the line
+  const char* bad_lines[] = {"250 1 2\n", "250 - -- --- ----\n", "\n"};
+  for (int32_t i = 0; i < 3; ++i)
+  {
+    fp = fopen(MSH_PLY_TEST_FILENAME, "wb");
+    assert(fp);
+    fprintf(fp,
+            "ply\nformat ascii 1.0\nelement face 3\n"
+            "property list uchar int vertex_indices\nend_header\n"
+            "3 0 1 2\n%s3 2 1 0\n",
+            bad_lines[i]);
+    fclose(fp);
+
+    int32_t* faces            = NULL;
+    int32_t n_faces           = 0;
+    msh_ply_desc_t descriptor = {.element_name   = (char*)"face",
+                                 .property_names = (const char*[]){"vertex_indices"},
+                                 .num_properties = 1,
+                                 .data_type      = MSH_PLY_INT32,
+                                 .list_type      = MSH_PLY_UINT8,
+                                 .data           = &faces,
+                                 .data_count     = &n_faces};
+    msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+    assert(pf);
+    msh_ply_add_descriptor(pf, &descriptor);
+    int32_t err = msh_ply_read(pf);
+    assert(err == MSH_PLY_ASCII_PARSE_ERR);
+    msh_ply_close(pf);
+    free(faces);
+
+    faces                     = (int32_t*)malloc(3 * 16 * sizeof(int32_t));
+    descriptor.list_size_hint = 3;
+    pf                        = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+    assert(pf);
+    err = msh_ply_read_chunk(pf, &descriptor, 16);
+    assert(err == MSH_PLY_ASCII_PARSE_ERR);
+    msh_ply_close(pf);
+    free(faces);
+  }
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+compressed_test(const char* mode, int32_t level)
+{
+  // Large enough for the decoder to record a few checkpoints
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 400000, 300000);
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(&ref, descriptors);
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  msh_ply_set_compression_level(pf, level);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  int32_t err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  uint8_t magic[2] = {0};
+  FILE* fp         = fopen(MSH_PLY_TEST_FILENAME, "rb");
+  assert(fp);
+  assert(fread(magic, 1, 2, fp) == 2);
+  fclose(fp);
+  assert(magic[0] == 0x1f && magic[1] == 0x8b);
+
+  test_mesh_read_back(&ref, MSH_PLY_TEST_FILENAME, "rm", 4);
+
+  // Reading two elements in turns keeps jumping back and forth within the stream
+  const int32_t max_rows = 50000;
+  test_mesh_t mesh       = {0};
+  mesh.vertices          = (float*)malloc(3 * max_rows * sizeof(float));
+  mesh.faces             = (int32_t*)malloc(3 * max_rows * sizeof(int32_t));
+  test_mesh_descriptors(&mesh, descriptors);
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  int32_t n_vertices = 0;
+  int32_t n_faces    = 0;
+  while (n_vertices < ref.n_vertices || n_faces < ref.n_faces)
+  {
+    err = msh_ply_read_chunk(pf, &descriptors[1], max_rows);
+    assert(!err);
+    assert(!memcmp(mesh.faces, ref.faces + 3 * n_faces, 3 * mesh.n_faces * sizeof(int32_t)));
+    n_faces += mesh.n_faces;
+    err = msh_ply_read_chunk(pf, &descriptors[0], max_rows);
+    assert(!err);
+    assert(!memcmp(mesh.vertices,
+                   ref.vertices + 3 * n_vertices,
+                   3 * mesh.n_vertices * sizeof(float)));
+    n_vertices += mesh.n_vertices;
+  }
+  assert(n_vertices == ref.n_vertices);
+  assert(n_faces == ref.n_faces);
+  msh_ply_close(pf);
+
+  test_mesh_term(&mesh);
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+quantized_test(const char* mode)
+{
+  const int32_t n_vertices = 20000;
+  const float bbox_min[3]  = {-2.0f, -1.0f, 0.0f};
+  const float bbox_max[3]  = {2.0f, 1.0f, 8.0f};
+  // Vertices store position, confidence and normal, so quantized properties are not at the ends
+  float* ref = (float*)malloc(7 * n_vertices * sizeof(float));
+  for (int32_t i = 0; i < n_vertices; ++i)
+  {
+    float* v = &ref[7 * i];
+    for (int32_t c = 0; c < 3; ++c)
+    {
+      float t  = (float)(((int64_t)i * (c + 7) * 7919) % 10007) / 10006.0f;
+      v[c]    = bbox_min[c] + t * (bbox_max[c] - bbox_min[c]);
+      v[4 + c] = (float)(((int64_t)i * (c + 3) * 104729) % 2001) - 1000.0f;
+    }
+    v[3]         = 0.5f * i;
+    float length = sqrtf(v[4] * v[4] + v[5] * v[5] + v[6] * v[6]);
+    if (length == 0.0f) { v[6] = length = 1.0f; }
+    for (int32_t c = 4; c < 7; ++c) { v[c] /= length; }
+  }
+  int32_t n_faces = 1000;
+  int32_t* faces  = (int32_t*)malloc(3 * n_faces * sizeof(int32_t));
+  for (int32_t i = 0; i < 3 * n_faces; ++i) { faces[i] = i % n_vertices; }
+
+  msh_ply_quantization_t quantization = {
+    .element_name   = "vertex",
+    .position_names = {"x", "y", "z"},
+    .bbox_min       = {bbox_min[0], bbox_min[1], bbox_min[2]},
+    .bbox_max       = {bbox_max[0], bbox_max[1], bbox_max[2]},
+    .position_bits  = 16,
+    .normal_names   = {"nx", "ny", "nz"},
+    .normal_bits    = 0};
+  msh_ply_desc_t descriptors[2];
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"x", "y", "z", "confidence", "nx", "ny", "nz"},
+    .num_properties = 7,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = &ref,
+    .data_count     = (int32_t*)&n_vertices};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"face",
+    .property_names = (const char*[]){"vertex_indices"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &faces,
+    .data_count     = &n_faces,
+    .list_size_hint = 3};
+
+  // Normals are only stored when all three of them are given in order
+  msh_ply_desc_t shuffled   = descriptors[0];
+  shuffled.property_names   = (const char*[]){"x", "y", "z", "confidence", "ny", "nx", "nz"};
+  msh_ply_t* pf             = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  msh_ply_set_quantization(pf, &quantization);
+  msh_ply_add_descriptor(pf, &shuffled);
+  assert(msh_ply_write(pf) == MSH_PLY_QUANTIZATION_ERR);
+  msh_ply_close(pf);
+
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  int32_t err = msh_ply_set_quantization(pf, &quantization);
+  assert(!err);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  // Positions come back within half of the quantization step, normals within a few degrees
+  float* vertices = NULL;
+  int32_t count   = 0;
+  msh_ply_desc_t vertex_desc = {
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"nx", "ny", "nz", "x", "y", "z", "confidence"},
+    .num_properties = 7,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = &vertices,
+    .data_count     = &count};
+  for (int32_t num_threads = 1; num_threads <= 4; num_threads += 3)
+  {
+    pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "rm");
+    assert(pf);
+    msh_ply_set_num_threads(pf, num_threads);
+    msh_ply_add_descriptor(pf, &vertex_desc);
+    err = msh_ply_read(pf);
+    assert(!err);
+    assert(count == n_vertices);
+    msh_ply_element_t* el = msh_ply_find_element(pf, "vertex");
+    assert(msh_ply_find_property(el, "x")->type == MSH_PLY_UINT16);
+    assert(msh_ply_find_property(el, "confidence")->type == MSH_PLY_FLOAT);
+    assert(msh_ply_find_property(el, "nx")->type == MSH_PLY_INT8);
+    assert(!msh_ply_find_property(el, "nz"));
+    for (int32_t i = 0; i < n_vertices; ++i)
+    {
+      const float* v = &vertices[7 * i];
+      const float* r = &ref[7 * i];
+      for (int32_t c = 0; c < 3; ++c)
+      {
+        float step = (bbox_max[c] - bbox_min[c]) / 65535.0f;
+        assert(fabsf(v[3 + c] - r[c]) <= 0.5f * step + 1e-5f);
+      }
+      assert(v[6] == r[3]);
+      assert(v[0] * r[4] + v[1] * r[5] + v[2] * r[6] > 0.99f);
+    }
+    msh_ply_close(pf);
+    free(vertices);
+    vertices = NULL;
+  }
+
+  // Integer requests return the stored values
+  uint16_t* positions = NULL;
+  msh_ply_desc_t raw_desc = {
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"x", "y", "z"},
+    .num_properties = 3,
+    .data_type      = MSH_PLY_UINT16,
+    .data           = &positions,
+    .data_count     = &count};
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+  assert(pf);
+  msh_ply_add_descriptor(pf, &raw_desc);
+  err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+  for (int32_t i = 0; i < 3 * n_vertices; ++i)
+  {
+    int32_t c    = i % 3;
+    float t      = (ref[7 * (i / 3) + c] - bbox_min[c]) / (bbox_max[c] - bbox_min[c]);
+    float q      = t * 65535.0f;
+    float offset = positions[i] - q;
+    assert(offset <= 0.51f && offset >= -0.51f);
+  }
+  free(positions);
+
+  // Chunks are dequantized too, also when streamed with more bits per normal
+  quantization.normal_bits = 12;
+  pf                       = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  msh_ply_set_quantization(pf, &quantization);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  float* all_vertices = ref;
+  const int32_t half  = n_vertices / 2;
+  err                 = msh_ply_write_rows(pf, "vertex", half);
+  assert(!err);
+  ref = all_vertices + 7 * half;
+  err = msh_ply_write_rows(pf, "vertex", n_vertices - half);
+  assert(!err);
+  ref = all_vertices;
+  err = msh_ply_write_rows(pf, "face", n_faces);
+  assert(!err);
+  msh_ply_close(pf);
+
+  const int32_t max_rows = 3000;
+  double* normals        = (double*)malloc(3 * max_rows * sizeof(double));
+  msh_ply_desc_t normal_desc = {
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"nx", "ny", "nz"},
+    .num_properties = 3,
+    .data_type      = MSH_PLY_DOUBLE,
+    .data           = &normals,
+    .data_count     = &count};
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+  assert(pf);
+  int32_t n_read = 0;
+  while (n_read < n_vertices)
+  {
+    err = msh_ply_read_chunk(pf, &normal_desc, max_rows);
+    assert(!err && count > 0);
+    for (int32_t i = 0; i < count; ++i)
+    {
+      const double* n = &normals[3 * i];
+      const float* r  = &ref[7 * (n_read + i) + 4];
+      assert(n[0] * r[0] + n[1] * r[1] + n[2] * r[2] > 0.9999);
+    }
+    n_read += count;
+  }
+  msh_ply_close(pf);
+  assert(n_read == n_vertices);
+
+  free(normals);
+  free(faces);
+  free(ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+spatial_order_test(const char* mode, msh_ply_curve_t curve)
+{
+  const int32_t n_vertices = 30000;
+  int32_t n_faces          = n_vertices / 3;
+  float* vertices          = (float*)malloc(4 * n_vertices * sizeof(float));
+  int32_t* faces           = (int32_t*)malloc(3 * n_faces * sizeof(int32_t));
+  uint32_t seed            = 12345;
+  for (int32_t i = 0; i < n_vertices; ++i)
+  {
+    for (int32_t c = 0; c < 3; ++c)
+    {
+      seed                    = seed * 1664525u + 1013904223u;
+      vertices[4 * i + c] = (float)(seed >> 8) / (float)(1 << 24) * 100.0f;
+    }
+    vertices[4 * i + 3] = (float)i;
+  }
+  // Faces refer to every vertex once, so they tell where each vertex went
+  for (int32_t i = 0; i < 3 * n_faces; ++i) { faces[i] = (int32_t)(((int64_t)i * 7) % n_vertices); }
+  float* vertices_copy = (float*)malloc(4 * n_vertices * sizeof(float));
+  memcpy(vertices_copy, vertices, 4 * n_vertices * sizeof(float));
+
+  msh_ply_desc_t descriptors[2];
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"x", "y", "z", "id"},
+    .num_properties = 4,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = &vertices,
+    .data_count     = (int32_t*)&n_vertices};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"face",
+    .property_names = (const char*[]){"vertex_indices"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &faces,
+    .data_count     = &n_faces,
+    .list_size_hint = 3};
+  msh_ply_spatial_order_t order = {.element_name        = "vertex",
+                                   .position_names      = {"x", "y", "z"},
+                                   .curve               = curve,
+                                   .index_element_name  = "face",
+                                   .index_property_name = "vertex_indices"};
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  int32_t err = msh_ply_set_spatial_order(pf, &order);
+  assert(!err);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+  assert(!memcmp(vertices, vertices_copy, 4 * n_vertices * sizeof(float)));
+
+  char header[512] = {0};
+  char comment[128];
+  snprintf(comment,
+           sizeof(comment),
+           "comment spatial_order vertex %s x y z\n",
+           curve == MSH_PLY_CURVE_MORTON ? "morton" : "hilbert");
+  FILE* fp = fopen(MSH_PLY_TEST_FILENAME, "rb");
+  assert(fp);
+  assert(fread(header, 1, sizeof(header) - 1, fp) > 0);
+  fclose(fp);
+  assert(strstr(header, comment));
+
+  float* sorted          = NULL;
+  int32_t* sorted_faces  = NULL;
+  int32_t n_sorted       = 0;
+  int32_t n_sorted_faces = 0;
+  descriptors[0].data       = &sorted;
+  descriptors[0].data_count = &n_sorted;
+  descriptors[1].data       = &sorted_faces;
+  descriptors[1].data_count = &n_sorted_faces;
+  pf                        = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+  assert(n_sorted == n_vertices && n_sorted_faces == n_faces);
+  for (int32_t i = 0; i < 3 * n_faces; ++i)
+  {
+    assert(!memcmp(&sorted[4 * sorted_faces[i]], &vertices[4 * faces[i]], 4 * sizeof(float)));
+  }
+
+  // Consecutive points of the sorted file are much closer to each other
+  double distance        = 0.0;
+  double sorted_distance = 0.0;
+  for (int32_t i = 1; i < n_vertices; ++i)
+  {
+    float d[3], ds[3];
+    for (int32_t c = 0; c < 3; ++c)
+    {
+      d[c]  = vertices[4 * i + c] - vertices[4 * (i - 1) + c];
+      ds[c] = sorted[4 * i + c] - sorted[4 * (i - 1) + c];
+    }
+    distance += sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    sorted_distance += sqrtf(ds[0] * ds[0] + ds[1] * ds[1] + ds[2] * ds[2]);
+  }
+  assert(sorted_distance * 10.0 < distance);
+
+  free(sorted);
+  free(sorted_faces);
+  free(vertices_copy);
+  free(vertices);
+  free(faces);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+region_read_test(const char* mode, int32_t with_lists)
+{
+  // Points on a grid, in the order of the grid, so that blocks of rows are compact
+  const int32_t n_vertices = 100000;
+  float* vertices          = (float*)malloc(4 * n_vertices * sizeof(float));
+  uint8_t* list_sizes      = (uint8_t*)malloc(n_vertices);
+  int32_t* lists           = (int32_t*)malloc(3 * n_vertices * sizeof(int32_t));
+  int32_t n_values         = 0;
+  for (int32_t i = 0; i < n_vertices; ++i)
+  {
+    vertices[4 * i + 0] = (float)(i % 50);
+    vertices[4 * i + 1] = (float)((i / 50) % 50);
+    vertices[4 * i + 2] = (float)(i / 2500);
+    vertices[4 * i + 3] = (float)i;
+    list_sizes[i]       = (uint8_t)(i % 4);
+    for (int32_t j = 0; j < list_sizes[i]; ++j) { lists[n_values++] = i + j; }
+  }
+
+  msh_ply_desc_t descriptors[2];
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"x", "y", "z", "id"},
+    .num_properties = 4,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = &vertices,
+    .data_count     = (int32_t*)&n_vertices};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"neighbors"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &lists,
+    .list_data      = &list_sizes,
+    .data_count     = (int32_t*)&n_vertices};
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  if (with_lists) { msh_ply_add_descriptor(pf, &descriptors[1]); }
+  int32_t err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  const char* index_filename = "msh_ply_test.idx";
+  const char* position_names[] = {"x", "y", "z"};
+  const float aabb_min[3]      = {10.0f, 20.0f, 5.0f};
+  const float aabb_max[3]      = {14.0f, 22.0f, 6.0f};
+  float* region                = NULL;
+  int32_t n_region             = 0;
+  msh_ply_desc_t region_desc   = {.element_name   = (char*)"vertex",
+                                .property_names = (const char*[]){"id", "z", "y", "x"},
+                                .num_properties = 4,
+                                .data_type      = MSH_PLY_FLOAT,
+                                .data           = &region,
+                                .data_count     = &n_region};
+
+  // Index is used right away, or loaded later by another reader
+  for (int32_t load = 0; load < 2; ++load)
+  {
+    pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+    assert(pf);
+    err = msh_ply_read_region(pf, aabb_min, aabb_max, &region_desc);
+    assert(err == MSH_PLY_INVALID_INDEX_ERR);
+    if (load) { err = msh_ply_load_index(pf, index_filename); }
+    else
+    {
+      err = msh_ply_build_index(pf, index_filename, "vertex", position_names, 1000);
+    }
+    assert(!err);
+    err = msh_ply_read_region(pf, aabb_min, aabb_max, &region_desc);
+    assert(!err);
+    msh_ply_close(pf);
+
+    // Every point in the box is returned, and far fewer points than the whole file
+    int32_t n_inside = 0;
+    for (int32_t i = 0; i < n_region; ++i)
+    {
+      const float* v = &region[4 * i];
+      int32_t id     = (int32_t)v[0];
+      assert(!memcmp(&vertices[4 * id], &v[3], sizeof(float)));
+      assert(vertices[4 * id + 1] == v[2] && vertices[4 * id + 2] == v[1]);
+      int32_t inside = 1;
+      for (int32_t c = 0; c < 3; ++c)
+      {
+        inside &= (v[3 - c] >= aabb_min[c] && v[3 - c] <= aabb_max[c]);
+      }
+      n_inside += inside;
+    }
+    assert(n_inside == 5 * 3 * 2);
+    assert(n_region > 0 && n_region < n_vertices / 10);
+    free(region);
+    region = NULL;
+  }
+
+  // Index of a different file is refused
+  int32_t n_fewer           = n_vertices - 1;
+  descriptors[0].data_count = &n_fewer;
+  pf                        = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "r");
+  assert(pf);
+  assert(msh_ply_load_index(pf, index_filename) == MSH_PLY_INVALID_INDEX_ERR);
+  msh_ply_close(pf);
+
+  free(vertices);
+  free(list_sizes);
+  free(lists);
+  remove(index_filename);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+probe_test()
+{
+  const char* modes[]     = {"wb", "w", "wbz"};
+  const char* filenames[] = {"msh_ply_probe_0.ply",
+                             "msh_ply_probe_1.ply",
+                             "msh_ply_probe_2.ply",
+                             "msh_ply_probe_3.ply",
+                             "msh_ply_probe_missing.ply"};
+  test_mesh_t ref         = {0};
+  test_mesh_init(&ref, 1000, 700);
+  for (int32_t i = 0; i < 3; ++i) { test_mesh_write(&ref, filenames[i], modes[i]); }
+
+  // Header longer than a single probe read
+  FILE* fp = fopen(filenames[3], "wb");
+  assert(fp);
+  fprintf(fp, "ply\nformat ascii 1.0\n");
+  for (int32_t i = 0; i < 200; ++i) { fprintf(fp, "comment padding line %d\n", i); }
+  fprintf(fp, "element vertex 1\nproperty double x\nproperty uchar flags\nend_header\n0.5 1\n");
+  fclose(fp);
+
+  msh_ply_info_t infos[5];
+  int32_t err_codes[5];
+  for (int32_t num_threads = 1; num_threads <= 4; num_threads += 3)
+  {
+    memset(infos, 0, sizeof(infos));
+    int32_t err = msh_ply_probe_files(filenames, 5, infos, err_codes, num_threads);
+    assert(err == MSH_PLY_FILE_OPEN_ERR);
+    assert(err_codes[4] == MSH_PLY_FILE_OPEN_ERR);
+
+    // Probed headers match the ones parsed by the decoder
+    for (int32_t i = 0; i < 3; ++i)
+    {
+      const msh_ply_info_t* info = &infos[i];
+      assert(!err_codes[i]);
+      assert(info->is_compressed == (i == 2));
+      msh_ply_t* pf = msh_ply_open(filenames[i], "rb");
+      assert(pf);
+      err = msh_ply_parse_header(pf);
+      assert(!err);
+      assert(info->format == (msh_ply_format_t)pf->format);
+      assert(info->header_size == pf->_header_size);
+      assert(info->num_elements == 2);
+      assert(info->num_properties == 4);
+      for (int32_t j = 0; j < info->num_elements; ++j)
+      {
+        const msh_ply_info_element_t* el = &info->elements[j];
+        const msh_ply_element_t* ref_el  = &pf->elements[j];
+        assert(!strcmp(el->name, ref_el->name));
+        assert(el->count == ref_el->count);
+        assert(el->num_properties == (int32_t)msh_ply_array_len(ref_el->properties));
+        for (int32_t k = 0; k < el->num_properties; ++k)
+        {
+          const msh_ply_info_property_t* pr = &info->properties[el->first_property + k];
+          assert(!strcmp(pr->name, ref_el->properties[k].name));
+          assert(pr->type == ref_el->properties[k].type);
+          assert(pr->list_type == ref_el->properties[k].list_type);
+        }
+      }
+      assert(info->elements[0].row_size == 3 * sizeof(float));
+      assert(info->elements[1].row_size == 0);
+      msh_ply_close(pf);
+    }
+
+    assert(!err_codes[3]);
+    assert(infos[3].format == MSH_PLY_ASCII);
+    assert(infos[3].num_elements == 1);
+    assert(infos[3].elements[0].row_size == sizeof(double) + 1);
+    assert(infos[3].properties[1].type == MSH_PLY_UINT8);
+    assert(infos[3].header_size > MSH_PLY_PROBE_SIZE);
+  }
+
+  test_mesh_term(&ref);
+  for (int32_t i = 0; i < 4; ++i) { remove(filenames[i]); }
+}
+
+typedef struct test_arena
+{
+  uint8_t* buf;
+  size_t size;
+  size_t used;
+} test_arena_t;
+
+void*
+test_arena_alloc(size_t size, void* user_data)
+{
+  test_arena_t* arena = (test_arena_t*)user_data;
+  size                = (size + 15) & ~(size_t)15;
+  if (arena->size - arena->used < size) { return NULL; }
+  void* ptr = arena->buf + arena->used;
+  arena->used += size;
+  return ptr;
+}
+
+void
+arena_test(const char* mode)
+{
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 100000, 70000);
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(&ref, descriptors);
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  int32_t err = msh_ply_set_arena(pf, 256);
+  assert(!err);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  // Faces are read as variable length lists, with their sizes and offsets
+  test_arena_t output = {0};
+  output.size         = 8 * 1024 * 1024;
+  output.buf          = (uint8_t*)malloc(output.size);
+  test_mesh_t mesh    = {0};
+  uint8_t* face_sizes = NULL;
+  int32_t* offsets    = NULL;
+
+  test_mesh_descriptors(&mesh, descriptors);
+  descriptors[1].list_data      = &face_sizes;
+  descriptors[1].list_offsets   = &offsets;
+  descriptors[1].list_size_hint = 0;
+  pf                            = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  err = msh_ply_set_arena(pf, 0);
+  assert(!err);
+  assert(msh_ply_set_arena(pf, 0) == MSH_PLY_ARENA_ERR);
+  msh_ply_set_num_threads(pf, 4);
+  msh_ply_set_output_allocator(pf, test_arena_alloc, &output);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  // All of the returned data comes from the arena
+  uint8_t* arena_end = output.buf + output.used;
+  assert((uint8_t*)mesh.vertices >= output.buf && (uint8_t*)mesh.vertices < arena_end);
+  assert((uint8_t*)mesh.faces >= output.buf && (uint8_t*)mesh.faces < arena_end);
+  assert(face_sizes >= output.buf && face_sizes < arena_end);
+  assert((uint8_t*)offsets >= output.buf && (uint8_t*)offsets < arena_end);
+  test_mesh_check(&mesh, &ref);
+  for (int32_t i = 0; i < ref.n_faces; ++i)
+  {
+    assert(face_sizes[i] == 3);
+    assert(offsets[i] == 3 * i);
+  }
+
+  // Arena can not take over a handle that already allocated
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  err = msh_ply_parse_header(pf);
+  assert(!err);
+  assert(msh_ply_set_arena(pf, 0) == MSH_PLY_ARENA_ERR);
+  msh_ply_close(pf);
+
+  free(output.buf);
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+separate_arrays_test(const char* mode, int32_t with_lists)
+{
+  const int32_t n_vertices = 200000;
+  float* vertices          = (float*)malloc(4 * n_vertices * sizeof(float));
+  uint8_t* list_sizes      = (uint8_t*)malloc(n_vertices);
+  int32_t* lists           = (int32_t*)malloc(3 * n_vertices * sizeof(int32_t));
+  int32_t n_values         = 0;
+  for (int32_t i = 0; i < n_vertices; ++i)
+  {
+    vertices[4 * i + 0] = (float)(i % 50);
+    vertices[4 * i + 1] = (float)((i / 50) % 50);
+    vertices[4 * i + 2] = (float)(i / 2500);
+    vertices[4 * i + 3] = (float)i;
+    list_sizes[i]       = (uint8_t)(i % 4);
+    for (int32_t j = 0; j < list_sizes[i]; ++j) { lists[n_values++] = i + j; }
+  }
+
+  msh_ply_desc_t descriptors[2];
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"x", "y", "z", "id"},
+    .num_properties = 4,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = &vertices,
+    .data_count     = (int32_t*)&n_vertices};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"neighbors"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &lists,
+    .list_data      = &list_sizes,
+    .data_count     = (int32_t*)&n_vertices};
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, mode);
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  if (with_lists) { msh_ply_add_descriptor(pf, &descriptors[1]); }
+  int32_t err = msh_ply_write(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  // Same type, and converted to doubles in a different order
+  float* positions      = NULL;
+  float* columns[3]     = {NULL};
+  double* converted     = NULL;
+  double* id_columns[2] = {NULL};
+  int32_t n_positions   = 0;
+  int32_t n_converted   = 0;
+  msh_ply_desc_t position_desc  = {.element_name   = (char*)"vertex",
+                                  .property_names = (const char*[]){"x", "y", "z"},
+                                  .num_properties = 3,
+                                  .data_type      = MSH_PLY_FLOAT,
+                                  .data           = &positions,
+                                  .data_count     = &n_positions,
+                                  .property_data  = (void**)columns};
+  msh_ply_desc_t converted_desc = {.element_name   = (char*)"vertex",
+                                   .property_names = (const char*[]){"id", "z"},
+                                   .num_properties = 2,
+                                   .data_type      = MSH_PLY_DOUBLE,
+                                   .data           = &converted,
+                                   .data_count     = &n_converted,
+                                   .property_data  = (void**)id_columns};
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  msh_ply_set_num_threads(pf, 4);
+  msh_ply_add_descriptor(pf, &position_desc);
+  msh_ply_add_descriptor(pf, &converted_desc);
+  err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  assert(n_positions == n_vertices);
+  assert(n_converted == n_vertices);
+  assert(columns[0] == positions);
+  assert(id_columns[0] == converted);
+  for (int32_t i = 0; i < n_vertices; ++i)
+  {
+    for (int32_t c = 0; c < 3; ++c) { assert(columns[c][i] == vertices[4 * i + c]); }
+    assert(id_columns[0][i] == (double)vertices[4 * i + 3]);
+    assert(id_columns[1][i] == (double)vertices[4 * i + 2]);
+  }
+  free(positions);
+  free(converted);
+
+  // Lists cannot be split into arrays, and only whole elements can be read
+  int32_t* neighbors            = NULL;
+  int32_t* neighbor_columns[1]  = {NULL};
+  int32_t n_neighbors           = 0;
+  msh_ply_desc_t neighbors_desc = {.element_name   = (char*)"vertex",
+                                   .property_names = (const char*[]){"neighbors"},
+                                   .num_properties = 1,
+                                   .data_type      = MSH_PLY_INT32,
+                                   .list_type      = MSH_PLY_UINT8,
+                                   .data           = &neighbors,
+                                   .data_count     = &n_neighbors,
+                                   .property_data  = (void**)neighbor_columns};
+  if (with_lists)
+  {
+    pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+    assert(pf);
+    msh_ply_add_descriptor(pf, &neighbors_desc);
+    assert(msh_ply_read(pf) == MSH_PLY_SEPARATE_ARRAYS_ERR);
+    msh_ply_close(pf);
+  }
+  pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  float chunk[3 * 16];
+  positions = chunk;
+  assert(msh_ply_read_chunk(pf, &position_desc, 16) == MSH_PLY_SEPARATE_ARRAYS_ERR);
+  msh_ply_close(pf);
+
+  free(vertices);
+  free(list_sizes);
+  free(lists);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+lazy_read_test(const char* mode)
+{
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 10000, 7000);
+  test_mesh_write(&ref, MSH_PLY_TEST_FILENAME, mode);
+
+  test_mesh_t mesh = {0};
+  msh_ply_desc_t descriptors[2];
+  test_mesh_descriptors(&mesh, descriptors);
+
+  // Only counts are known after reading, and data is decoded once it is loaded
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  msh_ply_set_lazy_read(pf, 1);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  msh_ply_add_descriptor(pf, &descriptors[1]);
+  int32_t err = msh_ply_read(pf);
+  assert(!err);
+  assert(mesh.n_vertices == ref.n_vertices);
+  assert(mesh.n_faces == ref.n_faces);
+  assert(!mesh.vertices && !mesh.faces);
+
+  err = msh_ply_load(pf, &descriptors[1]);
+  assert(!err);
+  assert(!mesh.vertices);
+  assert(!memcmp(mesh.faces, ref.faces, 3 * ref.n_faces * sizeof(int32_t)));
+  int32_t* faces = mesh.faces;
+  err            = msh_ply_load(pf, &descriptors[1]);
+  assert(!err);
+  assert(mesh.faces == faces);
+  err = msh_ply_load(pf, &descriptors[0]);
+  assert(!err);
+  assert(!memcmp(mesh.vertices, ref.vertices, 3 * ref.n_vertices * sizeof(float)));
+
+  msh_ply_desc_t late_desc = descriptors[0];
+  assert(msh_ply_load(pf, &late_desc) == MSH_PLY_LAZY_LOAD_ERR);
+  msh_ply_close(pf);
+  test_mesh_term(&mesh);
+
+  // Data read without lazy reading is already loaded
+  mesh = (test_mesh_t){0};
+  pf   = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  msh_ply_add_descriptor(pf, &descriptors[0]);
+  err = msh_ply_read(pf);
+  assert(!err);
+  float* vertices = mesh.vertices;
+  err             = msh_ply_load(pf, &descriptors[0]);
+  assert(!err);
+  assert(mesh.vertices == vertices);
+  msh_ply_close(pf);
+
+  test_mesh_term(&mesh);
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+parallel_write_test()
+{
+  // Vertices span several chunks, and polygons of variable size are written whole
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 1000000, 500000);
+  const int32_t n_polygons = 1000;
+  uint8_t* polygon_sizes   = (uint8_t*)malloc(n_polygons);
+  int32_t* polygons        = (int32_t*)malloc(4 * n_polygons * sizeof(int32_t));
+  int32_t n_values         = 0;
+  for (int32_t i = 0; i < n_polygons; ++i)
+  {
+    polygon_sizes[i] = (uint8_t)(3 + i % 2);
+    for (int32_t j = 0; j < polygon_sizes[i]; ++j) { polygons[n_values++] = i + j; }
+  }
+  msh_ply_desc_t descriptors[3];
+  test_mesh_descriptors(&ref, descriptors);
+  descriptors[2] = descriptors[1];
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"polygon",
+    .property_names = (const char*[]){"vertex_indices"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &polygons,
+    .list_data      = &polygon_sizes,
+    .data_count     = (int32_t*)&n_polygons};
+
+  // Files written by one thread, and by four tasks, are the same
+  uint8_t* contents[2] = {NULL};
+  size_t sizes[2]      = {0};
+  int32_t n_tasks      = 0;
+  for (int32_t i = 0; i < 2; ++i)
+  {
+    msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "wb");
+    assert(pf);
+    msh_ply_set_num_threads(pf, i ? 4 : 1);
+    if (i) { msh_ply_set_task_runner(pf, serial_task_runner, &n_tasks); }
+    for (int32_t j = 0; j < 3; ++j) { msh_ply_add_descriptor(pf, &descriptors[j]); }
+    int32_t err = msh_ply_write(pf);
+    assert(!err);
+    msh_ply_close(pf);
+
+    FILE* fp = fopen(MSH_PLY_TEST_FILENAME, "rb");
+    assert(fp);
+    fseek(fp, 0, SEEK_END);
+    sizes[i]    = (size_t)ftell(fp);
+    contents[i] = (uint8_t*)malloc(sizes[i]);
+    fseek(fp, 0, SEEK_SET);
+    assert(fread(contents[i], 1, sizes[i], fp) == sizes[i]);
+    fclose(fp);
+  }
+  assert(n_tasks > 0);
+  assert(sizes[0] == sizes[1]);
+  assert(!memcmp(contents[0], contents[1], sizes[0]));
+
+  test_mesh_read_back(&ref, MSH_PLY_TEST_FILENAME, "rb", 1);
+
+  free(contents[0]);
+  free(contents[1]);
+  free(polygon_sizes);
+  free(polygons);
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+void
+swap_bytes(void* data, int32_t size)
+{
+  uint8_t* bytes = (uint8_t*)data;
+  for (int32_t i = 0; i < size / 2; ++i)
+  {
+    uint8_t tmp         = bytes[i];
+    bytes[i]            = bytes[size - 1 - i];
+    bytes[size - 1 - i] = tmp;
+  }
+}
+
+void
+big_endian_read_test()
+{
+  test_mesh_t ref = {0};
+  test_mesh_init(&ref, 1000, 700);
+
+  FILE* fp = fopen(MSH_PLY_TEST_FILENAME, "wb");
+  assert(fp);
+  fprintf(fp,
+          "ply\nformat binary_big_endian 1.0\n"
+          "element vertex %d\nproperty float x\nproperty float y\nproperty float z\n"
+          "property uchar red\n"
+          "element face %d\nproperty list uchar int vertex_indices\nend_header\n",
+          ref.n_vertices,
+          ref.n_faces);
+  for (int32_t i = 0; i < ref.n_vertices; ++i)
+  {
+    for (int32_t j = 0; j < 3; ++j)
+    {
+      float value = ref.vertices[3 * i + j];
+      swap_bytes(&value, sizeof(value));
+      fwrite(&value, sizeof(value), 1, fp);
+    }
+    fputc(i % 256, fp);
+  }
+  for (int32_t i = 0; i < ref.n_faces; ++i)
+  {
+    fputc(3, fp);
+    for (int32_t j = 0; j < 3; ++j)
+    {
+      int32_t value = ref.faces[3 * i + j];
+      swap_bytes(&value, sizeof(value));
+      fwrite(&value, sizeof(value), 1, fp);
+    }
+  }
+  fclose(fp);
+
+  // Positions are converted to doubles and colors to floats, so swapping and conversion mix
+  double* vertices = NULL;
+  float* colors    = NULL;
+  int32_t* faces   = NULL;
+  int32_t n_vertices = 0, n_colors = 0, n_faces = 0;
+  msh_ply_desc_t descriptors[3];
+  descriptors[0] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"x", "y", "z"},
+    .num_properties = 3,
+    .data_type      = MSH_PLY_DOUBLE,
+    .data           = &vertices,
+    .data_count     = &n_vertices};
+  descriptors[1] = (msh_ply_desc_t){
+    .element_name   = (char*)"vertex",
+    .property_names = (const char*[]){"red"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_FLOAT,
+    .data           = &colors,
+    .data_count     = &n_colors};
+  descriptors[2] = (msh_ply_desc_t){
+    .element_name   = (char*)"face",
+    .property_names = (const char*[]){"vertex_indices"},
+    .num_properties = 1,
+    .data_type      = MSH_PLY_INT32,
+    .list_type      = MSH_PLY_UINT8,
+    .data           = &faces,
+    .data_count     = &n_faces,
+    .list_size_hint = 3};
+
+  msh_ply_t* pf = msh_ply_open(MSH_PLY_TEST_FILENAME, "rb");
+  assert(pf);
+  for (int32_t i = 0; i < 3; ++i) { msh_ply_add_descriptor(pf, &descriptors[i]); }
+  int32_t err = msh_ply_read(pf);
+  assert(!err);
+  msh_ply_close(pf);
+
+  assert(n_vertices == ref.n_vertices && n_colors == ref.n_vertices);
+  assert(n_faces == ref.n_faces);
+  for (int32_t i = 0; i < 3 * ref.n_vertices; ++i)
+  {
+    assert(vertices[i] == (double)ref.vertices[i]);
+  }
+  for (int32_t i = 0; i < ref.n_vertices; ++i) { assert(colors[i] == (float)(i % 256)); }
+  assert(!memcmp(faces, ref.faces, 3 * ref.n_faces * sizeof(int32_t)));
+
+  free(vertices);
+  free(colors);
+  free(faces);
+  test_mesh_term(&ref);
+  remove(MSH_PLY_TEST_FILENAME);
+}
+
+// Fills 'count' values of 'type'. Floating point values stay within range of every integer type
+// if 'in_int_range' is set, so that their conversions are defined.
+void
+kernel_values_init(uint8_t* values, msh_ply_type_id_t type, int32_t count, int32_t in_int_range)
+{
+  int32_t byte_size = msh_ply__type_to_byte_size(type);
+  uint32_t state    = 777u + (uint32_t)type;
+  for (int32_t i = 0; i < count; ++i)
+  {
+    state        = state * 1664525u + 1013904223u;
+    double value = in_int_range ? (state % 12000) / 100.0 + (state % 3) / 3.0
+                                : (double)(int32_t)state / 3.0;
+    float value_f = (float)value;
+    if (type == MSH_PLY_FLOAT) { memcpy(values + 4 * i, &value_f, 4); }
+    else if (type == MSH_PLY_DOUBLE) { memcpy(values + 8 * i, &value, 8); }
+    else { memcpy(values + i * byte_size, &state, byte_size); }
+  }
+}
+
+void
+kernels_test()
+{
+  // Bulk kernels are compared against handling one value at a time, which only runs scalar code.
+  // Counts leave tails after the vector loops, and cross the blocks of the column conversion.
+  const int32_t counts[] = {1, 3, 7, 8, 15, 16, 17, 31, 33, 63, 257, 600};
+  const int32_t n_counts = (int32_t)(sizeof(counts) / sizeof(counts[0]));
+  const int32_t max_count = 600;
+  uint8_t* src            = (uint8_t*)malloc(16 * max_count + 1);
+  uint8_t* column         = (uint8_t*)malloc(16 * max_count + 1);
+  uint8_t* dst            = (uint8_t*)malloc(16 * max_count + 1);
+  uint8_t* ref            = (uint8_t*)malloc(8 * max_count);
+
+  for (int32_t size = 2; size <= 8; size *= 2)
+  {
+    for (int32_t k = 0; k < n_counts; ++k)
+    {
+      int32_t count = counts[k];
+      kernel_values_init(src, MSH_PLY_UINT8, size * count, 0);
+      memcpy(dst + 1, src, size * count);
+      msh_ply__swap_bytes(dst + 1, size, count);
+      for (int32_t i = 0; i < count; ++i) { swap_bytes(src + i * size, size); }
+      assert(!memcmp(dst + 1, src, size * count));
+    }
+  }
+
+  for (int32_t src_type = MSH_PLY_INT8; src_type <= MSH_PLY_DOUBLE; ++src_type)
+  {
+    for (int32_t dst_type = MSH_PLY_INT8; dst_type <= MSH_PLY_DOUBLE; ++dst_type)
+    {
+      msh_ply_type_id_t st = (msh_ply_type_id_t)src_type;
+      msh_ply_type_id_t dt = (msh_ply_type_id_t)dst_type;
+      int32_t ss           = msh_ply__type_to_byte_size(st);
+      int32_t ds           = msh_ply__type_to_byte_size(dt);
+      int32_t in_int_range = (dt != MSH_PLY_FLOAT && dt != MSH_PLY_DOUBLE);
+      for (int32_t k = 0; k < n_counts; ++k)
+      {
+        int32_t count = counts[k];
+        kernel_values_init(src + 1, st, count, in_int_range);
+        for (int32_t i = 0; i < count; ++i)
+        {
+          msh_ply__convert_block(ref + i * ds, dt, src + 1 + i * ss, st, 1);
+        }
+
+        // Unaligned, contiguous values in system byte order
+        msh_ply__convert_block(dst + 1, dt, src + 1, st, count);
+        assert(!memcmp(dst + 1, ref, count * ds));
+
+        // Big endian values, both packed and interleaved with other properties
+        for (int32_t strided = 0; strided <= 1; ++strided)
+        {
+          size_t src_stride = ss + 3 * strided;
+          size_t dst_stride = ds + 5 * strided;
+          for (int32_t i = 0; i < count; ++i)
+          {
+            memcpy(column + 1 + i * src_stride, src + 1 + i * ss, ss);
+            swap_bytes(column + 1 + i * src_stride, ss);
+          }
+          msh_ply__convert_column(dst + 1, dst_stride, dt, column + 1, src_stride, st, count, 1);
+          for (int32_t i = 0; i < count; ++i)
+          {
+            assert(!memcmp(dst + 1 + i * dst_stride, ref + i * ds, ds));
+          }
+        }
+      }
+    }
+  }
+
+  free(src);
+  free(column);
+  free(dst);
+  free(ref);
+}
+
+int
+main()
+{
+  printf("Running msh_ply.h tests!\n");
+
+  printf("| Testing msh_ply_open with memory mapping\n");
+  mapped_read_test();
+  printf("|    -> Passed!\n");
+
+  printf("| Testing parallel reading\n");
+  parallel_read_test();
+  printf("|    -> Passed!\n");
+
+  printf("| Testing big endian reading\n");
+  big_endian_read_test();
+  printf("|    -> Passed!\n");
+
+  printf("| Testing byte swapping and type conversion kernels\n");
+  kernels_test();
+  printf("|    -> Passed!\n");
+
+  printf("| Testing reading of variable length lists\n");
+  polygon_read_test("wb");
+  polygon_read_test("w");
+  printf("|    -> Passed!\n");
+
+  printf("| Testing msh_ply_open_io\n");
+  io_backend_read_test("wb");
+  io_backend_read_test("w");
+  printf("|    -> Passed!\n");
+
+  printf("| Testing msh_ply_read_chunk\n");
+  chunked_read_test();
+  printf("|    -> Passed!\n");
+
+  printf("| Testing msh_ply_write_rows\n");
+  streamed_write_test("wb");
+  streamed_write_test("w");
+  printf("|    -> Passed!\n");
+
+  printf("| Testing ASCII writing\n");
+  ascii_write_test();
+  printf("|    -> Passed!\n");
+
+  printf("| Testing ASCII reading across blocks\n");
+  ascii_block_read_test();
+  printf("|    -> Passed!\n");
+
+  printf("| Testing gzip compressed files\n");
+  compressed_test("wbz", 6);
+  compressed_test("wbz", 0);
+  compressed_test("wz", 1);
+  streamed_write_test("wbz");
+  streamed_write_test("wz");
+  printf("|    -> Passed!\n");
+
+  printf("| Testing quantized positions and normals\n");
+  quantized_test("wb");
+  quantized_test("w");
+  printf("|    -> Passed!\n");
+
+  printf("| Testing spatially ordered writing\n");
+  spatial_order_test("wb", MSH_PLY_CURVE_HILBERT);
+  spatial_order_test("w", MSH_PLY_CURVE_MORTON);
+  printf("|    -> Passed!\n");
+
+  printf("| Testing msh_ply_read_region\n");
+  region_read_test("wb", 0);
+  region_read_test("wb", 1);
+  region_read_test("w", 1);
+  region_read_test("wbz", 0);
+  printf("|    -> Passed!\n");
+
+  printf("| Testing msh_ply_probe\n");
+  probe_test();
+  printf("|    -> Passed!\n");
+
+  printf("| Testing msh_ply_set_arena\n");
+  arena_test("wb");
+  arena_test("w");
+  printf("|    -> Passed!\n");
+
+  printf("| Testing reading into separate property arrays\n");
+  separate_arrays_test("wb", 0);
+  separate_arrays_test("wb", 1);
+  separate_arrays_test("w", 1);
+  printf("|    -> Passed!\n");
+
+  printf("| Testing lazy reading\n");
+  lazy_read_test("wb");
+  lazy_read_test("w");
+  printf("|    -> Passed!\n");
+
+  printf("| Testing parallel binary writing\n");
+  parallel_write_test();
+  printf("|    -> Passed!\n");
+
+  return 0;
+}